@@ -60,6 +60,8 @@ namespace KlayGE
 	class joiner;
 	class threader;
 	class thread_pool;
+	class task_group;
+	class task_scheduler;
 
 	class half;
 	template <typename T, int N>
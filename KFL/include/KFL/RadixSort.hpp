@@ -0,0 +1,99 @@
+/**
+ * @file RadixSort.hpp
+ * @author Minmin Gong
+ *
+ * @section DESCRIPTION
+ *
+ * This source file is part of KFL, a subproject of KlayGE
+ * For the latest info, see http://www.klayge.org
+ *
+ * @section LICENSE
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published
+ * by the Free Software Foundation; either version 2 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program; if not, write to the Free Software
+ * Foundation, Inc., 59 Temple Place, Suite 330, Boston, MA 02111-1307 USA
+ *
+ * You may alternatively use this source under the terms of
+ * the KlayGE Proprietary License (KPL). You can obtained such a license
+ * from http://www.klayge.org/licensing/.
+ */
+
+
+#ifndef _KFL_RADIXSORT_HPP
+#define _KFL_RADIXSORT_HPP
+
+#pragma once
+
+#include <boost/assert.hpp>
+#include <algorithm>
+#include <cstddef>
+#include <cstdint>
+#include <utility>
+
+namespace KlayGE
+{
+	// Stable LSD radix sort on 64-bit keys, 8 bits per pass. key(item) gives the key of an item. The histograms of all
+	//  the digits are built in one pass over the items, and the digits that are the same in every key are skipped,
+	//  so keys with only a few varying bytes sort in a few passes. temp is scratch space of the same size as items.
+	//  The result is in items.
+	template <typename T, typename KeyFunc>
+	void RadixSort(T* items, T* temp, size_t num, KeyFunc key)
+	{
+		BOOST_ASSERT((0 == num) || (items != temp));
+
+		size_t const NUM_DIGITS = 8;
+		size_t const NUM_BUCKETS = 256;
+
+		size_t counts[NUM_DIGITS][NUM_BUCKETS] = {};
+		for (size_t i = 0; i < num; ++ i)
+		{
+			uint64_t const k = key(items[i]);
+			for (size_t d = 0; d < NUM_DIGITS; ++ d)
+			{
+				++ counts[d][(k >> (d * 8)) & 0xFF];
+			}
+		}
+
+		T* src = items;
+		T* dst = temp;
+		for (size_t d = 0; d < NUM_DIGITS; ++ d)
+		{
+			size_t* count = counts[d];
+			if ((num > 0) && (num == count[(key(src[0]) >> (d * 8)) & 0xFF]))
+			{
+				continue;
+			}
+
+			size_t offset = 0;
+			for (size_t b = 0; b < NUM_BUCKETS; ++ b)
+			{
+				size_t const c = count[b];
+				count[b] = offset;
+				offset += c;
+			}
+
+			for (size_t i = 0; i < num; ++ i)
+			{
+				dst[count[(key(src[i]) >> (d * 8)) & 0xFF] ++] = std::move(src[i]);
+			}
+			std::swap(src, dst);
+		}
+
+		if (src != items)
+		{
+			std::move(src, src + num, items);
+		}
+	}
+}
+
+#endif		// _KFL_RADIXSORT_HPP
@@ -54,6 +54,14 @@ namespace KlayGE
 			: res_name_(name), timestamp_(timestamp), istream_(is), streambuf_(streambuf)
 		{
 		}
+		// For resources that live in memory as a whole, e.g. a mapped file. data must stay valid as long as streambuf.
+		ResIdentifier(std::string_view name, uint64_t timestamp,
+				std::shared_ptr<std::istream> const & is, std::shared_ptr<std::streambuf> const & streambuf,
+				void const * data, uint64_t size)
+			: res_name_(name), timestamp_(timestamp), istream_(is), streambuf_(streambuf),
+				data_(data), size_(size)
+		{
+		}
 
 		void ResName(std::string_view name)
 		{
@@ -113,11 +121,24 @@ namespace KlayGE
 			return *istream_;
 		}
 
+		// The whole resource as a contiguous block, next to the stream interface. Loaders can parse it in place
+		//  instead of reading a copy. nullptr if the resource is only available as a stream.
+		void const * data() const
+		{
+			return data_;
+		}
+		uint64_t size() const
+		{
+			return size_;
+		}
+
 	private:
 		std::string res_name_;
 		uint64_t timestamp_;
 		std::shared_ptr<std::istream> istream_;
 		std::shared_ptr<std::streambuf> streambuf_;
+		void const * data_ = nullptr;
+		uint64_t size_ = 0;
 	};
 }
 
@@ -34,6 +34,7 @@
 #pragma once
 
 #include <KFL/PreDeclare.hpp>
+#include <KFL/Math.hpp>
 
 #if defined(KLAYGE_SSE_SUPPORT) && !defined(KLAYGE_COMPILER_CLANGC2)
 	#define SIMD_MATH_SSE
@@ -251,6 +252,23 @@ namespace KlayGE
 		// From Game Programming Gems 5, Section 2.6.
 		void ObliqueClipping(SIMDMatrixF4& proj, SIMDVectorF4 const & clip_plane);
 
+		// Bound
+		///////////////////////////////////////////////////////////////////////////////
+		// Batch tests against the 6 planes of a frustum, 4 bounds per iteration. The bounds are given as separate arrays
+		//  of their components, which don't have to be aligned. overlaps[i] gets the same result as the MathLib version.
+		void IntersectAABBFrustum(BoundOverlap* overlaps, float const * center_x, float const * center_y,
+			float const * center_z, float const * extent_x, float const * extent_y, float const * extent_z, size_t num,
+			Frustum const & frustum);
+		void IntersectSphereFrustum(BoundOverlap* overlaps, float const * center_x, float const * center_y,
+			float const * center_z, float const * radius, size_t num, Frustum const & frustum);
+
+		// Rasterization
+		///////////////////////////////////////////////////////////////////////////////
+		// Depth only rasterization of a triangle, 4 pixels per iteration. x and y of the vertices are in pixels, z is the
+		//  depth. Every pixel whose center is inside the triangle gets the min of its depth and the interpolated one.
+		//  Both windings are rasterized. pitch is in floats, and must be a multiple of 4.
+		void RasterizeTriangleDepth(float* depth, uint32_t width, uint32_t height, uint32_t pitch,
+			float3 const & v0, float3 const & v1, float3 const & v2);
 
 		// Color
 		///////////////////////////////////////////////////////////////////////////////
@@ -0,0 +1,245 @@
+/**
+ * @file TaskScheduler.hpp
+ * @author Minmin Gong
+ *
+ * @section DESCRIPTION
+ *
+ * This source file is part of KFL, a subproject of KlayGE
+ * For the latest info, see http://www.klayge.org
+ *
+ * @section LICENSE
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published
+ * by the Free Software Foundation; either version 2 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program; if not, write to the Free Software
+ * Foundation, Inc., 59 Temple Place, Suite 330, Boston, MA 02111-1307 USA
+ *
+ * You may alternatively use this source under the terms of
+ * the KlayGE Proprietary License (KPL). You can obtained such a license
+ * from http://www.klayge.org/licensing/.
+ */
+
+#ifndef _KFL_TASKSCHEDULER_HPP
+#define _KFL_TASKSCHEDULER_HPP
+
+#pragma once
+
+#include <boost/assert.hpp>
+#include <boost/noncopyable.hpp>
+#include <algorithm>
+#include <atomic>
+#include <condition_variable>
+#include <deque>
+#include <exception>
+#include <functional>
+#include <memory>
+#include <mutex>
+#include <thread>
+#include <vector>
+
+namespace KlayGE
+{
+	class task_scheduler;
+
+	// A set of tasks that can be waited on as a whole. Tasks spawned into a group can spawn more tasks into the same
+	//  group (fork/join). Waiting on a group from any thread, including the main thread, helps executing pending
+	//  tasks instead of blocking.
+	class task_group : boost::noncopyable
+	{
+		friend class task_scheduler;
+
+	public:
+		explicit task_group(task_scheduler& scheduler);
+		~task_group();
+
+		task_scheduler& scheduler() const
+		{
+			return scheduler_;
+		}
+
+		// Spawns a task into this group. It's put into the local deque if called from a worker thread.
+		void run(std::function<void()> task);
+
+		// Schedules a continuation that is spawned into this group after all the current tasks finish. If the group
+		//  is already done, the continuation is spawned immediately.
+		void then(std::function<void()> func);
+
+		// Waits until all tasks in the group, including continuations, are done. The calling thread executes pending
+		//  tasks meanwhile. The first exception thrown by a task is rethrown here.
+		void wait();
+
+		bool done() const
+		{
+			return 0 == pending_.load(std::memory_order_acquire);
+		}
+
+	private:
+		void on_task_done();
+		void on_exception(std::exception_ptr const & ex);
+
+	private:
+		task_scheduler& scheduler_;
+		std::atomic<uint32_t> pending_;
+
+		std::mutex mutex_;
+		std::vector<std::function<void()>> continuations_;
+		std::exception_ptr exception_;
+	};
+
+	// A work-stealing task scheduler. Each worker owns a deque, pushes and pops tasks at its back, and steals from the
+	//  front of the others when it runs out of work. Tasks spawned from non-worker threads go into a shared injection
+	//  queue.
+	class task_scheduler : boost::noncopyable
+	{
+		friend class task_group;
+
+		struct task
+		{
+			std::function<void()> func;
+			task_group* group;
+		};
+
+		struct task_queue
+		{
+			std::mutex mutex;
+			std::deque<task> tasks;
+		};
+
+	public:
+		// 0 means one worker per hardware thread, minus the calling thread.
+		explicit task_scheduler(uint32_t num_workers = 0);
+		~task_scheduler();
+
+		uint32_t num_workers() const
+		{
+			return static_cast<uint32_t>(workers_.size());
+		}
+
+		// Returns true if the calling thread is one of the workers of this scheduler.
+		bool in_worker_thread() const;
+
+		// Executes one pending task on the calling thread. Returns false if there is nothing to do.
+		bool try_run_one();
+
+		// Calls func(i) for every i in [first, last). The range is split recursively into chunks of at least grain
+		//  indices. 0 grain picks one automatically.
+		template <typename Index, typename Func>
+		void parallel_for(Index first, Index last, Index grain, Func const & func)
+		{
+			if (last <= first)
+			{
+				return;
+			}
+
+			grain = this->auto_grain(first, last, grain);
+			if (last - first <= grain)
+			{
+				for (Index i = first; i < last; ++ i)
+				{
+					func(i);
+				}
+			}
+			else
+			{
+				task_group group(*this);
+				this->split_range(group, first, last, grain, func);
+				group.wait();
+			}
+		}
+
+		template <typename Index, typename Func>
+		void parallel_for(Index first, Index last, Func const & func)
+		{
+			this->parallel_for(first, last, static_cast<Index>(0), func);
+		}
+
+		// Splits [first, last) into fixed chunks, calls map(chunk_first, chunk_last) for each chunk in parallel, and
+		//  combines the partial results with reduce in chunk order. The result doesn't depend on the scheduling.
+		template <typename Index, typename T, typename Map, typename Reduce>
+		T parallel_reduce(Index first, Index last, Index grain, T const & identity, Map const & map, Reduce const & reduce)
+		{
+			if (last <= first)
+			{
+				return identity;
+			}
+
+			grain = this->auto_grain(first, last, grain);
+			size_t const num_chunks = static_cast<size_t>((last - first + grain - 1) / grain);
+			std::vector<T> partials(num_chunks, identity);
+			this->parallel_for(static_cast<size_t>(0), num_chunks, static_cast<size_t>(1),
+				[first, last, grain, &partials, &map](size_t chunk)
+				{
+					Index const chunk_first = static_cast<Index>(first + chunk * grain);
+					Index const chunk_last = std::min(static_cast<Index>(chunk_first + grain), last);
+					partials[chunk] = map(chunk_first, chunk_last);
+				});
+
+			T ret = identity;
+			for (auto const & partial : partials)
+			{
+				ret = reduce(ret, partial);
+			}
+			return ret;
+		}
+
+	private:
+		template <typename Index>
+		Index auto_grain(Index first, Index last, Index grain) const
+		{
+			if (grain <= 0)
+			{
+				// About 8 chunks per thread, including the helping caller
+				Index const num_chunks = static_cast<Index>((this->num_workers() + 1) * 8);
+				grain = std::max(static_cast<Index>((last - first) / num_chunks), static_cast<Index>(1));
+			}
+			return grain;
+		}
+
+		template <typename Index, typename Func>
+		void split_range(task_group& group, Index first, Index last, Index grain, Func const & func)
+		{
+			// Hand the upper halves to thieves and keep the lower one, so big chunks are stolen first
+			while (last - first > grain)
+			{
+				Index const mid = first + (last - first) / 2;
+				group.run([this, &group, mid, last, grain, &func]()
+					{
+						this->split_range(group, mid, last, grain, func);
+					});
+				last = mid;
+			}
+			for (Index i = first; i < last; ++ i)
+			{
+				func(i);
+			}
+		}
+
+		void spawn(task_group& group, std::function<void()> func);
+		bool pop_task(task& t);
+		void execute(task& t);
+		void worker_func(uint32_t index);
+
+	private:
+		std::vector<std::thread> workers_;
+
+		// One queue per worker, and the last one for tasks spawned from other threads
+		std::vector<std::unique_ptr<task_queue>> queues_;
+
+		std::atomic<int32_t> num_queued_;
+		std::atomic<int32_t> num_sleeping_;
+		std::mutex sleep_mutex_;
+		std::condition_variable sleep_cond_;
+		std::atomic<bool> quit_;
+	};
+}
+
+#endif		// _KFL_TASKSCHEDULER_HPP
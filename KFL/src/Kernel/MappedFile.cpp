@@ -0,0 +1,169 @@
+/**
+ * @file MappedFile.cpp
+ * @author Minmin Gong
+ *
+ * @section DESCRIPTION
+ *
+ * This source file is part of KFL, a subproject of KlayGE
+ * For the latest info, see http://www.klayge.org
+ *
+ * @section LICENSE
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published
+ * by the Free Software Foundation; either version 2 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program; if not, write to the Free Software
+ * Foundation, Inc., 59 Temple Place, Suite 330, Boston, MA 02111-1307 USA
+ *
+ * You may alternatively use this source under the terms of
+ * the KlayGE Proprietary License (KPL). You can obtained such a license
+ * from http://www.klayge.org/licensing/.
+ */
+
+#include <KFL/KFL.hpp>
+
+#ifdef KLAYGE_PLATFORM_WINDOWS
+#include <windows.h>
+#else
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+#endif
+
+#include <KFL/MappedFile.hpp>
+
+namespace KlayGE
+{
+	MappedFile::MappedFile()
+		: data_(nullptr), size_(0),
+#ifdef KLAYGE_PLATFORM_WINDOWS
+			file_handle_(INVALID_HANDLE_VALUE), mapping_handle_(nullptr)
+#else
+			fd_(-1)
+#endif
+	{
+	}
+
+	MappedFile::~MappedFile()
+	{
+		this->Close();
+	}
+
+	bool MappedFile::Open(std::string const & file_name)
+	{
+		this->Close();
+
+#ifdef KLAYGE_PLATFORM_WINDOWS
+		std::wstring wname;
+		Convert(wname, file_name);
+		// Caches like .kfx and .model_bin are regenerated while they can still be mapped, so don't lock others out
+		DWORD const share_mode = FILE_SHARE_READ | FILE_SHARE_WRITE | FILE_SHARE_DELETE;
+#ifdef KLAYGE_PLATFORM_WINDOWS_DESKTOP
+		file_handle_ = ::CreateFileW(wname.c_str(), GENERIC_READ, share_mode, nullptr, OPEN_EXISTING,
+			FILE_ATTRIBUTE_NORMAL, nullptr);
+#else
+		file_handle_ = ::CreateFile2(wname.c_str(), GENERIC_READ, share_mode, OPEN_EXISTING, nullptr);
+#endif
+		if (INVALID_HANDLE_VALUE == file_handle_)
+		{
+			return false;
+		}
+
+		LARGE_INTEGER file_size;
+		if (!::GetFileSizeEx(file_handle_, &file_size) || (0 == file_size.QuadPart))
+		{
+			this->Close();
+			return false;
+		}
+		size_ = file_size.QuadPart;
+
+#ifdef KLAYGE_PLATFORM_WINDOWS_DESKTOP
+		mapping_handle_ = ::CreateFileMappingW(file_handle_, nullptr, PAGE_READONLY, 0, 0, nullptr);
+#else
+		mapping_handle_ = ::CreateFileMappingFromApp(file_handle_, nullptr, PAGE_READONLY, 0, nullptr);
+#endif
+		if (nullptr == mapping_handle_)
+		{
+			this->Close();
+			return false;
+		}
+
+#ifdef KLAYGE_PLATFORM_WINDOWS_DESKTOP
+		data_ = ::MapViewOfFile(mapping_handle_, FILE_MAP_READ, 0, 0, 0);
+#else
+		data_ = ::MapViewOfFileFromApp(mapping_handle_, FILE_MAP_READ, 0, 0);
+#endif
+		if (nullptr == data_)
+		{
+			this->Close();
+			return false;
+		}
+#else
+		fd_ = ::open(file_name.c_str(), O_RDONLY);
+		if (fd_ < 0)
+		{
+			return false;
+		}
+
+		struct stat file_stat;
+		if ((::fstat(fd_, &file_stat) != 0) || (0 == file_stat.st_size))
+		{
+			this->Close();
+			return false;
+		}
+		size_ = static_cast<uint64_t>(file_stat.st_size);
+
+		void* data = ::mmap(nullptr, static_cast<size_t>(size_), PROT_READ, MAP_PRIVATE, fd_, 0);
+		if (MAP_FAILED == data)
+		{
+			this->Close();
+			return false;
+		}
+		data_ = data;
+#endif
+
+		return true;
+	}
+
+	void MappedFile::Close()
+	{
+#ifdef KLAYGE_PLATFORM_WINDOWS
+		if (data_ != nullptr)
+		{
+			::UnmapViewOfFile(data_);
+		}
+		if (mapping_handle_ != nullptr)
+		{
+			::CloseHandle(mapping_handle_);
+			mapping_handle_ = nullptr;
+		}
+		if (file_handle_ != INVALID_HANDLE_VALUE)
+		{
+			::CloseHandle(file_handle_);
+			file_handle_ = INVALID_HANDLE_VALUE;
+		}
+#else
+		if (data_ != nullptr)
+		{
+			::munmap(data_, static_cast<size_t>(size_));
+		}
+		if (fd_ >= 0)
+		{
+			::close(fd_);
+			fd_ = -1;
+		}
+#endif
+
+		data_ = nullptr;
+		size_ = 0;
+	}
+}
@@ -0,0 +1,285 @@
+/**
+ * @file TaskScheduler.cpp
+ * @author Minmin Gong
+ *
+ * @section DESCRIPTION
+ *
+ * This source file is part of KFL, a subproject of KlayGE
+ * For the latest info, see http://www.klayge.org
+ *
+ * @section LICENSE
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published
+ * by the Free Software Foundation; either version 2 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program; if not, write to the Free Software
+ * Foundation, Inc., 59 Temple Place, Suite 330, Boston, MA 02111-1307 USA
+ *
+ * You may alternatively use this source under the terms of
+ * the KlayGE Proprietary License (KPL). You can obtained such a license
+ * from http://www.klayge.org/licensing/.
+ */
+
+#include <KFL/KFL.hpp>
+
+#include <KFL/TaskScheduler.hpp>
+
+namespace
+{
+	// The scheduler and queue index of the current worker thread. Non-worker threads have a null scheduler.
+	thread_local KlayGE::task_scheduler* tls_scheduler = nullptr;
+	thread_local uint32_t tls_worker_index = 0;
+}
+
+namespace KlayGE
+{
+	task_group::task_group(task_scheduler& scheduler)
+		: scheduler_(scheduler), pending_(0)
+	{
+	}
+
+	task_group::~task_group()
+	{
+		try
+		{
+			this->wait();
+		}
+		catch (...)
+		{
+		}
+	}
+
+	void task_group::run(std::function<void()> task)
+	{
+		scheduler_.spawn(*this, std::move(task));
+	}
+
+	void task_group::then(std::function<void()> func)
+	{
+		{
+			std::lock_guard<std::mutex> lock(mutex_);
+			if (pending_.load() > 0)
+			{
+				continuations_.push_back(std::move(func));
+				return;
+			}
+		}
+
+		this->run(std::move(func));
+	}
+
+	void task_group::wait()
+	{
+		while (!this->done())
+		{
+			if (!scheduler_.try_run_one())
+			{
+				std::this_thread::yield();
+			}
+		}
+
+		std::exception_ptr ex;
+		{
+			std::lock_guard<std::mutex> lock(mutex_);
+			ex = exception_;
+			exception_ = nullptr;
+		}
+		if (ex)
+		{
+			std::rethrow_exception(ex);
+		}
+	}
+
+	void task_group::on_task_done()
+	{
+		uint32_t count = pending_.load();
+		for (;;)
+		{
+			if (1 == count)
+			{
+				// The last task spawns the continuations. Dropping to 0 only happens under the lock, so then() can't
+				//  miss it, and the continuations are counted before this task leaves.
+				std::lock_guard<std::mutex> lock(mutex_);
+				for (auto& func : continuations_)
+				{
+					this->run(std::move(func));
+				}
+				continuations_.clear();
+				pending_.fetch_sub(1, std::memory_order_acq_rel);
+				break;
+			}
+			else if (pending_.compare_exchange_weak(count, count - 1, std::memory_order_acq_rel))
+			{
+				break;
+			}
+		}
+	}
+
+	void task_group::on_exception(std::exception_ptr const & ex)
+	{
+		std::lock_guard<std::mutex> lock(mutex_);
+		if (!exception_)
+		{
+			exception_ = ex;
+		}
+	}
+
+
+	task_scheduler::task_scheduler(uint32_t num_workers)
+		: num_queued_(0), num_sleeping_(0), quit_(false)
+	{
+		if (0 == num_workers)
+		{
+			num_workers = std::max(std::thread::hardware_concurrency(), 2U) - 1;
+		}
+
+		for (uint32_t i = 0; i <= num_workers; ++ i)
+		{
+			queues_.push_back(MakeUniquePtr<task_queue>());
+		}
+		for (uint32_t i = 0; i < num_workers; ++ i)
+		{
+			workers_.emplace_back(std::bind(&task_scheduler::worker_func, this, i));
+		}
+	}
+
+	task_scheduler::~task_scheduler()
+	{
+		{
+			std::lock_guard<std::mutex> lock(sleep_mutex_);
+			quit_ = true;
+			sleep_cond_.notify_all();
+		}
+		for (auto& worker : workers_)
+		{
+			worker.join();
+		}
+	}
+
+	bool task_scheduler::in_worker_thread() const
+	{
+		return this == tls_scheduler;
+	}
+
+	bool task_scheduler::try_run_one()
+	{
+		task t;
+		if (this->pop_task(t))
+		{
+			this->execute(t);
+			return true;
+		}
+		else
+		{
+			return false;
+		}
+	}
+
+	void task_scheduler::spawn(task_group& group, std::function<void()> func)
+	{
+		group.pending_.fetch_add(1, std::memory_order_relaxed);
+
+		uint32_t const queue_index = this->in_worker_thread() ? tls_worker_index : this->num_workers();
+		{
+			auto& queue = *queues_[queue_index];
+			std::lock_guard<std::mutex> lock(queue.mutex);
+			queue.tasks.push_back({ std::move(func), &group });
+		}
+
+		++ num_queued_;
+		if (num_sleeping_ > 0)
+		{
+			std::lock_guard<std::mutex> lock(sleep_mutex_);
+			sleep_cond_.notify_one();
+		}
+	}
+
+	bool task_scheduler::pop_task(task& t)
+	{
+		if (num_queued_.load(std::memory_order_acquire) <= 0)
+		{
+			return false;
+		}
+
+		uint32_t const num_queues = static_cast<uint32_t>(queues_.size());
+		uint32_t const injection_index = this->num_workers();
+		uint32_t const self_index = this->in_worker_thread() ? tls_worker_index : injection_index;
+
+		// LIFO from the own queue for locality
+		{
+			auto& queue = *queues_[self_index];
+			std::lock_guard<std::mutex> lock(queue.mutex);
+			if (!queue.tasks.empty())
+			{
+				t = std::move(queue.tasks.back());
+				queue.tasks.pop_back();
+				-- num_queued_;
+				return true;
+			}
+		}
+
+		// FIFO from the others, starting from the injection queue
+		for (uint32_t i = 0; i < num_queues; ++ i)
+		{
+			uint32_t const victim = (injection_index + i) % num_queues;
+			if (victim != self_index)
+			{
+				auto& queue = *queues_[victim];
+				std::lock_guard<std::mutex> lock(queue.mutex);
+				if (!queue.tasks.empty())
+				{
+					t = std::move(queue.tasks.front());
+					queue.tasks.pop_front();
+					-- num_queued_;
+					return true;
+				}
+			}
+		}
+
+		return false;
+	}
+
+	void task_scheduler::execute(task& t)
+	{
+		try
+		{
+			t.func();
+		}
+		catch (...)
+		{
+			t.group->on_exception(std::current_exception());
+		}
+		t.func = std::function<void()>();
+		t.group->on_task_done();
+	}
+
+	void task_scheduler::worker_func(uint32_t index)
+	{
+		tls_scheduler = this;
+		tls_worker_index = index;
+
+		while (!quit_)
+		{
+			if (!this->try_run_one())
+			{
+				std::unique_lock<std::mutex> lock(sleep_mutex_);
+				++ num_sleeping_;
+				sleep_cond_.wait(lock, [this]
+					{
+						return quit_ || (num_queued_ > 0);
+					});
+				-- num_sleeping_;
+			}
+		}
+
+		tls_scheduler = nullptr;
+	}
+}
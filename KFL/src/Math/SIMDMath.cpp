@@ -2155,6 +2155,242 @@ namespace KlayGE
 			proj.Col(2, clip_plane * SetVector(c));
 		}
 
+		// Bound
+		///////////////////////////////////////////////////////////////////////////////
+		void IntersectAABBFrustum(BoundOverlap* overlaps, float const * center_x, float const * center_y,
+			float const * center_z, float const * extent_x, float const * extent_y, float const * extent_z, size_t num,
+			Frustum const & frustum)
+		{
+			size_t i = 0;
+
+#if defined(SIMD_MATH_SSE)
+			__m128 plane_a[6], plane_b[6], plane_c[6], plane_d[6];
+			__m128 abs_a[6], abs_b[6], abs_c[6];
+			for (uint32_t j = 0; j < 6; ++ j)
+			{
+				Plane const & plane = frustum.FrustumPlane(j);
+				plane_a[j] = _mm_set1_ps(plane.a());
+				plane_b[j] = _mm_set1_ps(plane.b());
+				plane_c[j] = _mm_set1_ps(plane.c());
+				plane_d[j] = _mm_set1_ps(plane.d());
+				abs_a[j] = _mm_set1_ps(MathLib::abs(plane.a()));
+				abs_b[j] = _mm_set1_ps(MathLib::abs(plane.b()));
+				abs_c[j] = _mm_set1_ps(MathLib::abs(plane.c()));
+			}
+
+			__m128 const zero = _mm_setzero_ps();
+			for (; i + 4 <= num; i += 4)
+			{
+				__m128 const cx = _mm_loadu_ps(center_x + i);
+				__m128 const cy = _mm_loadu_ps(center_y + i);
+				__m128 const cz = _mm_loadu_ps(center_z + i);
+				__m128 const ex = _mm_loadu_ps(extent_x + i);
+				__m128 const ey = _mm_loadu_ps(extent_y + i);
+				__m128 const ez = _mm_loadu_ps(extent_z + i);
+
+				__m128 outside = zero;
+				__m128 partial = zero;
+				for (uint32_t j = 0; j < 6; ++ j)
+				{
+					// Distance of the center, and the projected radius of the box on the plane normal
+					__m128 const dist = _mm_add_ps(_mm_add_ps(_mm_mul_ps(cx, plane_a[j]), _mm_mul_ps(cy, plane_b[j])),
+						_mm_add_ps(_mm_mul_ps(cz, plane_c[j]), plane_d[j]));
+					__m128 const r = _mm_add_ps(_mm_add_ps(_mm_mul_ps(ex, abs_a[j]), _mm_mul_ps(ey, abs_b[j])),
+						_mm_mul_ps(ez, abs_c[j]));
+
+					outside = _mm_or_ps(outside, _mm_cmplt_ps(_mm_add_ps(dist, r), zero));
+					partial = _mm_or_ps(partial, _mm_cmplt_ps(_mm_sub_ps(dist, r), zero));
+				}
+
+				int const outside_bits = _mm_movemask_ps(outside);
+				int const partial_bits = _mm_movemask_ps(partial);
+				for (int k = 0; k < 4; ++ k)
+				{
+					overlaps[i + k] = (outside_bits & (1 << k)) ? BO_No : ((partial_bits & (1 << k)) ? BO_Partial : BO_Yes);
+				}
+			}
+#endif
+
+			for (; i < num; ++ i)
+			{
+				bool outside = false;
+				bool partial = false;
+				for (uint32_t j = 0; j < 6; ++ j)
+				{
+					Plane const & plane = frustum.FrustumPlane(j);
+					float const dist = (center_x[i] * plane.a() + center_y[i] * plane.b())
+						+ (center_z[i] * plane.c() + plane.d());
+					float const r = (extent_x[i] * MathLib::abs(plane.a()) + extent_y[i] * MathLib::abs(plane.b()))
+						+ extent_z[i] * MathLib::abs(plane.c());
+
+					outside |= (dist + r < 0);
+					partial |= (dist - r < 0);
+				}
+
+				overlaps[i] = outside ? BO_No : (partial ? BO_Partial : BO_Yes);
+			}
+		}
+
+		void IntersectSphereFrustum(BoundOverlap* overlaps, float const * center_x, float const * center_y,
+			float const * center_z, float const * radius, size_t num, Frustum const & frustum)
+		{
+			size_t i = 0;
+
+#if defined(SIMD_MATH_SSE)
+			__m128 plane_a[6], plane_b[6], plane_c[6], plane_d[6];
+			for (uint32_t j = 0; j < 6; ++ j)
+			{
+				Plane const & plane = frustum.FrustumPlane(j);
+				plane_a[j] = _mm_set1_ps(plane.a());
+				plane_b[j] = _mm_set1_ps(plane.b());
+				plane_c[j] = _mm_set1_ps(plane.c());
+				plane_d[j] = _mm_set1_ps(plane.d());
+			}
+
+			__m128 const zero = _mm_setzero_ps();
+			for (; i + 4 <= num; i += 4)
+			{
+				__m128 const cx = _mm_loadu_ps(center_x + i);
+				__m128 const cy = _mm_loadu_ps(center_y + i);
+				__m128 const cz = _mm_loadu_ps(center_z + i);
+				__m128 const r = _mm_loadu_ps(radius + i);
+				__m128 const neg_r = _mm_sub_ps(zero, r);
+
+				__m128 outside = zero;
+				__m128 partial = zero;
+				for (uint32_t j = 0; j < 6; ++ j)
+				{
+					__m128 const dist = _mm_add_ps(_mm_add_ps(_mm_mul_ps(cx, plane_a[j]), _mm_mul_ps(cy, plane_b[j])),
+						_mm_add_ps(_mm_mul_ps(cz, plane_c[j]), plane_d[j]));
+
+					outside = _mm_or_ps(outside, _mm_cmple_ps(dist, neg_r));
+					partial = _mm_or_ps(partial, _mm_cmplt_ps(dist, r));
+				}
+
+				int const outside_bits = _mm_movemask_ps(outside);
+				int const partial_bits = _mm_movemask_ps(partial);
+				for (int k = 0; k < 4; ++ k)
+				{
+					overlaps[i + k] = (outside_bits & (1 << k)) ? BO_No : ((partial_bits & (1 << k)) ? BO_Partial : BO_Yes);
+				}
+			}
+#endif
+
+			for (; i < num; ++ i)
+			{
+				bool outside = false;
+				bool partial = false;
+				for (uint32_t j = 0; j < 6; ++ j)
+				{
+					Plane const & plane = frustum.FrustumPlane(j);
+					float const dist = (center_x[i] * plane.a() + center_y[i] * plane.b())
+						+ (center_z[i] * plane.c() + plane.d());
+
+					outside |= (dist <= -radius[i]);
+					partial |= (dist < radius[i]);
+				}
+
+				overlaps[i] = outside ? BO_No : (partial ? BO_Partial : BO_Yes);
+			}
+		}
+
+		// Rasterization
+		///////////////////////////////////////////////////////////////////////////////
+		void RasterizeTriangleDepth(float* depth, uint32_t width, uint32_t height, uint32_t pitch,
+			float3 const & v0, float3 const & v1, float3 const & v2)
+		{
+			BOOST_ASSERT(0 == (pitch & 3));
+
+			float const area = (v1.x() - v0.x()) * (v2.y() - v0.y()) - (v1.y() - v0.y()) * (v2.x() - v0.x());
+			if (!(MathLib::abs(area) > 0))
+			{
+				return;
+			}
+
+			// Counter-clockwise in the math sense, so the points inside are on the positive side of every edge
+			float3 const & p0 = v0;
+			float3 const & p1 = (area > 0) ? v1 : v2;
+			float3 const & p2 = (area > 0) ? v2 : v1;
+			float const inv_area = 1 / MathLib::abs(area);
+
+			// Edge functions in the form of a * x + b * y + c. The one opposite to a vertex is its barycentric weight.
+			float const a12 = p1.y() - p2.y();
+			float const b12 = p2.x() - p1.x();
+			float const c12 = -(a12 * p1.x() + b12 * p1.y());
+			float const a20 = p2.y() - p0.y();
+			float const b20 = p0.x() - p2.x();
+			float const c20 = -(a20 * p2.x() + b20 * p2.y());
+			float const a01 = p0.y() - p1.y();
+			float const b01 = p1.x() - p0.x();
+			float const c01 = -(a01 * p0.x() + b01 * p0.y());
+
+			// The depth is linear in screen space
+			float const za = (p0.z() * a12 + p1.z() * a20 + p2.z() * a01) * inv_area;
+			float const zb = (p0.z() * b12 + p1.z() * b20 + p2.z() * b01) * inv_area;
+			float const zc = (p0.z() * c12 + p1.z() * c20 + p2.z() * c01) * inv_area;
+
+			float const fw = static_cast<float>(width);
+			float const fh = static_cast<float>(height);
+			float const min_x = MathLib::clamp(std::min(std::min(p0.x(), p1.x()), p2.x()), 0.0f, fw);
+			float const max_x = MathLib::clamp(std::max(std::max(p0.x(), p1.x()), p2.x()), 0.0f, fw);
+			float const min_y = MathLib::clamp(std::min(std::min(p0.y(), p1.y()), p2.y()), 0.0f, fh);
+			float const max_y = MathLib::clamp(std::max(std::max(p0.y(), p1.y()), p2.y()), 0.0f, fh);
+			uint32_t const x_begin = static_cast<uint32_t>(min_x) & ~3U;
+			uint32_t const x_end = std::min(static_cast<uint32_t>(max_x) + 1, width);
+			uint32_t const y_begin = static_cast<uint32_t>(min_y);
+			uint32_t const y_end = std::min(static_cast<uint32_t>(max_y) + 1, height);
+
+#if defined(SIMD_MATH_SSE)
+			__m128 const v_a12 = _mm_set1_ps(a12);
+			__m128 const v_a20 = _mm_set1_ps(a20);
+			__m128 const v_a01 = _mm_set1_ps(a01);
+			__m128 const v_za = _mm_set1_ps(za);
+			__m128 const v_width = _mm_set1_ps(fw);
+			__m128 const zero = _mm_setzero_ps();
+			__m128 const offsets = _mm_set_ps(3.5f, 2.5f, 1.5f, 0.5f);
+			for (uint32_t y = y_begin; y < y_end; ++ y)
+			{
+				float const fy = y + 0.5f;
+				__m128 const row12 = _mm_set1_ps(b12 * fy + c12);
+				__m128 const row20 = _mm_set1_ps(b20 * fy + c20);
+				__m128 const row01 = _mm_set1_ps(b01 * fy + c01);
+				__m128 const row_z = _mm_set1_ps(zb * fy + zc);
+				float* row = depth + y * pitch;
+				for (uint32_t x = x_begin; x < x_end; x += 4)
+				{
+					__m128 const fx = _mm_add_ps(_mm_set1_ps(static_cast<float>(x)), offsets);
+					__m128 const e12 = _mm_add_ps(_mm_mul_ps(v_a12, fx), row12);
+					__m128 const e20 = _mm_add_ps(_mm_mul_ps(v_a20, fx), row20);
+					__m128 const e01 = _mm_add_ps(_mm_mul_ps(v_a01, fx), row01);
+					__m128 const inside = _mm_and_ps(_mm_and_ps(_mm_cmpge_ps(e12, zero), _mm_cmpge_ps(e20, zero)),
+						_mm_and_ps(_mm_cmpge_ps(e01, zero), _mm_cmplt_ps(fx, v_width)));
+					if (_mm_movemask_ps(inside))
+					{
+						__m128 const z = _mm_add_ps(_mm_mul_ps(v_za, fx), row_z);
+						__m128 const old_z = _mm_loadu_ps(row + x);
+						__m128 const new_z = _mm_min_ps(old_z, z);
+						_mm_storeu_ps(row + x, _mm_or_ps(_mm_and_ps(inside, new_z), _mm_andnot_ps(inside, old_z)));
+					}
+				}
+			}
+#else
+			for (uint32_t y = y_begin; y < y_end; ++ y)
+			{
+				float const fy = y + 0.5f;
+				float* row = depth + y * pitch;
+				for (uint32_t x = x_begin; x < x_end; ++ x)
+				{
+					float const fx = x + 0.5f;
+					if ((a12 * fx + (b12 * fy + c12) >= 0) && (a20 * fx + (b20 * fy + c20) >= 0)
+						&& (a01 * fx + (b01 * fy + c01) >= 0))
+					{
+						row[x] = std::min(row[x], za * fx + (zb * fy + zc));
+					}
+				}
+			}
+#endif
+		}
+
 		// Color
 		///////////////////////////////////////////////////////////////////////////////
 		SIMDVectorF4 NegativeColor(SIMDVectorF4 const & rhs)
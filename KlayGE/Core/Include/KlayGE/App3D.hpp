@@ -68,7 +68,9 @@ namespace KlayGE
 			URV_ReflectionOnly = 1UL << 7,
 			URV_SpecialShadingOnly = 1UL << 8,
 			URV_SimpleForwardOnly = 1UL << 9,
-			URV_VDMOnly = 1UL << 10
+			URV_VDMOnly = 1UL << 10,
+			URV_StaticOnly = 1UL << 11,
+			URV_MoveableOnly = 1UL << 12
 		};
 
 	public:
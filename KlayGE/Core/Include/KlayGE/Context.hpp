@@ -57,6 +57,11 @@ namespace KlayGE
 
 		bool perf_profiler;
 		bool location_sensor;
+
+		// Replayed at startup if not empty. Then the requests of the first manifest_record_time seconds are recorded
+		//  into it for the next run, 0 means not recording.
+		std::string prefetch_manifest;
+		float manifest_record_time;
 	};
 
 	class KLAYGE_CORE_API Context : boost::noncopyable
@@ -158,6 +163,11 @@ namespace KlayGE
 			return *gtp_instance_;
 		}
 
+		task_scheduler& TaskScheduler()
+		{
+			return *gts_instance_;
+		}
+
 	private:
 		void DestroyAll();
 
@@ -191,6 +201,7 @@ namespace KlayGE
 		DllLoader ads_loader_;
 
 		std::unique_ptr<thread_pool> gtp_instance_;
+		std::unique_ptr<task_scheduler> gts_instance_;
 	};
 }
 
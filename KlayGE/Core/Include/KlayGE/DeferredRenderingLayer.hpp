@@ -103,6 +103,10 @@ namespace KlayGE
 
 		uint32_t num_cascades;
 		std::array<TexturePtr, CascadedShadowLayer::MAX_NUM_CASCADES> filtered_csm_texs;
+		// The light view projection with the crop of each cascade, and the caster generation of the scene manager,
+		//  when it was drawn last time
+		std::array<float4x4, CascadedShadowLayer::MAX_NUM_CASCADES> csm_view_projs;
+		std::array<uint32_t, CascadedShadowLayer::MAX_NUM_CASCADES> csm_caster_generations;
 
 		std::array<FrameBufferPtr, 2> merged_shading_fbs;
 		std::array<TexturePtr, 2> merged_shading_texs;
@@ -120,6 +124,8 @@ namespace KlayGE
 		IndirectLightingLayerPtr il_layer;
 
 		std::vector<char> light_visibles;
+		// Indices of the enabled lights in light_visibles, in order
+		std::vector<uint32_t> visible_lights;
 
 #if DEFAULT_DEFERRED == TRIDITIONAL_DEFERRED
 		FrameBufferPtr lighting_fb;
@@ -293,6 +299,28 @@ namespace KlayGE
 		}
 		void SetViewportCascades(uint32_t vp, uint32_t num_cascades, float pssm_lambda);
 
+		// Keeps the depth of the static casters for each shadow map of spot and point lights, and only draws the
+		//  moveable casters over it every frame. The static casters are drawn again when the light or one of the
+		//  static objects changes. Cascaded and reflective shadow maps are always drawn in full. Off by default.
+		void CachedShadows(bool cached);
+		bool CachedShadows() const
+		{
+			return cached_shadows_;
+		}
+		// The number of 2D shadow maps and cube faces drawn in a frame. The lights are ranked by how much of the
+		//  screen they cover, and by how long they have waited. The largest ones get all their faces, distant point
+		//  lights one or two, and the rest keep their maps from the earlier frames until their turn. A light that just
+		//  got a shadow map is always drawn in full. 0 draws everything every frame. Otherwise the far half of the
+		//  cascades is drawn every other frame, as long as they and the objects casting shadows don't move.
+		void ShadowMapUpdateBudget(uint32_t num_maps)
+		{
+			sm_update_budget_ = num_maps;
+		}
+		uint32_t ShadowMapUpdateBudget() const
+		{
+			return sm_update_budget_;
+		}
+
 		// For debug only
 		void ForceLineMode(bool line)
 		{
@@ -350,10 +378,15 @@ namespace KlayGE
 		void BuildLightList();
 		void BuildVisibleSceneObjList(bool& has_opaque_objs, bool& has_transparency_back_objs, bool& has_transparency_front_objs);
 		void BuildPassScanList(bool has_opaque_objs, bool has_transparency_back_objs, bool has_transparency_front_objs);
-		void CheckLightVisible(uint32_t vp_index, uint32_t light_index);
+		// The bound of the light volume, for the lights that have one
+		AABBox LightVolumeBound(LightSource const & light) const;
+		void CheckLightsVisible();
+		void ClipShadowViews();
+		void ScheduleShadowMaps();
 		void AppendGBufferPassScanCode(uint32_t vp_index, PassTargetBuffer pass_tb);
 		void AppendShadowPassScanCode(uint32_t light_index);
 		void AppendCascadedShadowPassScanCode(uint32_t vp_index, uint32_t light_index);
+		void AppendStaticShadowMapScanCode(uint32_t light_index, int32_t index_in_pass);
 		void AppendIndirectLightingPassScanCode(uint32_t vp_index, uint32_t light_index);
 		void AppendShadingPassScanCode(uint32_t vp_index, PassTargetBuffer pass_tb);
 		void PreparePVP(PerViewport& pvp);
@@ -363,7 +396,7 @@ namespace KlayGE
 		void RenderDecals(PerViewport const & pvp, PassType pass_type);
 		void PrepareLightCamera(PerViewport const & pvp, LightSource const & light,
 			int32_t index_in_pass, PassType pass_type);
-		void PostGenerateShadowMap(PerViewport const & pvp, int32_t org_no, int32_t index_in_pass);
+		void PostGenerateShadowMap(PerViewport const & pvp, int32_t org_no, int32_t sm_index);
 		void UpdateShadowing(PerViewport const & pvp);
 #if DEFAULT_DEFERRED == LIGHT_INDEXED_DEFERRED
 		void UpdateShadowingCS(PerViewport const & pvp);
@@ -402,7 +435,8 @@ namespace KlayGE
 		uint32_t GBufferGenerationDRJob(PerViewport& pvp, PassType pass_type);
 		uint32_t GBufferProcessingDRJob(PerViewport const & pvp);
 		uint32_t OpaqueGBufferProcessingDRJob(PerViewport const & pvp);
-		uint32_t ShadowMapGenerationDRJob(PerViewport const & pvp, PassType pass_type, int32_t org_no, int32_t index_in_pass);
+		uint32_t ShadowMapGenerationDRJob(PerViewport& pvp, PassType pass_type, int32_t org_no, int32_t index_in_pass);
+		uint32_t StaticShadowMapGenerationDRJob(int32_t org_no, int32_t index_in_pass);
 		uint32_t IndirectLightingDRJob(PerViewport const & pvp, int32_t org_no);
 		uint32_t ShadowingDRJob(PerViewport const & pvp, PassTargetBuffer pass_tb);
 		uint32_t ShadingDRJob(PerViewport const & pvp, PassType pass_type, int32_t index_in_pass);
@@ -502,7 +536,7 @@ namespace KlayGE
 #endif
 		static uint32_t const MAX_NUM_SHADOWED_LIGHTS = 4;
 		static uint32_t const MAX_NUM_SHADOWED_SPOT_LIGHTS = 4;
-		static uint32_t const MAX_NUM_SHADOWED_POINT_LIGHTS = 1;
+		static uint32_t const MAX_NUM_SHADOWED_POINT_LIGHTS = 3;
 		static uint32_t const MAX_NUM_PROJECTIVE_SHADOWED_SPOT_LIGHTS = 1;
 		static uint32_t const MAX_NUM_PROJECTIVE_SHADOWED_POINT_LIGHTS = 1;
 
@@ -517,6 +551,41 @@ namespace KlayGE
 		std::array<TexturePtr, MAX_NUM_SHADOWED_SPOT_LIGHTS + MAX_NUM_PROJECTIVE_SHADOWED_SPOT_LIGHTS> filtered_sm_2d_texs_;
 		std::array<TexturePtr, MAX_NUM_SHADOWED_POINT_LIGHTS + MAX_NUM_PROJECTIVE_SHADOWED_POINT_LIGHTS> filtered_sm_cube_texs_;
 
+		struct static_sm_cache_t
+		{
+			FrameBufferPtr fb;
+			TexturePtr depth_tex;
+			// What the depth was drawn for. The light is null until it's drawn.
+			LightSource const * light;
+			float4x4 view_proj;
+			uint32_t static_generation;
+		};
+		// The depth of the static casters of each 2D shadow map, and of each face of each cube shadow map. Lights can
+		//  share a slot, it's only used by a light after AppendStaticShadowMapScanCode took it for that light.
+		static_sm_cache_t* StaticShadowMapCache(uint32_t light_index, int32_t index_in_pass);
+		bool cached_shadows_;
+		std::array<static_sm_cache_t, MAX_NUM_SHADOWED_SPOT_LIGHTS + MAX_NUM_PROJECTIVE_SHADOWED_SPOT_LIGHTS> static_sm_2d_caches_;
+		std::array<std::array<static_sm_cache_t, 6>,
+			MAX_NUM_SHADOWED_POINT_LIGHTS + MAX_NUM_PROJECTIVE_SHADOWED_POINT_LIGHTS> static_sm_cube_caches_;
+
+		struct sm_slot_state_t
+		{
+			// The light whose maps are in the slot, null if none
+			LightSource const * light;
+			uint32_t next_face;
+			uint32_t frames_waited;
+		};
+		uint32_t sm_update_budget_;
+		uint32_t sm_frame_;
+		std::array<sm_slot_state_t, MAX_NUM_SHADOWED_SPOT_LIGHTS + MAX_NUM_PROJECTIVE_SHADOWED_SPOT_LIGHTS> sm_2d_slot_states_;
+		std::array<sm_slot_state_t,
+			MAX_NUM_SHADOWED_POINT_LIGHTS + MAX_NUM_PROJECTIVE_SHADOWED_POINT_LIGHTS> sm_cube_slot_states_;
+		// A bit for each map of each light in lights_, set if it's drawn in this frame. Cascades are decided by their
+		//  jobs, after the cascades of the frame are known.
+		std::vector<uint32_t> sm_update_masks_;
+		// The map drawn by the last shadow map job, filtered by the next one. -1 if none.
+		int32_t unfiltered_sm_index_;
+
 		PostProcessPtr sm_filter_pp_;
 		PostProcessPtr csm_filter_pp_;
 		PostProcessPtr depth_to_esm_pp_;
@@ -34,15 +34,73 @@
 #pragma once
 
 #include <KlayGE/PreDeclare.hpp>
+#include <KlayGE/ResPacket.hpp>
 #include <KFL/CXX17/string_view.hpp>
 
+#include <mutex>
 #include <string>
+#include <unordered_map>
+#include <vector>
+
+#include <boost/noncopyable.hpp>
+
+struct IInArchive;
 
 namespace KlayGE
 {
+	// An opened 7z archive. It keeps the archive and a name to index table alive, so finding and extracting files
+	//  doesn't reopen the archive every time. It's safe to use from multiple threads.
+	class KLAYGE_CORE_API Archive7z : public ResPacket
+	{
+	public:
+		Archive7z(ResIdentifierPtr const & archive_is, std::string_view password);
+		~Archive7z() override;
+
+		uint64_t Timestamp() const override
+		{
+			return timestamp_;
+		}
+		std::vector<std::string> const & FilePaths() const override
+		{
+			return file_paths_;
+		}
+		bool Contains(std::string_view file_path) const override;
+
+		ResIdentifierPtr Open(std::string const & name, std::string_view file_path) override;
+		// Files in the same solid block are decompressed once
+		void Open(std::vector<std::string> const & names, std::vector<std::string> const & file_paths,
+			std::vector<ResIdentifierPtr>& res) override;
+
+		uint32_t Find(std::string_view extract_file_path) const;
+
+		// Extracts a file into a buffer pre-sized to its unpacked size. Returns false if it's not in the archive.
+		bool Extract(std::string_view extract_file_path, std::vector<uint8_t>& data);
+		// Extracts several files in one pass, so each solid block is decompressed once for all files in it. Files not
+		//  in the archive get an empty buffer.
+		void Extract(std::vector<std::string> const & extract_file_paths, std::vector<std::vector<uint8_t>>& data);
+
+	private:
+		uint64_t UnpackedSize(uint32_t index) const;
+
+	private:
+		std::shared_ptr<IInArchive> archive_;
+		std::string password_;
+		uint64_t timestamp_;
+
+		std::vector<std::string> file_paths_;
+		std::unordered_map<std::string, uint32_t> file_indices_;
+
+		// IInArchive isn't thread safe
+		std::mutex mutex_;
+	};
+
 	KLAYGE_CORE_API uint32_t Find7z(ResIdentifierPtr const & archive_is,
 		std::string_view password,
 		std::string_view extract_file_path);
+	// Returns the paths of all files in the archive, with '/' as the separator
+	KLAYGE_CORE_API void List7z(ResIdentifierPtr const & archive_is,
+		std::string_view password,
+		std::vector<std::string>& file_paths);
 	KLAYGE_CORE_API void Extract7z(ResIdentifierPtr const & archive_is,
 		std::string_view password,
 		std::string_view extract_file_path,
@@ -0,0 +1,123 @@
+/**
+ * @file KPKPacket.hpp
+ * @author Minmin Gong
+ *
+ * @section DESCRIPTION
+ *
+ * This source file is part of KlayGE
+ * For the latest info, see http://www.klayge.org
+ *
+ * @section LICENSE
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published
+ * by the Free Software Foundation; either version 2 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program; if not, write to the Free Software
+ * Foundation, Inc., 59 Temple Place, Suite 330, Boston, MA 02111-1307 USA
+ *
+ * You may alternatively use this source under the terms of
+ * the KlayGE Proprietary License (KPL). You can obtained such a license
+ * from http://www.klayge.org/licensing/.
+ */
+
+#ifndef _KLAYGE_KPKPACKET_HPP
+#define _KLAYGE_KPKPACKET_HPP
+
+#pragma once
+
+#include <KlayGE/PreDeclare.hpp>
+#include <KlayGE/ResPacket.hpp>
+#include <KFL/MappedFile.hpp>
+
+namespace KlayGE
+{
+	// A packet format that is fast to open. The file is a header, a table of entries sorted by name hash, a name pool,
+	//  and the data of each entry at its own alignment. The whole file is memory mapped. Stored entries are opened in
+	//  place, and the others are decoded with LZ4.
+	class KLAYGE_CORE_API KPKPacket : public ResPacket
+	{
+	public:
+		static uint32_t constexpr FOURCC = MakeFourCC<'K', 'P', 'K', '0'>::value;
+		static uint32_t constexpr VERSION = 1;
+
+		enum Codec
+		{
+			C_Stored = 0,
+			C_LZ4
+		};
+
+#ifdef KLAYGE_HAS_STRUCT_PACK
+#pragma pack(push, 1)
+#endif
+		struct Header
+		{
+			uint32_t fourcc;
+			uint32_t version;
+			uint32_t num_entries;
+			uint32_t names_size;
+			uint64_t data_offset;
+			uint64_t reserved;
+		};
+
+		struct Entry
+		{
+			uint64_t name_hash;
+			uint32_t name_offset;
+			uint32_t name_length;
+			uint64_t offset;
+			uint64_t packed_size;
+			uint64_t original_size;
+			uint32_t codec;
+			uint32_t alignment;
+		};
+#ifdef KLAYGE_HAS_STRUCT_PACK
+#pragma pack(pop)
+#endif
+
+	public:
+		KPKPacket(std::string const & pkt_name, uint64_t timestamp);
+
+		uint64_t Timestamp() const override
+		{
+			return timestamp_;
+		}
+		std::vector<std::string> const & FilePaths() const override
+		{
+			return file_paths_;
+		}
+		bool Contains(std::string_view file_path) const override;
+
+		using ResPacket::Open;
+		ResIdentifierPtr Open(std::string const & name, std::string_view file_path) override;
+
+		// Writes a packet. Entries are LZ4 encoded if that saves more than an eighth of the size, otherwise stored.
+		//  Stored entries start at an alignment boundary so they can be used in place.
+		static void Save(std::string const & pkt_name, std::vector<std::string> const & file_paths,
+			std::vector<std::vector<uint8_t>> const & data, uint32_t alignment = 16);
+
+		static uint64_t NameHash(std::string_view file_path);
+
+	private:
+		Entry const * FindEntry(std::string_view file_path) const;
+
+	private:
+		std::shared_ptr<MappedFile> file_;
+		uint64_t timestamp_;
+
+		Entry const * entries_;
+		uint32_t num_entries_;
+		char const * names_;
+
+		std::vector<std::string> file_paths_;
+	};
+}
+
+#endif			// _KLAYGE_KPKPACKET_HPP
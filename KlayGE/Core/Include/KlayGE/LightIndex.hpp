@@ -0,0 +1,90 @@
+/**
+ * @file LightIndex.hpp
+ * @author Minmin Gong
+ *
+ * @section DESCRIPTION
+ *
+ * This source file is part of KlayGE
+ * For the latest info, see http://www.klayge.org
+ *
+ * @section LICENSE
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published
+ * by the Free Software Foundation; either version 2 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program; if not, write to the Free Software
+ * Foundation, Inc., 59 Temple Place, Suite 330, Boston, MA 02111-1307 USA
+ *
+ * You may alternatively use this source under the terms of
+ * the KlayGE Proprietary License (KPL). You can obtained such a license
+ * from http://www.klayge.org/licensing/.
+ */
+
+
+#ifndef _LIGHTINDEX_HPP
+#define _LIGHTINDEX_HPP
+
+#pragma once
+
+#include <KlayGE/PreDeclare.hpp>
+#include <KFL/ArrayRef.hpp>
+#include <KFL/AABBox.hpp>
+#include <KFL/Frustum.hpp>
+
+#include <vector>
+
+namespace KlayGE
+{
+	// World space bounds of many lights, for frustum queries that don't test the lights one by one. The lights are
+	//  sorted along a Morton curve of their centers and split into small groups. A query tests the bounds of the
+	//  groups first, and only the lights in groups crossing the frustum after that, both with SIMD.
+	class KLAYGE_CORE_API LightIndex : boost::noncopyable
+	{
+	public:
+		void Clear();
+		// id is returned by the queries, the index of the light in the caller's list for example
+		void Add(uint32_t id, AABBox const & aabb);
+		// Must be called after the last Add, before the queries
+		void Build();
+
+		uint32_t NumLights() const
+		{
+			return static_cast<uint32_t>(ids_.size());
+		}
+
+		// The ids of the lights whose bounds intersect the frustum, in increasing order
+		void Query(Frustum const & frustum, std::vector<uint32_t>& ids) const;
+		// ids[k] gets the lights of frusta[k]. A null frustum contains every light.
+		void Query(ArrayRef<Frustum const *> frusta, std::vector<std::vector<uint32_t>>& ids) const;
+
+	private:
+		struct bounds_t
+		{
+			std::vector<float> center_x, center_y, center_z;
+			std::vector<float> extent_x, extent_y, extent_z;
+
+			void Resize(size_t size);
+			void Set(size_t index, AABBox const & aabb);
+		};
+
+		std::vector<AABBox> aabbs_;
+		std::vector<uint32_t> ids_;
+
+		// The lights in Morton order, and the bounds of each group of them
+		bounds_t light_bounds_;
+		std::vector<uint32_t> sorted_ids_;
+		bounds_t group_bounds_;
+
+		mutable std::vector<BoundOverlap> overlaps_;
+	};
+}
+
+#endif		// _LIGHTINDEX_HPP
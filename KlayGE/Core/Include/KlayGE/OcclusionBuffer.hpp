@@ -0,0 +1,96 @@
+/**
+ * @file OcclusionBuffer.hpp
+ * @author Minmin Gong
+ *
+ * @section DESCRIPTION
+ *
+ * This source file is part of KlayGE
+ * For the latest info, see http://www.klayge.org
+ *
+ * @section LICENSE
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published
+ * by the Free Software Foundation; either version 2 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program; if not, write to the Free Software
+ * Foundation, Inc., 59 Temple Place, Suite 330, Boston, MA 02111-1307 USA
+ *
+ * You may alternatively use this source under the terms of
+ * the KlayGE Proprietary License (KPL). You can obtained such a license
+ * from http://www.klayge.org/licensing/.
+ */
+
+
+#ifndef _OCCLUSIONBUFFER_HPP
+#define _OCCLUSIONBUFFER_HPP
+
+#pragma once
+
+#include <KlayGE/PreDeclare.hpp>
+#include <KFL/AABBox.hpp>
+#include <KFL/Matrix.hpp>
+
+#include <vector>
+
+namespace KlayGE
+{
+	// A small depth buffer rasterized on the CPU, for occlusion culling without a GPU. The occluders are rasterized
+	//  first, then a hierarchy of max depths is built, and bounds are tested against it. Depths are z / w after the
+	//  projection, 0 on the near plane and 1 on the far plane.
+	class KLAYGE_CORE_API OcclusionBuffer : boost::noncopyable
+	{
+	public:
+		OcclusionBuffer(uint32_t width, uint32_t height);
+
+		void Resize(uint32_t width, uint32_t height);
+		uint32_t Width() const
+		{
+			return width_;
+		}
+		uint32_t Height() const
+		{
+			return height_;
+		}
+
+		void Clear();
+		// Triangles crossing the near plane are skipped, so the buffer is never nearer than the occluders
+		void RasterizeTriangles(float3 const * positions, uint32_t num_vertices, uint16_t const * indices,
+			uint32_t num_indices, float4x4 const & mvp);
+		void BuildHiZ();
+
+		// True if the bound is behind the occluders everywhere it covers. Bounds crossing the near plane or out of the
+		//  buffer are never occluded. BuildHiZ must be called after the last rasterization.
+		bool Occluded(AABBox const & aabb, float4x4 const & view_proj) const;
+
+		float Depth(uint32_t x, uint32_t y) const;
+
+	private:
+		uint32_t width_;
+		uint32_t height_;
+		// Rows are padded to a multiple of 4 floats for the rasterizer
+		uint32_t pitch_;
+		std::vector<float> depth_;
+
+		struct hiz_level_t
+		{
+			uint32_t width;
+			uint32_t height;
+			std::vector<float> max_depth;
+		};
+		// Level 0 is the depth buffer without padding, every level after it has the max of 2x2 texels of the one before
+		std::vector<hiz_level_t> hiz_;
+
+		std::vector<float3> screen_positions_;
+		std::vector<uint8_t> clipped_;
+	};
+}
+
+#endif		// _OCCLUSIONBUFFER_HPP
@@ -341,6 +341,12 @@ namespace KlayGE
 
 		std::vector<Particle> particles_;
 		std::vector<std::pair<uint32_t, float>> active_particles_;
+		// Copies of the active particles in drawing order, and their bound, from the last sub thread update. The
+		//  main thread builds the instance data from them, particles_ keeps changing meanwhile.
+		std::vector<Particle> active_particle_snapshot_;
+		AABBox active_particle_bound_;
+		// The camera is moved on the main thread, the sub thread update sorts with the view matrix copied here
+		float4x4 view_mat_;
 
 		float gravity_;
 		float3 force_;
@@ -40,6 +40,12 @@ namespace KlayGE
 	class ResLoadingDesc;
 	typedef std::shared_ptr<ResLoadingDesc> ResLoadingDescPtr;
 	class ResLoader;
+	class ResPacket;
+	typedef std::shared_ptr<ResPacket> ResPacketPtr;
+	class Archive7z;
+	typedef std::shared_ptr<Archive7z> Archive7zPtr;
+	class KPKPacket;
+	typedef std::shared_ptr<KPKPacket> KPKPacketPtr;
 	class PerfRange;
 	typedef std::shared_ptr<PerfRange> PerfRangePtr;
 	class PerfProfiler;
@@ -52,6 +58,9 @@ namespace KlayGE
 	typedef std::shared_ptr<SceneObject> SceneObjectPtr;
 	class SceneObjectHelper;
 	typedef std::shared_ptr<SceneObjectHelper> SceneObjectHelperPtr;
+	class SceneObjectStore;
+	class OcclusionBuffer;
+	class LightIndex;
 	class SceneObjectSkyBox;
 	typedef std::shared_ptr<SceneObjectSkyBox> SceneObjectSkyBoxPtr;
 	class SceneObjectLightSourceProxy;
@@ -238,6 +238,9 @@ namespace KlayGE
 		void IndirectArgsOffset(uint32_t offset);
 		uint32_t IndirectArgsOffset() const;
 
+		// True if both draw the same vertices from the same buffers. The instance streams aren't compared.
+		bool SameGeometry(RenderLayout const & rhs) const;
+
 	protected:
 		topology_type topo_type_;
 
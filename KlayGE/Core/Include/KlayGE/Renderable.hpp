@@ -143,6 +143,10 @@ namespace KlayGE
 		{
 			return technique_;
 		}
+		RenderMaterialPtr const & Material() const
+		{
+			return mtl_;
+		}
 
 		virtual void NumLods(uint32_t lods);
 		virtual uint32_t NumLods() const;
@@ -34,28 +34,31 @@
 #pragma once
 
 #include <KlayGE/PreDeclare.hpp>
+#include <atomic>
+#include <condition_variable>
+#include <functional>
 #include <istream>
+#include <list>
+#include <queue>
+#include <unordered_map>
+#include <unordered_set>
 #include <vector>
 #include <string>
-#if defined(KLAYGE_COMPILER_MSVC)
-#pragma warning(push)
-#pragma warning(disable: 4512) // consume_via_copy in lockfree doesn't have assignment operator.
-#elif defined(KLAYGE_COMPILER_CLANG)
-#pragma clang diagnostic push
-#pragma clang diagnostic ignored "-Wunused-parameter" // Ignore unused parameter 'x', 'alloc'
-#endif
-#include <boost/lockfree/spsc_queue.hpp>
-#if defined(KLAYGE_COMPILER_MSVC)
-#pragma warning(pop)
-#elif defined(KLAYGE_COMPILER_CLANG)
-#pragma clang diagnostic pop
-#endif
 
 #include <KFL/ResIdentifier.hpp>
 #include <KFL/Thread.hpp>
+#include <KFL/Timer.hpp>
 
 namespace KlayGE
 {
+	// Requests with higher priority are picked up by the loading threads first
+	enum ResLoadingPriority
+	{
+		RLP_Prefetch = 0,
+		RLP_Normal,
+		RLP_Immediate
+	};
+
 	class KLAYGE_CORE_API ResLoadingDesc : boost::noncopyable
 	{
 	public:
@@ -76,7 +79,35 @@ namespace KlayGE
 
 		virtual bool HasSubThreadStage() const = 0;
 
+		// Estimated bytes MainThreadStage uploads to the GPU. Used by the upload budget of ResLoader::Update.
+		virtual uint64_t MainThreadStageBytes() const
+		{
+			return 0;
+		}
+		// Estimated memory held by the loaded resource. Used by the retention budget of ResLoader.
+		virtual uint64_t ResourceBytes() const
+		{
+			return 0;
+		}
+
+		// Fills what a prefetch manifest needs to recreate this request. Returns false if the request can't be
+		//  recreated from a name and an access hint.
+		virtual bool ManifestEntry(std::string& name, uint32_t& access_hint) const
+		{
+			KFL_UNUSED(name);
+			KFL_UNUSED(access_hint);
+			return false;
+		}
+
 		virtual bool Match(ResLoadingDesc const & rhs) const = 0;
+
+		// Descs that match must have the same hash. It's computed from the content (type, name, access hints), not the
+		//  address. The default one only separates the types.
+		virtual size_t Hash() const
+		{
+			return static_cast<size_t>(this->Type());
+		}
+
 		virtual void CopyDataFrom(ResLoadingDesc const & rhs) = 0;
 		virtual std::shared_ptr<void> CloneResourceFrom(std::shared_ptr<void> const & resource) = 0;
 
@@ -85,6 +116,22 @@ namespace KlayGE
 
 	class KLAYGE_CORE_API ResLoader : boost::noncopyable
 	{
+	public:
+		typedef std::function<ResLoadingDescPtr(std::string const & name, uint32_t access_hint)> ManifestDescFactory;
+
+		struct RetentionStats
+		{
+			// Queries served by a resource that only the retention cache kept alive
+			uint64_t hits;
+			// Queries that had to load the resource
+			uint64_t misses;
+			uint64_t evictions;
+
+			// Resources held only by the retention cache
+			uint32_t num_retained;
+			uint64_t retained_bytes;
+		};
+
 	public:
 		ResLoader();
 		~ResLoader();
@@ -97,17 +144,23 @@ namespace KlayGE
 
 		void AddPath(std::string const & path);
 		void DelPath(std::string const & path);
+		// Locate and Open resolve names from cached directory and packet listings. Call these after files are
+		//  added or removed under the search paths at runtime.
+		void RescanPaths();
+		void InvalidateResName(std::string const & name);
 		std::string const & LocalFolder() const
 		{
 			return local_path_;
 		}
 
 		ResIdentifierPtr Open(std::string const & name);
+		// Opens several files. The ones in the same packet are extracted in one pass.
+		void Open(std::vector<std::string> const & names, std::vector<ResIdentifierPtr>& res);
 		std::string Locate(std::string const & name);
 		std::string AbsPath(std::string const & path);
 
 		std::shared_ptr<void> SyncQuery(ResLoadingDescPtr const & res_desc);
-		std::shared_ptr<void> ASyncQuery(ResLoadingDescPtr const & res_desc);
+		std::shared_ptr<void> ASyncQuery(ResLoadingDescPtr const & res_desc, ResLoadingPriority priority = RLP_Normal);
 		void Unload(std::shared_ptr<void> const & res);
 
 		template <typename T>
@@ -117,10 +170,16 @@ namespace KlayGE
 		}
 
 		template <typename T>
-		std::shared_ptr<T> ASyncQueryT(ResLoadingDescPtr const & res_desc)
+		std::shared_ptr<T> ASyncQueryT(ResLoadingDescPtr const & res_desc, ResLoadingPriority priority = RLP_Normal)
+		{
+			return std::static_pointer_cast<T>(this->ASyncQuery(res_desc, priority));
+		}
+
+		uint32_t NumLoadingThreads() const
 		{
-			return std::static_pointer_cast<T>(this->ASyncQuery(res_desc));
+			return static_cast<uint32_t>(loading_threads_.size());
 		}
+		void NumLoadingThreads(uint32_t num);
 
 		template <typename T>
 		void Unload(std::shared_ptr<T> const & res)
@@ -128,16 +187,141 @@ namespace KlayGE
 			this->Unload(std::static_pointer_cast<void>(res));
 		}
 
+		// Runs the main thread stages of completed async requests, higher priority first, within the per-frame budget
 		void Update();
 
+		// Limits the main thread stages Update runs per frame, by time in seconds and by bytes uploaded to the GPU.
+		//  0 means no limit. At least one stage runs per frame, so loading always progresses.
+		void MainThreadStageBudget(float time, uint64_t upload_bytes);
+		float MainThreadTimeBudget() const
+		{
+			return main_thread_time_budget_;
+		}
+		uint64_t MainThreadUploadBudget() const
+		{
+			return main_thread_upload_budget_;
+		}
+
+		// Number of async requests that are still loading or waiting for their main thread stage. Can be used to
+		//  decide when to show a loading screen.
+		uint32_t RemainingBacklog();
+
+		// Keeps loaded resources alive after their last user releases them, up to bytes of them, evicting the least
+		//  recently used first. max_entries also limits the number of them, so resources without a size estimate
+		//  can't pile up. 0 bytes disables the cache, 0 entries means no limit. Unload evicts a resource right away.
+		void RetentionBudget(uint64_t bytes, uint32_t max_entries);
+		// A separate byte budget for one type of ResLoadingDesc, such as CT_HASH("TextureLoadingDesc"). The type's
+		//  resources still count in the global budget.
+		void TypeRetentionBudget(uint64_t desc_type, uint64_t bytes);
+		RetentionStats RetentionStatistics();
+		void ResetRetentionStatistics();
+
+		// Records the type, name and access hint of every request made in the next duration seconds into a prefetch
+		//  manifest. It's saved to file_name, under LocalFolder() if file_name can't be written, when the time is up
+		//  or the loader is destroyed.
+		void RecordManifest(std::string const & file_name, float duration);
+		void StopRecordingManifest();
+		// Issues every request in a manifest as a RLP_Prefetch async query. A real query of the same resource takes
+		//  the request over with its own priority. The prefetched resources are held for as long as the recording
+		//  lasted, then handed to the retention cache. Returns false if the manifest can't be opened.
+		bool ReplayManifest(std::string const & file_name);
+		// Types of ResLoadingDesc that can be recreated from a manifest. Textures are registered by default.
+		void RegisterManifestType(uint64_t desc_type, ManifestDescFactory const & factory);
+
+	private:
+		enum LoadingStatus
+		{
+			LS_Loading,
+			LS_SubThreadStage,
+			LS_Complete,
+			LS_CanBeRemoved
+		};
+
+		struct LoadingState
+		{
+			explicit LoadingState(int32_t loader_refs)
+				: status(LS_Loading), loader_refs(loader_refs)
+			{
+			}
+
+			// Moves the status out of LS_SubThreadStage, and wakes up the threads waiting for that
+			bool LeaveSubThreadStage(LoadingStatus new_status);
+			// Returns the status once the sub thread stage is over
+			LoadingStatus WaitForSubThreadStage();
+
+			std::atomic<LoadingStatus> status;
+
+			// References to the resource held by the loader itself. The request is dropped if nobody else holds it.
+			int32_t loader_refs;
+
+			std::mutex sub_thread_mutex;
+			std::condition_variable sub_thread_cond;
+		};
+		typedef std::shared_ptr<LoadingState> LoadingStatePtr;
+
+		struct LoadedResource
+		{
+			ResLoadingDescPtr res_desc;
+			std::weak_ptr<void> res;
+			void const * res_ptr;
+		};
+		typedef std::unordered_multimap<size_t, LoadedResource> LoadedResourcesType;
+
+		struct LoadingQueueItem
+		{
+			ResLoadingDescPtr res_desc;
+			LoadingStatePtr state;
+			ResLoadingPriority priority;
+			uint64_t seq;
+
+			bool operator<(LoadingQueueItem const & rhs) const
+			{
+				// Higher priority first, then first in first out
+				return (priority != rhs.priority) ? (priority < rhs.priority) : (seq > rhs.seq);
+			}
+		};
+
+		struct RetainedResource
+		{
+			ResLoadingDescPtr res_desc;
+			std::shared_ptr<void> res;
+			uint64_t bytes;
+		};
+		typedef std::list<RetainedResource> RetainedResourcesType;
+
+		struct DirListing
+		{
+			bool exists;
+			std::unordered_set<std::string> names;
+		};
+
 	private:
 		std::string RealPath(std::string const & path);
 
+		std::string ResolveResName(std::string const & name);
+		bool PathExists(std::string const & path);
+		DirListing& ListDir(std::string const & dir);
+		bool PktContains(std::string const & name, std::string const & res_name);
+		ResPacketPtr PktPacket(std::string const & name, std::string const & res_name, std::string& internal_name);
+
 		void AddLoadedResource(ResLoadingDescPtr const & res_desc, std::shared_ptr<void> const & res);
 		std::shared_ptr<void> FindMatchLoadedResource(ResLoadingDescPtr const & res_desc);
 		void RemoveUnrefResources();
+		LoadedResourcesType::iterator EraseLoadedResource(LoadedResourcesType::iterator iter);
+		void RetainResource(ResLoadingDescPtr const & res_desc, std::shared_ptr<void> const & res);
+		void ReleaseRetainedResource(void const * res_ptr);
+		void TrimRetainedResources();
+		void RecordManifestItem(ResLoadingDescPtr const & res_desc);
+		void SaveManifest();
 
+		void StartLoadingThreads(uint32_t num);
+		void StopLoadingThreads();
+		void EnqueueLoading(ResLoadingDescPtr const & res_desc, LoadingStatePtr const & state,
+			ResLoadingPriority priority);
+		bool IsLoadingDropped(LoadingQueueItem const & item);
 		void LoadingThreadFunc();
+		void CompleteLoading(LoadingQueueItem const & item);
+		void FinishLoading(LoadingQueueItem const & item);
 
 		ResIdentifierPtr LocatePkt(std::string const & name, std::string const & res_name,
 			std::string& password, std::string& internal_name);
@@ -152,27 +336,66 @@ namespace KlayGE
 	private:
 		static std::unique_ptr<ResLoader> res_loader_instance_;
 
-		enum LoadingStatus
-		{
-			LS_Loading,
-			LS_Complete,
-			LS_CanBeRemoved
-		};
-
 		std::string exe_path_;
 		std::string local_path_;
 		std::vector<std::string> paths_;
 		std::mutex paths_mutex_;
 
+		// Name to the full path found in paths_
+		std::unordered_map<std::string, std::string> res_name_index_;
+		// Directory to its entries, and packet file to the opened packet. Filled on first use.
+		std::unordered_map<std::string, DirListing> dir_listings_;
+		std::unordered_map<std::string, ResPacketPtr> pkt_packets_;
+
 		std::mutex loaded_mutex_;
 		std::mutex loading_mutex_;
-		std::vector<std::pair<ResLoadingDescPtr, std::weak_ptr<void>>> loaded_res_;
-		std::vector<std::pair<ResLoadingDescPtr, std::shared_ptr<volatile LoadingStatus>>> loading_res_;
-		boost::lockfree::spsc_queue<std::pair<ResLoadingDescPtr, std::shared_ptr<volatile LoadingStatus>>,
-			boost::lockfree::capacity<1024>> loading_res_queue_;
+		LoadedResourcesType loaded_res_;
+		// Resource address to its desc hash, for Unload
+		std::unordered_map<void const *, size_t> loaded_res_index_;
+		LoadedResourcesType::iterator loaded_cleanup_iter_;
+		size_t loaded_cleanup_bucket_count_;
+		std::unordered_multimap<size_t, std::pair<ResLoadingDescPtr, LoadingStatePtr>> loading_res_;
+
+		// Strong references to loaded resources, most recently used first. Guarded by loaded_mutex_.
+		RetainedResourcesType retained_res_;
+		std::unordered_map<void const *, RetainedResourcesType::iterator> retained_res_index_;
+		uint64_t retention_budget_;
+		uint32_t retention_max_entries_;
+		std::unordered_map<uint64_t, uint64_t> type_retention_budgets_;
+		RetentionStats retention_stats_;
+
+		std::mutex loading_queue_mutex_;
+		std::condition_variable loading_queue_cond_;
+		std::priority_queue<LoadingQueueItem> loading_queue_;
+		uint64_t loading_queue_seq_;
+
+		std::vector<joiner<void>> loading_threads_;
+		bool quit_;
+
+		// Requests with the sub thread stage done, handed to Update
+		std::mutex completed_mutex_;
+		std::vector<LoadingQueueItem> completed_queue_;
+		// Only touched by Update. Requests that didn't fit in the budget stay here for the next frames.
+		std::priority_queue<LoadingQueueItem> main_thread_queue_;
+		float main_thread_time_budget_;
+		uint64_t main_thread_upload_budget_;
+
+		// Recording of the prefetch manifest. manifest_file_ is empty if not recording. The requests issued by
+		//  ReplayManifest aren't recorded, so entries that are no longer used fade out of the manifest.
+		std::mutex manifest_mutex_;
+		std::string manifest_file_;
+		float manifest_duration_;
+		Timer manifest_timer_;
+		std::vector<std::string> manifest_lines_;
+		std::unordered_set<std::string> manifest_line_set_;
+		bool replaying_manifest_;
 
-		std::unique_ptr<joiner<void>> loading_thread_;
-		volatile bool quit_;
+		// Only touched by the main thread. prefetched_res_ keeps the prefetched resources from being dropped before
+		//  they're queried.
+		std::unordered_map<uint64_t, ManifestDescFactory> manifest_factories_;
+		std::vector<std::shared_ptr<void>> prefetched_res_;
+		float prefetch_hold_time_;
+		Timer prefetch_timer_;
 	};
 }
 
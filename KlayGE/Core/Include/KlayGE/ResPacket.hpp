@@ -0,0 +1,77 @@
+/**
+ * @file ResPacket.hpp
+ * @author Minmin Gong
+ *
+ * @section DESCRIPTION
+ *
+ * This source file is part of KlayGE
+ * For the latest info, see http://www.klayge.org
+ *
+ * @section LICENSE
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published
+ * by the Free Software Foundation; either version 2 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program; if not, write to the Free Software
+ * Foundation, Inc., 59 Temple Place, Suite 330, Boston, MA 02111-1307 USA
+ *
+ * You may alternatively use this source under the terms of
+ * the KlayGE Proprietary License (KPL). You can obtained such a license
+ * from http://www.klayge.org/licensing/.
+ */
+
+#ifndef _KLAYGE_RESPACKET_HPP
+#define _KLAYGE_RESPACKET_HPP
+
+#pragma once
+
+#include <KlayGE/PreDeclare.hpp>
+#include <KFL/CXX17/string_view.hpp>
+#include <KFL/MappedFile.hpp>
+
+#include <string>
+#include <vector>
+
+#include <boost/noncopyable.hpp>
+
+namespace KlayGE
+{
+	// A packet of resource files, such as a 7z archive or a KPK file. Names are case insensitive.
+	class KLAYGE_CORE_API ResPacket : boost::noncopyable
+	{
+	public:
+		virtual ~ResPacket();
+
+		virtual uint64_t Timestamp() const = 0;
+
+		// Paths of all files in the packet, with '/' as the separator
+		virtual std::vector<std::string> const & FilePaths() const = 0;
+		virtual bool Contains(std::string_view file_path) const = 0;
+
+		// Returns null if the file isn't in the packet
+		virtual ResIdentifierPtr Open(std::string const & name, std::string_view file_path) = 0;
+		virtual void Open(std::vector<std::string> const & names, std::vector<std::string> const & file_paths,
+			std::vector<ResIdentifierPtr>& res);
+	};
+
+	// Picks the packet format from the content of pkt_is. pkt_name is the file pkt_is is opened from.
+	KLAYGE_CORE_API ResPacketPtr OpenResPacket(std::string const & pkt_name, ResIdentifierPtr const & pkt_is,
+		std::string_view password);
+
+	// A ResIdentifier owning a buffer of data extracted from a packet
+	KLAYGE_CORE_API ResIdentifierPtr MakeBufferResIdentifier(std::string const & name, uint64_t timestamp,
+		std::vector<uint8_t>&& data);
+	// A ResIdentifier reading [offset, offset + size) of a mapped file in place. It keeps the mapping alive.
+	KLAYGE_CORE_API ResIdentifierPtr MakeMappedResIdentifier(std::string const & name, uint64_t timestamp,
+		std::shared_ptr<MappedFile> const & file, uint64_t offset, uint64_t size);
+}
+
+#endif			// _KLAYGE_RESPACKET_HPP
@@ -24,6 +24,10 @@
 #include <KlayGE/PreDeclare.hpp>
 
 #include <KlayGE/Renderable.hpp>
+#include <KlayGE/SceneObjectStore.hpp>
+#include <KlayGE/OcclusionBuffer.hpp>
+#include <KlayGE/LightIndex.hpp>
+#include <KFL/ArrayRef.hpp>
 #include <KFL/Frustum.hpp>
 #include <KFL/Thread.hpp>
 
@@ -43,7 +47,26 @@ namespace KlayGE
 
 		void SmallObjectThreshold(float area);
 		void SceneUpdateElapse(float elapse);
+
+		// Occlusion culling on the CPU, after the frustum culling, so it works without a GPU. The occluders are
+		//  rasterized into a small depth buffer, and the objects whose bounds are behind it everywhere are not
+		//  rendered. Off by default.
+		void OcclusionCulling(bool occlusion);
+		bool OcclusionCulling() const;
+		void OcclusionBufferSize(uint32_t width, uint32_t height);
+		// The proxy mesh is in the model space of obj. It has to be inside the geometry of obj, or it could hide
+		//  objects that are actually visible.
+		void AddOccluder(SceneObjectPtr const & obj, std::vector<float3> const & positions,
+			std::vector<uint16_t> const & indices);
+		void DelOccluder(SceneObjectPtr const & obj);
 		virtual void ClipScene();
+		// Frustum culling against several frusta in one walk over the objects. visible_bits[k] gets one bit per scene
+		//  object, in the order of GetSceneObject, set if the object is in frusta[k]. Children are only in a frustum
+		//  with their parents. A null frustum contains everything.
+		void ClipFrusta(ArrayRef<Frustum const *> frusta, std::vector<std::vector<uint32_t>>& visible_bits);
+		// Culls the scene for cameras of views rendered later in this frame, in one walk over the objects. The marks
+		//  are cached like the ones of Flush, so the flushes of these views don't cull again.
+		void ClipCameras(ArrayRef<Camera const *> cameras);
 
 		void AddCamera(CameraPtr const & camera);
 		void DelCamera(CameraPtr const & camera);
@@ -58,6 +81,10 @@ namespace KlayGE
 		uint32_t NumLights() const;
 		LightSourcePtr& GetLight(uint32_t index);
 		LightSourcePtr const & GetLight(uint32_t index) const;
+		// Bounds of the lights, for frustum queries over all of them at once. The renderer fills it every frame with
+		//  the volumes it lights, they depend on its settings.
+		LightIndex& GetLightIndex();
+		LightIndex const & GetLightIndex() const;
 
 		void AddSceneObject(SceneObjectPtr const & obj);
 		void AddSceneObjectLocked(SceneObjectPtr const & obj);
@@ -86,6 +113,13 @@ namespace KlayGE
 		uint32_t NumVerticesRendered() const;
 		uint32_t NumDrawCalls() const;
 		uint32_t NumDispatchCalls() const;
+		uint32_t NumObjectsOccluded() const;
+
+		// Increased when a static object casting shadows is added, removed, moved, shown or hidden. What is rendered
+		//  of those objects alone stays right until it changes.
+		uint32_t StaticGeneration() const;
+		// Increased when any object casting shadows, static or moveable, is added, removed, moved, shown or hidden
+		uint32_t CasterGeneration() const;
 
 	protected:
 		void Flush(uint32_t urt);
@@ -99,30 +133,107 @@ namespace KlayGE
 		virtual void DoSuspend() = 0;
 		virtual void DoResume() = 0;
 
+		// Runs the sub thread updates of the objects on the task scheduler, over the last object list published by
+		//  the main thread. It never takes update_mutex_, the model matrices and instance data the updates produce
+		//  are handed back to the main thread through sub_thread_results_.
 		void UpdateThreadFunc();
+		void PublishSubThreadObjects();
+		void ApplySubThreadResults();
 
 		BoundOverlap VisibleTestFromParent(SceneObject* obj, float3 const & view_dir, float3 const & eye_pos,
 			float4x4 const & view_proj);
 
+		// Recomputes the world matrices and bounds of the moveable objects whose local matrix or parent changed, or
+		//  whose parent's local matrix changed, on the task scheduler. The renderables are updated after that on the
+		//  calling thread, since they can be shared by several objects. Every ClipScene calls it, but only the first
+		//  one after a change has anything to do, the later cameras and passes reuse the cached bounds.
+		void PropagateTransforms();
+		// Culling of objects without parents is split into ranges that run on the task scheduler. Each range only
+		//  writes the marks of its own objects, so the result doesn't depend on the scheduling.
+		// The small object test only. The frustum test of the objects passing it is batched by FrustumTestBounds.
+		BoundOverlap VisibleTestRoot(uint32_t attrib, AABBox const & aabb_ws, float3 const & view_dir,
+			float3 const & eye_pos, float4x4 const & view_proj) const;
+		// Tests world space bounds against the frustum, 4 at a time with SIMD. The results are the same as testing them
+		//  one by one.
+		void FrustumTestBounds(BoundOverlap* overlaps, AABBox const * const * aabbs_ws, size_t num) const;
+		// Objects with parents are marked after the others, in order, so every parent is marked before its children
+		void ClipChildObjects(float3 const & view_dir, float3 const & eye_pos, float4x4 const & view_proj, bool omni);
+		BoundOverlap ClipChildObject(SceneObject* so, float3 const & view_dir, float3 const & eye_pos,
+			float4x4 const & view_proj, bool omni);
+		// The camera's view projection, with the crop matrix of the current cascade when a cascaded shadow map is
+		//  rendered
+		float4x4 ClipViewProj(Camera const & camera) const;
+
 	protected:
 		std::vector<CameraPtr> cameras_;
 		Frustum const * frustum_;
 		std::vector<LightSourcePtr> lights_;
 		std::vector<SceneObjectPtr> scene_objs_;
 		std::vector<SceneObjectPtr> overlay_scene_objs_;
-
-		std::unordered_map<size_t, std::shared_ptr<std::vector<BoundOverlap>>> visible_marks_map_;
+		// Transforms, bounds and marks of scene_objs_. Overlay objects aren't in it.
+		SceneObjectStore obj_store_;
+		std::vector<uint8_t> transform_updated_;
+		// The value of transform_generation_ when each slot last moved. PropagateTransforms increases it when
+		//  anything moves.
+		std::vector<uint32_t> transform_stamps_;
+		uint32_t transform_generation_;
+		// Increased when objects or occluders are added or removed, and when culling settings change. The marks
+		//  cached before that are all culled again.
+		uint32_t scene_generation_;
+		uint32_t static_generation_;
+		uint32_t caster_generation_;
 
 		float small_obj_threshold_;
 		float update_elapse_;
 
 	private:
+		// Marks of a view, kept across frames as long as the view is flushed. A view is a camera, and a cascade
+		//  for cascaded shadow maps.
+		struct visible_marks_t
+		{
+			// In the order of scene_objs_
+			std::vector<BoundOverlap> marks;
+			std::vector<uint32_t> visible_bits;
+			float4x4 view_proj;
+			uint32_t scene_generation;
+			uint32_t transform_generation;
+			uint32_t last_frame;
+			float small_obj_threshold;
+			bool occlusion_culled;
+		};
+
 		void FlushScene();
+		void CullOccludedObjects();
+		// Renderables drawing the same geometry with the same effect, technique and material, whose objects have
+		//  instance data, are merged into the first one of them in the render queue. Their objects go into its
+		//  instance stream, and they're drawn in one call.
+		void BatchInstances();
+		void DelOccluders(SceneObject const * obj);
+		// Marks of the objects in each view, by slot of the object store. cameras is either empty, or has the cameras
+		//  of the frusta for the small object test.
+		void ClipViews(ArrayRef<Frustum const *> frusta, ArrayRef<Camera const *> cameras,
+			std::vector<std::vector<BoundOverlap>>& marks);
+		size_t VisibleMarksSeed(Camera const & camera, int32_t cascade_index) const;
+		void VisibleBits(std::vector<uint32_t>& bits) const;
+		// Brings cached marks up to date by testing again only the objects that moved or were shown or hidden since
+		//  they were culled, and the children of those. Returns false if they have to be culled from scratch.
+		bool ReclipChangedObjects(visible_marks_t& vm, Camera const & camera, float4x4 const & view_proj);
+		void StoreVisibleMarks(visible_marks_t& vm, float4x4 const & view_proj, bool occlusion_culled);
 
 	private:
 		uint32_t urt_;
 
-		std::vector<std::pair<RenderTechnique const *, std::vector<Renderable*>>> render_queue_;
+		std::unordered_map<size_t, visible_marks_t> visible_marks_map_;
+		uint32_t flush_frame_;
+
+		// Each renderable has a key, packed from the most significant bits: technique weight (16), technique (16),
+		//  material (8) and depth (24). Depths are front to back for opaque techniques and back to front for
+		//  transparent ones. Techniques and materials are numbered in the order they're added in each flush.
+		std::vector<std::pair<uint64_t, Renderable*>> render_queue_;
+		std::vector<std::pair<uint64_t, Renderable*>> render_queue_scratch_;
+		std::unordered_map<RenderTechnique const *, uint32_t> render_tech_ids_;
+		std::unordered_map<RenderMaterial const *, uint32_t> render_mtl_ids_;
+		std::unordered_map<size_t, size_t> instance_batches_;
 
 		uint32_t num_objects_rendered_;
 		uint32_t num_renderables_rendered_;
@@ -130,9 +241,46 @@ namespace KlayGE
 		uint32_t num_vertices_rendered_;
 		uint32_t num_draw_calls_;
 		uint32_t num_dispatch_calls_;
+		uint32_t num_objects_occluded_;
+
+		struct occluder_t
+		{
+			SceneObject* obj;
+			std::vector<float3> positions;
+			std::vector<uint16_t> indices;
+		};
+		bool occlusion_culling_;
+		OcclusionBuffer occlusion_buffer_;
+		std::vector<occluder_t> occluders_;
+
+		LightIndex light_index_;
 
 		std::mutex update_mutex_;
 		std::unique_ptr<joiner<void>> update_thread_;
+		// Double buffered state between the main thread and the update thread, guarded by sub_thread_mutex_. The
+		//  main thread publishes the object list with their model matrices once per frame, and the update thread
+		//  publishes the model matrices and instance data produced by each round of sub thread updates. Both sides
+		//  only hold the lock to swap or append.
+		struct sub_thread_obj_t
+		{
+			SceneObjectPtr obj;
+			float4x4 model;
+			uint32_t model_seq;
+		};
+		struct sub_thread_result_t
+		{
+			SceneObjectPtr obj;
+			bool has_model;
+			float4x4 model;
+			uint32_t model_seq;
+			std::vector<uint8_t> instance_data;
+		};
+		std::mutex sub_thread_mutex_;
+		std::vector<sub_thread_obj_t> sub_thread_objs_;
+		std::vector<sub_thread_obj_t> sub_thread_objs_back_;
+		bool sub_thread_objs_new_;
+		std::vector<sub_thread_result_t> sub_thread_results_;
+		std::vector<sub_thread_result_t> sub_thread_results_back_;
 		volatile bool quit_;
 
 		bool deferred_mode_;
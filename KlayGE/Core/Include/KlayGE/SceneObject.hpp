@@ -27,6 +27,8 @@ namespace KlayGE
 {
 	class KLAYGE_CORE_API SceneObject : boost::noncopyable, public std::enable_shared_from_this<SceneObject>
 	{
+		friend class SceneManager;
+
 	public:
 		enum SOAttrib
 		{
@@ -49,6 +51,8 @@ namespace KlayGE
 
 		RenderablePtr const & GetRenderable() const;
 
+		// Inside a sub thread update of the scene manager, the matrix is only buffered in the object. The manager
+		//  applies the buffered matrices on the main thread, at the beginning of the next Update.
 		virtual void ModelMatrix(float4x4 const & mat);
 		virtual float4x4 const & ModelMatrix() const;
 		virtual float4x4 const & AbsModelMatrix() const;
@@ -67,6 +71,11 @@ namespace KlayGE
 		void BindSubThreadUpdateFunc(std::function<void(SceneObject&, float, float)> const & update_func);
 		void BindMainThreadUpdateFunc(std::function<void(SceneObject&, float, float)> const & update_func);
 
+		// Runs on the task scheduler, in parallel with the sub thread updates of other objects and with the main
+		//  thread, Flush included. The model matrix and the instance data are double buffered: ModelMatrix reads and
+		//  writes a copy of the sub thread, and the renderables read the instance data through RenderInstanceData.
+		//  Any other state an override writes must be the object's own and not read by the renderables. State the
+		//  main thread changes, such as cameras or renderables, has to be read or written in MainThreadUpdate.
 		virtual void SubThreadUpdate(float app_time, float elapsed_time);
 		virtual bool MainThreadUpdate(float app_time, float elapsed_time);
 
@@ -76,6 +85,8 @@ namespace KlayGE
 
 		std::vector<VertexElement> const & InstanceFormat() const;
 		virtual void const * InstanceData() const;
+		// What the renderables read. A copy of InstanceData from the last sub thread update, if it has run.
+		void const * RenderInstanceData() const;
 
 		// For select mode
 		virtual void ObjectID(uint32_t id);
@@ -102,13 +113,47 @@ namespace KlayGE
 		bool renderable_hw_res_ready_;
 		std::vector<VertexElement> instance_format_;
 
+		std::function<void(SceneObject&, float, float)> sub_thread_update_func_;
+		std::function<void(SceneObject&, float, float)> main_thread_update_func_;
+
+	private:
+		void AttachToStore(SceneObjectStore& store);
+		void DetachFromStore();
+
+		// The two halves of UpdateAbsModelMatrix. The first one only writes the object's own data, so it can run on
+		//  many objects in parallel. The second one writes to the renderable, which can be shared.
+		void UpdateAbsModelMatrixAndBound();
+		void UpdateRenderableModelMatrix();
+
+		// On the update thread. The model matrix from the main thread is taken unless the sub thread has set one
+		//  that isn't applied yet.
+		void SyncSubThreadModelMatrix(float4x4 const & mat, uint32_t applied_seq);
+		void BufferedSubThreadUpdate(float app_time, float elapsed_time);
+		// Returns false if the last sub thread updates didn't set the model matrix
+		bool FetchSubThreadModelMatrix(float4x4& mat, uint32_t& seq);
+		void FetchSubThreadInstanceData(std::vector<uint8_t>& data) const;
+		// On the main thread
+		void ApplySubThreadResult(bool has_model, float4x4 const & mat, uint32_t seq,
+			std::vector<uint8_t>& instance_data);
+
+	private:
+		// Only used while the object isn't in a scene manager. After it's added, they are kept in the manager's
+		//  SceneObjectStore, and moved back here when it's removed. Derived classes go through the accessors.
 		float4x4 model_;
 		float4x4 abs_model_;
-		std::unique_ptr<AABBox> pos_aabb_ws_;
+		AABBox pos_aabb_ws_;
 		BoundOverlap visible_mark_;
 
-		std::function<void(SceneObject&, float, float)> sub_thread_update_func_;
-		std::function<void(SceneObject&, float, float)> main_thread_update_func_;
+		SceneObjectStore* store_;
+		uint32_t store_handle_;
+
+		// Written by the update thread only
+		float4x4 sub_thread_model_;
+		bool sub_thread_model_dirty_;
+		uint32_t sub_thread_model_seq_;
+		// Written by the main thread only
+		uint32_t applied_sub_thread_model_seq_;
+		std::vector<uint8_t> render_instance_data_;
 	};
 }
 
@@ -0,0 +1,144 @@
+/**
+ * @file SceneObjectStore.hpp
+ * @author Minmin Gong
+ *
+ * @section DESCRIPTION
+ *
+ * This source file is part of KlayGE
+ * For the latest info, see http://www.klayge.org
+ *
+ * @section LICENSE
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published
+ * by the Free Software Foundation; either version 2 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program; if not, write to the Free Software
+ * Foundation, Inc., 59 Temple Place, Suite 330, Boston, MA 02111-1307 USA
+ *
+ * You may alternatively use this source under the terms of
+ * the KlayGE Proprietary License (KPL). You can obtained such a license
+ * from http://www.klayge.org/licensing/.
+ */
+
+
+#ifndef _SCENEOBJECTSTORE_HPP
+#define _SCENEOBJECTSTORE_HPP
+
+#pragma once
+
+#include <KlayGE/PreDeclare.hpp>
+#include <KFL/AABBox.hpp>
+#include <KFL/Matrix.hpp>
+
+#include <vector>
+
+namespace KlayGE
+{
+	// Transforms, bounds and culling state of the objects in a scene manager, each in its own array, so the loops over
+	//  all the objects walk contiguous memory instead of following a pointer per object. An object gets a slot when
+	//  it's added to the scene manager, and the handle stays the same until it's removed. The arrays can grow when
+	//  objects are added, so references into them are only valid until then.
+	class KLAYGE_CORE_API SceneObjectStore : boost::noncopyable
+	{
+	public:
+		static uint32_t const INVALID_HANDLE = 0xFFFFFFFFU;
+
+		uint32_t Alloc(SceneObject* obj);
+		void Free(uint32_t handle);
+
+		// Free slots are included, with a null object
+		uint32_t NumSlots() const
+		{
+			return static_cast<uint32_t>(objs_.size());
+		}
+
+		std::vector<SceneObject*> const & Objects() const
+		{
+			return objs_;
+		}
+
+		// Mirrors of SceneObject::Parent and SceneObject::Attrib, kept in sync by SceneObject
+		std::vector<SceneObject*>& Parents()
+		{
+			return parents_;
+		}
+		std::vector<SceneObject*> const & Parents() const
+		{
+			return parents_;
+		}
+		std::vector<uint32_t>& Attribs()
+		{
+			return attribs_;
+		}
+		std::vector<uint32_t> const & Attribs() const
+		{
+			return attribs_;
+		}
+
+		std::vector<float4x4>& ModelMatrices()
+		{
+			return models_;
+		}
+		std::vector<float4x4> const & ModelMatrices() const
+		{
+			return models_;
+		}
+		std::vector<float4x4>& AbsModelMatrices()
+		{
+			return abs_models_;
+		}
+		std::vector<float4x4> const & AbsModelMatrices() const
+		{
+			return abs_models_;
+		}
+		std::vector<AABBox>& PosBoundsWS()
+		{
+			return pos_aabbs_ws_;
+		}
+		std::vector<AABBox> const & PosBoundsWS() const
+		{
+			return pos_aabbs_ws_;
+		}
+		std::vector<BoundOverlap>& VisibleMarks()
+		{
+			return visible_marks_;
+		}
+		std::vector<BoundOverlap> const & VisibleMarks() const
+		{
+			return visible_marks_;
+		}
+
+		// Set when the local matrix or the parent of an object changes, cleared once the world matrix and bound are
+		//  recomputed. One byte per slot, so objects can be flagged from different threads.
+		std::vector<uint8_t>& DirtyFlags()
+		{
+			return dirty_flags_;
+		}
+		std::vector<uint8_t> const & DirtyFlags() const
+		{
+			return dirty_flags_;
+		}
+
+	private:
+		std::vector<SceneObject*> objs_;
+		std::vector<SceneObject*> parents_;
+		std::vector<uint32_t> attribs_;
+		std::vector<float4x4> models_;
+		std::vector<float4x4> abs_models_;
+		std::vector<AABBox> pos_aabbs_ws_;
+		std::vector<BoundOverlap> visible_marks_;
+		std::vector<uint8_t> dirty_flags_;
+
+		std::vector<uint32_t> free_handles_;
+	};
+}
+
+#endif		// _SCENEOBJECTSTORE_HPP
@@ -325,8 +325,16 @@ namespace KlayGE
 	KLAYGE_CORE_API void LoadTexture(ResIdentifierPtr const & tex_res, Texture::TextureType& type,
 		uint32_t& width, uint32_t& height, uint32_t& depth, uint32_t& num_mipmaps, uint32_t& array_size,
 		ElementFormat& format, std::vector<ElementInitData>& init_data, std::vector<uint8_t>& data_block);
+	// If tex_res is in memory as a whole, init_data points into it instead of a copy in data_block, and data_block is
+	//  left empty. tex_res has to outlive init_data then, and the data mustn't be modified.
+	KLAYGE_CORE_API void LoadTextureInPlace(ResIdentifierPtr const & tex_res, Texture::TextureType& type,
+		uint32_t& width, uint32_t& height, uint32_t& depth, uint32_t& num_mipmaps, uint32_t& array_size,
+		ElementFormat& format, std::vector<ElementInitData>& init_data, std::vector<uint8_t>& data_block);
 	KLAYGE_CORE_API TexturePtr SyncLoadTexture(std::string const & tex_name, uint32_t access_hint);
 	KLAYGE_CORE_API TexturePtr ASyncLoadTexture(std::string const & tex_name, uint32_t access_hint);
+	// The desc SyncLoadTexture and ASyncLoadTexture query with. Lets ResLoader recreate texture requests from a
+	//  prefetch manifest.
+	KLAYGE_CORE_API ResLoadingDescPtr MakeTextureLoadingDesc(std::string const & tex_name, uint32_t access_hint);
 
 	KLAYGE_CORE_API void SaveTexture(std::string const & tex_name, Texture::TextureType type,
 		uint32_t width, uint32_t height, uint32_t depth, uint32_t num_mipmaps, uint32_t array_size,
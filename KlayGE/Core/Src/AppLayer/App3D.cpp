@@ -538,6 +538,16 @@ namespace KlayGE
 			cfg.graphics_cfg);
 		Context::Instance().Config(cfg);
 
+		if (!cfg.prefetch_manifest.empty())
+		{
+			// Starts loading what the last run asked for, before OnCreate asks for it again
+			ResLoader::Instance().ReplayManifest(cfg.prefetch_manifest);
+			if (cfg.manifest_record_time > 0)
+			{
+				ResLoader::Instance().RecordManifest(cfg.prefetch_manifest, cfg.manifest_record_time);
+			}
+		}
+
 		this->OnCreate();
 		this->OnResize(cfg.graphics_cfg.width, cfg.graphics_cfg.height);
 	}
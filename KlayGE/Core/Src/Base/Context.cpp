@@ -35,6 +35,7 @@
 #include <KFL/XMLDom.hpp>
 #include <KlayGE/DeferredRenderingLayer.hpp>
 #include <KFL/Thread.hpp>
+#include <KFL/TaskScheduler.hpp>
 #include <KlayGE/PerfProfiler.hpp>
 #include <KlayGE/UI.hpp>
 #include <KFL/Hash.hpp>
@@ -114,6 +115,7 @@ namespace KlayGE
 #endif
 
 		gtp_instance_ = MakeUniquePtr<thread_pool>(1, 16);
+		gts_instance_ = MakeUniquePtr<task_scheduler>();
 	}
 
 	Context::~Context()
@@ -138,6 +140,7 @@ namespace KlayGE
 
 		app_ = nullptr;
 
+		gts_instance_.reset();
 		gtp_instance_.reset();
 	}
 
@@ -291,7 +294,11 @@ namespace KlayGE
 		static char const * available_sfs_array[] = { "NullShow" };
 		static char const * available_scfs_array[] = { "Python" };
 #endif
+#if defined(KLAYGE_PLATFORM_ANDROID) || defined(KLAYGE_PLATFORM_IOS)
 		static char const * available_sms_array[] = { "OCTree" };
+#else
+		static char const * available_sms_array[] = { "OCTree", "BVH" };
+#endif
 
 		int width = 800;
 		int height = 600;
@@ -316,6 +323,8 @@ namespace KlayGE
 		std::vector<std::pair<std::string, std::string>> graphics_options;
 		bool perf_profiler = false;
 		bool location_sensor = false;
+		std::string prefetch_manifest;
+		float manifest_record_time = 0;
 
 		std::string rf_name;
 		std::string af_name;
@@ -388,6 +397,17 @@ namespace KlayGE
 				location_sensor = location_sensor_node->Attrib("enabled")->ValueInt() ? true : false;
 			}
 
+			XMLNodePtr prefetch_manifest_node = context_node->FirstNode("prefetch_manifest");
+			if (prefetch_manifest_node)
+			{
+				prefetch_manifest = prefetch_manifest_node->Attrib("name")->ValueString();
+				XMLAttributePtr record_attr = prefetch_manifest_node->Attrib("record_time");
+				if (record_attr)
+				{
+					manifest_record_time = record_attr->ValueFloat();
+				}
+			}
+
 			XMLNodePtr frame_node = graphics_node->FirstNode("frame");
 			XMLAttributePtr attr;
 			attr = frame_node->Attrib("width");
@@ -707,6 +727,8 @@ namespace KlayGE
 		cfg_.deferred_rendering = false;
 		cfg_.perf_profiler = perf_profiler;
 		cfg_.location_sensor = location_sensor;
+		cfg_.prefetch_manifest = prefetch_manifest;
+		cfg_.manifest_record_time = manifest_record_time;
 	}
 
 	void Context::SaveCfg(std::string const & cfg_file)
@@ -752,6 +774,11 @@ namespace KlayGE
 			XMLNodePtr location_sensor_node = cfg_doc.AllocNode(XNT_Element, "location_sensor");
 			location_sensor_node->AppendAttrib(cfg_doc.AllocAttribInt("enabled", cfg_.location_sensor));
 			context_node->AppendNode(location_sensor_node);
+
+			XMLNodePtr prefetch_manifest_node = cfg_doc.AllocNode(XNT_Element, "prefetch_manifest");
+			prefetch_manifest_node->AppendAttrib(cfg_doc.AllocAttribString("name", cfg_.prefetch_manifest));
+			prefetch_manifest_node->AppendAttrib(cfg_doc.AllocAttribFloat("record_time", cfg_.manifest_record_time));
+			context_node->AppendNode(prefetch_manifest_node);
 		}
 		root->AppendNode(context_node);
 
@@ -30,11 +30,18 @@
 
 #include <KlayGE/KlayGE.hpp>
 #include <KFL/Util.hpp>
-#include <KlayGE/Extract7z.hpp>
+#include <KFL/Timer.hpp>
+#include <KFL/Hash.hpp>
+#include <KFL/Log.hpp>
+#include <KlayGE/ResPacket.hpp>
+#include <KlayGE/Texture.hpp>
 #include <KFL/CXX17/filesystem.hpp>
 
+#include <algorithm>
+#include <cctype>
 #include <fstream>
 #include <sstream>
+#include <thread>
 
 #if defined KLAYGE_PLATFORM_WINDOWS_DESKTOP
 #include <windows.h>
@@ -97,8 +104,16 @@ namespace KlayGE
 	std::unique_ptr<ResLoader> ResLoader::res_loader_instance_;
 
 	ResLoader::ResLoader()
-		: quit_(false)
+		: loaded_cleanup_bucket_count_(0),
+			retention_budget_(0), retention_max_entries_(0), retention_stats_(),
+			loading_queue_seq_(0), quit_(false),
+			main_thread_time_budget_(0), main_thread_upload_budget_(0),
+			manifest_duration_(0), replaying_manifest_(false), prefetch_hold_time_(0)
 	{
+		loaded_cleanup_iter_ = loaded_res_.end();
+
+		this->RegisterManifestType(CT_HASH("TextureLoadingDesc"), MakeTextureLoadingDesc);
+
 #if defined KLAYGE_PLATFORM_WINDOWS
 #if defined KLAYGE_PLATFORM_WINDOWS_DESKTOP
 		char buf[MAX_PATH];
@@ -225,14 +240,13 @@ namespace KlayGE
 #endif
 #endif
 
-		loading_thread_ = MakeUniquePtr<joiner<void>>(Context::Instance().ThreadPool()(
-				std::bind(&ResLoader::LoadingThreadFunc, this)));
+		this->StartLoadingThreads(std::max(std::min(std::thread::hardware_concurrency() / 2, 4U), 1U));
 	}
 
 	ResLoader::~ResLoader()
 	{
-		quit_ = true;
-		(*loading_thread_)();
+		this->StopRecordingManifest();
+		this->StopLoadingThreads();
 	}
 
 	ResLoader& ResLoader::Instance()
@@ -316,6 +330,9 @@ namespace KlayGE
 		if (!real_path.empty())
 		{
 			paths_.push_back(real_path);
+
+			// Names resolved before keep their result, since earlier paths take precedence
+			this->ListDir(real_path);
 		}
 	}
 
@@ -330,8 +347,179 @@ namespace KlayGE
 			if (iter != paths_.end())
 			{
 				paths_.erase(iter);
+				res_name_index_.clear();
+			}
+		}
+	}
+
+	void ResLoader::RescanPaths()
+	{
+		std::lock_guard<std::mutex> lock(paths_mutex_);
+
+		res_name_index_.clear();
+		dir_listings_.clear();
+		pkt_packets_.clear();
+	}
+
+	void ResLoader::InvalidateResName(std::string const & name)
+	{
+		std::lock_guard<std::mutex> lock(paths_mutex_);
+
+		res_name_index_.erase(name);
+		for (auto const & path : paths_)
+		{
+			std::string res_name(path + name);
+#if defined KLAYGE_PLATFORM_WINDOWS
+			std::replace(res_name.begin(), res_name.end(), '\\', '/');
+#endif
+			std::string::size_type const pkt_offset = res_name.find("//");
+			if (pkt_offset != std::string::npos)
+			{
+				pkt_packets_.erase(res_name.substr(0, pkt_offset));
+				res_name = res_name.substr(0, pkt_offset);
+			}
+			dir_listings_.erase(res_name.substr(0, res_name.rfind('/') + 1));
+		}
+	}
+
+	std::string ResLoader::ResolveResName(std::string const & name)
+	{
+		auto iter = res_name_index_.find(name);
+		if (iter != res_name_index_.end())
+		{
+			return iter->second;
+		}
+
+		for (auto const & path : paths_)
+		{
+			std::string res_name(path + name);
+#if defined KLAYGE_PLATFORM_WINDOWS
+			std::replace(res_name.begin(), res_name.end(), '\\', '/');
+#endif
+
+			if (this->PathExists(res_name) || this->PktContains(name, res_name))
+			{
+				res_name_index_.emplace(name, res_name);
+				return res_name;
+			}
+		}
+
+		return "";
+	}
+
+	bool ResLoader::PathExists(std::string const & path)
+	{
+		std::string::size_type const slash = path.rfind('/');
+		if (std::string::npos == slash)
+		{
+			return false;
+		}
+
+		DirListing& listing = this->ListDir(path.substr(0, slash + 1));
+		std::string file_name = path.substr(slash + 1);
+#if defined KLAYGE_PLATFORM_WINDOWS
+		std::transform(file_name.begin(), file_name.end(), file_name.begin(), ::tolower);
+#endif
+		if (listing.exists && (file_name.empty() || (listing.names.find(file_name) != listing.names.end())))
+		{
+			return true;
+		}
+
+		// The listing is taken once per directory, files written after that (e.g. by the JIT) aren't in it.
+		//   Misses are rare and not cached, so probe the file system again.
+		bool exists;
+		try
+		{
+			exists = std::filesystem::exists(std::filesystem::path(path));
+		}
+		catch (...)
+		{
+			exists = false;
+		}
+		if (exists)
+		{
+			listing.exists = true;
+			if (!file_name.empty())
+			{
+				listing.names.insert(file_name);
+			}
+		}
+		return exists;
+	}
+
+	ResLoader::DirListing& ResLoader::ListDir(std::string const & dir)
+	{
+		auto iter = dir_listings_.find(dir);
+		if (iter == dir_listings_.end())
+		{
+			DirListing listing;
+			try
+			{
+				std::filesystem::path dir_path(dir);
+				listing.exists = std::filesystem::is_directory(dir_path);
+				if (listing.exists)
+				{
+					for (std::filesystem::directory_iterator entry(dir_path), end; entry != end; ++ entry)
+					{
+						std::string entry_name = entry->path().filename().string();
+#if defined KLAYGE_PLATFORM_WINDOWS
+						std::transform(entry_name.begin(), entry_name.end(), entry_name.begin(), ::tolower);
+#endif
+						listing.names.insert(entry_name);
+					}
+				}
+			}
+			catch (...)
+			{
+				listing.exists = false;
+				listing.names.clear();
+			}
+
+			iter = dir_listings_.emplace(dir, std::move(listing)).first;
+		}
+
+		return iter->second;
+	}
+
+	bool ResLoader::PktContains(std::string const & name, std::string const & res_name)
+	{
+		std::string internal_name;
+		ResPacketPtr packet = this->PktPacket(name, res_name, internal_name);
+		return packet && packet->Contains(internal_name);
+	}
+
+	ResPacketPtr ResLoader::PktPacket(std::string const & name, std::string const & res_name, std::string& internal_name)
+	{
+		std::string::size_type const pkt_offset = res_name.find("//");
+		if (std::string::npos == pkt_offset)
+		{
+			return ResPacketPtr();
+		}
+
+		internal_name = res_name.substr(pkt_offset + 2);
+
+		std::string const pkt_key = res_name.substr(0, pkt_offset);
+		auto iter = pkt_packets_.find(pkt_key);
+		if (iter == pkt_packets_.end())
+		{
+			ResPacketPtr packet;
+
+			// Skips opening packets that are not there. Names with a password are left to LocatePkt.
+			if ((pkt_key.find('|') != std::string::npos) || this->PathExists(pkt_key))
+			{
+				std::string password;
+				std::string pkt_internal_name;
+				ResIdentifierPtr pkt_file = LocatePkt(name, res_name, password, pkt_internal_name);
+				if (pkt_file && *pkt_file)
+				{
+					packet = OpenResPacket(pkt_key.substr(0, pkt_key.find('|')), pkt_file, password);
+				}
 			}
+
+			iter = pkt_packets_.emplace(pkt_key, packet).first;
 		}
+
+		return iter->second;
 	}
 
 	std::string ResLoader::Locate(std::string const & name)
@@ -348,30 +536,10 @@ namespace KlayGE
 #else
 		{
 			std::lock_guard<std::mutex> lock(paths_mutex_);
-			for (auto const & path : paths_)
+			std::string res_name = this->ResolveResName(name);
+			if (!res_name.empty())
 			{
-				std::string res_name(path + name);
-#if defined KLAYGE_PLATFORM_WINDOWS
-				std::replace(res_name.begin(), res_name.end(), '\\', '/');
-#endif
-
-				if (std::filesystem::exists(std::filesystem::path(res_name)))
-				{
-					return res_name;
-				}
-				else
-				{
-					std::string password;
-					std::string internal_name;
-					ResIdentifierPtr pkt_file = LocatePkt(name, res_name, password, internal_name);
-					if (pkt_file && *pkt_file)
-					{
-						if (Find7z(pkt_file, password, internal_name) != 0xFFFFFFFF)
-						{
-							return res_name;
-						}
-					}
-				}
+				return res_name;
 			}
 		}
 #if defined KLAYGE_PLATFORM_WINDOWS_STORE
@@ -394,7 +562,8 @@ namespace KlayGE
 		{
 			std::shared_ptr<AAssetStreamBuf> asb = MakeSharedPtr<AAssetStreamBuf>(asset);
 			std::shared_ptr<std::istream> asset_file = MakeSharedPtr<std::istream>(asb.get());
-			return MakeSharedPtr<ResIdentifier>(name, 0, asset_file, asb);
+			return MakeSharedPtr<ResIdentifier>(name, 0, asset_file, asb,
+				AAsset_getBuffer(asset), static_cast<uint64_t>(AAsset_getLength(asset)));
 		}
 #elif defined(KLAYGE_PLATFORM_IOS)
 		std::string const & res_name = LocateFileIOS(name);
@@ -412,36 +581,48 @@ namespace KlayGE
 		}
 #else
 		{
-			std::lock_guard<std::mutex> lock(paths_mutex_);
-			for (auto const & path : paths_)
+			std::string res_name;
+			std::string internal_name;
+			ResPacketPtr packet;
 			{
-				std::string res_name(path + name);
-#if defined KLAYGE_PLATFORM_WINDOWS
-				std::replace(res_name.begin(), res_name.end(), '\\', '/');
-#endif
-
-				std::filesystem::path res_path(res_name);
-				if (std::filesystem::exists(res_path))
+				std::lock_guard<std::mutex> lock(paths_mutex_);
+				res_name = this->ResolveResName(name);
+				if (!res_name.empty())
 				{
-#if defined(KLAYGE_CXX17_LIBRARY_FILESYSTEM_SUPPORT) || defined(KLAYGE_TS_LIBRARY_FILESYSTEM_SUPPORT)
-					uint64_t timestamp = std::filesystem::last_write_time(res_path).time_since_epoch().count();
-#else
-					uint64_t timestamp = std::filesystem::last_write_time(res_path);
-#endif
-					// The static_cast is a workaround for a bug in clang/c2
-					return MakeSharedPtr<ResIdentifier>(name, timestamp,
-						MakeSharedPtr<std::ifstream>(res_name.c_str(), static_cast<std::ios_base::openmode>(std::ios_base::binary)));
+					packet = this->PktPacket(name, res_name, internal_name);
+				}
+			}
+			if (!res_name.empty())
+			{
+				if (packet)
+				{
+					return packet->Open(name, internal_name);
 				}
 				else
 				{
-					std::string password;
-					std::string internal_name;
-					ResIdentifierPtr pkt_file = LocatePkt(name, res_name, password, internal_name);
-					if (pkt_file && *pkt_file)
+					std::filesystem::path res_path(res_name);
+					try
+					{
+#if defined(KLAYGE_CXX17_LIBRARY_FILESYSTEM_SUPPORT) || defined(KLAYGE_TS_LIBRARY_FILESYSTEM_SUPPORT)
+						uint64_t timestamp = std::filesystem::last_write_time(res_path).time_since_epoch().count();
+#else
+						uint64_t timestamp = std::filesystem::last_write_time(res_path);
+#endif
+						// Mapped files can be parsed in place. Empty files can't be mapped, and fall back to streams.
+						std::shared_ptr<MappedFile> mapped_file = MakeSharedPtr<MappedFile>();
+						if (mapped_file->Open(res_name))
+						{
+							return MakeMappedResIdentifier(name, timestamp, mapped_file, 0, mapped_file->Size());
+						}
+
+						// The static_cast is a workaround for a bug in clang/c2
+						return MakeSharedPtr<ResIdentifier>(name, timestamp,
+							MakeSharedPtr<std::ifstream>(res_name.c_str(), static_cast<std::ios_base::openmode>(std::ios_base::binary)));
+					}
+					catch (...)
 					{
-						std::shared_ptr<std::iostream> packet_file = MakeSharedPtr<std::stringstream>();
-						Extract7z(pkt_file, password, internal_name, packet_file);
-						return MakeSharedPtr<ResIdentifier>(name, pkt_file->Timestamp(), packet_file);
+						// Removed after being indexed
+						this->InvalidateResName(name);
 					}
 				}
 			}
@@ -458,8 +639,61 @@ namespace KlayGE
 		return ResIdentifierPtr();
 	}
 
+	void ResLoader::Open(std::vector<std::string> const & names, std::vector<ResIdentifierPtr>& res)
+	{
+		res.assign(names.size(), ResIdentifierPtr());
+
+#if !defined(KLAYGE_PLATFORM_ANDROID) && !defined(KLAYGE_PLATFORM_IOS)
+		// Files in the same packet are opened together
+		std::unordered_map<ResPacketPtr, std::pair<std::vector<size_t>, std::vector<std::string>>> pkt_requests;
+		{
+			std::lock_guard<std::mutex> lock(paths_mutex_);
+			for (size_t i = 0; i < names.size(); ++ i)
+			{
+				std::string const res_name = this->ResolveResName(names[i]);
+				if (!res_name.empty())
+				{
+					std::string internal_name;
+					ResPacketPtr packet = this->PktPacket(names[i], res_name, internal_name);
+					if (packet)
+					{
+						auto& request = pkt_requests[packet];
+						request.first.push_back(i);
+						request.second.push_back(internal_name);
+					}
+				}
+			}
+		}
+
+		for (auto& request : pkt_requests)
+		{
+			std::vector<std::string> pkt_names(request.second.first.size());
+			for (size_t i = 0; i < pkt_names.size(); ++ i)
+			{
+				pkt_names[i] = names[request.second.first[i]];
+			}
+
+			std::vector<ResIdentifierPtr> pkt_res;
+			request.first->Open(pkt_names, request.second.second, pkt_res);
+			for (size_t i = 0; i < pkt_res.size(); ++ i)
+			{
+				res[request.second.first[i]] = pkt_res[i];
+			}
+		}
+#endif
+
+		for (size_t i = 0; i < names.size(); ++ i)
+		{
+			if (!res[i])
+			{
+				res[i] = this->Open(names[i]);
+			}
+		}
+	}
+
 	std::shared_ptr<void> ResLoader::SyncQuery(ResLoadingDescPtr const & res_desc)
 	{
+		this->RecordManifestItem(res_desc);
 		this->RemoveUnrefResources();
 
 		std::shared_ptr<void> loaded_res = this->FindMatchLoadedResource(res_desc);
@@ -481,34 +715,59 @@ namespace KlayGE
 		}
 		else
 		{
-			std::shared_ptr<volatile LoadingStatus> async_is_done;
+			LoadingStatePtr async_state;
 			bool found = false;
 			{
 				std::lock_guard<std::mutex> lock(loading_mutex_);
 
-				for (auto const & lrq : loading_res_)
+				auto const range = loading_res_.equal_range(res_desc->Hash());
+				for (auto iter = range.first; iter != range.second; ++ iter)
 				{
+					auto const & lrq = iter->second;
 					if (lrq.first->Match(*res_desc))
 					{
 						res_desc->CopyDataFrom(*lrq.first);
 						res = lrq.first->Resource();
-						async_is_done = lrq.second;
+						async_state = lrq.second;
 						found = true;
 						break;
 					}
 				}
 			}
 
+			bool sub_thread_done = false;
 			if (found)
 			{
-				*async_is_done = LS_Complete;
+				// Takes over the request. A loading thread that hasn't picked it up yet will skip it.
+				LoadingStatus status = LS_Loading;
+				if (!async_state->status.compare_exchange_strong(status, LS_Complete))
+				{
+					// A loading thread is running the sub thread stage. Waits for it instead of running the stage twice.
+					if (LS_SubThreadStage == status)
+					{
+						status = async_state->WaitForSubThreadStage();
+					}
+
+					if (LS_Complete == status)
+					{
+						// The loading thread has queued the request already, only the main thread stage is left
+						sub_thread_done = true;
+						found = false;
+					}
+					else
+					{
+						// Dropped by the loading thread
+						found = false;
+						res = res_desc->CreateResource();
+					}
+				}
 			}
 			else
 			{
 				res = res_desc->CreateResource();
 			}
 
-			if (res_desc->HasSubThreadStage())
+			if (!sub_thread_done && res_desc->HasSubThreadStage())
 			{
 				res_desc->SubThreadStage();
 			}
@@ -516,13 +775,21 @@ namespace KlayGE
 			res_desc->MainThreadStage();
 			res = res_desc->Resource();
 			this->AddLoadedResource(res_desc, res);
+			this->RetainResource(res_desc, res);
+
+			if (found)
+			{
+				// Lets Update retire the request, and clone the resource for the other requests waiting on it
+				this->CompleteLoading({ res_desc, async_state, RLP_Immediate, 0 });
+			}
 		}
 
 		return res;
 	}
 
-	std::shared_ptr<void> ResLoader::ASyncQuery(ResLoadingDescPtr const & res_desc)
+	std::shared_ptr<void> ResLoader::ASyncQuery(ResLoadingDescPtr const & res_desc, ResLoadingPriority priority)
 	{
+		this->RecordManifestItem(res_desc);
 		this->RemoveUnrefResources();
 
 		std::shared_ptr<void> res;
@@ -544,30 +811,39 @@ namespace KlayGE
 		}
 		else
 		{
-			std::shared_ptr<volatile LoadingStatus> async_is_done;
+			LoadingStatePtr async_state;
+			ResLoadingDescPtr async_desc;
 			bool found = false;
 			{
 				std::lock_guard<std::mutex> lock(loading_mutex_);
 
-				for (auto const & lrq : loading_res_)
+				auto const range = loading_res_.equal_range(res_desc->Hash());
+				for (auto iter = range.first; iter != range.second; ++ iter)
 				{
+					auto const & lrq = iter->second;
 					if (lrq.first->Match(*res_desc))
 					{
 						res_desc->CopyDataFrom(*lrq.first);
 						res = lrq.first->Resource();
-						async_is_done = lrq.second;
+						async_state = lrq.second;
+						async_desc = lrq.first;
 						found = true;
 						break;
 					}
 				}
+
+				if (found && !res_desc->StateLess())
+				{
+					loading_res_.emplace(res_desc->Hash(), std::make_pair(res_desc, async_state));
+				}
 			}
 
 			if (found)
 			{
-				if (!res_desc->StateLess())
+				if (priority > RLP_Prefetch)
 				{
-					std::lock_guard<std::mutex> lock(loading_mutex_);
-					loading_res_.emplace_back(res_desc, async_is_done);
+					// Promotes the request. The old queue item is skipped once this one is picked up.
+					this->EnqueueLoading(async_desc, async_state, priority);
 				}
 			}
 			else
@@ -576,19 +852,21 @@ namespace KlayGE
 				{
 					res = res_desc->CreateResource();
 
-					async_is_done = MakeSharedPtr<LoadingStatus>(LS_Loading);
+					// Everything except the local res is owned by the loader at this point
+					async_state = MakeSharedPtr<LoadingState>(res ? static_cast<int32_t>(res.use_count() - 1) : -1);
 
 					{
 						std::lock_guard<std::mutex> lock(loading_mutex_);
-						loading_res_.emplace_back(res_desc, async_is_done);
+						loading_res_.emplace(res_desc->Hash(), std::make_pair(res_desc, async_state));
 					}
-					loading_res_queue_.push(std::make_pair(res_desc, async_is_done));
+					this->EnqueueLoading(res_desc, async_state, priority);
 				}
 				else
 				{
 					res_desc->MainThreadStage();
 					res = res_desc->Resource();
 					this->AddLoadedResource(res_desc, res);
+					this->RetainResource(res_desc, res);
 				}
 			}
 		}
@@ -599,11 +877,28 @@ namespace KlayGE
 	{
 		std::lock_guard<std::mutex> lock(loaded_mutex_);
 
+		this->ReleaseRetainedResource(res.get());
+
+		auto index_iter = loaded_res_index_.find(res.get());
+		if (index_iter != loaded_res_index_.end())
+		{
+			auto const range = loaded_res_.equal_range(index_iter->second);
+			for (auto iter = range.first; iter != range.second; ++ iter)
+			{
+				if (res == iter->second.res.lock())
+				{
+					this->EraseLoadedResource(iter);
+					return;
+				}
+			}
+		}
+
+		// The index can miss an entry if the address was reused by another resource
 		for (auto iter = loaded_res_.begin(); iter != loaded_res_.end(); ++ iter)
 		{
-			if (res == iter->second.lock())
+			if (res == iter->second.res.lock())
 			{
-				loaded_res_.erase(iter);
+				this->EraseLoadedResource(iter);
 				break;
 			}
 		}
@@ -613,19 +908,27 @@ namespace KlayGE
 	{
 		std::lock_guard<std::mutex> lock(loaded_mutex_);
 
+		size_t const hash = res_desc->Hash();
 		bool found = false;
-		for (auto& c_desc : loaded_res_)
+		auto const range = loaded_res_.equal_range(hash);
+		for (auto iter = range.first; iter != range.second; ++ iter)
 		{
-			if (c_desc.first == res_desc)
+			auto& c_desc = iter->second;
+			if (c_desc.res_desc == res_desc)
 			{
-				c_desc.second = std::weak_ptr<void>(res);
+				c_desc.res = std::weak_ptr<void>(res);
+				c_desc.res_ptr = res.get();
 				found = true;
 				break;
 			}
 		}
 		if (!found)
 		{
-			loaded_res_.emplace_back(res_desc, std::weak_ptr<void>(res));
+			loaded_res_.emplace(hash, LoadedResource{ res_desc, std::weak_ptr<void>(res), res.get() });
+		}
+		if (res)
+		{
+			loaded_res_index_[res.get()] = hash;
 		}
 	}
 
@@ -634,14 +937,40 @@ namespace KlayGE
 		std::lock_guard<std::mutex> lock(loaded_mutex_);
 
 		std::shared_ptr<void> loaded_res;
-		for (auto const & lr : loaded_res_)
+		auto const range = loaded_res_.equal_range(res_desc->Hash());
+		for (auto iter = range.first; iter != range.second;)
 		{
-			if (lr.first->Match(*res_desc))
+			if (iter->second.res_desc->Match(*res_desc))
 			{
-				loaded_res = lr.second.lock();
-				break;
+				loaded_res = iter->second.res.lock();
+				if (loaded_res)
+				{
+					auto retained_iter = retained_res_index_.find(loaded_res.get());
+					if (retained_iter != retained_res_index_.end())
+					{
+						// Held by the cache and the local loaded_res only
+						if (2 == loaded_res.use_count())
+						{
+							++ retention_stats_.hits;
+						}
+						retained_res_.splice(retained_res_.begin(), retained_res_, retained_iter->second);
+					}
+					break;
+				}
+				else
+				{
+					iter = this->EraseLoadedResource(iter);
+				}
+			}
+			else
+			{
+				++ iter;
 			}
 		}
+		if (!loaded_res)
+		{
+			++ retention_stats_.misses;
+		}
 		return loaded_res;
 	}
 
@@ -649,33 +978,409 @@ namespace KlayGE
 	{
 		std::lock_guard<std::mutex> lock(loaded_mutex_);
 
-		for (auto iter = loaded_res_.begin(); iter != loaded_res_.end();)
+		// Only a few entries are checked on each call, so the cost doesn't grow with the number of loaded resources.
+		//  Inserting can rehash and invalidate the cursor, restart from the beginning in that case.
+		if (loaded_cleanup_bucket_count_ != loaded_res_.bucket_count())
+		{
+			loaded_cleanup_bucket_count_ = loaded_res_.bucket_count();
+			loaded_cleanup_iter_ = loaded_res_.begin();
+		}
+
+		uint32_t const MAX_CHECKS_PER_CALL = 16;
+		for (uint32_t i = 0; (i < MAX_CHECKS_PER_CALL) && !loaded_res_.empty(); ++ i)
 		{
-			if (iter->second.lock())
+			if (loaded_cleanup_iter_ == loaded_res_.end())
 			{
-				++ iter;
+				loaded_cleanup_iter_ = loaded_res_.begin();
+			}
+
+			if (loaded_cleanup_iter_->second.res.expired())
+			{
+				this->EraseLoadedResource(loaded_cleanup_iter_);
 			}
 			else
 			{
-				iter = loaded_res_.erase(iter);
+				++ loaded_cleanup_iter_;
+			}
+		}
+	}
+
+	ResLoader::LoadedResourcesType::iterator ResLoader::EraseLoadedResource(LoadedResourcesType::iterator iter)
+	{
+		auto index_iter = loaded_res_index_.find(iter->second.res_ptr);
+		if ((index_iter != loaded_res_index_.end()) && (index_iter->second == iter->first))
+		{
+			loaded_res_index_.erase(index_iter);
+		}
+
+		bool const is_cleanup_iter = (iter == loaded_cleanup_iter_);
+		iter = loaded_res_.erase(iter);
+		if (is_cleanup_iter)
+		{
+			loaded_cleanup_iter_ = iter;
+		}
+		return iter;
+	}
+
+	void ResLoader::RetainResource(ResLoadingDescPtr const & res_desc, std::shared_ptr<void> const & res)
+	{
+		std::lock_guard<std::mutex> lock(loaded_mutex_);
+
+		if ((0 == retention_budget_) || !res)
+		{
+			return;
+		}
+
+		auto iter = retained_res_index_.find(res.get());
+		if (iter != retained_res_index_.end())
+		{
+			retained_res_.splice(retained_res_.begin(), retained_res_, iter->second);
+		}
+		else
+		{
+			retained_res_.push_front({ res_desc, res, res_desc->ResourceBytes() });
+			retained_res_index_.emplace(res.get(), retained_res_.begin());
+		}
+	}
+
+	void ResLoader::ReleaseRetainedResource(void const * res_ptr)
+	{
+		auto iter = retained_res_index_.find(res_ptr);
+		if (iter != retained_res_index_.end())
+		{
+			retained_res_.erase(iter->second);
+			retained_res_index_.erase(iter);
+		}
+	}
+
+	void ResLoader::TrimRetainedResources()
+	{
+		// Destroyed after the lock is released
+		std::vector<std::shared_ptr<void>> evicted;
+
+		{
+			std::lock_guard<std::mutex> lock(loaded_mutex_);
+
+			// Only the resources nobody else holds count in the budgets
+			uint32_t num_retained = 0;
+			uint64_t retained_bytes = 0;
+			std::unordered_map<uint64_t, uint64_t> type_retained_bytes;
+			for (auto const & retained : retained_res_)
+			{
+				if (1 == retained.res.use_count())
+				{
+					++ num_retained;
+					retained_bytes += retained.bytes;
+					if (!type_retention_budgets_.empty())
+					{
+						type_retained_bytes[retained.res_desc->Type()] += retained.bytes;
+					}
+				}
+			}
+
+			for (auto iter = retained_res_.end(); iter != retained_res_.begin();)
+			{
+				-- iter;
+
+				bool const over_budget = (retained_bytes > retention_budget_)
+					|| ((retention_max_entries_ > 0) && (num_retained > retention_max_entries_));
+				if (!over_budget && type_retained_bytes.empty())
+				{
+					break;
+				}
+
+				if (1 == iter->res.use_count())
+				{
+					uint64_t const type = iter->res_desc->Type();
+					auto type_budget_iter = type_retention_budgets_.find(type);
+					bool const over_type_budget = (type_budget_iter != type_retention_budgets_.end())
+						&& (type_retained_bytes[type] > type_budget_iter->second);
+					if (over_budget || over_type_budget)
+					{
+						-- num_retained;
+						retained_bytes -= iter->bytes;
+						if (!type_retained_bytes.empty())
+						{
+							type_retained_bytes[type] -= iter->bytes;
+						}
+						++ retention_stats_.evictions;
+
+						evicted.push_back(std::move(iter->res));
+						retained_res_index_.erase(evicted.back().get());
+						iter = retained_res_.erase(iter);
+					}
+				}
+			}
+
+			retention_stats_.num_retained = num_retained;
+			retention_stats_.retained_bytes = retained_bytes;
+		}
+	}
+
+	void ResLoader::RetentionBudget(uint64_t bytes, uint32_t max_entries)
+	{
+		std::list<RetainedResource> released;
+		{
+			std::lock_guard<std::mutex> lock(loaded_mutex_);
+
+			retention_budget_ = bytes;
+			retention_max_entries_ = max_entries;
+			if (0 == bytes)
+			{
+				released.swap(retained_res_);
+				retained_res_index_.clear();
+				retention_stats_.num_retained = 0;
+				retention_stats_.retained_bytes = 0;
 			}
 		}
 	}
 
+	void ResLoader::TypeRetentionBudget(uint64_t desc_type, uint64_t bytes)
+	{
+		std::lock_guard<std::mutex> lock(loaded_mutex_);
+		type_retention_budgets_[desc_type] = bytes;
+	}
+
+	ResLoader::RetentionStats ResLoader::RetentionStatistics()
+	{
+		std::lock_guard<std::mutex> lock(loaded_mutex_);
+		return retention_stats_;
+	}
+
+	void ResLoader::ResetRetentionStatistics()
+	{
+		std::lock_guard<std::mutex> lock(loaded_mutex_);
+		retention_stats_.hits = 0;
+		retention_stats_.misses = 0;
+		retention_stats_.evictions = 0;
+	}
+
 	void ResLoader::Update()
 	{
-		std::vector<std::pair<ResLoadingDescPtr, std::shared_ptr<volatile LoadingStatus>>> tmp_loading_res;
 		{
-			std::lock_guard<std::mutex> lock(loading_mutex_);
-			tmp_loading_res = loading_res_;
+			std::lock_guard<std::mutex> lock(completed_mutex_);
+			for (auto const & item : completed_queue_)
+			{
+				main_thread_queue_.push(item);
+			}
+			completed_queue_.clear();
+		}
+
+		Timer timer;
+		uint64_t upload_bytes = 0;
+		bool has_run = false;
+		while (!main_thread_queue_.empty())
+		{
+			LoadingQueueItem const item = main_thread_queue_.top();
+			uint64_t const item_bytes = (LS_Complete == item.state->status) ? item.res_desc->MainThreadStageBytes() : 0;
+			if (has_run)
+			{
+				if (((main_thread_time_budget_ > 0) && (timer.elapsed() >= main_thread_time_budget_))
+					|| ((main_thread_upload_budget_ > 0) && (upload_bytes + item_bytes > main_thread_upload_budget_)))
+				{
+					break;
+				}
+			}
+
+			main_thread_queue_.pop();
+			this->FinishLoading(item);
+
+			upload_bytes += item_bytes;
+			has_run = true;
+		}
+
+		bool recording_done;
+		{
+			std::lock_guard<std::mutex> lock(manifest_mutex_);
+			recording_done = !manifest_file_.empty() && (manifest_timer_.elapsed() >= manifest_duration_);
+		}
+		if (recording_done)
+		{
+			this->SaveManifest();
+		}
+
+		// Released before trimming, so the retention cache decides which of them stay
+		if (!prefetched_res_.empty() && (prefetch_timer_.elapsed() >= prefetch_hold_time_))
+		{
+			prefetched_res_.clear();
+		}
+
+		this->TrimRetainedResources();
+	}
+
+	void ResLoader::RecordManifest(std::string const & file_name, float duration)
+	{
+		this->StopRecordingManifest();
+
+		std::lock_guard<std::mutex> lock(manifest_mutex_);
+		manifest_file_ = file_name;
+		manifest_duration_ = duration;
+		manifest_timer_.restart();
+	}
+
+	void ResLoader::StopRecordingManifest()
+	{
+		this->SaveManifest();
+	}
+
+	void ResLoader::RecordManifestItem(ResLoadingDescPtr const & res_desc)
+	{
+		std::lock_guard<std::mutex> lock(manifest_mutex_);
+		if (manifest_file_.empty() || replaying_manifest_ || (manifest_timer_.elapsed() >= manifest_duration_))
+		{
+			return;
 		}
 
-		for (auto& lrq : tmp_loading_res)
+		std::string name;
+		uint32_t access_hint;
+		if (res_desc->ManifestEntry(name, access_hint) && !name.empty())
 		{
-			if (LS_Complete == *lrq.second)
+			std::string line = std::to_string(res_desc->Type()) + ' ' + std::to_string(access_hint) + ' ' + name;
+			if (manifest_line_set_.insert(line).second)
 			{
-				ResLoadingDescPtr const & res_desc = lrq.first;
+				manifest_lines_.push_back(std::move(line));
+			}
+		}
+	}
+
+	void ResLoader::SaveManifest()
+	{
+		std::string file_name;
+		std::vector<std::string> lines;
+		double duration;
+		{
+			std::lock_guard<std::mutex> lock(manifest_mutex_);
+			file_name.swap(manifest_file_);
+			lines.swap(manifest_lines_);
+			manifest_line_set_.clear();
+			duration = std::min(manifest_timer_.elapsed(), static_cast<double>(manifest_duration_));
+		}
+
+		if (file_name.empty())
+		{
+			return;
+		}
+
+		std::ofstream ofs(file_name.c_str());
+		if (!ofs)
+		{
+			ofs.open((local_path_ + file_name).c_str());
+		}
+		if (!ofs)
+		{
+			LogError("Couldn't save the prefetch manifest %s.", file_name.c_str());
+			return;
+		}
+
+		// The first line has the recording time. Each of the others is a type, an access hint and a name.
+		ofs << "KlayGEPrefetchManifest " << duration << std::endl;
+		for (auto const & line : lines)
+		{
+			ofs << line << std::endl;
+		}
+	}
+
+	bool ResLoader::ReplayManifest(std::string const & file_name)
+	{
+		ResIdentifierPtr res = this->Open(file_name);
+		if (!res)
+		{
+			return false;
+		}
 
+		std::istream& is = res->input_stream();
+		std::string line;
+		std::getline(is, line);
+		std::istringstream header(line);
+		std::string magic;
+		float duration = 0;
+		header >> magic >> duration;
+		if (magic != "KlayGEPrefetchManifest")
+		{
+			return false;
+		}
+
+		{
+			std::lock_guard<std::mutex> lock(manifest_mutex_);
+			replaying_manifest_ = true;
+		}
+
+		while (std::getline(is, line))
+		{
+			if (!line.empty() && ('\r' == line.back()))
+			{
+				line.pop_back();
+			}
+
+			std::istringstream iss(line);
+			uint64_t type;
+			uint32_t access_hint;
+			std::string name;
+			if ((iss >> type >> access_hint) && std::getline(iss >> std::ws, name) && !name.empty())
+			{
+				auto iter = manifest_factories_.find(type);
+				if (iter != manifest_factories_.end())
+				{
+					prefetched_res_.push_back(this->ASyncQuery(iter->second(name, access_hint), RLP_Prefetch));
+				}
+			}
+		}
+
+		{
+			std::lock_guard<std::mutex> lock(manifest_mutex_);
+			replaying_manifest_ = false;
+		}
+
+		prefetch_hold_time_ = std::max(prefetch_hold_time_ - static_cast<float>(prefetch_timer_.elapsed()), duration);
+		prefetch_timer_.restart();
+
+		return true;
+	}
+
+	void ResLoader::RegisterManifestType(uint64_t desc_type, ManifestDescFactory const & factory)
+	{
+		manifest_factories_[desc_type] = factory;
+	}
+
+	void ResLoader::MainThreadStageBudget(float time, uint64_t upload_bytes)
+	{
+		main_thread_time_budget_ = time;
+		main_thread_upload_budget_ = upload_bytes;
+	}
+
+	uint32_t ResLoader::RemainingBacklog()
+	{
+		std::lock_guard<std::mutex> lock(loading_mutex_);
+		return static_cast<uint32_t>(loading_res_.size());
+	}
+
+	void ResLoader::CompleteLoading(LoadingQueueItem const & item)
+	{
+		std::lock_guard<std::mutex> lock(completed_mutex_);
+		completed_queue_.push_back(item);
+	}
+
+	void ResLoader::FinishLoading(LoadingQueueItem const & item)
+	{
+		// All the requests sharing the loading state, the one loaded and the ones that want a clone of it
+		size_t const hash = item.res_desc->Hash();
+		std::vector<ResLoadingDescPtr> res_descs;
+		{
+			std::lock_guard<std::mutex> lock(loading_mutex_);
+			auto const range = loading_res_.equal_range(hash);
+			for (auto iter = range.first; iter != range.second; ++ iter)
+			{
+				if (iter->second.second == item.state)
+				{
+					res_descs.push_back(iter->second.first);
+				}
+			}
+		}
+
+		if (LS_Complete == item.state->status)
+		{
+			for (auto const & res_desc : res_descs)
+			{
 				std::shared_ptr<void> res;
 				std::shared_ptr<void> loaded_res = this->FindMatchLoadedResource(res_desc);
 				if (loaded_res)
@@ -694,46 +1399,179 @@ namespace KlayGE
 					res_desc->MainThreadStage();
 					res = res_desc->Resource();
 					this->AddLoadedResource(res_desc, res);
+					this->RetainResource(res_desc, res);
 				}
-
-				*lrq.second = LS_CanBeRemoved;
 			}
 		}
 
+		// Requests attached meanwhile are handled in the next round
+		bool remaining = false;
 		{
 			std::lock_guard<std::mutex> lock(loading_mutex_);
-			for (auto iter = loading_res_.begin(); iter != loading_res_.end();)
+			auto const range = loading_res_.equal_range(hash);
+			for (auto iter = range.first; iter != range.second;)
 			{
-				if (LS_CanBeRemoved == *(iter->second))
-				{
-					iter = loading_res_.erase(iter);
-				}
-				else
+				if (iter->second.second == item.state)
 				{
-					++ iter;
+					if (std::find(res_descs.begin(), res_descs.end(), iter->second.first) != res_descs.end())
+					{
+						iter = loading_res_.erase(iter);
+						continue;
+					}
+					remaining = true;
 				}
+				++ iter;
+			}
+
+			if (!remaining)
+			{
+				item.state->status = LS_CanBeRemoved;
 			}
 		}
+		if (remaining)
+		{
+			main_thread_queue_.push(item);
+		}
+	}
+
+	void ResLoader::NumLoadingThreads(uint32_t num)
+	{
+		num = std::max(num, 1U);
+		if (num != this->NumLoadingThreads())
+		{
+			this->StopLoadingThreads();
+			this->StartLoadingThreads(num);
+		}
+	}
+
+	void ResLoader::StartLoadingThreads(uint32_t num)
+	{
+		BOOST_ASSERT(loading_threads_.empty());
+
+		quit_ = false;
+		for (uint32_t i = 0; i < num; ++ i)
+		{
+			loading_threads_.push_back(Context::Instance().ThreadPool()(std::bind(&ResLoader::LoadingThreadFunc, this)));
+		}
+	}
+
+	void ResLoader::StopLoadingThreads()
+	{
+		{
+			std::lock_guard<std::mutex> lock(loading_queue_mutex_);
+			quit_ = true;
+			loading_queue_cond_.notify_all();
+		}
+
+		for (auto& thread : loading_threads_)
+		{
+			thread();
+		}
+		loading_threads_.clear();
+	}
+
+	void ResLoader::EnqueueLoading(ResLoadingDescPtr const & res_desc, LoadingStatePtr const & state,
+		ResLoadingPriority priority)
+	{
+		std::lock_guard<std::mutex> lock(loading_queue_mutex_);
+		loading_queue_.push({ res_desc, state, priority, loading_queue_seq_ });
+		++ loading_queue_seq_;
+		loading_queue_cond_.notify_one();
+	}
+
+	bool ResLoader::IsLoadingDropped(LoadingQueueItem const & item)
+	{
+		if (item.state->loader_refs < 0)
+		{
+			return false;
+		}
+
+		std::shared_ptr<void> res = item.res_desc->Resource();
+		return res && (res.use_count() - 1 <= item.state->loader_refs);
 	}
 
 	void ResLoader::LoadingThreadFunc()
 	{
-		while (!quit_)
+		for (;;)
 		{
-			std::pair<ResLoadingDescPtr, std::shared_ptr<volatile LoadingStatus>> res_pair;
-			while (loading_res_queue_.pop(res_pair))
+			LoadingQueueItem item;
 			{
-				if (LS_Loading == *res_pair.second)
+				std::unique_lock<std::mutex> lock(loading_queue_mutex_);
+				loading_queue_cond_.wait(lock, [this]
+					{
+						return quit_ || !loading_queue_.empty();
+					});
+				if (quit_)
 				{
-					res_pair.first->SubThreadStage();
-					*res_pair.second = LS_Complete;
+					break;
 				}
+
+				item = loading_queue_.top();
+				loading_queue_.pop();
 			}
 
-			Sleep(10);
+			// A request can be queued more than once after being promoted, or taken over by SyncQuery
+			LoadingStatus expected = LS_Loading;
+			if (!item.state->status.compare_exchange_strong(expected, LS_SubThreadStage))
+			{
+				continue;
+			}
+
+			{
+				// Nobody can find the request while the lock is held, so it's safe to drop it here
+				std::lock_guard<std::mutex> lock(loading_mutex_);
+				if (this->IsLoadingDropped(item))
+				{
+					item.state->LeaveSubThreadStage(LS_CanBeRemoved);
+
+					auto const range = loading_res_.equal_range(item.res_desc->Hash());
+					for (auto iter = range.first; iter != range.second;)
+					{
+						if (iter->second.second == item.state)
+						{
+							iter = loading_res_.erase(iter);
+						}
+						else
+						{
+							++ iter;
+						}
+					}
+					continue;
+				}
+			}
+
+			item.res_desc->SubThreadStage();
+
+			if (item.state->LeaveSubThreadStage(LS_Complete))
+			{
+				this->CompleteLoading(item);
+			}
 		}
 	}
 
+	bool ResLoader::LoadingState::LeaveSubThreadStage(LoadingStatus new_status)
+	{
+		bool left;
+		{
+			// Changed under the lock, or a waiter could miss the notification between its check and its wait
+			std::lock_guard<std::mutex> lock(sub_thread_mutex);
+			LoadingStatus expected = LS_SubThreadStage;
+			left = status.compare_exchange_strong(expected, new_status);
+		}
+		sub_thread_cond.notify_all();
+		return left;
+	}
+
+	ResLoader::LoadingStatus ResLoader::LoadingState::WaitForSubThreadStage()
+	{
+		std::unique_lock<std::mutex> lock(sub_thread_mutex);
+		sub_thread_cond.wait(lock, [this]
+			{
+				return status != LS_SubThreadStage;
+			});
+		return status;
+	}
+
 
 	ResIdentifierPtr ResLoader::LocatePkt(std::string const & name, std::string const & res_name,
 			std::string& password, std::string& internal_name)
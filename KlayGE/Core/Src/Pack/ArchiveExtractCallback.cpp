@@ -47,7 +47,7 @@ namespace KlayGE
 		return S_OK;
 	}
 
-	STDMETHODIMP CArchiveExtractCallback::GetStream(UInt32 /*index*/, ISequentialOutStream** outStream, Int32 askExtractMode)
+	STDMETHODIMP CArchiveExtractCallback::GetStream(UInt32 index, ISequentialOutStream** outStream, Int32 askExtractMode)
 	{
 		enum 
 		{
@@ -56,14 +56,20 @@ namespace KlayGE
 			kSkip,
 		};
 
+		*outStream = nullptr;
 		if (kExtract == askExtractMode)
 		{
-			_outFileStream->AddRef();
-			*outStream = _outFileStream.get();
-		}
-		else
-		{
-			*outStream = nullptr;
+			ISequentialOutStream* stream = _outFileStream.get();
+			if (!out_file_streams_.empty())
+			{
+				auto iter = out_file_streams_.find(index);
+				stream = (iter != out_file_streams_.end()) ? iter->second.get() : nullptr;
+			}
+			if (stream != nullptr)
+			{
+				stream->AddRef();
+				*outStream = stream;
+			}
 		}
 		return S_OK;
 	}
@@ -98,6 +104,17 @@ namespace KlayGE
 	void CArchiveExtractCallback::Init(std::string_view pw, std::shared_ptr<ISequentialOutStream> const & outFileStream)
 	{
 		_outFileStream = outFileStream;
+		out_file_streams_.clear();
+
+		password_is_defined_ = !pw.empty();
+		Convert(password_, pw);
+	}
+
+	void CArchiveExtractCallback::Init(std::string_view pw,
+		std::unordered_map<uint32_t, std::shared_ptr<ISequentialOutStream>> const & outFileStreams)
+	{
+		_outFileStream.reset();
+		out_file_streams_ = outFileStreams;
 
 		password_is_defined_ = !pw.empty();
 		Convert(password_, pw);
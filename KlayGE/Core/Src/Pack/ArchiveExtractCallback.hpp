@@ -35,6 +35,7 @@
 
 #include <string>
 #include <atomic>
+#include <unordered_map>
 
 #include <CPP/7zip/Archive/IArchive.h>
 #include <CPP/7zip/IPassword.h>
@@ -107,6 +108,8 @@ namespace KlayGE
 		}
 
 		void Init(std::string_view pw, std::shared_ptr<ISequentialOutStream> const & outFileStream);
+		// For extracting several items at once. Each item index goes to its own stream.
+		void Init(std::string_view pw, std::unordered_map<uint32_t, std::shared_ptr<ISequentialOutStream>> const & outFileStreams);
 
 	private:
 		std::atomic<int32_t> ref_count_;
@@ -115,6 +118,7 @@ namespace KlayGE
 		std::wstring password_;
 
 		std::shared_ptr<ISequentialOutStream> _outFileStream;
+		std::unordered_map<uint32_t, std::shared_ptr<ISequentialOutStream>> out_file_streams_;
 	};
 }
 
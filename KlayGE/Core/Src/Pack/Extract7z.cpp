@@ -40,16 +40,9 @@
 
 #include <string>
 #include <algorithm>
+#include <cctype>
 
 #include <boost/assert.hpp>
-#if defined(KLAYGE_COMPILER_GCC)
-#pragma GCC diagnostic push
-#pragma GCC diagnostic ignored "-Wdeprecated-declarations" // Ignore auto_ptr declaration
-#endif
-#include <boost/algorithm/string.hpp>
-#if defined(KLAYGE_COMPILER_GCC)
-#pragma GCC diagnostic pop
-#endif
 
 #include <CPP/7zip/Archive/IArchive.h>
 
@@ -147,10 +140,7 @@ namespace
 	};
 
 
-	void GetArchiveIndex(std::shared_ptr<IInArchive>& archive, uint32_t& real_index,
-								ResIdentifierPtr const & archive_is,
-								std::string_view password,
-								std::string_view extract_file_path)
+	void OpenArchive(std::shared_ptr<IInArchive>& archive, ResIdentifierPtr const & archive_is, std::string_view password)
 	{
 		BOOST_ASSERT(archive_is);
 
@@ -166,63 +156,228 @@ namespace
 		std::shared_ptr<IArchiveOpenCallback> ocb = MakeCOMPtr(new CArchiveOpenCallback);
 		checked_pointer_cast<CArchiveOpenCallback>(ocb)->Init(password);
 		TIFHR(archive->Open(file.get(), 0, ocb.get()));
+	}
+
+	uint64_t ArchiveItemPosition(std::shared_ptr<IInArchive> const & archive, uint32_t index)
+	{
+		PROPVARIANT prop;
+		prop.vt = VT_EMPTY;
+		TIFHR(archive->GetProperty(index, kpidPosition, &prop));
+		if (prop.vt != VT_EMPTY)
+		{
+			return (VT_UI8 == prop.vt) ? prop.uhVal.QuadPart : 0xFFFFFFFFFFFFFFFFULL;
+		}
+		return 0;
+	}
+
+	bool IsArchiveItemExtractable(std::shared_ptr<IInArchive> const & archive, uint32_t index)
+	{
+		PROPVARIANT prop;
+		prop.vt = VT_EMPTY;
+		TIFHR(archive->GetProperty(index, kpidIsAnti, &prop));
+		if ((VT_BOOL == prop.vt) && (VARIANT_FALSE == prop.boolVal))
+		{
+			return 0 == ArchiveItemPosition(archive, index);
+		}
+		return false;
+	}
+
+	std::string ArchiveItemKey(std::string_view file_path)
+	{
+		std::string key(file_path);
+		std::transform(key.begin(), key.end(), key.begin(), ::tolower);
+		return key;
+	}
+}
+
+namespace KlayGE
+{
+	Archive7z::Archive7z(ResIdentifierPtr const & archive_is, std::string_view password)
+		: password_(password), timestamp_(archive_is->Timestamp())
+	{
+		OpenArchive(archive_, archive_is, password);
 
-		real_index = 0xFFFFFFFF;
 		uint32_t num_items;
-		TIFHR(archive->GetNumberOfItems(&num_items));
+		TIFHR(archive_->GetNumberOfItems(&num_items));
 
 		for (uint32_t i = 0; i < num_items; ++ i)
 		{
 			bool is_folder = true;
-			TIFHR(IsArchiveItemFolder(archive, i, is_folder));
-			if (!is_folder)
+			TIFHR(IsArchiveItemFolder(archive_, i, is_folder));
+			if (!is_folder && IsArchiveItemExtractable(archive_, i))
 			{
 				std::string file_path;
-				TIFHR(GetArchiveItemPath(archive, i, file_path));
+				TIFHR(GetArchiveItemPath(archive_, i, file_path));
 				std::replace(file_path.begin(), file_path.end(), '\\', '/');
-				if (!boost::algorithm::ilexicographical_compare(extract_file_path, file_path)
-					&& !boost::algorithm::ilexicographical_compare(file_path, extract_file_path))
+				if (file_indices_.emplace(ArchiveItemKey(file_path), i).second)
 				{
-					real_index = i;
-					break;
+					file_paths_.push_back(file_path);
 				}
 			}
 		}
-		if (real_index != 0xFFFFFFFF)
+	}
+
+	Archive7z::~Archive7z()
+	{
+		archive_->Close();
+	}
+
+	uint32_t Archive7z::Find(std::string_view extract_file_path) const
+	{
+		auto iter = file_indices_.find(ArchiveItemKey(extract_file_path));
+		return (iter != file_indices_.end()) ? iter->second : 0xFFFFFFFF;
+	}
+
+	bool Archive7z::Contains(std::string_view file_path) const
+	{
+		return this->Find(file_path) != 0xFFFFFFFF;
+	}
+
+	ResIdentifierPtr Archive7z::Open(std::string const & name, std::string_view file_path)
+	{
+		std::vector<uint8_t> data;
+		if (this->Extract(file_path, data))
 		{
-			PROPVARIANT prop;
-			prop.vt = VT_EMPTY;
-			TIFHR(archive->GetProperty(real_index, kpidIsAnti, &prop));
-			if ((VT_BOOL == prop.vt) && (VARIANT_FALSE == prop.boolVal))
+			return MakeBufferResIdentifier(name, timestamp_, std::move(data));
+		}
+		else
+		{
+			return ResIdentifierPtr();
+		}
+	}
+
+	void Archive7z::Open(std::vector<std::string> const & names, std::vector<std::string> const & file_paths,
+		std::vector<ResIdentifierPtr>& res)
+	{
+		BOOST_ASSERT(names.size() == file_paths.size());
+
+		std::vector<std::vector<uint8_t>> data;
+		this->Extract(file_paths, data);
+
+		res.resize(names.size());
+		for (size_t i = 0; i < names.size(); ++ i)
+		{
+			if (this->Contains(file_paths[i]))
 			{
-				prop.vt = VT_EMPTY;
-				TIFHR(archive->GetProperty(real_index, kpidPosition, &prop));
-				if (prop.vt != VT_EMPTY)
-				{
-					if ((prop.vt != VT_UI8) || (prop.uhVal.QuadPart != 0))
-					{
-						real_index = 0xFFFFFFFF;
-					}
-				}
+				res[i] = MakeBufferResIdentifier(names[i], timestamp_, std::move(data[i]));
 			}
 			else
 			{
-				real_index = 0xFFFFFFFF;
+				res[i].reset();
 			}
 		}
 	}
-}
 
-namespace KlayGE
-{
+	uint64_t Archive7z::UnpackedSize(uint32_t index) const
+	{
+		PROPVARIANT prop;
+		prop.vt = VT_EMPTY;
+		TIFHR(archive_->GetProperty(index, kpidSize, &prop));
+		return (VT_UI8 == prop.vt) ? prop.uhVal.QuadPart : 0;
+	}
+
+	bool Archive7z::Extract(std::string_view extract_file_path, std::vector<uint8_t>& data)
+	{
+		uint32_t index = this->Find(extract_file_path);
+		if (0xFFFFFFFF == index)
+		{
+			data.clear();
+			return false;
+		}
+
+		std::lock_guard<std::mutex> lock(mutex_);
+
+		data.resize(static_cast<size_t>(this->UnpackedSize(index)));
+
+		std::shared_ptr<ISequentialOutStream> out_stream = MakeCOMPtr(new CMemOutStream);
+		checked_pointer_cast<CMemOutStream>(out_stream)->Attach(data);
+
+		std::shared_ptr<IArchiveExtractCallback> ecb = MakeCOMPtr(new CArchiveExtractCallback);
+		checked_pointer_cast<CArchiveExtractCallback>(ecb)->Init(password_, out_stream);
+
+		TIFHR(archive_->Extract(&index, 1, false, ecb.get()));
+		checked_pointer_cast<CMemOutStream>(out_stream)->Finish();
+
+		return true;
+	}
+
+	void Archive7z::Extract(std::vector<std::string> const & extract_file_paths, std::vector<std::vector<uint8_t>>& data)
+	{
+		data.assign(extract_file_paths.size(), std::vector<uint8_t>());
+
+		std::vector<uint32_t> indices(extract_file_paths.size());
+		for (size_t i = 0; i < extract_file_paths.size(); ++ i)
+		{
+			indices[i] = this->Find(extract_file_paths[i]);
+		}
+
+		// 7z wants the indices sorted. Each item is extracted once, into the first slot that asks for it.
+		std::vector<uint32_t> sorted_indices;
+		std::unordered_map<uint32_t, size_t> first_slots;
+		for (size_t i = 0; i < indices.size(); ++ i)
+		{
+			if ((indices[i] != 0xFFFFFFFF) && first_slots.emplace(indices[i], i).second)
+			{
+				sorted_indices.push_back(indices[i]);
+			}
+		}
+		if (sorted_indices.empty())
+		{
+			return;
+		}
+		std::sort(sorted_indices.begin(), sorted_indices.end());
+
+		{
+			std::lock_guard<std::mutex> lock(mutex_);
+
+			std::unordered_map<uint32_t, std::shared_ptr<ISequentialOutStream>> out_streams;
+			for (auto const & slot : first_slots)
+			{
+				data[slot.second].resize(static_cast<size_t>(this->UnpackedSize(slot.first)));
+
+				std::shared_ptr<ISequentialOutStream> out_stream = MakeCOMPtr(new CMemOutStream);
+				checked_pointer_cast<CMemOutStream>(out_stream)->Attach(data[slot.second]);
+				out_streams.emplace(slot.first, out_stream);
+			}
+
+			std::shared_ptr<IArchiveExtractCallback> ecb = MakeCOMPtr(new CArchiveExtractCallback);
+			checked_pointer_cast<CArchiveExtractCallback>(ecb)->Init(password_, out_streams);
+
+			TIFHR(archive_->Extract(&sorted_indices[0], static_cast<uint32_t>(sorted_indices.size()), false, ecb.get()));
+			for (auto const & out_stream : out_streams)
+			{
+				checked_pointer_cast<CMemOutStream>(out_stream.second)->Finish();
+			}
+		}
+
+		for (size_t i = 0; i < indices.size(); ++ i)
+		{
+			if (indices[i] != 0xFFFFFFFF)
+			{
+				size_t const first_slot = first_slots[indices[i]];
+				if (first_slot != i)
+				{
+					data[i] = data[first_slot];
+				}
+			}
+		}
+	}
+
+
 	uint32_t Find7z(ResIdentifierPtr const & archive_is,
 								std::string_view password,
 								std::string_view extract_file_path)
 	{
-		std::shared_ptr<IInArchive> archive;
-		uint32_t real_index;
-		GetArchiveIndex(archive, real_index, archive_is, password, extract_file_path);
-		return real_index;
+		Archive7z archive(archive_is, password);
+		return archive.Find(extract_file_path);
+	}
+
+	void List7z(ResIdentifierPtr const & archive_is,
+								std::string_view password,
+								std::vector<std::string>& file_paths)
+	{
+		Archive7z archive(archive_is, password);
+		file_paths = archive.FilePaths();
 	}
 
 	void Extract7z(ResIdentifierPtr const & archive_is,
@@ -230,18 +385,11 @@ namespace KlayGE
 							   std::string_view extract_file_path,
 		std::shared_ptr<std::ostream> const & os)
 	{
-		std::shared_ptr<IInArchive> archive;
-		uint32_t real_index;
-		GetArchiveIndex(archive, real_index, archive_is, password, extract_file_path);
-		if (real_index != 0xFFFFFFFF)
+		Archive7z archive(archive_is, password);
+		std::vector<uint8_t> data;
+		if (archive.Extract(extract_file_path, data))
 		{
-			std::shared_ptr<ISequentialOutStream> out_stream = MakeCOMPtr(new COutStream);
-			checked_pointer_cast<COutStream>(out_stream)->Attach(os);
-
-			std::shared_ptr<IArchiveExtractCallback> ecb = MakeCOMPtr(new CArchiveExtractCallback);
-			checked_pointer_cast<CArchiveExtractCallback>(ecb)->Init(password, out_stream);
-
-			TIFHR(archive->Extract(&real_index, 1, false, ecb.get()));
+			os->write(reinterpret_cast<char const *>(data.data()), static_cast<std::streamsize>(data.size()));
 		}
 	}
 }
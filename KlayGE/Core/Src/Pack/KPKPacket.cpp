@@ -0,0 +1,279 @@
+/**
+ * @file KPKPacket.cpp
+ * @author Minmin Gong
+ *
+ * @section DESCRIPTION
+ *
+ * This source file is part of KlayGE
+ * For the latest info, see http://www.klayge.org
+ *
+ * @section LICENSE
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published
+ * by the Free Software Foundation; either version 2 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program; if not, write to the Free Software
+ * Foundation, Inc., 59 Temple Place, Suite 330, Boston, MA 02111-1307 USA
+ *
+ * You may alternatively use this source under the terms of
+ * the KlayGE Proprietary License (KPL). You can obtained such a license
+ * from http://www.klayge.org/licensing/.
+ */
+
+#include <KlayGE/KlayGE.hpp>
+#include <KFL/ErrorHandling.hpp>
+#include <KFL/ResIdentifier.hpp>
+#include <KlayGE/LZ4Codec.hpp>
+
+#include <algorithm>
+#include <cctype>
+#include <fstream>
+#include <istream>
+#include <numeric>
+
+#include <KlayGE/KPKPacket.hpp>
+
+namespace
+{
+	using namespace KlayGE;
+
+	// A byte of LZ4 block can't decode to more than 255 bytes
+	uint64_t constexpr MAX_LZ4_RATIO = 255;
+
+	bool NameEquals(std::string_view lhs, std::string_view rhs)
+	{
+		return (lhs.size() == rhs.size())
+			&& std::equal(lhs.begin(), lhs.end(), rhs.begin(), [](char a, char b)
+				{
+					return ::tolower(static_cast<unsigned char>(a)) == ::tolower(static_cast<unsigned char>(b));
+				});
+	}
+
+	uint64_t AlignUp(uint64_t offset, uint32_t alignment)
+	{
+		return (offset + alignment - 1) / alignment * alignment;
+	}
+}
+
+namespace KlayGE
+{
+	KPKPacket::KPKPacket(std::string const & pkt_name, uint64_t timestamp)
+		: file_(MakeSharedPtr<MappedFile>()), timestamp_(timestamp)
+	{
+		if (!file_->Open(pkt_name))
+		{
+			TERRC(std::errc::no_such_file_or_directory);
+		}
+
+		uint8_t const * data = file_->Data();
+		uint64_t const size = file_->Size();
+		if (size < sizeof(Header))
+		{
+			TERRC(std::errc::illegal_byte_sequence);
+		}
+
+		Header const & header = *reinterpret_cast<Header const *>(data);
+		num_entries_ = LE2Native(header.num_entries);
+		uint32_t const names_size = LE2Native(header.names_size);
+		if ((LE2Native(header.fourcc) != FOURCC) || (LE2Native(header.version) != VERSION)
+			|| (sizeof(Header) + static_cast<uint64_t>(num_entries_) * sizeof(Entry) + names_size > size))
+		{
+			TERRC(std::errc::illegal_byte_sequence);
+		}
+
+		entries_ = reinterpret_cast<Entry const *>(data + sizeof(Header));
+		names_ = reinterpret_cast<char const *>(entries_ + num_entries_);
+
+		file_paths_.resize(num_entries_);
+		for (uint32_t i = 0; i < num_entries_; ++ i)
+		{
+			Entry const & entry = entries_[i];
+			uint32_t const name_offset = LE2Native(entry.name_offset);
+			uint32_t const name_length = LE2Native(entry.name_length);
+			uint64_t const offset = LE2Native(entry.offset);
+			uint64_t const packed_size = LE2Native(entry.packed_size);
+			uint64_t const original_size = LE2Native(entry.original_size);
+			if ((static_cast<uint64_t>(name_offset) + name_length > names_size)
+				|| (offset > size) || (packed_size > size - offset)
+				|| ((LE2Native(entry.codec) == C_LZ4) && (original_size / MAX_LZ4_RATIO > packed_size)))
+			{
+				TERRC(std::errc::illegal_byte_sequence);
+			}
+
+			file_paths_[i].assign(names_ + name_offset, name_length);
+		}
+	}
+
+	bool KPKPacket::Contains(std::string_view file_path) const
+	{
+		return this->FindEntry(file_path) != nullptr;
+	}
+
+	ResIdentifierPtr KPKPacket::Open(std::string const & name, std::string_view file_path)
+	{
+		Entry const * entry = this->FindEntry(file_path);
+		if (nullptr == entry)
+		{
+			return ResIdentifierPtr();
+		}
+
+		uint64_t const offset = LE2Native(entry->offset);
+		uint64_t const packed_size = LE2Native(entry->packed_size);
+		uint64_t const original_size = LE2Native(entry->original_size);
+		switch (LE2Native(entry->codec))
+		{
+		case C_Stored:
+			// Read in place
+			return MakeMappedResIdentifier(name, timestamp_, file_, offset, packed_size);
+
+		case C_LZ4:
+			{
+				// original_size is checked against packed_size in the constructor, so it can be allocated directly
+				std::vector<uint8_t> decoded;
+				LZ4Codec lz4;
+				lz4.Decode(decoded, file_->Data() + offset, packed_size, original_size);
+				return MakeBufferResIdentifier(name, timestamp_, std::move(decoded));
+			}
+
+		default:
+			TERRC(std::errc::function_not_supported);
+		}
+	}
+
+	KPKPacket::Entry const * KPKPacket::FindEntry(std::string_view file_path) const
+	{
+		uint64_t const hash = NameHash(file_path);
+
+		Entry const * const entries_end = entries_ + num_entries_;
+		Entry const * iter = std::lower_bound(entries_, entries_end, hash,
+			[](Entry const & entry, uint64_t value)
+			{
+				return LE2Native(entry.name_hash) < value;
+			});
+		for (; (iter != entries_end) && (LE2Native(iter->name_hash) == hash); ++ iter)
+		{
+			std::string_view const entry_name(names_ + LE2Native(iter->name_offset), LE2Native(iter->name_length));
+			if (NameEquals(entry_name, file_path))
+			{
+				return iter;
+			}
+		}
+		return nullptr;
+	}
+
+	uint64_t KPKPacket::NameHash(std::string_view file_path)
+	{
+		// 64-bit FNV-1a of the lower case name. It's stored in files, so it can't depend on std::hash.
+		uint64_t hash = 0xCBF29CE484222325ULL;
+		for (auto ch : file_path)
+		{
+			hash ^= static_cast<uint8_t>(::tolower(static_cast<unsigned char>(ch)));
+			hash *= 0x100000001B3ULL;
+		}
+		return hash;
+	}
+
+	void KPKPacket::Save(std::string const & pkt_name, std::vector<std::string> const & file_paths,
+		std::vector<std::vector<uint8_t>> const & data, uint32_t alignment)
+	{
+		BOOST_ASSERT(file_paths.size() == data.size());
+		BOOST_ASSERT((alignment > 0) && (0 == (alignment & (alignment - 1))));
+
+		uint32_t const num_entries = static_cast<uint32_t>(file_paths.size());
+
+		std::vector<uint32_t> order(num_entries);
+		std::iota(order.begin(), order.end(), 0);
+		std::vector<uint64_t> hashes(num_entries);
+		for (uint32_t i = 0; i < num_entries; ++ i)
+		{
+			hashes[i] = NameHash(file_paths[i]);
+		}
+		std::stable_sort(order.begin(), order.end(), [&hashes](uint32_t lhs, uint32_t rhs)
+			{
+				return hashes[lhs] < hashes[rhs];
+			});
+
+		std::string names;
+		for (uint32_t i = 0; i < num_entries; ++ i)
+		{
+			names += file_paths[order[i]];
+		}
+
+		std::vector<Entry> entries(num_entries);
+		std::vector<std::vector<uint8_t>> packed(num_entries);
+		uint64_t offset = sizeof(Header) + num_entries * sizeof(Entry) + names.size();
+		uint64_t const data_offset = offset;
+		uint32_t name_offset = 0;
+		LZ4Codec lz4;
+		for (uint32_t i = 0; i < num_entries; ++ i)
+		{
+			uint32_t const index = order[i];
+			auto const & original = data[index];
+
+			lz4.Encode(packed[i], original.data(), original.size());
+			bool const use_lz4 = packed[i].size() < original.size() - original.size() / 8;
+			if (!use_lz4)
+			{
+				packed[i].clear();
+			}
+
+			uint32_t const entry_alignment = use_lz4 ? 1 : alignment;
+			offset = AlignUp(offset, entry_alignment);
+
+			Entry& entry = entries[i];
+			entry.name_hash = Native2LE(hashes[index]);
+			entry.name_offset = Native2LE(name_offset);
+			entry.name_length = Native2LE(static_cast<uint32_t>(file_paths[index].size()));
+			entry.offset = Native2LE(offset);
+			entry.packed_size = Native2LE(static_cast<uint64_t>(use_lz4 ? packed[i].size() : original.size()));
+			entry.original_size = Native2LE(static_cast<uint64_t>(original.size()));
+			entry.codec = Native2LE(static_cast<uint32_t>(use_lz4 ? C_LZ4 : C_Stored));
+			entry.alignment = Native2LE(entry_alignment);
+
+			name_offset += static_cast<uint32_t>(file_paths[index].size());
+			offset += LE2Native(entry.packed_size);
+		}
+
+		Header header;
+		header.fourcc = Native2LE(FOURCC);
+		header.version = Native2LE(VERSION);
+		header.num_entries = Native2LE(num_entries);
+		header.names_size = Native2LE(static_cast<uint32_t>(names.size()));
+		header.data_offset = Native2LE(data_offset);
+		header.reserved = 0;
+
+		std::ofstream ofs(pkt_name.c_str(), std::ios_base::binary);
+		if (!ofs)
+		{
+			TERRC(std::errc::permission_denied);
+		}
+		ofs.write(reinterpret_cast<char const *>(&header), sizeof(header));
+		if (num_entries > 0)
+		{
+			ofs.write(reinterpret_cast<char const *>(entries.data()), entries.size() * sizeof(entries[0]));
+		}
+		ofs.write(names.data(), names.size());
+
+		uint64_t pos = data_offset;
+		for (uint32_t i = 0; i < num_entries; ++ i)
+		{
+			uint64_t const entry_offset = LE2Native(entries[i].offset);
+			for (; pos < entry_offset; ++ pos)
+			{
+				ofs.put(0);
+			}
+
+			auto const & entry_data = packed[i].empty() ? data[order[i]] : packed[i];
+			ofs.write(reinterpret_cast<char const *>(entry_data.data()), entry_data.size());
+			pos += entry_data.size();
+		}
+	}
+}
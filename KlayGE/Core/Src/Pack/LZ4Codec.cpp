@@ -0,0 +1,264 @@
+/**
+ * @file LZ4Codec.cpp
+ * @author Minmin Gong
+ *
+ * @section DESCRIPTION
+ *
+ * This source file is part of KlayGE
+ * For the latest info, see http://www.klayge.org
+ *
+ * @section LICENSE
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published
+ * by the Free Software Foundation; either version 2 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program; if not, write to the Free Software
+ * Foundation, Inc., 59 Temple Place, Suite 330, Boston, MA 02111-1307 USA
+ *
+ * You may alternatively use this source under the terms of
+ * the KlayGE Proprietary License (KPL). You can obtained such a license
+ * from http://www.klayge.org/licensing/.
+ */
+
+#include <KlayGE/KlayGE.hpp>
+#include <KFL/ErrorHandling.hpp>
+
+#include <cstring>
+
+#include <KlayGE/LZ4Codec.hpp>
+
+namespace
+{
+	using namespace KlayGE;
+
+	uint32_t const MIN_MATCH = 4;
+	// The last 5 bytes are always literals, and the last match starts at least 12 bytes before the end
+	uint32_t const LAST_LITERALS = 5;
+	uint32_t const MF_LIMIT = 12;
+	uint32_t const MAX_DISTANCE = 65535;
+	uint32_t const HASH_LOG = 16;
+
+	uint32_t Read32(uint8_t const * p)
+	{
+		uint32_t ret;
+		std::memcpy(&ret, p, sizeof(ret));
+		return ret;
+	}
+
+	uint32_t HashSequence(uint32_t sequence)
+	{
+		return (sequence * 2654435761U) >> (32 - HASH_LOG);
+	}
+
+	void WriteLength(std::vector<uint8_t>& output, uint64_t len)
+	{
+		while (len >= 255)
+		{
+			output.push_back(255);
+			len -= 255;
+		}
+		output.push_back(static_cast<uint8_t>(len));
+	}
+
+	void WriteSequence(std::vector<uint8_t>& output, uint8_t const * literals, uint64_t num_literals,
+		uint32_t offset, uint64_t match_len)
+	{
+		uint8_t const lit_token = static_cast<uint8_t>(std::min<uint64_t>(num_literals, 15));
+		uint8_t const match_token = (match_len >= MIN_MATCH)
+			? static_cast<uint8_t>(std::min<uint64_t>(match_len - MIN_MATCH, 15)) : 0;
+		output.push_back(static_cast<uint8_t>((lit_token << 4) | match_token));
+		if (num_literals >= 15)
+		{
+			WriteLength(output, num_literals - 15);
+		}
+		output.insert(output.end(), literals, literals + num_literals);
+
+		if (match_len >= MIN_MATCH)
+		{
+			output.push_back(static_cast<uint8_t>(offset & 0xFF));
+			output.push_back(static_cast<uint8_t>(offset >> 8));
+			if (match_len - MIN_MATCH >= 15)
+			{
+				WriteLength(output, match_len - MIN_MATCH - 15);
+			}
+		}
+	}
+
+	uint64_t ReadLength(uint8_t const *& ip, uint8_t const * iend, uint64_t len)
+	{
+		if (15 == len)
+		{
+			uint8_t b;
+			do
+			{
+				if (ip >= iend)
+				{
+					TERRC(std::errc::illegal_byte_sequence);
+				}
+				b = *ip;
+				++ ip;
+				len += b;
+			} while (255 == b);
+		}
+		return len;
+	}
+}
+
+namespace KlayGE
+{
+	LZ4Codec::LZ4Codec()
+	{
+	}
+
+	LZ4Codec::~LZ4Codec()
+	{
+	}
+
+	void LZ4Codec::Encode(std::vector<uint8_t>& output, void const * input, uint64_t len)
+	{
+		uint8_t const * src = static_cast<uint8_t const *>(input);
+
+		output.clear();
+		output.reserve(static_cast<size_t>(len + len / 255 + 16));
+
+		uint64_t anchor = 0;
+		if (len > MF_LIMIT)
+		{
+			std::vector<int64_t> hash_table(1UL << HASH_LOG, -1);
+
+			uint64_t const match_limit = len - MF_LIMIT;
+			uint64_t const match_end_limit = len - LAST_LITERALS;
+			uint64_t ip = 0;
+			while (ip < match_limit)
+			{
+				uint32_t const sequence = Read32(src + ip);
+				uint32_t const hash = HashSequence(sequence);
+				int64_t ref = hash_table[hash];
+				hash_table[hash] = static_cast<int64_t>(ip);
+
+				if ((ref < 0) || (ip - ref > MAX_DISTANCE) || (Read32(src + ref) != sequence))
+				{
+					++ ip;
+					continue;
+				}
+
+				uint64_t match_len = MIN_MATCH;
+				while ((ip + match_len < match_end_limit) && (src[ref + match_len] == src[ip + match_len]))
+				{
+					++ match_len;
+				}
+				while ((ip > anchor) && (ref > 0) && (src[ip - 1] == src[ref - 1]))
+				{
+					-- ip;
+					-- ref;
+					++ match_len;
+				}
+
+				WriteSequence(output, src + anchor, ip - anchor, static_cast<uint32_t>(ip - ref), match_len);
+
+				ip += match_len;
+				anchor = ip;
+
+				if (ip - 2 < match_limit)
+				{
+					hash_table[HashSequence(Read32(src + ip - 2))] = static_cast<int64_t>(ip - 2);
+				}
+			}
+		}
+
+		WriteSequence(output, src + anchor, len - anchor, 0, 0);
+	}
+
+	void LZ4Codec::Decode(std::vector<uint8_t>& output, void const * input, uint64_t len, uint64_t original_len)
+	{
+		output.resize(static_cast<size_t>(original_len));
+		this->Decode(output.data(), input, len, original_len);
+	}
+
+	void LZ4Codec::Decode(void* output, void const * input, uint64_t len, uint64_t original_len)
+	{
+		uint8_t const * ip = static_cast<uint8_t const *>(input);
+		uint8_t const * const iend = ip + len;
+		uint8_t* const obegin = static_cast<uint8_t*>(output);
+		uint8_t* op = obegin;
+		uint8_t* const oend = obegin + original_len;
+
+		while (ip < iend)
+		{
+			uint8_t const token = *ip;
+			++ ip;
+
+			uint64_t const num_literals = ReadLength(ip, iend, token >> 4);
+			if ((num_literals > static_cast<uint64_t>(iend - ip)) || (num_literals > static_cast<uint64_t>(oend - op)))
+			{
+				TERRC(std::errc::illegal_byte_sequence);
+			}
+			std::memcpy(op, ip, static_cast<size_t>(num_literals));
+			ip += num_literals;
+			op += num_literals;
+
+			if (ip == iend)
+			{
+				// The last sequence has no match
+				break;
+			}
+
+			if (iend - ip < 2)
+			{
+				TERRC(std::errc::illegal_byte_sequence);
+			}
+			uint32_t const offset = ip[0] | (ip[1] << 8);
+			ip += 2;
+			if ((0 == offset) || (offset > op - obegin))
+			{
+				TERRC(std::errc::illegal_byte_sequence);
+			}
+
+			uint64_t const match_len = ReadLength(ip, iend, token & 0xF) + MIN_MATCH;
+			if (match_len > static_cast<uint64_t>(oend - op))
+			{
+				TERRC(std::errc::illegal_byte_sequence);
+			}
+
+			uint8_t const * match = op - offset;
+			if (offset >= match_len)
+			{
+				std::memcpy(op, match, static_cast<size_t>(match_len));
+				op += match_len;
+			}
+			else
+			{
+				// Overlapped, the match repeats the last offset bytes
+				uint8_t* const match_end = op + match_len;
+				if (offset >= 8)
+				{
+					while (match_end - op >= 8)
+					{
+						std::memcpy(op, match, 8);
+						op += 8;
+						match += 8;
+					}
+				}
+				while (op < match_end)
+				{
+					*op = *match;
+					++ op;
+					++ match;
+				}
+			}
+		}
+
+		if (op != oend)
+		{
+			TERRC(std::errc::illegal_byte_sequence);
+		}
+	}
+}
@@ -166,11 +166,8 @@ namespace KlayGE
 
 	uint64_t LZMACodec::Decode(std::ostream& os, ResIdentifierPtr const & is, uint64_t len, uint64_t original_len)
 	{
-		std::vector<uint8_t> in_data(static_cast<size_t>(len));
-		is->read(&in_data[0], static_cast<size_t>(len));
-
 		std::vector<uint8_t> output;
-		this->Decode(output, &in_data[0], len, original_len);
+		this->Decode(output, is, len, original_len);
 
 		os.write(reinterpret_cast<char*>(&output[0]), static_cast<std::streamsize>(output.size()));
 
@@ -189,10 +186,22 @@ namespace KlayGE
 
 	void LZMACodec::Decode(std::vector<uint8_t>& output, ResIdentifierPtr const & is, uint64_t len, uint64_t original_len)
 	{
-		std::vector<uint8_t> in_data(static_cast<size_t>(len));
-		is->read(&in_data[0], static_cast<size_t>(len));
+		if (is->data() != nullptr)
+		{
+			// Decode in place
+			uint64_t const offset = static_cast<uint64_t>(is->tellg());
+			Verify(offset + len <= is->size());
+			is->seekg(len, std::ios_base::cur);
 
-		this->Decode(output, &in_data[0], len, original_len);
+			this->Decode(output, static_cast<uint8_t const *>(is->data()) + offset, len, original_len);
+		}
+		else
+		{
+			std::vector<uint8_t> in_data(static_cast<size_t>(len));
+			is->read(&in_data[0], static_cast<size_t>(len));
+
+			this->Decode(output, &in_data[0], len, original_len);
+		}
 	}
 
 	void LZMACodec::Decode(std::vector<uint8_t>& output, void const * input, uint64_t len, uint64_t original_len)
@@ -205,14 +214,11 @@ namespace KlayGE
 	{
 		uint8_t const * p = static_cast<uint8_t const *>(input);
 
-		std::vector<uint8_t> in_data(static_cast<size_t>(len));
-		std::memcpy(&in_data[0], p, static_cast<std::streamsize>(in_data.size()));
-
 		SizeT s_out_len = static_cast<SizeT>(original_len);
 
 		SizeT s_src_len = static_cast<SizeT>(len - LZMA_PROPS_SIZE);
-		int res = LZMALoader::Instance().LzmaUncompress(static_cast<Byte*>(output), &s_out_len, &in_data[LZMA_PROPS_SIZE], &s_src_len,
-			&in_data[0], LZMA_PROPS_SIZE);
+		int res = LZMALoader::Instance().LzmaUncompress(static_cast<Byte*>(output), &s_out_len, p + LZMA_PROPS_SIZE, &s_src_len,
+			p, LZMA_PROPS_SIZE);
 		Verify(0 == res);
 	}
 }
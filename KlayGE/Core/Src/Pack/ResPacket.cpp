@@ -0,0 +1,132 @@
+/**
+ * @file ResPacket.cpp
+ * @author Minmin Gong
+ *
+ * @section DESCRIPTION
+ *
+ * This source file is part of KlayGE
+ * For the latest info, see http://www.klayge.org
+ *
+ * @section LICENSE
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published
+ * by the Free Software Foundation; either version 2 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program; if not, write to the Free Software
+ * Foundation, Inc., 59 Temple Place, Suite 330, Boston, MA 02111-1307 USA
+ *
+ * You may alternatively use this source under the terms of
+ * the KlayGE Proprietary License (KPL). You can obtained such a license
+ * from http://www.klayge.org/licensing/.
+ */
+
+#include <KlayGE/KlayGE.hpp>
+#include <KFL/CustomizedStreamBuf.hpp>
+#include <KFL/ResIdentifier.hpp>
+#include <KlayGE/Extract7z.hpp>
+#include <KlayGE/KPKPacket.hpp>
+
+#include <istream>
+
+#include <KlayGE/ResPacket.hpp>
+
+namespace
+{
+	// Owns the data extracted from a packet
+	class BufferStreamBuf : public KlayGE::MemStreamBuf
+	{
+	public:
+		explicit BufferStreamBuf(std::vector<uint8_t>&& data)
+			: MemStreamBuf(data.data(), data.data() + data.size()),
+				data_(std::move(data))
+		{
+		}
+
+		uint8_t const * Data() const
+		{
+			return data_.data();
+		}
+
+	private:
+		std::vector<uint8_t> data_;
+	};
+
+	// Keeps the mapping alive while the ResIdentifier is in use
+	class MappedStreamBuf : public KlayGE::MemStreamBuf
+	{
+	public:
+		MappedStreamBuf(std::shared_ptr<KlayGE::MappedFile> const & file, uint8_t const * begin, uint8_t const * end)
+			: MemStreamBuf(begin, end),
+				file_(file)
+		{
+		}
+
+	private:
+		std::shared_ptr<KlayGE::MappedFile> file_;
+	};
+}
+
+namespace KlayGE
+{
+	ResPacket::~ResPacket()
+	{
+	}
+
+	void ResPacket::Open(std::vector<std::string> const & names, std::vector<std::string> const & file_paths,
+		std::vector<ResIdentifierPtr>& res)
+	{
+		BOOST_ASSERT(names.size() == file_paths.size());
+
+		res.resize(names.size());
+		for (size_t i = 0; i < names.size(); ++ i)
+		{
+			res[i] = this->Open(names[i], file_paths[i]);
+		}
+	}
+
+
+	ResPacketPtr OpenResPacket(std::string const & pkt_name, ResIdentifierPtr const & pkt_is, std::string_view password)
+	{
+		uint32_t fourcc = 0;
+		pkt_is->read(&fourcc, sizeof(fourcc));
+		fourcc = LE2Native(fourcc);
+		pkt_is->clear();
+		pkt_is->seekg(0, std::ios_base::beg);
+
+		if (KPKPacket::FOURCC == fourcc)
+		{
+			return MakeSharedPtr<KPKPacket>(pkt_name, pkt_is->Timestamp());
+		}
+		else
+		{
+			return MakeSharedPtr<Archive7z>(pkt_is, password);
+		}
+	}
+
+	ResIdentifierPtr MakeBufferResIdentifier(std::string const & name, uint64_t timestamp, std::vector<uint8_t>&& data)
+	{
+		uint64_t const size = data.size();
+		std::shared_ptr<BufferStreamBuf> bsb = MakeSharedPtr<BufferStreamBuf>(std::move(data));
+		std::shared_ptr<std::istream> buffer_file = MakeSharedPtr<std::istream>(bsb.get());
+		return MakeSharedPtr<ResIdentifier>(name, timestamp, buffer_file, bsb, bsb->Data(), size);
+	}
+
+	ResIdentifierPtr MakeMappedResIdentifier(std::string const & name, uint64_t timestamp,
+		std::shared_ptr<MappedFile> const & file, uint64_t offset, uint64_t size)
+	{
+		BOOST_ASSERT(offset + size <= file->Size());
+
+		uint8_t const * data = file->Data() + offset;
+		std::shared_ptr<MappedStreamBuf> msb = MakeSharedPtr<MappedStreamBuf>(file, data, data + size);
+		std::shared_ptr<std::istream> mapped_file = MakeSharedPtr<std::istream>(msb.get());
+		return MakeSharedPtr<ResIdentifier>(name, timestamp, mapped_file, msb, data, size);
+	}
+}
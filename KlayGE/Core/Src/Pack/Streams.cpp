@@ -33,6 +33,8 @@
 
 #include <boost/assert.hpp>
 
+#include <cstring>
+
 #include <CPP/Common/MyWindows.h>
 
 #include "Streams.hpp"
@@ -150,4 +152,35 @@ namespace KlayGE
 	{
 		return E_NOTIMPL;
 	}
+
+
+	//////////////////////////
+	// CMemOutStream
+
+	void CMemOutStream::Attach(std::vector<uint8_t>& buff)
+	{
+		buff_ = &buff;
+		pos_ = 0;
+	}
+
+	void CMemOutStream::Finish()
+	{
+		buff_->resize(pos_);
+	}
+
+	STDMETHODIMP CMemOutStream::Write(const void *data, UInt32 size, UInt32* processedSize)
+	{
+		if (pos_ + size > buff_->size())
+		{
+			buff_->resize(pos_ + size);
+		}
+		std::memcpy(buff_->data() + pos_, data, size);
+		pos_ += size;
+		if (processedSize)
+		{
+			*processedSize = size;
+		}
+
+		return S_OK;
+	}
 }
@@ -38,6 +38,7 @@
 #include <fstream>
 #include <string>
 #include <atomic>
+#include <vector>
 
 #include <CPP/7zip/IStream.h>
 
@@ -161,6 +162,61 @@ namespace KlayGE
 
 		std::shared_ptr<std::ostream> os_;
 	};
+
+	// Writes into a buffer that is usually pre-sized to the unpacked size, so extracting doesn't reallocate
+	class CMemOutStream : boost::noncopyable, public ISequentialOutStream
+	{
+	public:
+		STDMETHOD_(ULONG, AddRef)()
+		{
+			++ ref_count_;
+			return ref_count_;
+		}
+		STDMETHOD_(ULONG, Release)()
+		{
+			-- ref_count_;
+			if (0 == ref_count_)
+			{
+				delete this;
+				return 0;
+			}
+			return ref_count_;
+		}
+
+		STDMETHOD(QueryInterface)(REFGUID iid, void** outObject)
+		{
+			if (IID_ISequentialOutStream == iid)
+			{
+				*outObject = static_cast<void*>(this);
+				this->AddRef();
+				return S_OK;
+			}
+			else
+			{
+				return E_NOINTERFACE;
+			}
+		}
+
+		CMemOutStream()
+			: ref_count_(1), buff_(nullptr), pos_(0)
+		{
+		}
+		virtual ~CMemOutStream()
+		{
+		}
+
+		void Attach(std::vector<uint8_t>& buff);
+		// Shrinks the buffer to the size written
+		void Finish();
+
+		STDMETHOD(Write)(const void* data, UInt32 size, UInt32* processedSize);
+
+	private:
+		std::atomic<int32_t> ref_count_;
+
+		std::vector<uint8_t>* buff_;
+		size_t pos_;
+	};
 }
 
 #endif		// _KFL_STREAMS_HPP
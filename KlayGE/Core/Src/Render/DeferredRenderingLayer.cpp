@@ -51,6 +51,8 @@
 #include <KlayGE/SSSBlur.hpp>
 #include <KlayGE/PerfProfiler.hpp>
 
+#include <algorithm>
+
 #include <boost/lexical_cast.hpp>
 
 #include <KlayGE/DeferredRenderingLayer.hpp>
@@ -67,6 +69,14 @@ namespace KlayGE
 	int const VPL_COUNT = 64 * ((1UL << (SAMPLE_LEVEL_CNT * 2)) - 1) / (4 - 1);
 
 	float const ESM_SCALE_FACTOR = 300.0f;
+	float const SM_SMALL_OBJ_THRESHOLD = 0.002f;
+
+	// A point light and three spot lights, the most that could be shadowed before the updates were scheduled
+	uint32_t const DEFAULT_SM_UPDATE_BUDGET = 9;
+	// Fractions of the screen height covered by a light. Above the first, all its maps are wanted in every frame.
+	//  Above the second, two faces of a cube map, or a 2D map. Below it, one face, or a 2D map every other frame.
+	float const SM_FULL_UPDATE_COVERAGE = 0.25f;
+	float const SM_PARTIAL_UPDATE_COVERAGE = 0.05f;
 
 #if DEFAULT_DEFERRED == LIGHT_INDEXED_DEFERRED
 	uint32_t const TILE_SIZE = 32;
@@ -392,7 +402,9 @@ namespace KlayGE
 		: active_viewport_(0),
 		sss_enabled_(true), translucency_enabled_(true),
 		ssr_enabled_(true), taa_enabled_(true),
-		light_scale_(1), illum_(0), indirect_scale_(1.0f),
+		light_scale_(1),
+		cached_shadows_(false), sm_update_budget_(DEFAULT_SM_UPDATE_BUDGET), sm_frame_(0), unfiltered_sm_index_(-1),
+		illum_(0), indirect_scale_(1.0f),
 		curr_cascade_index_(-1), force_line_mode_(false),
 		dr_debug_pp_(MakeSharedPtr<DeferredRenderingDebugPostProcess>()),
 		display_type_(DT_Final)
@@ -664,6 +676,9 @@ namespace KlayGE
 		{
 			filtered_sm_cube_texs_[i] = rf.MakeTextureCube(SM_SIZE, 1, 1, sm_tex_->Format(), 1, 0, EAH_GPU_Read | EAH_GPU_Write);
 		}
+		sm_slot_state_t const empty_slot_state = { nullptr, 0, 0 };
+		sm_2d_slot_states_.fill(empty_slot_state);
+		sm_cube_slot_states_.fill(empty_slot_state);
 
 		ssvo_pp_ = MakeSharedPtr<SSVOPostProcess>();
 		auto effect_x = SyncLoadRenderEffect("SSVO.fxml");
@@ -1049,6 +1064,8 @@ namespace KlayGE
 			BOOST_ASSERT(caps.rendertarget_format_support(EF_R16F, 1, 0));
 			fmt = EF_R16F;
 		}
+		pvp.csm_view_projs.fill(float4x4::Zero());
+		pvp.csm_caster_generations.fill(0);
 		if (tex_array_support_)
 		{
 			pvp.filtered_csm_texs[0] = rf.MakeTexture2D(SM_SIZE * 2, SM_SIZE * 2, 3,
@@ -1317,6 +1334,13 @@ namespace KlayGE
 		sm_light_indices_.clear();
 
 		uint32_t const num_lights = scene_mgr.NumLights();
+
+#if DEFAULT_DEFERRED == LIGHT_INDEXED_DEFERRED
+		// The unified shadowing compute shader has only one cube shadow map
+		uint32_t const max_num_sm_cube_lights = (cs_cldr_ && typed_uav_) ? 1 : MAX_NUM_SHADOWED_POINT_LIGHTS;
+#else
+		uint32_t const max_num_sm_cube_lights = MAX_NUM_SHADOWED_POINT_LIGHTS;
+#endif
 		
 		for (uint32_t i = 0; i < num_lights; ++ i)
 		{
@@ -1371,7 +1395,8 @@ namespace KlayGE
 							if ((projective_light_index_ < 0) && light->ProjectiveTexture())
 							{
 								projective_light_index_ = static_cast<int32_t>(i + 1 - num_ambient_lights);
-								sm_light_indices_.emplace_back(0, 4);
+								// The slot after the ones of the shadowed spot lights, its maps and caches aren't shared
+								sm_light_indices_.emplace_back(MAX_NUM_SHADOWED_SPOT_LIGHTS, 4);
 							}
 							else if ((num_sm_2d_lights < MAX_NUM_SHADOWED_SPOT_LIGHTS)
 								&& (num_sm_lights < MAX_NUM_SHADOWED_LIGHTS))
@@ -1392,9 +1417,9 @@ namespace KlayGE
 							if ((projective_light_index_ < 0) && light->ProjectiveTexture())
 							{
 								projective_light_index_ = static_cast<int32_t>(i + 1 - num_ambient_lights);
-								sm_light_indices_.emplace_back(0, 4);
+								sm_light_indices_.emplace_back(MAX_NUM_SHADOWED_POINT_LIGHTS, 4);
 							}
-							else if ((num_sm_cube_lights < MAX_NUM_SHADOWED_POINT_LIGHTS)
+							else if ((num_sm_cube_lights < max_num_sm_cube_lights)
 								&& (num_sm_lights < MAX_NUM_SHADOWED_LIGHTS))
 							{
 								sm_light_indices_.emplace_back(num_sm_cube_lights, num_sm_lights);
@@ -1425,6 +1450,25 @@ namespace KlayGE
 		}
 		lights_[0]->Color(ambient_clr);
 
+		LightIndex& light_index = scene_mgr.GetLightIndex();
+		light_index.Clear();
+		for (uint32_t li = 0; li < lights_.size(); ++ li)
+		{
+			switch (lights_[li]->Type())
+			{
+			case LightSource::LT_Spot:
+			case LightSource::LT_Point:
+			case LightSource::LT_SphereArea:
+			case LightSource::LT_TubeArea:
+				light_index.Add(li, this->LightVolumeBound(*lights_[li]));
+				break;
+
+			default:
+				break;
+			}
+		}
+		light_index.Build();
+
 		indirect_lighting_enabled_ = false;
 		if (rsm_fb_ && (illum_ != 1))
 		{
@@ -1495,6 +1539,9 @@ namespace KlayGE
 		jobs_.push_back(MakeSharedPtr<DeferredRenderingJob>(std::bind(&DeferredRenderingLayer::BeginPerfProfileDRJob,
 			this, std::ref(*shadow_map_perf_))));
 #endif
+		// Before the shadow passes, the static shadow map caches are checked against the transforms of this frame
+		this->ClipShadowViews();
+		this->ScheduleShadowMaps();
 		for (uint32_t i = 0; i < lights_.size(); ++ i)
 		{
 			auto const & light = *lights_[i];
@@ -1503,6 +1550,7 @@ namespace KlayGE
 				this->AppendShadowPassScanCode(i);
 			}
 		}
+		this->CheckLightsVisible();
 #ifndef KLAYGE_SHIP
 		jobs_.push_back(MakeSharedPtr<DeferredRenderingJob>(std::bind(&DeferredRenderingLayer::EndPerfProfileDRJob,
 			this, std::ref(*shadow_map_perf_))));
@@ -1528,20 +1576,6 @@ namespace KlayGE
 				pvp.g_buffer_enables[PTB_TransparencyFront]
 					= (pvp.attrib & VPAM_NoTransparencyFront) ? false : has_transparency_front_objs;
 
-				pvp.light_visibles.resize(lights_.size());
-				for (uint32_t li = 0; li < lights_.size(); ++ li)
-				{
-					auto const & light = *lights_[li];
-					if (light.Enabled())
-					{
-						this->CheckLightVisible(vpi, li);
-					}
-					else
-					{
-						pvp.light_visibles[li] = false;
-					}
-				}
-
 				for (uint32_t i = PTB_Opaque; i < PTB_None; ++ i)
 				{
 					PassTargetBuffer const pass_tb = static_cast<PassTargetBuffer>(i);
@@ -1623,13 +1657,8 @@ namespace KlayGE
 #endif
 	}
 
-	void DeferredRenderingLayer::CheckLightVisible(uint32_t vp_index, uint32_t light_index)
+	AABBox DeferredRenderingLayer::LightVolumeBound(LightSource const & light) const
 	{
-		SceneManager& scene_mgr = Context::Instance().SceneManagerInstance();
-
-		PerViewport& pvp = viewports_[vp_index];
-		auto const & light = *lights_[light_index];
-
 		float light_scale = std::min(light.Range() * 0.01f, 1.0f) * light_scale_;
 		switch (light.Type())
 		{
@@ -1639,9 +1668,8 @@ namespace KlayGE
 				float const scale = light.CosOuterInner().w();
 				float4x4 mat = MathLib::scaling(scale * light_scale, scale * light_scale, light_scale);
 				float4x4 light_model = mat * inv_light_view;
-				pvp.light_visibles[light_index] = (scene_mgr.AABBVisible(MathLib::transform_aabb(cone_aabb_, light_model)) != BO_No);
+				return MathLib::transform_aabb(cone_aabb_, light_model);
 			}
-			break;
 
 		case LightSource::LT_Point:
 		case LightSource::LT_SphereArea:
@@ -1650,13 +1678,270 @@ namespace KlayGE
 				float3 const & p = light.Position();
 				float4x4 light_model = MathLib::scaling(light_scale, light_scale, light_scale)
 					* MathLib::translation(p);
-				pvp.light_visibles[light_index] = (scene_mgr.AABBVisible(MathLib::transform_aabb(box_aabb_, light_model)) != BO_No);
+				return MathLib::transform_aabb(box_aabb_, light_model);
 			}
-			break;
 
 		default:
-			pvp.light_visibles[light_index] = true;
-			break;
+			KFL_UNREACHABLE("Invalid light type");
+		}
+	}
+
+	// The light volumes are tested against the cameras of all the viewports in one query of the light index
+	void DeferredRenderingLayer::CheckLightsVisible()
+	{
+		std::vector<uint32_t> vp_indices;
+		std::vector<Frustum const *> frusta;
+		for (uint32_t vpi = 0; vpi < viewports_.size(); ++ vpi)
+		{
+			PerViewport const & pvp = viewports_[vpi];
+			if (pvp.attrib & VPAM_Enabled)
+			{
+				Camera const & camera = *pvp.frame_buffer->GetViewport()->camera;
+				vp_indices.push_back(vpi);
+				frusta.push_back(camera.OmniDirectionalMode() ? nullptr : &camera.ViewFrustum());
+			}
+		}
+
+		std::vector<std::vector<uint32_t>> visible_ids;
+		Context::Instance().SceneManagerInstance().GetLightIndex().Query(frusta, visible_ids);
+
+		for (size_t k = 0; k < vp_indices.size(); ++ k)
+		{
+			PerViewport& pvp = viewports_[vp_indices[k]];
+
+			// Lights without volumes are always visible
+			pvp.light_visibles.assign(lights_.size(), false);
+			for (uint32_t li = 0; li < lights_.size(); ++ li)
+			{
+				LightSource::LightType const type = lights_[li]->Type();
+				if ((LightSource::LT_Ambient == type) || (LightSource::LT_Directional == type))
+				{
+					pvp.light_visibles[li] = true;
+				}
+			}
+			for (auto li : visible_ids[k])
+			{
+				pvp.light_visibles[li] = true;
+			}
+
+			pvp.visible_lights.clear();
+			for (uint32_t li = 0; li < lights_.size(); ++ li)
+			{
+				if (pvp.light_visibles[li] && lights_[li]->Enabled())
+				{
+					pvp.visible_lights.push_back(li);
+				}
+				else
+				{
+					pvp.light_visibles[li] = false;
+				}
+			}
+		}
+	}
+
+	// The shadow maps of spot and point lights are culled all at once, before their passes. The cascades can't be,
+	//  their crop matrices depend on the depth range of the G-buffer.
+	void DeferredRenderingLayer::ClipShadowViews()
+	{
+		std::vector<Camera const *> sm_cameras;
+		for (auto const & light : lights_)
+		{
+			if (!light->Enabled())
+			{
+				continue;
+			}
+
+			int32_t const attr = light->Attrib();
+			switch (light->Type())
+			{
+			case LightSource::LT_Spot:
+				if ((attr & LightSource::LSA_IndirectLighting) || !(attr & LightSource::LSA_NoShadow))
+				{
+					sm_cameras.push_back(light->SMCamera(0).get());
+				}
+				break;
+
+			case LightSource::LT_Point:
+			case LightSource::LT_SphereArea:
+			case LightSource::LT_TubeArea:
+				if (!(attr & LightSource::LSA_NoShadow))
+				{
+					for (uint32_t face = 0; face < 6; ++ face)
+					{
+						sm_cameras.push_back(light->SMCamera(face).get());
+					}
+				}
+				break;
+
+			default:
+				break;
+			}
+		}
+
+		if (!sm_cameras.empty())
+		{
+			// With the threshold of the shadow map jobs, or their marks wouldn't be the cached ones
+			auto& scene_mgr = Context::Instance().SceneManagerInstance();
+			scene_mgr.SmallObjectThreshold(SM_SMALL_OBJ_THRESHOLD);
+			scene_mgr.ClipCameras(sm_cameras);
+		}
+	}
+
+	// Spot and point lights share the budget. Each one first gets the maps it wants for its coverage, in the order of
+	//  priority, then what's left of the budget goes to them in the same order. Cascades are scheduled by their jobs.
+	void DeferredRenderingLayer::ScheduleShadowMaps()
+	{
+		++ sm_frame_;
+
+		sm_update_masks_.assign(lights_.size(), 0xFFFFFFFFU);
+
+		// Slots that aren't taken again in this frame are drawn in full by the next light that takes them
+		std::array<bool, MAX_NUM_SHADOWED_SPOT_LIGHTS + MAX_NUM_PROJECTIVE_SHADOWED_SPOT_LIGHTS> sm_2d_slot_taken;
+		std::array<bool, MAX_NUM_SHADOWED_POINT_LIGHTS + MAX_NUM_PROJECTIVE_SHADOWED_POINT_LIGHTS> sm_cube_slot_taken;
+		sm_2d_slot_taken.fill(false);
+		sm_cube_slot_taken.fill(false);
+
+		Camera const & camera = *viewports_[0].frame_buffer->GetViewport()->camera;
+		float3 const & eye_pos = camera.EyePos();
+		float const proj_scale = camera.ProjMatrix()(1, 1);
+
+		struct candidate_t
+		{
+			uint32_t light_index;
+			sm_slot_state_t* state;
+			uint32_t num_maps;
+			uint32_t num_wanted;
+			uint32_t num_drawn;
+			float priority;
+			bool full;
+		};
+		std::vector<candidate_t> candidates;
+		for (uint32_t i = 0; i < lights_.size(); ++ i)
+		{
+			auto const & light = *lights_[i];
+			int32_t const attr = light.Attrib();
+			int32_t const slot = sm_light_indices_[i].first;
+			if (!light.Enabled() || (attr & LightSource::LSA_NoShadow) || (slot < 0))
+			{
+				continue;
+			}
+
+			candidate_t cand;
+			switch (light.Type())
+			{
+			case LightSource::LT_Spot:
+				// The indirect lighting of this frame reads the reflective shadow map
+				if ((attr & LightSource::LSA_IndirectLighting) && rsm_fb_ && (illum_ != 1))
+				{
+					continue;
+				}
+				cand.state = &sm_2d_slot_states_[slot];
+				cand.num_maps = 1;
+				sm_2d_slot_taken[slot] = true;
+				break;
+
+			case LightSource::LT_Point:
+			case LightSource::LT_SphereArea:
+			case LightSource::LT_TubeArea:
+				cand.state = &sm_cube_slot_states_[slot];
+				cand.num_maps = 6;
+				sm_cube_slot_taken[slot] = true;
+				break;
+
+			default:
+				continue;
+			}
+
+			cand.light_index = i;
+			cand.num_drawn = 0;
+			cand.full = (cand.state->light != &light) || (0 == sm_update_budget_);
+			if (cand.state->light != &light)
+			{
+				// The slot has the maps of another light, or nothing
+				cand.state->light = &light;
+				cand.state->next_face = 0;
+				cand.state->frames_waited = 0;
+			}
+
+			if (cand.full)
+			{
+				cand.num_wanted = cand.num_maps;
+				cand.priority = 0;
+			}
+			else
+			{
+				AABBox const aabb = this->LightVolumeBound(light);
+				float const radius = MathLib::length(aabb.HalfSize());
+				float const dist = MathLib::length(aabb.Center() - eye_pos);
+				float const coverage = (dist > radius) ? std::min(radius * proj_scale / dist, 1.0f) : 1.0f;
+				if (coverage >= SM_FULL_UPDATE_COVERAGE)
+				{
+					cand.num_wanted = cand.num_maps;
+				}
+				else if (coverage >= SM_PARTIAL_UPDATE_COVERAGE)
+				{
+					cand.num_wanted = std::min(cand.num_maps, 2U);
+				}
+				else
+				{
+					cand.num_wanted = (cand.num_maps > 1) ? 1 : ((sm_frame_ + slot) & 1);
+				}
+				cand.priority = coverage * (cand.state->frames_waited + 1);
+			}
+			candidates.push_back(cand);
+		}
+		for (size_t i = 0; i < sm_2d_slot_states_.size(); ++ i)
+		{
+			if (!sm_2d_slot_taken[i])
+			{
+				sm_2d_slot_states_[i].light = nullptr;
+			}
+		}
+		for (size_t i = 0; i < sm_cube_slot_states_.size(); ++ i)
+		{
+			if (!sm_cube_slot_taken[i])
+			{
+				sm_cube_slot_states_[i].light = nullptr;
+			}
+		}
+
+		std::sort(candidates.begin(), candidates.end(),
+			[](candidate_t const & lhs, candidate_t const & rhs)
+			{
+				if (lhs.full != rhs.full)
+				{
+					return lhs.full;
+				}
+				return lhs.priority > rhs.priority;
+			});
+
+		// The lights drawn in full are over the budget if they have to
+		uint32_t budget = sm_update_budget_;
+		for (uint32_t pass = 0; pass < 2; ++ pass)
+		{
+			for (auto& cand : candidates)
+			{
+				uint32_t const target = (0 == pass) ? cand.num_wanted : cand.num_maps;
+				if (target > cand.num_drawn)
+				{
+					uint32_t const num = cand.full ? (target - cand.num_drawn) : std::min(target - cand.num_drawn, budget);
+					cand.num_drawn += num;
+					budget -= std::min(num, budget);
+				}
+			}
+		}
+
+		for (auto const & cand : candidates)
+		{
+			uint32_t mask = 0;
+			for (uint32_t j = 0; j < cand.num_drawn; ++ j)
+			{
+				mask |= 1UL << ((cand.state->next_face + j) % cand.num_maps);
+			}
+			sm_update_masks_[cand.light_index] = mask;
+
+			cand.state->next_face = (cand.state->next_face + cand.num_drawn) % cand.num_maps;
+			cand.state->frames_waited = (cand.num_drawn > 0) ? 0 : (cand.state->frames_waited + 1);
 		}
 	}
 
@@ -1728,12 +2013,16 @@ namespace KlayGE
 					}
 				}
 
-				if (sm_seq != 0)
+				if ((sm_seq != 0) && (sm_update_masks_[light_index] & 1))
 				{
+					if (PT_GenShadowMap == shadow_pt)
+					{
+						this->AppendStaticShadowMapScanCode(light_index, 0);
+					}
 					jobs_.push_back(MakeSharedPtr<DeferredRenderingJob>(std::bind(&DeferredRenderingLayer::ShadowMapGenerationDRJob,
-						this, std::cref(viewports_[0]), shadow_pt, light_index, 0)));
+						this, std::ref(viewports_[0]), shadow_pt, light_index, 0)));
 					jobs_.push_back(MakeSharedPtr<DeferredRenderingJob>(std::bind(&DeferredRenderingLayer::ShadowMapGenerationDRJob,
-						this, std::cref(viewports_[0]), shadow_pt, light_index, 1)));
+						this, std::ref(viewports_[0]), shadow_pt, light_index, 1)));
 				}
 			}
 			break;
@@ -1741,12 +2030,20 @@ namespace KlayGE
 		case LightSource::LT_Point:
 		case LightSource::LT_SphereArea:
 		case LightSource::LT_TubeArea:
-			if (0 == (attr & LightSource::LSA_NoShadow))
+			if ((0 == (attr & LightSource::LSA_NoShadow)) && (sm_update_masks_[light_index] & 0x3F))
 			{
 				for (int j = 0; j < 7; ++ j)
 				{
+					if (j < 6)
+					{
+						if (!(sm_update_masks_[light_index] & (1UL << j)))
+						{
+							continue;
+						}
+						this->AppendStaticShadowMapScanCode(light_index, j);
+					}
 					jobs_.push_back(MakeSharedPtr<DeferredRenderingJob>(std::bind(&DeferredRenderingLayer::ShadowMapGenerationDRJob,
-						this, std::cref(viewports_[0]), shadow_pt, light_index, j)));
+						this, std::ref(viewports_[0]), shadow_pt, light_index, j)));
 				}
 			}
 			break;
@@ -1760,6 +2057,28 @@ namespace KlayGE
 		}
 	}
 
+	void DeferredRenderingLayer::AppendStaticShadowMapScanCode(uint32_t light_index, int32_t index_in_pass)
+	{
+		auto cache = this->StaticShadowMapCache(light_index, index_in_pass);
+		if (!cache)
+		{
+			return;
+		}
+
+		auto const & light = *lights_[light_index];
+		float4x4 const & view_proj = light.SMCamera(index_in_pass)->ViewProjMatrix();
+		uint32_t const static_generation = Context::Instance().SceneManagerInstance().StaticGeneration();
+		if ((cache->light != &light) || (cache->view_proj != view_proj) || (cache->static_generation != static_generation))
+		{
+			cache->light = &light;
+			cache->view_proj = view_proj;
+			cache->static_generation = static_generation;
+
+			jobs_.push_back(MakeSharedPtr<DeferredRenderingJob>(std::bind(
+				&DeferredRenderingLayer::StaticShadowMapGenerationDRJob, this, light_index, index_in_pass)));
+		}
+	}
+
 	void DeferredRenderingLayer::AppendCascadedShadowPassScanCode(uint32_t vp_index, uint32_t light_index)
 	{
 		BOOST_ASSERT(LightSource::LT_Directional == lights_[light_index]->Type());
@@ -1773,7 +2092,7 @@ namespace KlayGE
 		for (uint32_t i = 0; i < pvp.num_cascades + 1; ++ i)
 		{
 			jobs_.push_back(MakeSharedPtr<DeferredRenderingJob>(std::bind(&DeferredRenderingLayer::ShadowMapGenerationDRJob,
-				this, std::cref(pvp), PT_GenCascadedShadowMap, light_index, i)));
+				this, std::ref(pvp), PT_GenCascadedShadowMap, light_index, i)));
 		}
 
 #ifndef KLAYGE_SHIP
@@ -2051,7 +2370,7 @@ namespace KlayGE
 		}
 	}
 
-	void DeferredRenderingLayer::PostGenerateShadowMap(PerViewport const & pvp, int32_t org_no, int32_t index_in_pass)
+	void DeferredRenderingLayer::PostGenerateShadowMap(PerViewport const & pvp, int32_t org_no, int32_t sm_index)
 	{
 		LightSource::LightType const type = lights_[org_no]->Type();
 
@@ -2066,11 +2385,11 @@ namespace KlayGE
 			pp_chain = checked_pointer_cast<PostProcessChain>(csm_filter_pp_);
 			if (tex_array_support_)
 			{
-				pp_chain->OutputPin(0, pvp.filtered_csm_texs[0], 0, index_in_pass - 1, 0);
+				pp_chain->OutputPin(0, pvp.filtered_csm_texs[0], 0, sm_index, 0);
 			}
 			else
 			{
-				pp_chain->OutputPin(0, pvp.filtered_csm_texs[index_in_pass - 1]);
+				pp_chain->OutputPin(0, pvp.filtered_csm_texs[sm_index]);
 			}
 		}
 		else
@@ -2079,7 +2398,7 @@ namespace KlayGE
 			if ((LightSource::LT_Point == type) || (LightSource::LT_SphereArea == type)
 				|| (LightSource::LT_TubeArea == type))
 			{
-				pp_chain->OutputPin(0, filtered_sm_cube_texs_[sm_light_indices_[org_no].first], 0, 0, index_in_pass - 1);
+				pp_chain->OutputPin(0, filtered_sm_cube_texs_[sm_light_indices_[org_no].first], 0, 0, sm_index);
 			}
 			else 
 			{
@@ -2101,7 +2420,7 @@ namespace KlayGE
 		int2 kernel_size;
 		if (LightSource::LT_Directional == type)
 		{
-			float3 const & scale = cascaded_shadow_layer_->CascadeScales()[index_in_pass - 1];
+			float3 const & scale = cascaded_shadow_layer_->CascadeScales()[sm_index];
 			float2 blur_kernel_size = blur_size_light_space_ * float2(scale.x(), scale.y()) * static_cast<float>(csm_tex_->Width(0));
 			kernel_size.x() = MathLib::clamp(static_cast<int32_t>(blur_kernel_size.x() + 0.5f), 1, 4);
 			kernel_size.y() = MathLib::clamp(static_cast<int32_t>(blur_kernel_size.y() + 0.5f), 1, 4);
@@ -2117,19 +2436,10 @@ namespace KlayGE
 		checked_pointer_cast<LogGaussianBlurPostProcess>(pp_chain)->ESMScaleFactor(ESM_SCALE_FACTOR, *sm_fb_->GetViewport()->camera);
 		pp_chain->Apply();
 
-		if (LightSource::LT_Directional == type)
+		// The mipmaps of a texture array are built after all the cascades
+		if ((LightSource::LT_Directional == type) && !tex_array_support_)
 		{
-			if (tex_array_support_)
-			{
-				if (static_cast<int32_t>(pvp.num_cascades) == index_in_pass)
-				{
-					pvp.filtered_csm_texs[0]->BuildMipSubLevels();
-				}
-			}
-			else
-			{
-				pvp.filtered_csm_texs[index_in_pass - 1]->BuildMipSubLevels();
-			}
+			pvp.filtered_csm_texs[sm_index]->BuildMipSubLevels();
 		}
 	}
 
@@ -2751,6 +3061,68 @@ namespace KlayGE
 		}
 	}
 
+	void DeferredRenderingLayer::CachedShadows(bool cached)
+	{
+		cached_shadows_ = cached;
+
+		auto& rf = Context::Instance().RenderFactoryInstance();
+		auto init_cache = [this, &rf, cached](static_sm_cache_t& cache)
+			{
+				cache.light = nullptr;
+				if (cached)
+				{
+					if (!cache.fb)
+					{
+						cache.depth_tex = rf.MakeTexture2D(SM_SIZE, SM_SIZE, 1, 1, sm_depth_tex_->Format(), 1, 0,
+							EAH_GPU_Read | EAH_GPU_Write);
+						cache.fb = rf.MakeFrameBuffer();
+						// Only the depth is kept, the color is converted from it after the moveable casters are drawn
+						cache.fb->Attach(FrameBuffer::ATT_Color0, sm_fb_->Attached(FrameBuffer::ATT_Color0));
+						cache.fb->Attach(FrameBuffer::ATT_DepthStencil, rf.Make2DDepthStencilRenderView(*cache.depth_tex, 0, 1, 0));
+					}
+				}
+				else
+				{
+					cache.fb.reset();
+					cache.depth_tex.reset();
+				}
+			};
+		for (auto& cache : static_sm_2d_caches_)
+		{
+			init_cache(cache);
+		}
+		for (auto& caches : static_sm_cube_caches_)
+		{
+			for (auto& cache : caches)
+			{
+				init_cache(cache);
+			}
+		}
+	}
+
+	DeferredRenderingLayer::static_sm_cache_t* DeferredRenderingLayer::StaticShadowMapCache(uint32_t light_index,
+		int32_t index_in_pass)
+	{
+		if (!cached_shadows_ || (sm_light_indices_[light_index].first < 0))
+		{
+			return nullptr;
+		}
+
+		switch (lights_[light_index]->Type())
+		{
+		case LightSource::LT_Spot:
+			return &static_sm_2d_caches_[sm_light_indices_[light_index].first];
+
+		case LightSource::LT_Point:
+		case LightSource::LT_SphereArea:
+		case LightSource::LT_TubeArea:
+			return &static_sm_cube_caches_[sm_light_indices_[light_index].first][index_in_pass];
+
+		default:
+			return nullptr;
+		}
+	}
+
 	void DeferredRenderingLayer::SetViewportCascades(uint32_t vp, uint32_t num_cascades, float pssm_lambda)
 	{
 		PerViewport& pvp = viewports_[vp];
@@ -2842,76 +3214,73 @@ namespace KlayGE
 		std::vector<uint32_t> sphere_area_lights_no_shadow;
 		std::vector<uint32_t> tube_area_lights_shadow;
 		std::vector<uint32_t> tube_area_lights_no_shadow;
-		for (uint32_t li = 0; li < lights_.size(); ++ li)
+		for (auto li : pvp.visible_lights)
 		{
 			auto const & light = *lights_[li];
-			if (light.Enabled() && pvp.light_visibles[li])
+			LightSource::LightType const type = light.Type();
+			switch (type)
 			{
-				LightSource::LightType const type = light.Type();
-				switch (type)
+			case LightSource::LT_Ambient:
+				this->UpdateLightIndexedLightingAmbientSun(pvp, type, li, pass_tb);
+				break;
+
+			case LightSource::LT_Directional:
+				if (light.Attrib() & LightSource::LSA_NoShadow)
+				{
+					directional_lights.push_back(li);
+				}
+				else
 				{
-				case LightSource::LT_Ambient:
 					this->UpdateLightIndexedLightingAmbientSun(pvp, type, li, pass_tb);
-					break;
-
-				case LightSource::LT_Directional:
-					if (light.Attrib() & LightSource::LSA_NoShadow)
-					{
-						directional_lights.push_back(li);
-					}
-					else
-					{
-						this->UpdateLightIndexedLightingAmbientSun(pvp, type, li, pass_tb);
-					}
-					break;
-
-				case LightSource::LT_Point:
-					if (light.Attrib() & LightSource::LSA_NoShadow)
-					{
-						point_lights_no_shadow.push_back(li);
-					}
-					else
-					{
-						point_lights_shadow.push_back(li);
-					}
-					break;
+				}
+				break;
 
-				case LightSource::LT_Spot:
-					if (light.Attrib() & LightSource::LSA_NoShadow)
-					{
-						spot_lights_no_shadow.push_back(li);
-					}
-					else
-					{
-						spot_lights_shadow.push_back(li);
-					}
-					break;
+			case LightSource::LT_Point:
+				if (light.Attrib() & LightSource::LSA_NoShadow)
+				{
+					point_lights_no_shadow.push_back(li);
+				}
+				else
+				{
+					point_lights_shadow.push_back(li);
+				}
+				break;
 
-				case LightSource::LT_SphereArea:
-					if (light.Attrib() & LightSource::LSA_NoShadow)
-					{
-						sphere_area_lights_no_shadow.push_back(li);
-					}
-					else
-					{
-						sphere_area_lights_shadow.push_back(li);
-					}
-					break;
+			case LightSource::LT_Spot:
+				if (light.Attrib() & LightSource::LSA_NoShadow)
+				{
+					spot_lights_no_shadow.push_back(li);
+				}
+				else
+				{
+					spot_lights_shadow.push_back(li);
+				}
+				break;
 
-				case LightSource::LT_TubeArea:
-					if (light.Attrib() & LightSource::LSA_NoShadow)
-					{
-						tube_area_lights_no_shadow.push_back(li);
-					}
-					else
-					{
-						tube_area_lights_shadow.push_back(li);
-					}
-					break;
+			case LightSource::LT_SphereArea:
+				if (light.Attrib() & LightSource::LSA_NoShadow)
+				{
+					sphere_area_lights_no_shadow.push_back(li);
+				}
+				else
+				{
+					sphere_area_lights_shadow.push_back(li);
+				}
+				break;
 
-				default:
-					KFL_UNREACHABLE("Invalid light type");
+			case LightSource::LT_TubeArea:
+				if (light.Attrib() & LightSource::LSA_NoShadow)
+				{
+					tube_area_lights_no_shadow.push_back(li);
 				}
+				else
+				{
+					tube_area_lights_shadow.push_back(li);
+				}
+				break;
+
+			default:
+				KFL_UNREACHABLE("Invalid light type");
 			}
 		}
 
@@ -3355,91 +3724,87 @@ namespace KlayGE
 
 		*skylight_diff_spec_mip_param_ = int3(0, 0, 0);
 
-		for (uint32_t li = 0; li < lights_.size();)
+		for (size_t vli = 0; vli < pvp.visible_lights.size();)
 		{
 			std::array<std::vector<uint32_t>, 11> available_lights;
-			for (uint32_t batch = 0; (batch < light_batch_) && (li < lights_.size()); ++ li)
+			for (uint32_t batch = 0; (batch < light_batch_) && (vli < pvp.visible_lights.size()); ++ batch, ++ vli)
 			{
+				uint32_t const li = pvp.visible_lights[vli];
 				auto const & light = *lights_[li];
-				if (light.Enabled() && pvp.light_visibles[li])
+				LightSource::LightType type = light.Type();
+				switch (type)
 				{
-					++ batch;
-
-					LightSource::LightType type = light.Type();
-					switch (type)
+				case LightSource::LT_Ambient:
+					available_lights[0].push_back(li);
+					if (light.SkylightTexY())
 					{
-					case LightSource::LT_Ambient:
-						available_lights[0].push_back(li);
-						if (light.SkylightTexY())
-						{
-							*skylight_y_cube_tex_param_ = light.SkylightTexY();
-							*skylight_c_cube_tex_param_ = light.SkylightTexC();
-
-							uint32_t const mip = light.SkylightTexY()->NumMipMaps();
-							*skylight_diff_spec_mip_param_ = int3(mip - 1, mip - 2, 1);
+						*skylight_y_cube_tex_param_ = light.SkylightTexY();
+						*skylight_c_cube_tex_param_ = light.SkylightTexC();
 
-							*inv_view_param_ = pvp.inv_view;
-						}
-						break;
+						uint32_t const mip = light.SkylightTexY()->NumMipMaps();
+						*skylight_diff_spec_mip_param_ = int3(mip - 1, mip - 2, 1);
 
-					case LightSource::LT_Directional:
-						if (light.Attrib() & LightSource::LSA_NoShadow)
-						{
-							available_lights[1].push_back(li);
-						}
-						else
-						{
-							available_lights[2].push_back(li);
-						}
-						break;
+						*inv_view_param_ = pvp.inv_view;
+					}
+					break;
 
-					case LightSource::LT_Point:
-						if (light.Attrib() & LightSource::LSA_NoShadow)
-						{
-							available_lights[3].push_back(li);
-						}
-						else
-						{
-							available_lights[4].push_back(li);
-						}
-						break;
+				case LightSource::LT_Directional:
+					if (light.Attrib() & LightSource::LSA_NoShadow)
+					{
+						available_lights[1].push_back(li);
+					}
+					else
+					{
+						available_lights[2].push_back(li);
+					}
+					break;
 
-					case LightSource::LT_Spot:
-						if (light.Attrib() & LightSource::LSA_NoShadow)
-						{
-							available_lights[5].push_back(li);
-						}
-						else
-						{
-							available_lights[6].push_back(li);
-						}
-						break;
+				case LightSource::LT_Point:
+					if (light.Attrib() & LightSource::LSA_NoShadow)
+					{
+						available_lights[3].push_back(li);
+					}
+					else
+					{
+						available_lights[4].push_back(li);
+					}
+					break;
 
-					case LightSource::LT_SphereArea:
-						if (light.Attrib() & LightSource::LSA_NoShadow)
-						{
-							available_lights[7].push_back(li);
-						}
-						else
-						{
-							available_lights[8].push_back(li);
-						}
-						break;
+				case LightSource::LT_Spot:
+					if (light.Attrib() & LightSource::LSA_NoShadow)
+					{
+						available_lights[5].push_back(li);
+					}
+					else
+					{
+						available_lights[6].push_back(li);
+					}
+					break;
 
-					case LightSource::LT_TubeArea:
-						if (light.Attrib() & LightSource::LSA_NoShadow)
-						{
-							available_lights[9].push_back(li);
-						}
-						else
-						{
-							available_lights[10].push_back(li);
-						}
-						break;
+				case LightSource::LT_SphereArea:
+					if (light.Attrib() & LightSource::LSA_NoShadow)
+					{
+						available_lights[7].push_back(li);
+					}
+					else
+					{
+						available_lights[8].push_back(li);
+					}
+					break;
 
-					default:
-						KFL_UNREACHABLE("Invalid light type");
+				case LightSource::LT_TubeArea:
+					if (light.Attrib() & LightSource::LSA_NoShadow)
+					{
+						available_lights[9].push_back(li);
+					}
+					else
+					{
+						available_lights[10].push_back(li);
 					}
+					break;
+
+				default:
+					KFL_UNREACHABLE("Invalid light type");
 				}
 			}
 
@@ -3847,7 +4212,7 @@ namespace KlayGE
 		return 0;
 	}
 
-	uint32_t DeferredRenderingLayer::ShadowMapGenerationDRJob(PerViewport const & pvp, PassType pass_type, int32_t org_no, 
+	uint32_t DeferredRenderingLayer::ShadowMapGenerationDRJob(PerViewport& pvp, PassType pass_type, int32_t org_no, 
 		int32_t index_in_pass)
 	{
 		auto& rf = Context::Instance().RenderFactoryInstance();
@@ -3862,23 +4227,60 @@ namespace KlayGE
 		auto const & light = *lights_[org_no];
 		this->PrepareLightCamera(pvp, light, index_in_pass, pass_type);
 
-		if (index_in_pass > 0)
+		// The faces of a cube map can be skipped, so the map to filter isn't always the previous index
+		if (unfiltered_sm_index_ >= 0)
 		{
-			this->PostGenerateShadowMap(pvp, org_no, index_in_pass);
+			this->PostGenerateShadowMap(pvp, org_no, unfiltered_sm_index_);
+			unfiltered_sm_index_ = -1;
+		}
+
+		bool no_draw = false;
+		if (LightSource::LT_Directional == light.Type())
+		{
+			if (static_cast<int32_t>(pvp.num_cascades) == index_in_pass)
+			{
+				if (tex_array_support_)
+				{
+					pvp.filtered_csm_texs[0]->BuildMipSubLevels();
+				}
+				no_draw = true;
+			}
+			else
+			{
+				// The near half of the cascades is drawn every frame, the far ones on alternate frames. The shading
+				//  uses the matrices of this frame, so a cascade is only skipped if neither it nor any caster has
+				//  moved since it was drawn.
+				float4x4 const view_proj = light.SMCamera(0)->ViewProjMatrix()
+					* cascaded_shadow_layer_->CascadeCropMatrix(index_in_pass);
+				uint32_t const caster_generation = scene_mgr.CasterGeneration();
+				if ((sm_update_budget_ > 0) && (static_cast<uint32_t>(index_in_pass) * 2 >= pvp.num_cascades)
+					&& ((index_in_pass + sm_frame_) & 1) && (pvp.csm_view_projs[index_in_pass] == view_proj)
+					&& (pvp.csm_caster_generations[index_in_pass] == caster_generation))
+				{
+					no_draw = true;
+				}
+				pvp.csm_view_projs[index_in_pass] = view_proj;
+				pvp.csm_caster_generations[index_in_pass] = caster_generation;
+			}
+		}
+		else
+		{
+			no_draw = (((LightSource::LT_Point == light.Type()) || (LightSource::LT_SphereArea == light.Type())
+				|| (LightSource::LT_TubeArea == light.Type())) && (6 == index_in_pass))
+				|| ((LightSource::LT_Spot == light.Type()) && (1 == index_in_pass));
 		}
 
 		uint32_t urv;
-		if ((((LightSource::LT_Point == light.Type()) || (LightSource::LT_SphereArea == light.Type())
-			|| (LightSource::LT_TubeArea == light.Type())) && (6 == index_in_pass))
-			|| ((LightSource::LT_Spot == light.Type()) && (1 == index_in_pass))
-			|| ((LightSource::LT_Directional == light.Type()) && (static_cast<int32_t>(pvp.num_cascades) == index_in_pass)))
+		if (no_draw)
 		{
 			curr_cascade_index_ = -1;
 			urv = 0;
 		}
 		else
 		{
-			scene_mgr.SmallObjectThreshold(0.002f);
+			unfiltered_sm_index_ = index_in_pass;
+
+			scene_mgr.SmallObjectThreshold(SM_SMALL_OBJ_THRESHOLD);
 
 			PassRT const pass_rt = GetPassRT(pass_type);
 
@@ -3886,9 +4288,20 @@ namespace KlayGE
 			switch (pass_rt)
 			{
 			case PRT_ShadowMap:
-				re.BindFrameBuffer(sm_fb_);
-				sm_fb_->Attached(FrameBuffer::ATT_Color0)->Discard();
-				sm_fb_->Attached(FrameBuffer::ATT_DepthStencil)->ClearDepth(1.0f);
+				{
+					re.BindFrameBuffer(sm_fb_);
+					sm_fb_->Attached(FrameBuffer::ATT_Color0)->Discard();
+					auto cache = this->StaticShadowMapCache(org_no, index_in_pass);
+					if (cache && (cache->light == &light))
+					{
+						cache->depth_tex->CopyToTexture(*sm_depth_tex_);
+						urv |= App3DFramework::URV_MoveableOnly;
+					}
+					else
+					{
+						sm_fb_->Attached(FrameBuffer::ATT_DepthStencil)->ClearDepth(1.0f);
+					}
+				}
 				break;
 
 			case PRT_CascadedShadowMap:
@@ -3916,6 +4329,34 @@ namespace KlayGE
 		return urv;
 	}
 
+	uint32_t DeferredRenderingLayer::StaticShadowMapGenerationDRJob(int32_t org_no, int32_t index_in_pass)
+	{
+		auto cache = this->StaticShadowMapCache(org_no, index_in_pass);
+		if (!cache || (cache->light != lights_[org_no]))
+		{
+			return 0;
+		}
+
+		auto& re = Context::Instance().RenderFactoryInstance().RenderEngineInstance();
+		auto& scene_mgr = Context::Instance().SceneManagerInstance();
+
+		for (auto const & deo : visible_scene_objs_)
+		{
+			deo->Pass(PT_GenShadowMap);
+		}
+
+		// Same camera and threshold as the shadow map itself, so both flushes share the visible marks. It runs before
+		//  the previous face is filtered, but that only reads sm_depth_tex_, which isn't touched here.
+		cache->fb->GetViewport()->camera = lights_[org_no]->SMCamera(index_in_pass);
+		curr_cascade_index_ = -1;
+		scene_mgr.SmallObjectThreshold(SM_SMALL_OBJ_THRESHOLD);
+
+		re.BindFrameBuffer(cache->fb);
+		cache->fb->Attached(FrameBuffer::ATT_DepthStencil)->ClearDepth(1.0f);
+
+		return App3DFramework::URV_NeedFlush | App3DFramework::URV_OpaqueOnly | App3DFramework::URV_StaticOnly;
+	}
+
 	uint32_t DeferredRenderingLayer::IndirectLightingDRJob(PerViewport const & pvp, int32_t org_no)
 	{
 		depth_to_esm_pp_->Apply();
@@ -3971,29 +4412,26 @@ namespace KlayGE
 			this->UpdateLightIndexedLighting(pvp, pass_tb);
 		}
 #elif DEFAULT_DEFERRED == TRIDITIONAL_DEFERRED
-		for (uint32_t li = 0; li < lights_.size(); ++ li)
+		for (auto li : pvp.visible_lights)
 		{
 			auto const & light = *lights_[li];
-			if (light.Enabled() && pvp.light_visibles[li])
-			{
-				LightSource::LightType type = light.Type();
-				int32_t attr = light.Attrib();
+			LightSource::LightType type = light.Type();
+			int32_t attr = light.Attrib();
 
-				this->PrepareLightCamera(pvp, light, index_in_pass, pass_type);
+			this->PrepareLightCamera(pvp, light, index_in_pass, pass_type);
 
-				*light_attrib_param_ = float4(attr & LightSource::LSA_NoDiffuse ? 0.0f : 1.0f,
-					attr & LightSource::LSA_NoSpecular ? 0.0f : 1.0f,
-					attr & LightSource::LSA_NoShadow ? -1.0f : 1.0f, light.ProjectiveTexture() ? 1.0f : -1.0f);
-				*light_color_param_ = light.Color();
-				*light_falloff_range_param_ = float4(light.Falloff().x(), light.Falloff().y(),
-					light.Falloff().z(), light.Range() * light_scale_);
+			*light_attrib_param_ = float4(attr & LightSource::LSA_NoDiffuse ? 0.0f : 1.0f,
+				attr & LightSource::LSA_NoSpecular ? 0.0f : 1.0f,
+				attr & LightSource::LSA_NoShadow ? -1.0f : 1.0f, light.ProjectiveTexture() ? 1.0f : -1.0f);
+			*light_color_param_ = light.Color();
+			*light_falloff_range_param_ = float4(light.Falloff().x(), light.Falloff().y(),
+				light.Falloff().z(), light.Range() * light_scale_);
 
-				float3 extend_es = MathLib::transform_normal(light.Extend(), pvp.view);
-				*light_radius_extend_param_ = float4(light.Radius(), extend_es.x(),
-					extend_es.y(), extend_es.z());
+			float3 extend_es = MathLib::transform_normal(light.Extend(), pvp.view);
+			*light_radius_extend_param_ = float4(light.Radius(), extend_es.x(),
+				extend_es.y(), extend_es.z());
 
-				this->UpdateLighting(pvp, type, li);
-			}
+			this->UpdateLighting(pvp, type, li);
 		}
 
 		this->UpdateShading(pvp, pass_tb);
@@ -30,6 +30,7 @@
 #include <KlayGE/Camera.hpp>
 #include <KFL/XMLDom.hpp>
 #include <KlayGE/LZMACodec.hpp>
+#include <KlayGE/ResPacket.hpp>
 #include <KlayGE/Light.hpp>
 #include <KlayGE/RenderMaterial.hpp>
 #include <KFL/Hash.hpp>
@@ -38,6 +39,7 @@
 #include <fstream>
 #include <sstream>
 #include <cstring>
+#include <unordered_set>
 
 #include <MeshMLLib/MeshMLLib.hpp>
 
@@ -199,6 +201,42 @@ namespace
 			return true;
 		}
 
+		uint64_t ResourceBytes() const override
+		{
+			uint64_t bytes = 0;
+			RenderModelPtr const & model = *model_desc_.model;
+			if (model)
+			{
+				// Meshes share the merged buffers
+				std::unordered_set<GraphicsBuffer const *> buffers;
+				auto add_buffer = [&bytes, &buffers](GraphicsBufferPtr const & buffer)
+					{
+						if (buffer && buffers.insert(buffer.get()).second)
+						{
+							bytes += buffer->Size();
+						}
+					};
+
+				for (uint32_t i = 0; i < model->NumSubrenderables(); ++ i)
+				{
+					Renderable const & mesh = *model->Subrenderable(i);
+					for (uint32_t lod = 0; lod < mesh.NumLods(); ++ lod)
+					{
+						RenderLayout const & rl = mesh.GetRenderLayout(lod);
+						for (uint32_t j = 0; j < rl.NumVertexStreams(); ++ j)
+						{
+							add_buffer(rl.GetVertexStream(j));
+						}
+						if (rl.UseIndices())
+						{
+							add_buffer(rl.GetIndexStream());
+						}
+					}
+				}
+			}
+			return bytes;
+		}
+
 		bool Match(ResLoadingDesc const & rhs) const override
 		{
 			if (this->Type() == rhs.Type())
@@ -210,6 +248,15 @@ namespace
 			return false;
 		}
 
+		size_t Hash() const override
+		{
+			size_t seed = 0;
+			HashCombine(seed, this->Type());
+			HashRange(seed, model_desc_.res_name.begin(), model_desc_.res_name.end());
+			HashCombine(seed, model_desc_.access_hint);
+			return seed;
+		}
+
 		void CopyDataFrom(ResLoadingDesc const & rhs) override
 		{
 			BOOST_ASSERT(this->Type() == rhs.Type());
@@ -1013,6 +1060,7 @@ namespace KlayGE
 		}
 		else
 		{
+			// Scoped, so the mapped model_bin is released before MeshMLJIT rewrites it
 			ResIdentifierPtr lzma_file = ResLoader::Instance().Open(path_name + jit_ext_name);
 			uint32_t fourcc;
 			lzma_file->read(&fourcc, sizeof(fourcc));
@@ -1123,18 +1171,19 @@ namespace KlayGE
 		ver = LE2Native(ver);
 		BOOST_ASSERT(MODEL_BIN_VERSION == ver);
 
-		std::shared_ptr<std::stringstream> ss = MakeSharedPtr<std::stringstream>();
-
 		uint64_t original_len, len;
 		lzma_file->read(&original_len, sizeof(original_len));
 		original_len = LE2Native(original_len);
 		lzma_file->read(&len, sizeof(len));
 		len = LE2Native(len);
 
+		// Decoded straight from a mapped file, and read from the decoded buffer without another copy
+		std::vector<uint8_t> decoded_data;
 		LZMACodec lzma;
-		lzma.Decode(*ss, lzma_file, len, original_len);
+		lzma.Decode(decoded_data, lzma_file, len, original_len);
 
-		ResIdentifierPtr decoded = MakeSharedPtr<ResIdentifier>(lzma_file->ResName(), lzma_file->Timestamp(), ss);
+		ResIdentifierPtr decoded = MakeBufferResIdentifier(lzma_file->ResName(), lzma_file->Timestamp(),
+			std::move(decoded_data));
 
 		uint32_t num_mtls;
 		decoded->read(&num_mtls, sizeof(num_mtls));
@@ -356,6 +356,14 @@ namespace
 			return false;
 		}
 
+		size_t Hash() const override
+		{
+			size_t seed = 0;
+			HashCombine(seed, this->Type());
+			HashRange(seed, ps_desc_.res_name.begin(), ps_desc_.res_name.end());
+			return seed;
+		}
+
 		void CopyDataFrom(ResLoadingDesc const & rhs) override
 		{
 			BOOST_ASSERT(this->Type() == rhs.Type());
@@ -609,7 +617,7 @@ namespace KlayGE
 
 	ParticleSystem::ParticleSystem(uint32_t max_num_particles)
 		: SceneObjectHelper(SOA_Moveable | SOA_NotCastShadow),
-			particles_(max_num_particles),
+			particles_(max_num_particles), view_mat_(float4x4::Identity()),
 			gravity_(0.5f), force_(0, 0, 0), media_density_(0.0f)
 	{
 		this->ClearParticles();
@@ -728,7 +736,11 @@ namespace KlayGE
 		auto emitter_iter = emitters_.begin();
 		uint32_t new_particle = (*emitter_iter)->Update(elapsed_time);
 
-		float4x4 const & view_mat = Context::Instance().AppInstance().ActiveCamera().ViewMatrix();
+		float4x4 view_mat;
+		{
+			std::lock_guard<std::mutex> lock(update_mutex_);
+			view_mat = view_mat_;
+		}
 		std::vector<std::pair<uint32_t, float>> active_particles;
 
 		float3 min_bb(+1e10f, +1e10f, +1e10f);
@@ -782,15 +794,22 @@ namespace KlayGE
 			}
 		}
 
+		std::vector<Particle> snapshot;
 		if (!active_particles.empty())
 		{
 			std::sort(active_particles.begin(), active_particles.end(), ParticleCmp());
 
-			checked_pointer_cast<RenderParticles>(renderable_)->PosBound(AABBox(min_bb, max_bb));
+			snapshot.reserve(active_particles.size());
+			for (auto const & active_particle : active_particles)
+			{
+				snapshot.push_back(particles_[active_particle.first]);
+			}
 		}
 
 		std::lock_guard<std::mutex> lock(update_mutex_);
-		active_particles_ = active_particles;
+		active_particles_.swap(active_particles);
+		active_particle_snapshot_.swap(snapshot);
+		active_particle_bound_ = AABBox(min_bb, max_bb);
 	}
 
 	bool ParticleSystem::MainThreadUpdate(float app_time, float elapsed_time)
@@ -800,11 +819,15 @@ namespace KlayGE
 
 		std::lock_guard<std::mutex> lock(update_mutex_);
 
+		view_mat_ = Context::Instance().AppInstance().ActiveCamera().ViewMatrix();
+
 		uint32_t const num_active_particles = static_cast<uint32_t>(active_particles_.size());
 
 		RenderLayout& rl = renderable_->GetRenderLayout();
 		if (!active_particles_.empty())
 		{
+			checked_pointer_cast<RenderParticles>(renderable_)->PosBound(active_particle_bound_);
+
 			GraphicsBufferPtr instance_gb;
 			if (gs_support_)
 			{
@@ -849,7 +872,7 @@ namespace KlayGE
 				ParticleInstance* instance_data = mapper.Pointer<ParticleInstance>();
 				for (uint32_t i = 0; i < num_active_particles; ++ i, ++ instance_data)
 				{
-					Particle const & par = particles_[active_particles_[i].first];
+					Particle const & par = active_particle_snapshot_[i];
 					instance_data->pos = par.pos;
 					instance_data->life = par.life;
 					instance_data->spin = par.spin;
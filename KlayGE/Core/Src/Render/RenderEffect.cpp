@@ -2685,6 +2685,17 @@ namespace KlayGE
 			return false;
 		}
 
+		size_t Hash() const override
+		{
+			size_t seed = 0;
+			HashCombine(seed, this->Type());
+			for (auto const & name : effect_desc_.res_name)
+			{
+				HashRange(seed, name.begin(), name.end());
+			}
+			return seed;
+		}
+
 		void CopyDataFrom(ResLoadingDesc const & rhs) override
 		{
 			BOOST_ASSERT(this->Type() == rhs.Type());
@@ -3172,8 +3183,13 @@ namespace KlayGE
 		}
 #endif
 
-		ResIdentifierPtr kfx_source = ResLoader::Instance().Open(kfx_name);
-		if (!this->StreamIn(kfx_source, effect))
+		bool loaded;
+		{
+			// The source can be a mapped file. Releases it before the kfx is rewritten.
+			ResIdentifierPtr kfx_source = ResLoader::Instance().Open(kfx_name);
+			loaded = this->StreamIn(kfx_source, effect);
+		}
+		if (!loaded)
 		{
 #if KLAYGE_IS_DEV_PLATFORM
 			effect.params_.clear();
@@ -242,4 +242,28 @@ namespace KlayGE
 	{
 		return indirect_args_offset;
 	}
+
+	bool RenderLayout::SameGeometry(RenderLayout const & rhs) const
+	{
+		if ((topo_type_ != rhs.topo_type_) || (vertex_streams_.size() != rhs.vertex_streams_.size())
+			|| (index_stream_ != rhs.index_stream_) || (index_format_ != rhs.index_format_)
+			|| (force_num_vertices_ != rhs.force_num_vertices_) || (force_num_indices_ != rhs.force_num_indices_)
+			|| (start_vertex_location_ != rhs.start_vertex_location_)
+			|| (start_index_location_ != rhs.start_index_location_)
+			|| (base_vertex_location_ != rhs.base_vertex_location_)
+			|| indirect_args_buff_ || rhs.indirect_args_buff_)
+		{
+			return false;
+		}
+
+		for (size_t i = 0; i < vertex_streams_.size(); ++ i)
+		{
+			if ((vertex_streams_[i].stream != rhs.vertex_streams_[i].stream)
+				|| (vertex_streams_[i].format != rhs.vertex_streams_[i].format))
+			{
+				return false;
+			}
+		}
+		return true;
+	}
 }
@@ -317,7 +317,7 @@ namespace KlayGE
 				GraphicsBuffer::Mapper mapper(*inst_stream, BA_Write_Only);
 				for (size_t i = 0; i < instances_.size(); ++ i)
 				{
-					uint8_t const * src = static_cast<uint8_t const *>(instances_[i]->InstanceData());
+					uint8_t const * src = static_cast<uint8_t const *>(instances_[i]->RenderInstanceData());
 					std::copy(src, src + size, mapper.Pointer<uint8_t>() + i * size);
 				}
 			}
@@ -294,6 +294,37 @@ namespace KlayGE
 	{
 	}
 
+	bool ShaderObject::StreamIn(ResIdentifierPtr const & res, ShaderType type, RenderEffect const & effect,
+		std::array<uint32_t, ST_NumShaderTypes> const & shader_desc_ids)
+	{
+		uint32_t len;
+		res->read(&len, sizeof(len));
+		len = LE2Native(len);
+		if (res->data() != nullptr)
+		{
+			// Parsed in place
+			uint64_t const offset = static_cast<uint64_t>(res->tellg());
+			if (offset + len > res->size())
+			{
+				return false;
+			}
+			res->seekg(len, std::ios_base::cur);
+
+			return this->AttachNativeShader(type, effect, shader_desc_ids,
+				ArrayRef<uint8_t>(static_cast<uint8_t const *>(res->data()) + offset, len));
+		}
+		else
+		{
+			std::vector<uint8_t> native_shader_block(len);
+			if (len > 0)
+			{
+				res->read(&native_shader_block[0], len * sizeof(native_shader_block[0]));
+			}
+
+			return this->AttachNativeShader(type, effect, shader_desc_ids, native_shader_block);
+		}
+	}
+
 #if KLAYGE_IS_DEV_PLATFORM
 	std::vector<uint8_t> ShaderObject::CompileToDXBC(ShaderType type, RenderEffect const & effect,
 			RenderTechnique const & tech, RenderPass const & pass,
@@ -1076,6 +1076,18 @@ namespace
 	}
 
 
+	// Copies the sub-resources of a texture loaded in place, so they can be modified and outlive tex_res
+	void CopyInPlaceTextureData(ResIdentifierPtr const & tex_res, std::vector<ElementInitData>& init_data,
+		std::vector<uint8_t>& data_block)
+	{
+		uint8_t const * res_data = static_cast<uint8_t const *>(tex_res->data());
+		data_block.assign(res_data, res_data + tex_res->size());
+		for (auto& sub_res : init_data)
+		{
+			sub_res.data = &data_block[static_cast<uint8_t const *>(sub_res.data) - res_data];
+		}
+	}
+
 	class TextureLoadingDesc : public ResLoadingDesc
 	{
 	private:
@@ -1093,6 +1105,9 @@ namespace
 				ElementFormat format;
 				std::vector<ElementInitData> init_data;
 				std::vector<uint8_t> data_block;
+
+				// If init_data points into the resource in place
+				ResIdentifierPtr res;
 			};
 			std::shared_ptr<TexData> tex_data;
 
@@ -1256,6 +1271,60 @@ namespace
 			return true;
 		}
 
+		uint64_t MainThreadStageBytes() const override
+		{
+			// Nothing left for the main thread if the texture is already created in the sub thread
+			uint64_t bytes = 0;
+			if (tex_desc_.tex_data)
+			{
+				TexDesc::TexData const & tex_data = *tex_desc_.tex_data;
+				for (size_t i = 0; i < tex_data.init_data.size(); ++ i)
+				{
+					uint32_t depth = 1;
+					if (Texture::TT_3D == tex_data.type)
+					{
+						depth = std::max<uint32_t>(tex_data.depth >> (i % tex_data.num_mipmaps), 1);
+					}
+					bytes += static_cast<uint64_t>(tex_data.init_data[i].slice_pitch) * depth;
+				}
+			}
+			return bytes;
+		}
+
+		bool ManifestEntry(std::string& name, uint32_t& access_hint) const override
+		{
+			name = tex_desc_.res_name;
+			access_hint = tex_desc_.access_hint;
+			return true;
+		}
+
+		uint64_t ResourceBytes() const override
+		{
+			uint64_t bytes = 0;
+			TexturePtr const & tex = *tex_desc_.tex;
+			if (tex)
+			{
+				ElementFormat const format = tex->Format();
+				uint32_t const array_size = tex->ArraySize() * ((Texture::TT_Cube == tex->Type()) ? 6 : 1);
+				for (uint32_t level = 0; level < tex->NumMipMaps(); ++ level)
+				{
+					uint32_t const width = tex->Width(level);
+					uint32_t const height = tex->Height(level);
+					uint32_t const depth = tex->Depth(level);
+					if (IsCompressedFormat(format))
+					{
+						uint32_t const block_size = NumFormatBytes(format) * 4;
+						bytes += static_cast<uint64_t>((width + 3) / 4) * ((height + 3) / 4) * depth * block_size * array_size;
+					}
+					else
+					{
+						bytes += static_cast<uint64_t>(width) * height * depth * NumFormatBytes(format) * array_size;
+					}
+				}
+			}
+			return bytes;
+		}
+
 		bool Match(ResLoadingDesc const & rhs) const override
 		{
 			if (this->Type() == rhs.Type())
@@ -1267,6 +1336,15 @@ namespace
 			return false;
 		}
 
+		size_t Hash() const override
+		{
+			size_t seed = 0;
+			HashCombine(seed, this->Type());
+			HashRange(seed, tex_desc_.res_name.begin(), tex_desc_.res_name.end());
+			HashCombine(seed, tex_desc_.access_hint);
+			return seed;
+		}
+
 		void CopyDataFrom(ResLoadingDesc const & rhs) override
 		{
 			BOOST_ASSERT(this->Type() == rhs.Type());
@@ -1293,10 +1371,16 @@ namespace
 		{
 			TexDesc::TexData& tex_data = *tex_desc_.tex_data;
 
-			LoadTexture(tex_desc_.res_name, tex_data.type,
+			// Mapped files are uploaded straight from the mapping, without a copy in data_block
+			tex_data.res = ResLoader::Instance().Open(tex_desc_.res_name);
+			LoadTextureInPlace(tex_data.res, tex_data.type,
 				tex_data.width, tex_data.height, tex_data.depth,
 				tex_data.num_mipmaps, tex_data.array_size, tex_data.format,
 				tex_data.init_data, tex_data.data_block);
+			if (nullptr == tex_data.res->data())
+			{
+				tex_data.res.reset();
+			}
 
 			RenderFactory& rf = Context::Instance().RenderFactoryInstance();
 			RenderDeviceCaps const & caps = rf.RenderEngineInstance().DeviceCaps();
@@ -1318,6 +1402,8 @@ namespace
 			if (((EF_BC5 == tex_data.format) && !caps.texture_format_support(EF_BC5))
 				|| ((EF_BC5_SRGB == tex_data.format) && !caps.texture_format_support(EF_BC5_SRGB)))
 			{
+				this->DetachFromRes();
+
 				BC1Block tmp;
 				for (size_t i = 0; i < tex_data.init_data.size(); ++ i)
 				{
@@ -1342,6 +1428,8 @@ namespace
 			if (((EF_BC4 == tex_data.format) && !caps.texture_format_support(EF_BC4))
 				|| ((EF_BC4_SRGB == tex_data.format) && !caps.texture_format_support(EF_BC4_SRGB)))
 			{
+				this->DetachFromRes();
+
 				BC1Block tmp;
 				for (size_t i = 0; i < tex_data.init_data.size(); ++ i)
 				{
@@ -1413,7 +1501,12 @@ namespace
 
 						std::vector<uint8_t> new_data_block;
 						std::vector<uint32_t> new_sub_res_start;
-						if (needs_new_data_block)
+						if (!needs_new_data_block)
+						{
+							// Converted in place
+							this->DetachFromRes();
+						}
+						else
 						{
 							uint32_t new_data_block_size = 0;
 							new_sub_res_start.resize(array_size * tex_data.num_mipmaps);
@@ -1496,6 +1589,7 @@ namespace
 						if (needs_new_data_block)
 						{
 							tex_data.data_block.swap(new_data_block);
+							tex_data.res.reset();
 						}
 
 						tex_data.format = convert_fmts[i][1];
@@ -1516,6 +1610,17 @@ namespace
 			}
 		}
 
+		// The mapping of a file is read-only. Sub-resources have to be copied before being modified.
+		void DetachFromRes()
+		{
+			TexDesc::TexData& tex_data = *tex_desc_.tex_data;
+			if (tex_data.res)
+			{
+				CopyInPlaceTextureData(tex_data.res, tex_data.init_data, tex_data.data_block);
+				tex_data.res.reset();
+			}
+		}
+
 		TexturePtr CreateTexture()
 		{
 			TexDesc::TexData const & tex_data = *tex_desc_.tex_data;
@@ -1997,6 +2102,18 @@ namespace KlayGE
 	void LoadTexture(ResIdentifierPtr const & tex_res, Texture::TextureType& type,
 		uint32_t& width, uint32_t& height, uint32_t& depth, uint32_t& num_mipmaps, uint32_t& array_size,
 		ElementFormat& format, std::vector<ElementInitData>& init_data, std::vector<uint8_t>& data_block)
+	{
+		LoadTextureInPlace(tex_res, type, width, height, depth, num_mipmaps, array_size,
+			format, init_data, data_block);
+		if (tex_res->data() != nullptr)
+		{
+			CopyInPlaceTextureData(tex_res, init_data, data_block);
+		}
+	}
+
+	void LoadTextureInPlace(ResIdentifierPtr const & tex_res, Texture::TextureType& type,
+		uint32_t& width, uint32_t& height, uint32_t& depth, uint32_t& num_mipmaps, uint32_t& array_size,
+		ElementFormat& format, std::vector<ElementInitData>& init_data, std::vector<uint8_t>& data_block)
 	{
 		uint32_t row_pitch, slice_pitch;
 		GetImageInfo(tex_res, type, width, height, depth, num_mipmaps, array_size, format,
@@ -2013,6 +2130,30 @@ namespace KlayGE
 			}
 		}
 
+		// Returns the offset of a sub-resource, in the resource itself if it's in memory, or in data_block
+		uint8_t const * res_data = static_cast<uint8_t const *>(tex_res->data());
+		auto read_sub_res = [&tex_res, res_data, &data_block](uint32_t size)
+			{
+				size_t offset;
+				if (res_data != nullptr)
+				{
+					offset = static_cast<size_t>(tex_res->tellg());
+					if (offset + size > tex_res->size())
+					{
+						TERRC(std::errc::io_error);
+					}
+					tex_res->seekg(size, std::ios_base::cur);
+				}
+				else
+				{
+					offset = data_block.size();
+					data_block.resize(offset + size);
+					tex_res->read(&data_block[offset], size);
+					BOOST_ASSERT(tex_res->gcount() == static_cast<int>(size));
+				}
+				return offset;
+			};
+
 		std::vector<size_t> base;
 		switch (type)
 		{
@@ -2037,13 +2178,10 @@ namespace KlayGE
 							image_size = (padding ? ((the_width + 3) & ~3) : the_width) * fmt_size;
 						}
 
-						base[index] = data_block.size();
-						data_block.resize(base[index] + image_size);
 						init_data[index].row_pitch = image_size;
 						init_data[index].slice_pitch = image_size;
 
-						tex_res->read(&data_block[base[index]], static_cast<std::streamsize>(image_size));
-						BOOST_ASSERT(tex_res->gcount() == static_cast<int>(image_size));
+						base[index] = read_sub_res(image_size);
 
 						the_width = std::max<uint32_t>(the_width / 2, 1);
 					}
@@ -2067,23 +2205,17 @@ namespace KlayGE
 							uint32_t const block_size = NumFormatBytes(format) * 4;
 							uint32_t image_size = ((the_width + 3) / 4) * ((the_height + 3) / 4) * block_size;
 
-							base[index] = data_block.size();
-							data_block.resize(base[index] + image_size);
 							init_data[index].row_pitch = (the_width + 3) / 4 * block_size;
 							init_data[index].slice_pitch = image_size;
 
-							tex_res->read(&data_block[base[index]], static_cast<std::streamsize>(image_size));
-							BOOST_ASSERT(tex_res->gcount() == static_cast<int>(image_size));
+							base[index] = read_sub_res(image_size);
 						}
 						else
 						{
 							init_data[index].row_pitch = (padding ? ((the_width + 3) & ~3) : the_width) * fmt_size;
 							init_data[index].slice_pitch = init_data[index].row_pitch * the_height;
-							base[index] = data_block.size();
-							data_block.resize(base[index] + init_data[index].slice_pitch);
 
-							tex_res->read(&data_block[base[index]], static_cast<std::streamsize>(init_data[index].slice_pitch));
-							BOOST_ASSERT(tex_res->gcount() == static_cast<int>(init_data[index].slice_pitch));
+							base[index] = read_sub_res(init_data[index].slice_pitch);
 						}
 
 						the_width = std::max<uint32_t>(the_width / 2, 1);
@@ -2110,23 +2242,17 @@ namespace KlayGE
 							uint32_t const block_size = NumFormatBytes(format) * 4;
 							uint32_t image_size = ((the_width + 3) / 4) * ((the_height + 3) / 4) * the_depth * block_size;
 
-							base[index] = data_block.size();
-							data_block.resize(base[index] + image_size);
 							init_data[index].row_pitch = (the_width + 3) / 4 * block_size;
 							init_data[index].slice_pitch = ((the_width + 3) / 4) * ((the_height + 3) / 4) * block_size;
 
-							tex_res->read(&data_block[base[index]], static_cast<std::streamsize>(image_size));
-							BOOST_ASSERT(tex_res->gcount() == static_cast<int>(image_size));
+							base[index] = read_sub_res(image_size);
 						}
 						else
 						{
 							init_data[index].row_pitch = (padding ? ((the_width + 3) & ~3) : the_width) * fmt_size;
 							init_data[index].slice_pitch = init_data[index].row_pitch * the_height;
-							base[index] = data_block.size();
-							data_block.resize(base[index] + init_data[index].slice_pitch * the_depth);
 
-							tex_res->read(&data_block[base[index]], static_cast<std::streamsize>(init_data[index].slice_pitch * the_depth));
-							BOOST_ASSERT(tex_res->gcount() == static_cast<int>(init_data[index].slice_pitch * the_depth));
+							base[index] = read_sub_res(init_data[index].slice_pitch * the_depth);
 						}
 
 						the_width = std::max<uint32_t>(the_width / 2, 1);
@@ -2155,23 +2281,17 @@ namespace KlayGE
 								uint32_t const block_size = NumFormatBytes(format) * 4;
 								uint32_t image_size = ((the_width + 3) / 4) * ((the_height + 3) / 4) * block_size;
 
-								base[index] = data_block.size();
-								data_block.resize(base[index] + image_size);
 								init_data[index].row_pitch = (the_width + 3) / 4 * block_size;
 								init_data[index].slice_pitch = image_size;
 
-								tex_res->read(&data_block[base[index]], static_cast<std::streamsize>(image_size));
-								BOOST_ASSERT(tex_res->gcount() == static_cast<int>(image_size));
+								base[index] = read_sub_res(image_size);
 							}
 							else
 							{
 								init_data[index].row_pitch = (padding ? ((the_width + 3) & ~3) : the_width) * fmt_size;
 								init_data[index].slice_pitch = init_data[index].row_pitch * the_width;
-								base[index] = data_block.size();
-								data_block.resize(base[index] + init_data[index].slice_pitch);
 
-								tex_res->read(&data_block[base[index]], static_cast<std::streamsize>(init_data[index].slice_pitch));
-								BOOST_ASSERT(tex_res->gcount() == static_cast<int>(init_data[index].slice_pitch));
+								base[index] = read_sub_res(init_data[index].slice_pitch);
 							}
 
 							the_width = std::max<uint32_t>(the_width / 2, 1);
@@ -2185,18 +2305,23 @@ namespace KlayGE
 
 		for (size_t i = 0; i < base.size(); ++ i)
 		{
-			init_data[i].data = &data_block[base[i]];
+			init_data[i].data = (res_data != nullptr) ? res_data + base[i] : &data_block[base[i]];
 		}
 	}
 
 	TexturePtr SyncLoadTexture(std::string const & tex_name, uint32_t access_hint)
 	{
-		return ResLoader::Instance().SyncQueryT<Texture>(MakeSharedPtr<TextureLoadingDesc>(tex_name, access_hint));
+		return ResLoader::Instance().SyncQueryT<Texture>(MakeTextureLoadingDesc(tex_name, access_hint));
 	}
 
 	TexturePtr ASyncLoadTexture(std::string const & tex_name, uint32_t access_hint)
 	{
-		return ResLoader::Instance().ASyncQueryT<Texture>(MakeSharedPtr<TextureLoadingDesc>(tex_name, access_hint));
+		return ResLoader::Instance().ASyncQueryT<Texture>(MakeTextureLoadingDesc(tex_name, access_hint));
+	}
+
+	ResLoadingDescPtr MakeTextureLoadingDesc(std::string const & tex_name, uint32_t access_hint)
+	{
+		return MakeSharedPtr<TextureLoadingDesc>(tex_name, access_hint);
 	}
 
 	void SaveTexture(std::string const & tex_name, Texture::TextureType type,
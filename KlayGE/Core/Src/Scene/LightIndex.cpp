@@ -0,0 +1,211 @@
+/**
+ * @file LightIndex.cpp
+ * @author Minmin Gong
+ *
+ * @section DESCRIPTION
+ *
+ * This source file is part of KlayGE
+ * For the latest info, see http://www.klayge.org
+ *
+ * @section LICENSE
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published
+ * by the Free Software Foundation; either version 2 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program; if not, write to the Free Software
+ * Foundation, Inc., 59 Temple Place, Suite 330, Boston, MA 02111-1307 USA
+ *
+ * You may alternatively use this source under the terms of
+ * the KlayGE Proprietary License (KPL). You can obtained such a license
+ * from http://www.klayge.org/licensing/.
+ */
+
+
+#include <KlayGE/KlayGE.hpp>
+#include <KFL/Math.hpp>
+#include <KFL/SIMDMath.hpp>
+#include <KFL/RadixSort.hpp>
+
+#include <algorithm>
+#include <boost/assert.hpp>
+
+#include <KlayGE/LightIndex.hpp>
+
+namespace
+{
+	// Lights in each group of the index
+	uint32_t const LIGHT_GROUP_SIZE = 32;
+
+	// Spreads the lower 10 bits of v to every third bit
+	uint32_t SpreadBits(uint32_t v)
+	{
+		v &= 0x3FF;
+		v = (v | (v << 16)) & 0x030000FF;
+		v = (v | (v << 8)) & 0x0300F00F;
+		v = (v | (v << 4)) & 0x030C30C3;
+		v = (v | (v << 2)) & 0x09249249;
+		return v;
+	}
+}
+
+namespace KlayGE
+{
+	void LightIndex::bounds_t::Resize(size_t size)
+	{
+		center_x.resize(size);
+		center_y.resize(size);
+		center_z.resize(size);
+		extent_x.resize(size);
+		extent_y.resize(size);
+		extent_z.resize(size);
+	}
+
+	void LightIndex::bounds_t::Set(size_t index, AABBox const & aabb)
+	{
+		float3 const center = aabb.Center();
+		float3 const extent = aabb.HalfSize();
+		center_x[index] = center.x();
+		center_y[index] = center.y();
+		center_z[index] = center.z();
+		extent_x[index] = extent.x();
+		extent_y[index] = extent.y();
+		extent_z[index] = extent.z();
+	}
+
+	void LightIndex::Clear()
+	{
+		aabbs_.clear();
+		ids_.clear();
+		sorted_ids_.clear();
+		light_bounds_.Resize(0);
+		group_bounds_.Resize(0);
+	}
+
+	void LightIndex::Add(uint32_t id, AABBox const & aabb)
+	{
+		aabbs_.push_back(aabb);
+		ids_.push_back(id);
+	}
+
+	void LightIndex::Build()
+	{
+		uint32_t const num_lights = static_cast<uint32_t>(aabbs_.size());
+		if (0 == num_lights)
+		{
+			sorted_ids_.clear();
+			light_bounds_.Resize(0);
+			group_bounds_.Resize(0);
+			return;
+		}
+
+		float3 bb_min = aabbs_[0].Center();
+		float3 bb_max = bb_min;
+		for (auto const & aabb : aabbs_)
+		{
+			float3 const center = aabb.Center();
+			bb_min = MathLib::minimize(bb_min, center);
+			bb_max = MathLib::maximize(bb_max, center);
+		}
+		float3 const bb_size = MathLib::maximize(bb_max - bb_min, float3(1e-6f, 1e-6f, 1e-6f));
+		float3 const quantize = float3(1023, 1023, 1023) / bb_size;
+
+		std::vector<std::pair<uint32_t, uint32_t>> codes(num_lights);
+		for (uint32_t i = 0; i < num_lights; ++ i)
+		{
+			float3 const p = (aabbs_[i].Center() - bb_min) * quantize;
+			uint32_t const code = SpreadBits(static_cast<uint32_t>(p.x()))
+				| (SpreadBits(static_cast<uint32_t>(p.y())) << 1) | (SpreadBits(static_cast<uint32_t>(p.z())) << 2);
+			codes[i] = std::make_pair(code, i);
+		}
+		std::vector<std::pair<uint32_t, uint32_t>> codes_temp(num_lights);
+		RadixSort(codes.data(), codes_temp.data(), codes.size(),
+			[](std::pair<uint32_t, uint32_t> const & code)
+			{
+				return static_cast<uint64_t>(code.first);
+			});
+
+		uint32_t const num_groups = (num_lights + LIGHT_GROUP_SIZE - 1) / LIGHT_GROUP_SIZE;
+		light_bounds_.Resize(num_lights);
+		sorted_ids_.resize(num_lights);
+		group_bounds_.Resize(num_groups);
+		for (uint32_t g = 0; g < num_groups; ++ g)
+		{
+			uint32_t const first = g * LIGHT_GROUP_SIZE;
+			uint32_t const last = std::min(first + LIGHT_GROUP_SIZE, num_lights);
+			AABBox group_bb = aabbs_[codes[first].second];
+			for (uint32_t i = first; i < last; ++ i)
+			{
+				uint32_t const index = codes[i].second;
+				light_bounds_.Set(i, aabbs_[index]);
+				sorted_ids_[i] = ids_[index];
+				group_bb |= aabbs_[index];
+			}
+			group_bounds_.Set(g, group_bb);
+		}
+	}
+
+	void LightIndex::Query(Frustum const & frustum, std::vector<uint32_t>& ids) const
+	{
+		ids.clear();
+
+		uint32_t const num_lights = static_cast<uint32_t>(sorted_ids_.size());
+		uint32_t const num_groups = static_cast<uint32_t>(group_bounds_.center_x.size());
+		BOOST_ASSERT(num_lights == aabbs_.size());
+
+		overlaps_.resize(num_groups + LIGHT_GROUP_SIZE);
+		BoundOverlap* group_overlaps = overlaps_.data();
+		BoundOverlap* light_overlaps = overlaps_.data() + num_groups;
+		SIMDMathLib::IntersectAABBFrustum(group_overlaps, group_bounds_.center_x.data(), group_bounds_.center_y.data(),
+			group_bounds_.center_z.data(), group_bounds_.extent_x.data(), group_bounds_.extent_y.data(),
+			group_bounds_.extent_z.data(), num_groups, frustum);
+		for (uint32_t g = 0; g < num_groups; ++ g)
+		{
+			uint32_t const first = g * LIGHT_GROUP_SIZE;
+			uint32_t const last = std::min(first + LIGHT_GROUP_SIZE, num_lights);
+			if (BO_Yes == group_overlaps[g])
+			{
+				ids.insert(ids.end(), sorted_ids_.begin() + first, sorted_ids_.begin() + last);
+			}
+			else if (BO_Partial == group_overlaps[g])
+			{
+				SIMDMathLib::IntersectAABBFrustum(light_overlaps, &light_bounds_.center_x[first],
+					&light_bounds_.center_y[first], &light_bounds_.center_z[first], &light_bounds_.extent_x[first],
+					&light_bounds_.extent_y[first], &light_bounds_.extent_z[first], last - first, frustum);
+				for (uint32_t i = first; i < last; ++ i)
+				{
+					if (light_overlaps[i - first] != BO_No)
+					{
+						ids.push_back(sorted_ids_[i]);
+					}
+				}
+			}
+		}
+
+		std::sort(ids.begin(), ids.end());
+	}
+
+	void LightIndex::Query(ArrayRef<Frustum const *> frusta, std::vector<std::vector<uint32_t>>& ids) const
+	{
+		ids.resize(frusta.size());
+		for (size_t k = 0; k < frusta.size(); ++ k)
+		{
+			if (frusta[k])
+			{
+				this->Query(*frusta[k], ids[k]);
+			}
+			else
+			{
+				ids[k] = ids_;
+				std::sort(ids[k].begin(), ids[k].end());
+			}
+		}
+	}
+}
@@ -0,0 +1,218 @@
+/**
+ * @file OcclusionBuffer.cpp
+ * @author Minmin Gong
+ *
+ * @section DESCRIPTION
+ *
+ * This source file is part of KlayGE
+ * For the latest info, see http://www.klayge.org
+ *
+ * @section LICENSE
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published
+ * by the Free Software Foundation; either version 2 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program; if not, write to the Free Software
+ * Foundation, Inc., 59 Temple Place, Suite 330, Boston, MA 02111-1307 USA
+ *
+ * You may alternatively use this source under the terms of
+ * the KlayGE Proprietary License (KPL). You can obtained such a license
+ * from http://www.klayge.org/licensing/.
+ */
+
+
+#include <KlayGE/KlayGE.hpp>
+#include <KFL/Math.hpp>
+#include <KFL/SIMDMath.hpp>
+
+#include <algorithm>
+#include <boost/assert.hpp>
+
+#include <KlayGE/OcclusionBuffer.hpp>
+
+namespace
+{
+	// Bounds are tested on the first level where they cover at most this many texels in each direction
+	uint32_t const MAX_TEST_TEXELS = 4;
+}
+
+namespace KlayGE
+{
+	OcclusionBuffer::OcclusionBuffer(uint32_t width, uint32_t height)
+	{
+		this->Resize(width, height);
+	}
+
+	void OcclusionBuffer::Resize(uint32_t width, uint32_t height)
+	{
+		BOOST_ASSERT((width > 0) && (height > 0));
+
+		width_ = width;
+		height_ = height;
+		pitch_ = (width + 3) & ~3U;
+		depth_.assign(pitch_ * height_, 1.0f);
+
+		hiz_.clear();
+		uint32_t w = width;
+		uint32_t h = height;
+		for (;;)
+		{
+			hiz_level_t level;
+			level.width = w;
+			level.height = h;
+			level.max_depth.assign(w * h, 1.0f);
+			hiz_.push_back(std::move(level));
+
+			if ((1 == w) && (1 == h))
+			{
+				break;
+			}
+			w = std::max((w + 1) / 2, 1U);
+			h = std::max((h + 1) / 2, 1U);
+		}
+	}
+
+	void OcclusionBuffer::Clear()
+	{
+		std::fill(depth_.begin(), depth_.end(), 1.0f);
+	}
+
+	void OcclusionBuffer::RasterizeTriangles(float3 const * positions, uint32_t num_vertices, uint16_t const * indices,
+		uint32_t num_indices, float4x4 const & mvp)
+	{
+		float const half_width = width_ * 0.5f;
+		float const half_height = height_ * 0.5f;
+
+		screen_positions_.resize(num_vertices);
+		clipped_.resize(num_vertices);
+		for (uint32_t i = 0; i < num_vertices; ++ i)
+		{
+			float4 const pos = MathLib::transform(float4(positions[i].x(), positions[i].y(), positions[i].z(), 1), mvp);
+			clipped_[i] = (pos.w() <= 0) || (pos.z() < 0);
+			if (!clipped_[i])
+			{
+				float const inv_w = 1 / pos.w();
+				screen_positions_[i] = float3((pos.x() * inv_w + 1) * half_width, (1 - pos.y() * inv_w) * half_height,
+					pos.z() * inv_w);
+			}
+		}
+
+		for (uint32_t i = 0; i + 3 <= num_indices; i += 3)
+		{
+			uint16_t const i0 = indices[i + 0];
+			uint16_t const i1 = indices[i + 1];
+			uint16_t const i2 = indices[i + 2];
+			BOOST_ASSERT((i0 < num_vertices) && (i1 < num_vertices) && (i2 < num_vertices));
+
+			if (!clipped_[i0] && !clipped_[i1] && !clipped_[i2])
+			{
+				SIMDMathLib::RasterizeTriangleDepth(&depth_[0], width_, height_, pitch_,
+					screen_positions_[i0], screen_positions_[i1], screen_positions_[i2]);
+			}
+		}
+	}
+
+	void OcclusionBuffer::BuildHiZ()
+	{
+		for (uint32_t y = 0; y < height_; ++ y)
+		{
+			std::copy(depth_.begin() + y * pitch_, depth_.begin() + y * pitch_ + width_,
+				hiz_[0].max_depth.begin() + y * width_);
+		}
+
+		for (size_t l = 1; l < hiz_.size(); ++ l)
+		{
+			hiz_level_t const & src = hiz_[l - 1];
+			hiz_level_t& dst = hiz_[l];
+			for (uint32_t y = 0; y < dst.height; ++ y)
+			{
+				uint32_t const y0 = y * 2;
+				uint32_t const y1 = std::min(y0 + 1, src.height - 1);
+				for (uint32_t x = 0; x < dst.width; ++ x)
+				{
+					uint32_t const x0 = x * 2;
+					uint32_t const x1 = std::min(x0 + 1, src.width - 1);
+					dst.max_depth[y * dst.width + x] = std::max(
+						std::max(src.max_depth[y0 * src.width + x0], src.max_depth[y0 * src.width + x1]),
+						std::max(src.max_depth[y1 * src.width + x0], src.max_depth[y1 * src.width + x1]));
+				}
+			}
+		}
+	}
+
+	bool OcclusionBuffer::Occluded(AABBox const & aabb, float4x4 const & view_proj) const
+	{
+		float const half_width = width_ * 0.5f;
+		float const half_height = height_ * 0.5f;
+
+		float min_x = +1e10f;
+		float max_x = -1e10f;
+		float min_y = +1e10f;
+		float max_y = -1e10f;
+		float min_z = +1e10f;
+		for (int i = 0; i < 8; ++ i)
+		{
+			float3 const corner = aabb.Corner(i);
+			float4 const pos = MathLib::transform(float4(corner.x(), corner.y(), corner.z(), 1), view_proj);
+			if ((pos.w() <= 0) || (pos.z() < 0))
+			{
+				return false;
+			}
+
+			float const inv_w = 1 / pos.w();
+			float const x = (pos.x() * inv_w + 1) * half_width;
+			float const y = (1 - pos.y() * inv_w) * half_height;
+			min_x = std::min(min_x, x);
+			max_x = std::max(max_x, x);
+			min_y = std::min(min_y, y);
+			max_y = std::max(max_y, y);
+			min_z = std::min(min_z, pos.z() * inv_w);
+		}
+
+		if ((max_x < 0) || (max_y < 0) || (min_x >= width_) || (min_y >= height_))
+		{
+			return false;
+		}
+
+		// Every pixel the rectangle touches, a superset of the ones the bound covers
+		uint32_t const x0 = static_cast<uint32_t>(std::max(min_x, 0.0f));
+		// Clamped as floats, a bound far off the screen would overflow the cast
+		uint32_t const x1 = static_cast<uint32_t>(std::min(max_x, static_cast<float>(width_ - 1)));
+		uint32_t const y0 = static_cast<uint32_t>(std::max(min_y, 0.0f));
+		uint32_t const y1 = static_cast<uint32_t>(std::min(max_y, static_cast<float>(height_ - 1)));
+
+		uint32_t l = 0;
+		while ((l + 1 < hiz_.size())
+			&& (((x1 >> l) - (x0 >> l) >= MAX_TEST_TEXELS) || ((y1 >> l) - (y0 >> l) >= MAX_TEST_TEXELS)))
+		{
+			++ l;
+		}
+
+		hiz_level_t const & level = hiz_[l];
+		for (uint32_t y = y0 >> l; y <= (y1 >> l); ++ y)
+		{
+			for (uint32_t x = x0 >> l; x <= (x1 >> l); ++ x)
+			{
+				if (level.max_depth[y * level.width + x] >= min_z)
+				{
+					return false;
+				}
+			}
+		}
+		return true;
+	}
+
+	float OcclusionBuffer::Depth(uint32_t x, uint32_t y) const
+	{
+		BOOST_ASSERT((x < width_) && (y < height_));
+		return depth_[y * pitch_ + x];
+	}
+}
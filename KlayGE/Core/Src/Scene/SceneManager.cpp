@@ -47,6 +47,7 @@
 #include <KlayGE/RenderFactory.hpp>
 #include <KlayGE/Renderable.hpp>
 #include <KlayGE/RenderEffect.hpp>
+#include <KlayGE/RenderLayout.hpp>
 #include <KlayGE/Light.hpp>
 #include <KlayGE/SceneObject.hpp>
 #include <KlayGE/Input.hpp>
@@ -54,24 +55,66 @@
 #include <KlayGE/FrameBuffer.hpp>
 #include <KlayGE/DeferredRenderingLayer.hpp>
 #include <KFL/Hash.hpp>
+#include <KFL/TaskScheduler.hpp>
+#include <KFL/SIMDMath.hpp>
+#include <KFL/RadixSort.hpp>
+#include <KlayGE/SceneObjectStore.hpp>
 
 #include <map>
 #include <algorithm>
 
 #include <KlayGE/SceneManager.hpp>
 
+namespace
+{
+	// Objects per task of the parallel culling
+	size_t const CULLING_GRAIN = 256;
+	// Bounds gathered on the stack for each call of the batch frustum test
+	size_t const CULLING_BATCH = 64;
+	// Default size of the occlusion buffer
+	uint32_t const OCCLUSION_BUFFER_WIDTH = 256;
+	uint32_t const OCCLUSION_BUFFER_HEIGHT = 128;
+	// Objects per task of the sub thread updates. They can be heavy, particle systems for example.
+	size_t const SUB_THREAD_UPDATE_GRAIN = 4;
+	// Cached marks of a view are dropped after this many frames without a flush of the view
+	uint32_t const VISIBLE_MARKS_MAX_AGE = 8;
+	// Cached marks are patched when at most 1 / RECLIP_DIVISOR of the objects changed, and culled again otherwise
+	size_t const RECLIP_DIVISOR = 4;
+	// Largest quantized depth in a render queue key
+	uint32_t const RENDER_DEPTH_KEY_MAX = 0xFFFFFF;
+
+	// The world space center of an instance. The cached bound is used when the scene manager keeps it up to date.
+	KlayGE::float3 InstanceCenterWS(KlayGE::Renderable const & renderable, KlayGE::SceneObject const & so)
+	{
+		using namespace KlayGE;
+
+		uint32_t const attr = so.Attrib();
+		if (!(attr & SceneObject::SOA_Overlay) && (attr & (SceneObject::SOA_Cullable | SceneObject::SOA_Moveable)))
+		{
+			return so.PosBoundWS().Center();
+		}
+		else
+		{
+			return MathLib::transform_coord(renderable.PosBound().Center(), so.AbsModelMatrix());
+		}
+	}
+}
+
 namespace KlayGE
 {
 	// 캯
 	/////////////////////////////////////////////////////////////////////////////////
 	SceneManager::SceneManager()
 		: frustum_(nullptr),
+			transform_generation_(0), scene_generation_(0), static_generation_(0), caster_generation_(0),
 			small_obj_threshold_(0),
 			update_elapse_(1.0f / 60),
+			flush_frame_(0),
 			num_objects_rendered_(0), num_renderables_rendered_(0),
 			num_primitives_rendered_(0), num_vertices_rendered_(0),
-			num_draw_calls_(0), num_dispatch_calls_(0),
-			quit_(false), deferred_mode_(false)
+			num_draw_calls_(0), num_dispatch_calls_(0), num_objects_occluded_(0),
+			occlusion_culling_(false), occlusion_buffer_(OCCLUSION_BUFFER_WIDTH, OCCLUSION_BUFFER_HEIGHT),
+			sub_thread_objs_new_(false), quit_(false), deferred_mode_(false)
 	{
 	}
 
@@ -107,6 +150,54 @@ namespace KlayGE
 		update_elapse_ = elapse;
 	}
 
+	void SceneManager::OcclusionCulling(bool occlusion)
+	{
+		occlusion_culling_ = occlusion;
+		++ scene_generation_;
+	}
+
+	bool SceneManager::OcclusionCulling() const
+	{
+		return occlusion_culling_;
+	}
+
+	void SceneManager::OcclusionBufferSize(uint32_t width, uint32_t height)
+	{
+		std::lock_guard<std::mutex> lock(update_mutex_);
+		occlusion_buffer_.Resize(width, height);
+		++ scene_generation_;
+	}
+
+	void SceneManager::AddOccluder(SceneObjectPtr const & obj, std::vector<float3> const & positions,
+		std::vector<uint16_t> const & indices)
+	{
+		BOOST_ASSERT(indices.size() % 3 == 0);
+
+		std::lock_guard<std::mutex> lock(update_mutex_);
+		occluder_t occluder;
+		occluder.obj = obj.get();
+		occluder.positions = positions;
+		occluder.indices = indices;
+		occluders_.push_back(std::move(occluder));
+		++ scene_generation_;
+	}
+
+	void SceneManager::DelOccluder(SceneObjectPtr const & obj)
+	{
+		std::lock_guard<std::mutex> lock(update_mutex_);
+		this->DelOccluders(obj.get());
+		++ scene_generation_;
+	}
+
+	void SceneManager::DelOccluders(SceneObject const * obj)
+	{
+		occluders_.erase(std::remove_if(occluders_.begin(), occluders_.end(),
+			[obj](occluder_t const & occluder)
+			{
+				return occluder.obj == obj;
+			}), occluders_.end());
+	}
+
 	// ü
 	/////////////////////////////////////////////////////////////////////////////////
 	void SceneManager::ClipScene()
@@ -114,64 +205,385 @@ namespace KlayGE
 		App3DFramework& app = Context::Instance().AppInstance();
 		Camera& camera = app.ActiveCamera();
 
-		float4x4 view_proj = camera.ViewProjMatrix();
-		auto drl = Context::Instance().DeferredRenderingLayerInstance();
-		if (drl)
+		float4x4 const view_proj = this->ClipViewProj(camera);
+		float3 const & view_dir = camera.ForwardVec();
+		float3 const & eye_pos = camera.EyePos();
+		bool const omni = camera.OmniDirectionalMode();
+
+		this->PropagateTransforms();
+
+		auto const & objs = obj_store_.Objects();
+		auto const & parents = obj_store_.Parents();
+		auto const & attribs = obj_store_.Attribs();
+		auto const & aabbs_ws = obj_store_.PosBoundsWS();
+		auto& marks = obj_store_.VisibleMarks();
+		size_t const num_slots = obj_store_.NumSlots();
+		size_t const num_chunks = (num_slots + CULLING_GRAIN - 1) / CULLING_GRAIN;
+		Context::Instance().TaskScheduler().parallel_for(static_cast<size_t>(0), num_chunks, static_cast<size_t>(1),
+			[&, this](size_t chunk)
+			{
+				uint32_t batch_handles[CULLING_GRAIN];
+				AABBox const * batch_aabbs[CULLING_GRAIN];
+				BoundOverlap batch_overlaps[CULLING_GRAIN];
+				size_t num_batch = 0;
+
+				size_t const first = chunk * CULLING_GRAIN;
+				size_t const last = std::min(first + CULLING_GRAIN, num_slots);
+				for (size_t i = first; i < last; ++ i)
+				{
+					if (objs[i] && !parents[i])
+					{
+						uint32_t const attr = attribs[i];
+						BoundOverlap const visible = (attr & SceneObject::SOA_Invisible)
+							? BO_No : this->VisibleTestRoot(attr, aabbs_ws[i], view_dir, eye_pos, view_proj);
+						if (!omni && (BO_Yes == visible) && (attr & SceneObject::SOA_Cullable))
+						{
+							batch_handles[num_batch] = static_cast<uint32_t>(i);
+							batch_aabbs[num_batch] = &aabbs_ws[i];
+							++ num_batch;
+						}
+						else
+						{
+							marks[i] = visible;
+						}
+					}
+				}
+
+				this->FrustumTestBounds(batch_overlaps, batch_aabbs, num_batch);
+				for (size_t i = 0; i < num_batch; ++ i)
+				{
+					marks[batch_handles[i]] = batch_overlaps[i];
+				}
+			});
+
+		this->ClipChildObjects(view_dir, eye_pos, view_proj, omni);
+	}
+
+	void SceneManager::ClipFrusta(ArrayRef<Frustum const *> frusta, std::vector<std::vector<uint32_t>>& visible_bits)
+	{
+		std::lock_guard<std::mutex> lock(update_mutex_);
+
+		std::vector<std::vector<BoundOverlap>> marks;
+		this->ClipViews(frusta, ArrayRef<Camera const *>(), marks);
+
+		visible_bits.resize(frusta.size());
+		for (size_t k = 0; k < frusta.size(); ++ k)
 		{
-			int32_t cas_index = drl->CurrCascadeIndex();
-			if (cas_index >= 0)
+			auto& bits = visible_bits[k];
+			bits.assign((scene_objs_.size() + 31) / 32, 0);
+			for (size_t i = 0; i < scene_objs_.size(); ++ i)
 			{
-				view_proj *= drl->GetCascadedShadowLayer()->CascadeCropMatrix(cas_index);
+				if (marks[k][scene_objs_[i]->store_handle_] != BO_No)
+				{
+					bits[i / 32] |= (1UL << (i & 31));
+				}
 			}
 		}
+	}
 
-		for (auto const & obj : scene_objs_)
+	void SceneManager::ClipCameras(ArrayRef<Camera const *> cameras)
+	{
+		std::lock_guard<std::mutex> lock(update_mutex_);
+
+		this->PropagateTransforms();
+
+		// Views whose cached marks are still right don't need the walk. Re-clipping them goes through frustum_,
+		//  which is set back afterwards, the queries between flushes are still against the view flushed last.
+		Frustum const * const flushed_frustum = frustum_;
+		std::vector<Camera const *> clip_cameras;
+		std::vector<Frustum const *> frusta;
+		for (auto camera : cameras)
 		{
-			auto so = obj.get();
-			BoundOverlap visible;
-			uint32_t const attr = so->Attrib();
-			if (so->Visible())
+			frustum_ = camera->OmniDirectionalMode() ? nullptr : &camera->ViewFrustum();
+			auto iter = visible_marks_map_.find(this->VisibleMarksSeed(*camera, -1));
+			if ((iter == visible_marks_map_.end()) || !this->ReclipChangedObjects(iter->second, *camera,
+				camera->ViewProjMatrix()))
+			{
+				clip_cameras.push_back(camera);
+				frusta.push_back(camera->OmniDirectionalMode() ? nullptr : &camera->ViewFrustum());
+			}
+		}
+		frustum_ = flushed_frustum;
+		if (clip_cameras.empty())
+		{
+			return;
+		}
+
+		std::vector<std::vector<BoundOverlap>> marks;
+		this->ClipViews(frusta, clip_cameras, marks);
+
+		for (size_t k = 0; k < clip_cameras.size(); ++ k)
+		{
+			for (auto const & obj : scene_objs_)
+			{
+				obj->VisibleMark(marks[k][obj->store_handle_]);
+			}
+
+			auto& vm = visible_marks_map_[this->VisibleMarksSeed(*clip_cameras[k], -1)];
+			this->StoreVisibleMarks(vm, clip_cameras[k]->ViewProjMatrix(), false);
+		}
+	}
+
+	void SceneManager::ClipViews(ArrayRef<Frustum const *> frusta, ArrayRef<Camera const *> cameras,
+		std::vector<std::vector<BoundOverlap>>& marks)
+	{
+		BOOST_ASSERT(cameras.empty() || (cameras.size() == frusta.size()));
+
+		this->PropagateTransforms();
+
+		size_t const num_views = frusta.size();
+		bool const small_obj_test = !cameras.empty() && (small_obj_threshold_ > 0);
+		std::vector<float4x4> view_projs(cameras.size());
+		for (size_t k = 0; k < cameras.size(); ++ k)
+		{
+			view_projs[k] = cameras[k]->ViewProjMatrix();
+		}
+
+		auto const & objs = obj_store_.Objects();
+		auto const & parents = obj_store_.Parents();
+		auto const & attribs = obj_store_.Attribs();
+		auto const & aabbs_ws = obj_store_.PosBoundsWS();
+		size_t const num_slots = obj_store_.NumSlots();
+		marks.resize(num_views);
+		for (auto& view_marks : marks)
+		{
+			view_marks.assign(num_slots, BO_No);
+		}
+
+		// The bounds of each batch are gathered once and tested against every frustum
+		size_t const num_chunks = (num_slots + CULLING_GRAIN - 1) / CULLING_GRAIN;
+		Context::Instance().TaskScheduler().parallel_for(static_cast<size_t>(0), num_chunks, static_cast<size_t>(1),
+			[&, this](size_t chunk)
 			{
-				visible = this->VisibleTestFromParent(so, camera.ForwardVec(), camera.EyePos(), view_proj);
-				if (BO_Partial == visible)
+				uint32_t batch_handles[CULLING_BATCH];
+				float center_x[CULLING_BATCH], center_y[CULLING_BATCH], center_z[CULLING_BATCH];
+				float extent_x[CULLING_BATCH], extent_y[CULLING_BATCH], extent_z[CULLING_BATCH];
+				BoundOverlap overlaps[CULLING_BATCH];
+				size_t num_batch = 0;
+
+				auto test_batch = [&]()
 				{
-					if (attr & SceneObject::SOA_Moveable)
+					for (size_t k = 0; k < num_views; ++ k)
 					{
-						so->UpdateAbsModelMatrix();
+						if (frusta[k])
+						{
+							SIMDMathLib::IntersectAABBFrustum(overlaps, center_x, center_y, center_z,
+								extent_x, extent_y, extent_z, num_batch, *frusta[k]);
+						}
+						else
+						{
+							std::fill(overlaps, overlaps + num_batch, BO_Yes);
+						}
+
+						for (size_t b = 0; b < num_batch; ++ b)
+						{
+							uint32_t const handle = batch_handles[b];
+							BoundOverlap visible = overlaps[b];
+							if (small_obj_test && (visible != BO_No))
+							{
+								Camera const & camera = *cameras[k];
+								if (BO_No == this->VisibleTestRoot(attribs[handle], aabbs_ws[handle],
+									camera.ForwardVec(), camera.EyePos(), view_projs[k]))
+								{
+									visible = BO_No;
+								}
+							}
+							marks[k][handle] = visible;
+						}
 					}
+					num_batch = 0;
+				};
 
-					if (attr & SceneObject::SOA_Cullable)
+				size_t const first = chunk * CULLING_GRAIN;
+				size_t const last = std::min(first + CULLING_GRAIN, num_slots);
+				for (size_t i = first; i < last; ++ i)
+				{
+					uint32_t const attr = attribs[i];
+					if (objs[i] && !parents[i] && !(attr & SceneObject::SOA_Invisible))
 					{
-						if (small_obj_threshold_ > 0)
+						if (attr & SceneObject::SOA_Cullable)
 						{
-							visible = ((MathLib::ortho_area(camera.ForwardVec(), so->PosBoundWS()) > small_obj_threshold_)
-								&& (MathLib::perspective_area(camera.EyePos(), view_proj, so->PosBoundWS()) > small_obj_threshold_))
-								? BO_Yes : BO_No;
+							float3 const center = aabbs_ws[i].Center();
+							float3 const extent = aabbs_ws[i].HalfSize();
+							batch_handles[num_batch] = static_cast<uint32_t>(i);
+							center_x[num_batch] = center.x();
+							center_y[num_batch] = center.y();
+							center_z[num_batch] = center.z();
+							extent_x[num_batch] = extent.x();
+							extent_y[num_batch] = extent.y();
+							extent_z[num_batch] = extent.z();
+							++ num_batch;
+							if (CULLING_BATCH == num_batch)
+							{
+								test_batch();
+							}
 						}
 						else
 						{
-							visible = BO_Yes;
+							for (size_t k = 0; k < num_views; ++ k)
+							{
+								marks[k][i] = BO_Yes;
+							}
 						}
 					}
-					else
+				}
+				test_batch();
+			});
+
+		// Children in the order they were added, after their parents, as in ClipChildObjects
+		for (auto const & obj : scene_objs_)
+		{
+			SceneObject const * so = obj.get();
+			SceneObject const * parent = so->Parent();
+			if (!parent || !so->Visible())
+			{
+				continue;
+			}
+
+			uint32_t const handle = so->store_handle_;
+			uint32_t const attr = attribs[handle];
+			for (size_t k = 0; k < num_views; ++ k)
+			{
+				BoundOverlap visible = parent->store_ ? marks[k][parent->store_handle_] : BO_No;
+				if ((visible != BO_No) && (attr & SceneObject::SOA_Cullable))
+				{
+					AABBox const & aabb_ws = aabbs_ws[handle];
+					if (small_obj_test && (BO_No == this->VisibleTestRoot(attr, aabb_ws, cameras[k]->ForwardVec(),
+						cameras[k]->EyePos(), view_projs[k])))
 					{
-						visible = BO_Yes;
+						visible = BO_No;
 					}
-
-					if (!camera.OmniDirectionalMode() && (attr & SceneObject::SOA_Cullable)
-						&& (BO_Yes == visible))
+					else if (frusta[k])
 					{
-						visible = this->AABBVisible(so->PosBoundWS());
+						visible = frusta[k]->Intersect(aabb_ws);
 					}
 				}
+				marks[k][handle] = visible;
 			}
-			else
+		}
+	}
+
+	size_t SceneManager::VisibleMarksSeed(Camera const & camera, int32_t cascade_index) const
+	{
+		size_t seed = 0;
+		HashCombine(seed, camera.OmniDirectionalMode());
+		HashCombine(seed, &camera);
+		// The cascades of a cascaded shadow map share the camera, but not the crop matrix
+		HashCombine(seed, cascade_index);
+		return seed;
+	}
+
+	void SceneManager::VisibleBits(std::vector<uint32_t>& bits) const
+	{
+		bits.assign((scene_objs_.size() + 31) / 32, 0);
+		for (size_t i = 0; i < scene_objs_.size(); ++ i)
+		{
+			if (scene_objs_[i]->Visible())
 			{
-				visible = BO_No;
+				bits[i / 32] |= (1UL << (i & 31));
+			}
+		}
+	}
+
+	bool SceneManager::ReclipChangedObjects(visible_marks_t& vm, Camera const & camera, float4x4 const & view_proj)
+	{
+		if ((vm.scene_generation != scene_generation_) || (vm.marks.size() != scene_objs_.size())
+			|| (vm.view_proj != view_proj) || (vm.small_obj_threshold != small_obj_threshold_))
+		{
+			return false;
+		}
+
+		std::vector<uint32_t> visible_bits;
+		this->VisibleBits(visible_bits);
+
+		// Children come after their parents in scene_objs_, so a parent is flagged before its children are checked
+		std::vector<uint8_t> changed(obj_store_.NumSlots(), 0);
+		size_t num_changed = 0;
+		if ((vm.transform_generation != transform_generation_) || (visible_bits != vm.visible_bits))
+		{
+			for (size_t i = 0; i < scene_objs_.size(); ++ i)
+			{
+				auto so = scene_objs_[i].get();
+				bool obj_changed = (transform_stamps_[so->store_handle_] > vm.transform_generation)
+					|| ((visible_bits[i / 32] ^ vm.visible_bits[i / 32]) & (1UL << (i & 31)));
+				auto parent = so->Parent();
+				if (!obj_changed && parent && parent->store_)
+				{
+					obj_changed = (changed[parent->store_handle_] != 0);
+				}
+				if (obj_changed)
+				{
+					changed[so->store_handle_] = 1;
+					++ num_changed;
+				}
+			}
+		}
+
+		// Occlusion depends on every object in front, so it's all or nothing
+		if ((num_changed > 0) && (vm.occlusion_culled || (num_changed * RECLIP_DIVISOR > scene_objs_.size())))
+		{
+			return false;
+		}
+
+		for (size_t i = 0; i < scene_objs_.size(); ++ i)
+		{
+			scene_objs_[i]->VisibleMark(vm.marks[i]);
+		}
+
+		if (num_changed > 0)
+		{
+			float3 const & view_dir = camera.ForwardVec();
+			float3 const & eye_pos = camera.EyePos();
+			bool const omni = camera.OmniDirectionalMode();
+			for (size_t i = 0; i < scene_objs_.size(); ++ i)
+			{
+				auto so = scene_objs_[i].get();
+				if (changed[so->store_handle_])
+				{
+					BoundOverlap visible;
+					if (so->Parent())
+					{
+						visible = this->ClipChildObject(so, view_dir, eye_pos, view_proj, omni);
+					}
+					else
+					{
+						uint32_t const attr = so->Attrib();
+						visible = (attr & SceneObject::SOA_Invisible)
+							? BO_No : this->VisibleTestRoot(attr, so->PosBoundWS(), view_dir, eye_pos, view_proj);
+						if (!omni && (BO_Yes == visible) && (attr & SceneObject::SOA_Cullable))
+						{
+							// Not the virtual one. The structure of a plugin keeps the state of its last ClipScene,
+							//  which can be for another view.
+							visible = this->SceneManager::AABBVisible(so->PosBoundWS());
+						}
+					}
+					so->VisibleMark(visible);
+					vm.marks[i] = visible;
+				}
 			}
 
-			so->VisibleMark(visible);
+			vm.visible_bits.swap(visible_bits);
 		}
+		vm.transform_generation = transform_generation_;
+		vm.last_frame = flush_frame_;
+
+		return true;
+	}
+
+	void SceneManager::StoreVisibleMarks(visible_marks_t& vm, float4x4 const & view_proj, bool occlusion_culled)
+	{
+		vm.marks.resize(scene_objs_.size());
+		for (size_t i = 0; i < scene_objs_.size(); ++ i)
+		{
+			vm.marks[i] = scene_objs_[i]->VisibleMark();
+		}
+		this->VisibleBits(vm.visible_bits);
+		vm.view_proj = view_proj;
+		vm.scene_generation = scene_generation_;
+		vm.transform_generation = transform_generation_;
+		vm.last_frame = flush_frame_;
+		vm.small_obj_threshold = small_obj_threshold_;
+		vm.occlusion_culled = occlusion_culled;
 	}
 
 	void SceneManager::AddCamera(CameraPtr const & camera)
@@ -238,6 +650,16 @@ namespace KlayGE
 		return lights_[index];
 	}
 
+	LightIndex& SceneManager::GetLightIndex()
+	{
+		return light_index_;
+	}
+
+	LightIndex const & SceneManager::GetLightIndex() const
+	{
+		return light_index_;
+	}
+
 	// Ⱦ
 	/////////////////////////////////////////////////////////////////////////////////
 	void SceneManager::AddSceneObject(SceneObjectPtr const & obj)
@@ -260,6 +682,11 @@ namespace KlayGE
 		}
 		else
 		{
+			if (!obj->store_)
+			{
+				obj->AttachToStore(obj_store_);
+			}
+
 			if ((attr & SceneObject::SOA_Cullable)
 				&& !(attr & SceneObject::SOA_Moveable))
 			{
@@ -268,6 +695,15 @@ namespace KlayGE
 
 			scene_objs_.push_back(obj);
 			this->OnAddSceneObject(obj);
+			++ scene_generation_;
+			if (!(attr & (SceneObject::SOA_Moveable | SceneObject::SOA_NotCastShadow)))
+			{
+				++ static_generation_;
+			}
+			if (!(attr & SceneObject::SOA_NotCastShadow))
+			{
+				++ caster_generation_;
+			}
 		}
 	}
 
@@ -299,8 +735,26 @@ namespace KlayGE
 
 	std::vector<SceneObjectPtr>::iterator SceneManager::DelSceneObjectLocked(std::vector<SceneObjectPtr>::iterator iter)
 	{
+		SceneObjectPtr obj = *iter;
 		this->OnDelSceneObject(iter);
-		return scene_objs_.erase(iter);
+		auto ret = scene_objs_.erase(iter);
+		++ scene_generation_;
+		if (!(obj->Attrib() & (SceneObject::SOA_Moveable | SceneObject::SOA_NotCastShadow)))
+		{
+			++ static_generation_;
+		}
+		if (!(obj->Attrib() & SceneObject::SOA_NotCastShadow))
+		{
+			++ caster_generation_;
+		}
+
+		// An object can be added more than once, and shares the slot until the last one is gone
+		if (obj->store_ && (std::find(scene_objs_.begin(), scene_objs_.end(), obj) == scene_objs_.end()))
+		{
+			obj->DetachFromStore();
+			this->DelOccluders(obj.get());
+		}
+		return ret;
 	}
 
 	// Ⱦ
@@ -357,20 +811,14 @@ namespace KlayGE
 			{
 				RenderTechnique const * obj_tech = obj->GetRenderTechnique();
 				BOOST_ASSERT(obj_tech);
-				bool found = false;
-				for (auto& items : render_queue_)
-				{
-					if (items.first == obj_tech)
-					{
-						items.second.push_back(obj);
-						found = true;
-						break;
-					}
-				}
-				if (!found)
-				{
-					render_queue_.emplace_back(obj_tech, std::vector<Renderable*>(1, obj));
-				}
+
+				// The depth is filled in by Flush, after all the instances are added
+				uint64_t const weight = static_cast<uint64_t>(MathLib::clamp(obj_tech->Weight(), 0.0f, 65535.0f));
+				uint64_t const tech_id = render_tech_ids_.emplace(obj_tech,
+					static_cast<uint32_t>(render_tech_ids_.size())).first->second;
+				uint64_t const mtl_id = render_mtl_ids_.emplace(obj->Material().get(),
+					static_cast<uint32_t>(render_mtl_ids_.size())).first->second;
+				render_queue_.emplace_back((weight << 48) | ((tech_id & 0xFFFF) << 32) | ((mtl_id & 0xFF) << 24), obj);
 			}
 		}
 	}
@@ -451,8 +899,19 @@ namespace KlayGE
 	void SceneManager::ClearObject()
 	{
 		std::lock_guard<std::mutex> lock(update_mutex_);
+		for (auto const & obj : scene_objs_)
+		{
+			if (obj->store_)
+			{
+				obj->DetachFromStore();
+			}
+		}
 		scene_objs_.resize(0);
 		overlay_scene_objs_.resize(0);
+		occluders_.clear();
+		++ scene_generation_;
+		++ static_generation_;
+		++ caster_generation_;
 	}
 
 	// ³
@@ -468,6 +927,8 @@ namespace KlayGE
 		RenderEngine& re = Context::Instance().RenderFactoryInstance().RenderEngineInstance();
 		re.BeginFrame();
 
+		this->ApplySubThreadResults();
+
 		this->FlushScene();
 
 		if (!update_thread_ && !quit_)
@@ -488,6 +949,8 @@ namespace KlayGE
 				}
 			}
 
+			this->PublishSubThreadObjects();
+
 			overlay_scene_objs_.clear();
 			for (auto iter = lights_.begin(); iter != lights_.end();)
 			{
@@ -505,6 +968,18 @@ namespace KlayGE
 			{
 				scene_obj->OnAttachRenderable(true);
 				this->OnAddSceneObject(scene_obj);
+				if (!(scene_obj->Attrib() & (SceneObject::SOA_Moveable | SceneObject::SOA_NotCastShadow)))
+				{
+					++ static_generation_;
+				}
+				if (!(scene_obj->Attrib() & SceneObject::SOA_NotCastShadow))
+				{
+					++ caster_generation_;
+				}
+			}
+			if (!added_scene_objs.empty())
+			{
+				++ scene_generation_;
 			}
 		}
 
@@ -549,6 +1024,7 @@ namespace KlayGE
 		num_renderables_rendered_ = 0;
 		num_primitives_rendered_ = 0;
 		num_vertices_rendered_ = 0;
+		num_objects_occluded_ = 0;
 
 		Camera& camera = app.ActiveCamera();
 		auto const & scene_objs = (urt & App3DFramework::URV_Overlay) ? overlay_scene_objs_ : scene_objs_;
@@ -557,42 +1033,28 @@ namespace KlayGE
 		{
 			scene_obj->VisibleMark(BO_No);
 		}
-		if (urt & App3DFramework::URV_NeedFlush)
+		// Overlay objects are marked by their visibility below, culling them would be lost
+		if ((urt & App3DFramework::URV_NeedFlush) && !(urt & App3DFramework::URV_Overlay))
 		{
 			frustum_ = &camera.ViewFrustum();
 
-			std::vector<uint32_t> visible_list((scene_objs.size() + 31) / 32, 0);
-			for (size_t i = 0; i < scene_objs.size(); ++ i)
-			{
-				if (scene_objs[i]->Visible())
-				{
-					visible_list[i / 32] |= (1UL << (i & 31));
-				}
-			}
-			size_t seed = 0;
-			HashRange(seed, visible_list.begin(), visible_list.end());
-			HashCombine(seed, camera.OmniDirectionalMode());
-			HashCombine(seed, &camera);
+			// The objects have to be at their places of this frame before the cached marks are checked
+			this->PropagateTransforms();
 
+			auto drl = Context::Instance().DeferredRenderingLayerInstance();
+			float4x4 const view_proj = this->ClipViewProj(camera);
+			size_t const seed = this->VisibleMarksSeed(camera, drl ? drl->CurrCascadeIndex() : -1);
 			auto vmiter = visible_marks_map_.find(seed);
-			if (vmiter == visible_marks_map_.end())
+			if ((vmiter == visible_marks_map_.end()) || !this->ReclipChangedObjects(vmiter->second, camera, view_proj))
 			{
 				this->ClipScene();
-
-				auto visible_marks = MakeUniquePtr<std::vector<BoundOverlap>>(scene_objs.size());
-				for (size_t i = 0; i < scene_objs.size(); ++ i)
+				bool const occlusion_culled = occlusion_culling_ && !occluders_.empty() && !camera.OmniDirectionalMode();
+				if (occlusion_culled)
 				{
-					(*visible_marks)[i] = scene_objs[i]->VisibleMark();
+					this->CullOccludedObjects();
 				}
 
-				visible_marks_map_.emplace(seed, std::move(visible_marks));
-			}
-			else
-			{
-				for (size_t i = 0; i < scene_objs.size(); ++ i)
-				{
-					scene_objs[i]->VisibleMark((*vmiter->second)[i]);
-				}
+				this->StoreVisibleMarks(visible_marks_map_[seed], view_proj, occlusion_culled);
 			}
 		}
 		if (urt & App3DFramework::URV_Overlay)
@@ -617,11 +1079,18 @@ namespace KlayGE
 			}
 		}
 
+		uint32_t const moveable_filter = urt & (App3DFramework::URV_StaticOnly | App3DFramework::URV_MoveableOnly);
 		for (auto const & obj : scene_objs)
 		{
 			auto so = obj.get();
 			if ((so->VisibleMark() != BO_No) && (0 == so->NumChildren()))
 			{
+				if (moveable_filter && !(moveable_filter & ((so->Attrib() & SceneObject::SOA_Moveable)
+					? App3DFramework::URV_MoveableOnly : App3DFramework::URV_StaticOnly)))
+				{
+					continue;
+				}
+
 				auto renderable = so->GetRenderable().get();
 				if (renderable)
 				{
@@ -635,61 +1104,47 @@ namespace KlayGE
 			}
 		}
 
-		std::sort(render_queue_.begin(), render_queue_.end(),
-			[](std::pair<RenderTechnique const *, std::vector<Renderable*>> const & lhs,
-				std::pair<RenderTechnique const *, std::vector<Renderable*>> const & rhs)
-			{
-				BOOST_ASSERT(lhs.first);
-				BOOST_ASSERT(rhs.first);
-
-				return lhs.first->Weight() < rhs.first->Weight();
-			});
+		this->BatchInstances();
 
 		float4 const & view_mat_z = camera.ViewMatrix().Col(2);
-		for (auto& items : render_queue_)
+		float const near_plane = camera.NearPlane();
+		float const depth_scale = RENDER_DEPTH_KEY_MAX / std::max(camera.FarPlane() - near_plane, 1e-6f);
+		for (auto& item : render_queue_)
 		{
-			if (!items.first->Transparent() && !items.first->HasDiscard() && (items.second.size() > 1))
+			Renderable const & renderable = *item.second;
+			uint32_t const num = renderable.NumInstances();
+			float min_depth = camera.FarPlane();
+			for (uint32_t i = 0; i < num; ++ i)
 			{
-				std::vector<std::pair<float, uint32_t>> min_depths(items.second.size());
-				for (size_t j = 0; j < min_depths.size(); ++ j)
-				{
-					Renderable const * renderable = items.second[j];
-					AABBox const & box = renderable->PosBound();
-					uint32_t const num = renderable->NumInstances();
-					float md = 1e10f;
-					for (uint32_t i = 0; i < num; ++ i)
-					{
-						float4x4 const & mat = renderable->GetInstance(i)->ModelMatrix();
-						float4 const zvec(MathLib::dot(mat.Row(0), view_mat_z),
-							MathLib::dot(mat.Row(1), view_mat_z), MathLib::dot(mat.Row(2), view_mat_z),
-							MathLib::dot(mat.Row(3), view_mat_z));
-						for (int k = 0; k < 8; ++ k)
-						{
-							float3 const v = box.Corner(k);
-							md = std::min(md, v.x() * zvec.x() + v.y() * zvec.y() + v.z() * zvec.z() + zvec.w());
-						}
-					}
-
-					min_depths[j] = std::make_pair(md, static_cast<uint32_t>(j));
-				}
-
-				std::sort(min_depths.begin(), min_depths.end());
-
-				std::vector<Renderable*> sorted_items(min_depths.size());
-				for (size_t j = 0; j < min_depths.size(); ++ j)
-				{
-					sorted_items[j] = items.second[min_depths[j].second];
-				}
-				items.second.swap(sorted_items);
+				float3 const center = InstanceCenterWS(renderable, *renderable.GetInstance(i));
+				min_depth = std::min(min_depth, center.x() * view_mat_z.x() + center.y() * view_mat_z.y()
+					+ center.z() * view_mat_z.z() + view_mat_z.w());
 			}
 
-			for (auto const & item : items.second)
+			uint32_t depth_key = static_cast<uint32_t>(MathLib::clamp((min_depth - near_plane) * depth_scale,
+				0.0f, static_cast<float>(RENDER_DEPTH_KEY_MAX)));
+			if (renderable.GetRenderTechnique()->Transparent())
 			{
-				item->Render();
+				depth_key = RENDER_DEPTH_KEY_MAX - depth_key;
 			}
-			num_renderables_rendered_ += static_cast<uint32_t>(items.second.size());
+			item.first |= depth_key;
+		}
+
+		render_queue_scratch_.resize(render_queue_.size());
+		RadixSort(render_queue_.data(), render_queue_scratch_.data(), render_queue_.size(),
+			[](std::pair<uint64_t, Renderable*> const & item)
+			{
+				return item.first;
+			});
+
+		for (auto const & item : render_queue_)
+		{
+			item.second->Render();
 		}
+		num_renderables_rendered_ += static_cast<uint32_t>(render_queue_.size());
 		render_queue_.resize(0);
+		render_tech_ids_.clear();
+		render_mtl_ids_.clear();
 
 		num_primitives_rendered_ += re.NumPrimitivesJustRendered();
 		num_vertices_rendered_ += re.NumVerticesJustRendered();
@@ -735,11 +1190,152 @@ namespace KlayGE
 		return num_dispatch_calls_;
 	}
 
+	uint32_t SceneManager::NumObjectsOccluded() const
+	{
+		return num_objects_occluded_;
+	}
+
+	uint32_t SceneManager::StaticGeneration() const
+	{
+		return static_generation_;
+	}
+
+	uint32_t SceneManager::CasterGeneration() const
+	{
+		return caster_generation_;
+	}
+
+	void SceneManager::BatchInstances()
+	{
+		bool merged = false;
+		for (size_t i = 0; i < render_queue_.size(); ++ i)
+		{
+			// Transparent renderables are drawn back to front, which a batch would break
+			Renderable* renderable = render_queue_[i].second;
+			if ((0 == renderable->NumInstances()) || renderable->GetInstance(0)->InstanceFormat().empty()
+				|| (renderable->NumLods() != 1) || renderable->SelectMode()
+				|| (renderable->GetRenderTechnique() && renderable->GetRenderTechnique()->Transparent()))
+			{
+				continue;
+			}
+
+			RenderLayout const & layout = renderable->GetRenderLayout();
+			size_t seed = 0;
+			HashCombine(seed, renderable->GetRenderEffect().get());
+			HashCombine(seed, renderable->GetRenderTechnique());
+			HashCombine(seed, renderable->Material().get());
+			HashCombine(seed, layout.GetIndexStream().get());
+			for (uint32_t s = 0; s < layout.NumVertexStreams(); ++ s)
+			{
+				HashCombine(seed, layout.GetVertexStream(s).get());
+			}
+
+			auto const iter = instance_batches_.emplace(seed, i);
+			if (!iter.second)
+			{
+				// A hash collision only costs a missed batch
+				Renderable* leader = render_queue_[iter.first->second].second;
+				if ((leader->GetRenderEffect() == renderable->GetRenderEffect())
+					&& (leader->GetRenderTechnique() == renderable->GetRenderTechnique())
+					&& (leader->Material() == renderable->Material())
+					&& (leader->GetInstance(0)->InstanceFormat() == renderable->GetInstance(0)->InstanceFormat())
+					&& leader->GetRenderLayout().SameGeometry(layout))
+				{
+					for (uint32_t j = 0; j < renderable->NumInstances(); ++ j)
+					{
+						leader->AddInstance(renderable->GetInstance(j));
+					}
+					renderable->ClearInstances();
+					render_queue_[i].second = nullptr;
+					merged = true;
+				}
+			}
+		}
+		instance_batches_.clear();
+
+		if (merged)
+		{
+			render_queue_.erase(std::remove_if(render_queue_.begin(), render_queue_.end(),
+				[](std::pair<uint64_t, Renderable*> const & item)
+				{
+					return nullptr == item.second;
+				}), render_queue_.end());
+		}
+	}
+
+	void SceneManager::CullOccludedObjects()
+	{
+		Camera& camera = Context::Instance().AppInstance().ActiveCamera();
+		float4x4 view_proj = camera.ViewProjMatrix();
+		auto drl = Context::Instance().DeferredRenderingLayerInstance();
+		if (drl)
+		{
+			int32_t cas_index = drl->CurrCascadeIndex();
+			if (cas_index >= 0)
+			{
+				view_proj *= drl->GetCascadedShadowLayer()->CascadeCropMatrix(cas_index);
+			}
+		}
+
+		occlusion_buffer_.Clear();
+		for (auto const & occluder : occluders_)
+		{
+			if (occluder.obj->Visible())
+			{
+				occlusion_buffer_.RasterizeTriangles(&occluder.positions[0],
+					static_cast<uint32_t>(occluder.positions.size()), &occluder.indices[0],
+					static_cast<uint32_t>(occluder.indices.size()), occluder.obj->AbsModelMatrix() * view_proj);
+			}
+		}
+		occlusion_buffer_.BuildHiZ();
+
+		// Only the objects passing the frustum culling are tested. The buffer is read only here, so the tests run in
+		//  parallel, and each range counts its own occluded objects.
+		auto const & objs = obj_store_.Objects();
+		auto const & attribs = obj_store_.Attribs();
+		auto const & aabbs_ws = obj_store_.PosBoundsWS();
+		auto& marks = obj_store_.VisibleMarks();
+		size_t const num_slots = obj_store_.NumSlots();
+		size_t const num_chunks = (num_slots + CULLING_GRAIN - 1) / CULLING_GRAIN;
+		std::vector<uint32_t> num_occluded(num_chunks, 0);
+		Context::Instance().TaskScheduler().parallel_for(static_cast<size_t>(0), num_chunks, static_cast<size_t>(1),
+			[&, this](size_t chunk)
+			{
+				size_t const first = chunk * CULLING_GRAIN;
+				size_t const last = std::min(first + CULLING_GRAIN, num_slots);
+				for (size_t i = first; i < last; ++ i)
+				{
+					if (objs[i] && (marks[i] != BO_No) && (attribs[i] & SceneObject::SOA_Cullable)
+						&& occlusion_buffer_.Occluded(aabbs_ws[i], view_proj))
+					{
+						marks[i] = BO_No;
+						++ num_occluded[chunk];
+					}
+				}
+			});
+
+		for (auto n : num_occluded)
+		{
+			num_objects_occluded_ += n;
+		}
+	}
+
 	void SceneManager::FlushScene()
 	{
 		RenderEngine& re = Context::Instance().RenderFactoryInstance().RenderEngineInstance();
 
-		visible_marks_map_.clear();
+		++ flush_frame_;
+		for (auto iter = visible_marks_map_.begin(); iter != visible_marks_map_.end();)
+		{
+			if (flush_frame_ - iter->second.last_frame > VISIBLE_MARKS_MAX_AGE)
+			{
+				iter = visible_marks_map_.erase(iter);
+			}
+			else
+			{
+				++ iter;
+			}
+		}
 
 		uint32_t urt;
 		App3DFramework& app = Context::Instance().AppInstance();
@@ -779,6 +1375,9 @@ namespace KlayGE
 
 	void SceneManager::UpdateThreadFunc()
 	{
+		std::vector<sub_thread_obj_t> objs;
+		std::vector<sub_thread_result_t> results;
+
 		Timer timer;
 		float app_time = 0;
 		while (!quit_)
@@ -792,16 +1391,50 @@ namespace KlayGE
 				WindowPtr const & win = Context::Instance().AppInstance().MainWnd();
 				if (win && win->Active())
 				{
-					std::lock_guard<std::mutex> lock(update_mutex_);
+					{
+						std::lock_guard<std::mutex> lock(sub_thread_mutex_);
+						if (sub_thread_objs_new_)
+						{
+							objs.swap(sub_thread_objs_);
+							sub_thread_objs_new_ = false;
+
+							// Picks up the matrices set on the main thread, unless a newer one of the sub thread
+							//  updates hasn't been applied yet
+							for (auto const & so : objs)
+							{
+								so.obj->SyncSubThreadModelMatrix(so.model, so.model_seq);
+							}
+						}
+					}
+
+					// Runs beside Flush and the main thread updates. The updates only write the copies of their
+					//  objects, which are fetched below and applied by the main thread in its next Update.
+					Context::Instance().TaskScheduler().parallel_for(static_cast<size_t>(0), objs.size(),
+						SUB_THREAD_UPDATE_GRAIN,
+						[&objs, app_time, frame_time](size_t i)
+						{
+							objs[i].obj->BufferedSubThreadUpdate(app_time, frame_time);
+						});
 
-					for (auto const & scene_obj : scene_objs_)
+					for (auto const & so : objs)
 					{
-						scene_obj->SubThreadUpdate(app_time, frame_time);
+						sub_thread_result_t result;
+						result.obj = so.obj;
+						result.has_model = so.obj->FetchSubThreadModelMatrix(result.model, result.model_seq);
+						so.obj->FetchSubThreadInstanceData(result.instance_data);
+						if (result.has_model || !result.instance_data.empty())
+						{
+							results.push_back(std::move(result));
+						}
 					}
-					for (auto const & scene_obj : overlay_scene_objs_)
+					if (!results.empty())
 					{
-						scene_obj->SubThreadUpdate(app_time, frame_time);
+						// Appended, the main thread may not have applied the previous ones yet. The later ones win.
+						std::lock_guard<std::mutex> lock(sub_thread_mutex_);
+						sub_thread_results_.insert(sub_thread_results_.end(), std::make_move_iterator(results.begin()),
+							std::make_move_iterator(results.end()));
 					}
+					results.clear();
 				}
 
 				if (frame_time < update_elapse_)
@@ -812,6 +1445,206 @@ namespace KlayGE
 		}
 	}
 
+	// Called with update_mutex_ held. The list swapped out is the one the update thread dropped, or one it never
+	//  picked up, so the objects are released on the main thread.
+	void SceneManager::PublishSubThreadObjects()
+	{
+		sub_thread_objs_back_.clear();
+		for (auto const & objs : { &scene_objs_, &overlay_scene_objs_ })
+		{
+			for (auto const & obj : *objs)
+			{
+				sub_thread_objs_back_.push_back({ obj, obj->ModelMatrix(), obj->applied_sub_thread_model_seq_ });
+			}
+		}
+
+		std::lock_guard<std::mutex> lock(sub_thread_mutex_);
+		sub_thread_objs_.swap(sub_thread_objs_back_);
+		sub_thread_objs_new_ = true;
+	}
+
+	void SceneManager::ApplySubThreadResults()
+	{
+		{
+			std::lock_guard<std::mutex> lock(sub_thread_mutex_);
+			sub_thread_results_back_.swap(sub_thread_results_);
+		}
+
+		if (!sub_thread_results_back_.empty())
+		{
+			std::lock_guard<std::mutex> lock(update_mutex_);
+			for (auto& result : sub_thread_results_back_)
+			{
+				result.obj->ApplySubThreadResult(result.has_model, result.model, result.model_seq, result.instance_data);
+			}
+			sub_thread_results_back_.clear();
+		}
+	}
+
+	void SceneManager::PropagateTransforms()
+	{
+		auto const & objs = obj_store_.Objects();
+		auto const & parents = obj_store_.Parents();
+		auto const & attribs = obj_store_.Attribs();
+		auto& dirty_flags = obj_store_.DirtyFlags();
+		size_t const num_slots = obj_store_.NumSlots();
+
+		// A world matrix only depends on the local matrices of the object and its parent, not on the parent's world
+		//  matrix, so there's no order between the levels of a hierarchy. All the dirty objects go in one pass.
+		transform_updated_.assign(num_slots, 0);
+		Context::Instance().TaskScheduler().parallel_for(static_cast<size_t>(0), num_slots, CULLING_GRAIN,
+			[this, &objs, &parents, &attribs, &dirty_flags](size_t i)
+			{
+				SceneObject* so = objs[i];
+				if (so && (attribs[i] & SceneObject::SOA_Moveable))
+				{
+					SceneObject const * parent = parents[i];
+					if (dirty_flags[i] || (parent && parent->store_ && dirty_flags[parent->store_handle_]))
+					{
+						so->UpdateAbsModelMatrixAndBound();
+						transform_updated_[i] = 1;
+					}
+				}
+			});
+
+		// Static objects don't get new bounds, but they're stamped like the others
+		transform_stamps_.resize(num_slots, 0);
+		bool moved = false;
+		bool static_moved = false;
+		bool caster_moved = false;
+		for (size_t i = 0; i < num_slots; ++ i)
+		{
+			if (transform_updated_[i])
+			{
+				objs[i]->UpdateRenderableModelMatrix();
+			}
+			if (transform_updated_[i] || (objs[i] && dirty_flags[i]))
+			{
+				if (!moved)
+				{
+					++ transform_generation_;
+					moved = true;
+				}
+				transform_stamps_[i] = transform_generation_;
+
+				// SceneObject::Pass shows and hides the objects not casting shadows in every frame
+				if (!static_moved && !(attribs[i] & (SceneObject::SOA_Moveable | SceneObject::SOA_NotCastShadow)))
+				{
+					++ static_generation_;
+					static_moved = true;
+				}
+				if (!caster_moved && !(attribs[i] & SceneObject::SOA_NotCastShadow))
+				{
+					++ caster_generation_;
+					caster_moved = true;
+				}
+			}
+			dirty_flags[i] = 0;
+		}
+	}
+
+	BoundOverlap SceneManager::VisibleTestRoot(uint32_t attrib, AABBox const & aabb_ws, float3 const & view_dir,
+		float3 const & eye_pos, float4x4 const & view_proj) const
+	{
+		BoundOverlap visible;
+		if (attrib & SceneObject::SOA_Cullable)
+		{
+			if (small_obj_threshold_ > 0)
+			{
+				visible = ((MathLib::ortho_area(view_dir, aabb_ws) > small_obj_threshold_)
+					&& (MathLib::perspective_area(eye_pos, view_proj, aabb_ws) > small_obj_threshold_))
+					? BO_Yes : BO_No;
+			}
+			else
+			{
+				visible = BO_Yes;
+			}
+		}
+		else
+		{
+			visible = BO_Yes;
+		}
+
+		return visible;
+	}
+
+	void SceneManager::FrustumTestBounds(BoundOverlap* overlaps, AABBox const * const * aabbs_ws, size_t num) const
+	{
+		if (!frustum_)
+		{
+			std::fill(overlaps, overlaps + num, BO_Yes);
+			return;
+		}
+
+		float center_x[CULLING_BATCH], center_y[CULLING_BATCH], center_z[CULLING_BATCH];
+		float extent_x[CULLING_BATCH], extent_y[CULLING_BATCH], extent_z[CULLING_BATCH];
+		for (size_t first = 0; first < num; first += CULLING_BATCH)
+		{
+			size_t const num_batch = std::min(num - first, CULLING_BATCH);
+			for (size_t i = 0; i < num_batch; ++ i)
+			{
+				AABBox const & aabb_ws = *aabbs_ws[first + i];
+				float3 const center = aabb_ws.Center();
+				float3 const extent = aabb_ws.HalfSize();
+				center_x[i] = center.x();
+				center_y[i] = center.y();
+				center_z[i] = center.z();
+				extent_x[i] = extent.x();
+				extent_y[i] = extent.y();
+				extent_z[i] = extent.z();
+			}
+
+			SIMDMathLib::IntersectAABBFrustum(overlaps + first, center_x, center_y, center_z,
+				extent_x, extent_y, extent_z, num_batch, *frustum_);
+		}
+	}
+
+	void SceneManager::ClipChildObjects(float3 const & view_dir, float3 const & eye_pos, float4x4 const & view_proj,
+		bool omni)
+	{
+		for (auto const & obj : scene_objs_)
+		{
+			auto so = obj.get();
+			if (so->Parent())
+			{
+				so->VisibleMark(this->ClipChildObject(so, view_dir, eye_pos, view_proj, omni));
+			}
+		}
+	}
+
+	BoundOverlap SceneManager::ClipChildObject(SceneObject* so, float3 const & view_dir, float3 const & eye_pos,
+		float4x4 const & view_proj, bool omni)
+	{
+		BoundOverlap visible = BO_No;
+		if (so->Visible())
+		{
+			// The small object test is done in VisibleTestFromParent
+			visible = this->VisibleTestFromParent(so, view_dir, eye_pos, view_proj);
+			if (BO_Partial == visible)
+			{
+				// Also called when cached marks are re-clipped, so it can't rely on the state of the plugin's structure
+				visible = (!omni && (so->Attrib() & SceneObject::SOA_Cullable))
+					? this->SceneManager::AABBVisible(so->PosBoundWS()) : BO_Yes;
+			}
+		}
+		return visible;
+	}
+
+	float4x4 SceneManager::ClipViewProj(Camera const & camera) const
+	{
+		float4x4 view_proj = camera.ViewProjMatrix();
+		auto drl = Context::Instance().DeferredRenderingLayerInstance();
+		if (drl)
+		{
+			int32_t cas_index = drl->CurrCascadeIndex();
+			if (cas_index >= 0)
+			{
+				view_proj *= drl->GetCascadedShadowLayer()->CascadeCropMatrix(cas_index);
+			}
+		}
+		return view_proj;
+	}
+
 	BoundOverlap SceneManager::VisibleTestFromParent(SceneObject* obj, float3 const & view_dir, float3 const & eye_pos,
 		float4x4 const & view_proj)
 	{
@@ -826,11 +1659,6 @@ namespace KlayGE
 			else
 			{
 				uint32_t const attr = obj->Attrib();
-				if (attr & SceneObject::SOA_Moveable)
-				{
-					obj->UpdateAbsModelMatrix();
-				}
-
 				if (attr & SceneObject::SOA_Cullable)
 				{
 					if (small_obj_threshold_ > 0)
@@ -19,26 +19,33 @@
 #include <KlayGE/Context.hpp>
 #include <KFL/Math.hpp>
 #include <KlayGE/Renderable.hpp>
+#include <KlayGE/SceneObjectStore.hpp>
 
 #include <boost/assert.hpp>
 
 #include <KlayGE/SceneObject.hpp>
 
+namespace
+{
+	// Set while a task of the scene manager's update thread runs SubThreadUpdate
+	thread_local bool tls_in_sub_thread_update = false;
+}
+
 namespace KlayGE
 {
 	SceneObject::SceneObject(uint32_t attrib)
 		: attrib_(attrib), parent_(nullptr), renderable_hw_res_ready_(false),
 			model_(float4x4::Identity()), abs_model_(float4x4::Identity()),
-			visible_mark_(BO_No)
+			pos_aabb_ws_(float3(0, 0, 0), float3(0, 0, 0)), visible_mark_(BO_No),
+			store_(nullptr), store_handle_(SceneObjectStore::INVALID_HANDLE),
+			sub_thread_model_(float4x4::Identity()), sub_thread_model_dirty_(false), sub_thread_model_seq_(0),
+			applied_sub_thread_model_seq_(0)
 	{
-		if (!(attrib & SOA_Overlay) && (attrib & (SOA_Cullable | SOA_Moveable)))
-		{
-			pos_aabb_ws_ = MakeUniquePtr<AABBox>();
-		}
 	}
 
 	SceneObject::~SceneObject()
 	{
+		BOOST_ASSERT(!store_);
 	}
 
 	SceneObject* SceneObject::Parent() const
@@ -49,6 +56,11 @@ namespace KlayGE
 	void SceneObject::Parent(SceneObject* so)
 	{
 		parent_ = so;
+		if (store_)
+		{
+			store_->Parents()[store_handle_] = so;
+			store_->DirtyFlags()[store_handle_] = 1;
+		}
 	}
 
 	uint32_t SceneObject::NumChildren() const
@@ -69,54 +81,63 @@ namespace KlayGE
 
 	void SceneObject::ModelMatrix(float4x4 const & mat)
 	{
-		model_ = mat;
+		if (tls_in_sub_thread_update)
+		{
+			sub_thread_model_ = mat;
+			sub_thread_model_dirty_ = true;
+			++ sub_thread_model_seq_;
+		}
+		else if (store_)
+		{
+			store_->ModelMatrices()[store_handle_] = mat;
+			store_->DirtyFlags()[store_handle_] = 1;
+		}
+		else
+		{
+			model_ = mat;
+		}
 	}
 
 	float4x4 const & SceneObject::ModelMatrix() const
 	{
-		return model_;
+		if (tls_in_sub_thread_update)
+		{
+			return sub_thread_model_;
+		}
+		return store_ ? store_->ModelMatrices()[store_handle_] : model_;
 	}
 
 	float4x4 const & SceneObject::AbsModelMatrix() const
 	{
-		return abs_model_;
+		return store_ ? store_->AbsModelMatrices()[store_handle_] : abs_model_;
 	}
 
 	AABBox const & SceneObject::PosBoundWS() const
 	{
-		return *pos_aabb_ws_;
+		return store_ ? store_->PosBoundsWS()[store_handle_] : pos_aabb_ws_;
 	}
 
 	void SceneObject::UpdateAbsModelMatrix()
 	{
-		if (parent_)
+		this->UpdateAbsModelMatrixAndBound();
+		this->UpdateRenderableModelMatrix();
+	}
+
+	void SceneObject::VisibleMark(BoundOverlap vm)
+	{
+		if (store_)
 		{
-			abs_model_ = parent_->ModelMatrix() * model_;
+			store_->VisibleMarks()[store_handle_] = vm;
 		}
 		else
 		{
-			abs_model_ = model_;
+			visible_mark_ = vm;
 		}
-
-		if (renderable_)
-		{
-			if (pos_aabb_ws_)
-			{
-				*pos_aabb_ws_ = MathLib::transform_aabb(renderable_->PosBound(), abs_model_);
-			}
-
-			renderable_->ModelMatrix(abs_model_);
-		}
-	}
-
-	void SceneObject::VisibleMark(BoundOverlap vm)
-	{
-		visible_mark_ = vm;
 	}
 
 	BoundOverlap SceneObject::VisibleMark() const
 	{
-		return visible_mark_;
+		return store_ ? store_->VisibleMarks()[store_handle_] : visible_mark_;
 	}
 
 	void SceneObject::BindSubThreadUpdateFunc(std::function<void(SceneObject&, float, float)> const & update_func)
@@ -137,6 +158,63 @@ namespace KlayGE
 		}
 	}
 
+	void SceneObject::SyncSubThreadModelMatrix(float4x4 const & mat, uint32_t applied_seq)
+	{
+		if (applied_seq == sub_thread_model_seq_)
+		{
+			sub_thread_model_ = mat;
+		}
+	}
+
+	void SceneObject::BufferedSubThreadUpdate(float app_time, float elapsed_time)
+	{
+		tls_in_sub_thread_update = true;
+		this->SubThreadUpdate(app_time, elapsed_time);
+		tls_in_sub_thread_update = false;
+	}
+
+	bool SceneObject::FetchSubThreadModelMatrix(float4x4& mat, uint32_t& seq)
+	{
+		bool const dirty = sub_thread_model_dirty_;
+		if (dirty)
+		{
+			mat = sub_thread_model_;
+			seq = sub_thread_model_seq_;
+			sub_thread_model_dirty_ = false;
+		}
+		return dirty;
+	}
+
+	void SceneObject::FetchSubThreadInstanceData(std::vector<uint8_t>& data) const
+	{
+		data.clear();
+		if (!instance_format_.empty())
+		{
+			uint32_t size = 0;
+			for (auto const & ve : instance_format_)
+			{
+				size += ve.element_size();
+			}
+
+			uint8_t const * src = static_cast<uint8_t const *>(this->InstanceData());
+			data.assign(src, src + size);
+		}
+	}
+
+	void SceneObject::ApplySubThreadResult(bool has_model, float4x4 const & mat, uint32_t seq,
+		std::vector<uint8_t>& instance_data)
+	{
+		if (has_model)
+		{
+			this->ModelMatrix(mat);
+			applied_sub_thread_model_seq_ = seq;
+		}
+		if (!instance_data.empty())
+		{
+			render_instance_data_.swap(instance_data);
+		}
+	}
+
 	bool SceneObject::MainThreadUpdate(float app_time, float elapsed_time)
 	{
 		bool refreshed = false;
@@ -204,6 +282,12 @@ namespace KlayGE
 
 	void SceneObject::Visible(bool vis)
 	{
+		if (store_ && (vis != this->Visible()))
+		{
+			// Stamped like a move, so the caches of what was rendered see it
+			store_->DirtyFlags()[store_handle_] = 1;
+		}
+
 		if (vis)
 		{
 			attrib_ &= ~SOA_Invisible;
@@ -212,6 +296,10 @@ namespace KlayGE
 		{
 			attrib_ |= SOA_Invisible;
 		}
+		if (store_)
+		{
+			store_->Attribs()[store_handle_] = attrib_;
+		}
 
 		for (auto const & child : children_)
 		{
@@ -229,6 +317,11 @@ namespace KlayGE
 		return nullptr;
 	}
 
+	void const * SceneObject::RenderInstanceData() const
+	{
+		return render_instance_data_.empty() ? this->InstanceData() : render_instance_data_.data();
+	}
+
 	void SceneObject::SelectMode(bool select_mode)
 	{
 		if (renderable_)
@@ -348,4 +441,58 @@ namespace KlayGE
 			this->AddToSceneManagerLocked();
 		}
 	}
+
+	void SceneObject::AttachToStore(SceneObjectStore& store)
+	{
+		BOOST_ASSERT(!store_);
+
+		store_handle_ = store.Alloc(this);
+		store.Parents()[store_handle_] = parent_;
+		store.Attribs()[store_handle_] = attrib_;
+		store.ModelMatrices()[store_handle_] = model_;
+		store.AbsModelMatrices()[store_handle_] = abs_model_;
+		store.PosBoundsWS()[store_handle_] = pos_aabb_ws_;
+		store.VisibleMarks()[store_handle_] = visible_mark_;
+		store_ = &store;
+	}
+
+	void SceneObject::DetachFromStore()
+	{
+		BOOST_ASSERT(store_);
+
+		model_ = store_->ModelMatrices()[store_handle_];
+		abs_model_ = store_->AbsModelMatrices()[store_handle_];
+		pos_aabb_ws_ = store_->PosBoundsWS()[store_handle_];
+		visible_mark_ = store_->VisibleMarks()[store_handle_];
+		store_->Free(store_handle_);
+		store_ = nullptr;
+		store_handle_ = SceneObjectStore::INVALID_HANDLE;
+	}
+
+	void SceneObject::UpdateAbsModelMatrixAndBound()
+	{
+		float4x4& abs_model = store_ ? store_->AbsModelMatrices()[store_handle_] : abs_model_;
+		if (parent_)
+		{
+			abs_model = parent_->ModelMatrix() * this->ModelMatrix();
+		}
+		else
+		{
+			abs_model = this->ModelMatrix();
+		}
+
+		if (renderable_ && !(attrib_ & SOA_Overlay) && (attrib_ & (SOA_Cullable | SOA_Moveable)))
+		{
+			AABBox& pos_aabb_ws = store_ ? store_->PosBoundsWS()[store_handle_] : pos_aabb_ws_;
+			pos_aabb_ws = MathLib::transform_aabb(renderable_->PosBound(), abs_model);
+		}
+	}
+
+	void SceneObject::UpdateRenderableModelMatrix()
+	{
+		if (renderable_)
+		{
+			renderable_->ModelMatrix(this->AbsModelMatrix());
+		}
+	}
 }
@@ -0,0 +1,80 @@
+/**
+ * @file SceneObjectStore.cpp
+ * @author Minmin Gong
+ *
+ * @section DESCRIPTION
+ *
+ * This source file is part of KlayGE
+ * For the latest info, see http://www.klayge.org
+ *
+ * @section LICENSE
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published
+ * by the Free Software Foundation; either version 2 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program; if not, write to the Free Software
+ * Foundation, Inc., 59 Temple Place, Suite 330, Boston, MA 02111-1307 USA
+ *
+ * You may alternatively use this source under the terms of
+ * the KlayGE Proprietary License (KPL). You can obtained such a license
+ * from http://www.klayge.org/licensing/.
+ */
+
+
+#include <KlayGE/KlayGE.hpp>
+
+#include <boost/assert.hpp>
+
+#include <KlayGE/SceneObjectStore.hpp>
+
+namespace KlayGE
+{
+	uint32_t SceneObjectStore::Alloc(SceneObject* obj)
+	{
+		BOOST_ASSERT(obj);
+
+		uint32_t handle;
+		if (free_handles_.empty())
+		{
+			handle = static_cast<uint32_t>(objs_.size());
+			objs_.push_back(obj);
+			parents_.push_back(nullptr);
+			attribs_.push_back(0);
+			models_.push_back(float4x4::Identity());
+			abs_models_.push_back(float4x4::Identity());
+			pos_aabbs_ws_.push_back(AABBox(float3(0, 0, 0), float3(0, 0, 0)));
+			visible_marks_.push_back(BO_No);
+			dirty_flags_.push_back(1);
+		}
+		else
+		{
+			handle = free_handles_.back();
+			free_handles_.pop_back();
+			objs_[handle] = obj;
+			dirty_flags_[handle] = 1;
+		}
+
+		return handle;
+	}
+
+	void SceneObjectStore::Free(uint32_t handle)
+	{
+		BOOST_ASSERT(handle < objs_.size());
+		BOOST_ASSERT(objs_[handle]);
+
+		objs_[handle] = nullptr;
+		parents_[handle] = nullptr;
+		attribs_[handle] = 0;
+		visible_marks_[handle] = BO_No;
+		dirty_flags_[handle] = 0;
+		free_handles_.push_back(handle);
+	}
+}
@@ -0,0 +1,114 @@
+/**
+ * @file BVH.hpp
+ * @author Minmin Gong
+ *
+ * @section DESCRIPTION
+ *
+ * This source file is part of KlayGE
+ * For the latest info, see http://www.klayge.org
+ *
+ * @section LICENSE
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published
+ * by the Free Software Foundation; either version 2 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program; if not, write to the Free Software
+ * Foundation, Inc., 59 Temple Place, Suite 330, Boston, MA 02111-1307 USA
+ *
+ * You may alternatively use this source under the terms of
+ * the KlayGE Proprietary License (KPL). You can obtained such a license
+ * from http://www.klayge.org/licensing/.
+ */
+
+#ifndef _BVH_HPP
+#define _BVH_HPP
+
+#pragma once
+
+#include <KlayGE/PreDeclare.hpp>
+#include <KlayGE/SceneNode.hpp>
+#include <KlayGE/SceneManager.hpp>
+#include <KFL/AABBox.hpp>
+
+#include <unordered_map>
+#include <vector>
+
+namespace KlayGE
+{
+	// A scene manager on a dynamic AABB tree. Every cullable object without a parent is a leaf, moveable or not.
+	//  The leaves of moveable objects are enlarged by a margin, and only go back into the tree when their bounds leave
+	//  the enlarged ones, so most moves don't touch the tree at all. Insertion picks the sibling by surface area, and
+	//  rotations keep the tree balanced.
+	class BVH : public SceneManager
+	{
+	public:
+		BVH();
+
+		// The bounds of moveable leaves are enlarged by this fraction of their size on each side. 0.1 by default.
+		void FatMargin(float margin);
+		float FatMargin() const;
+
+		virtual void ClipScene() override;
+
+		virtual void ClearObject() override;
+
+	private:
+		virtual void OnAddSceneObject(SceneObjectPtr const & obj) override;
+		virtual void OnDelSceneObject(std::vector<SceneObjectPtr>::iterator iter) override;
+		virtual void DoSuspend() override;
+		virtual void DoResume() override;
+
+		void RemoveObj(SceneObject* so);
+		void RefitMoveables();
+		void MarkTreeObjs(float3 const & view_dir, float3 const & eye_pos, float4x4 const & view_proj, bool omni);
+		bool LargeEnough(AABBox const & aabb, float3 const & view_dir, float3 const & eye_pos,
+			float4x4 const & view_proj) const;
+
+		int AllocNode();
+		void FreeNode(int index);
+		void InsertLeaf(int leaf);
+		void RemoveLeaf(int leaf);
+		void RefitAncestors(int index);
+		int Balance(int index);
+		int Rotate(int index, int child);
+
+	private:
+		struct bvh_node_t
+		{
+			AABBox bb;
+			// The next free node for nodes in the free list
+			int parent;
+			// -1 for leaves
+			int children[2];
+			// 0 for leaves
+			int height;
+
+			SceneObject* obj;
+		};
+
+		std::vector<bvh_node_t> nodes_;
+		int root_;
+		int free_list_;
+
+		std::unordered_map<SceneObject*, int> obj_leaves_;
+		std::vector<int> moveable_leaves_;
+		// Objects that aren't in the tree, tested one by one after it in the order they were added. Children come
+		//  after their parents that way.
+		std::vector<SceneObject*> linear_objs_;
+
+		std::vector<std::pair<int, BoundOverlap>> traversal_stack_;
+
+		float fat_margin_;
+		uint32_t refit_frame_;
+	};
+}
+
+#endif		// _BVH_HPP
@@ -29,6 +29,7 @@
 #include <KlayGE/SceneManager.hpp>
 #include <KFL/AABBox.hpp>
 
+#include <unordered_map>
 #include <vector>
 
 namespace KlayGE
@@ -55,9 +56,19 @@ namespace KlayGE
 		virtual void DoSuspend() override;
 		virtual void DoResume() override;
 
+		void RebuildTree();
+		void InsertObject(SceneObject* so);
+		void RemoveObject(SceneObject* so);
+		void GrowRoot(AABBox const & aabb);
 		void DivideNode(size_t index, uint32_t curr_depth);
-		void NodeVisible(size_t index);
-		void MarkNodeObjs(size_t index, bool force);
+		void MergeNode(size_t index);
+		int ChildContaining(size_t index, AABBox const & aabb) const;
+		size_t AllocNodeBlock(size_t parent_index);
+		void FreeNodeBlock(size_t first_index);
+		void NodeVisible(size_t index, float3 const & view_dir, float3 const & eye_pos, float4x4 const & view_proj);
+		void SubtreeVisible(size_t index, float3 const & view_dir, float3 const & eye_pos, float4x4 const & view_proj);
+		void CollectVisibleNodes(size_t index, bool force);
+		void MarkNodeObjs(size_t index, float3 const & view_dir, float3 const & eye_pos, float4x4 const & view_proj);
 
 		BoundOverlap BoundVisible(size_t index, AABBox const & aabb) const;
 		BoundOverlap BoundVisible(size_t index, OBBox const & obb) const;
@@ -72,13 +83,24 @@ namespace KlayGE
 		struct octree_node_t
 		{
 			AABBox bb;
+			int parent_index;
 			int first_child_index;
 			BoundOverlap visible;
+			// Objects in this node and all the nodes under it
+			uint32_t num_objs;
 
+			// Objects that fit in this node but in none of its children
 			std::vector<SceneObject*> obj_ptrs;
 		};
 
+		// The root is always the first node. Children of a node are 8 nodes in a row, recycled through free_node_blocks_.
 		std::vector<octree_node_t> octree_;
+		std::vector<size_t> free_node_blocks_;
+		std::unordered_map<SceneObject*, size_t> obj_nodes_;
+		// Static objects added since the last ClipScene, inserted there
+		std::vector<SceneObject*> pending_objs_;
+		// Nodes with objects that pass the node test, filled by CollectVisibleNodes
+		std::vector<size_t> visible_nodes_;
 
 		uint32_t max_tree_depth_;
 
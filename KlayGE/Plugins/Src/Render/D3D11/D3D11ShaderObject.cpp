@@ -259,7 +259,7 @@ namespace KlayGE
 	}
 
 	bool D3D11ShaderObject::AttachNativeShader(ShaderType type, RenderEffect const & effect,
-		std::array<uint32_t, ST_NumShaderTypes> const & shader_desc_ids, std::vector<uint8_t> const & native_shader_block)
+		std::array<uint32_t, ST_NumShaderTypes> const & shader_desc_ids, ArrayRef<uint8_t> native_shader_block)
 	{
 		bool ret = false;
 
@@ -401,21 +401,6 @@ namespace KlayGE
 		return ret;
 	}
 
-	bool D3D11ShaderObject::StreamIn(ResIdentifierPtr const & res, ShaderType type, RenderEffect const & effect,
-		std::array<uint32_t, ST_NumShaderTypes> const & shader_desc_ids)
-	{
-		uint32_t len;
-		res->read(&len, sizeof(len));
-		len = LE2Native(len);
-		std::vector<uint8_t> native_shader_block(len);
-		if (len > 0)
-		{
-			res->read(&native_shader_block[0], len * sizeof(native_shader_block[0]));
-		}
-
-		return this->AttachNativeShader(type, effect, shader_desc_ids, native_shader_block);
-	}
-
 	void D3D11ShaderObject::StreamOut(std::ostream& os, ShaderType type)
 	{
 		std::ostringstream oss(std::ios_base::binary | std::ios_base::out);
@@ -115,7 +115,7 @@ namespace KlayGE
 	}
 
 	bool NullShaderObject::AttachNativeShader(ShaderType type, RenderEffect const & effect,
-		std::array<uint32_t, ST_NumShaderTypes> const & shader_desc_ids, std::vector<uint8_t> const & native_shader_block)
+		std::array<uint32_t, ST_NumShaderTypes> const & shader_desc_ids, ArrayRef<uint8_t> native_shader_block)
 	{
 		KFL_UNUSED(type);
 		KFL_UNUSED(effect);
@@ -0,0 +1,519 @@
+/**
+ * @file BVH.cpp
+ * @author Minmin Gong
+ *
+ * @section DESCRIPTION
+ *
+ * This source file is part of KlayGE
+ * For the latest info, see http://www.klayge.org
+ *
+ * @section LICENSE
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published
+ * by the Free Software Foundation; either version 2 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program; if not, write to the Free Software
+ * Foundation, Inc., 59 Temple Place, Suite 330, Boston, MA 02111-1307 USA
+ *
+ * You may alternatively use this source under the terms of
+ * the KlayGE Proprietary License (KPL). You can obtained such a license
+ * from http://www.klayge.org/licensing/.
+ */
+
+#include <KlayGE/KlayGE.hpp>
+#include <KFL/Util.hpp>
+#include <KFL/Math.hpp>
+#include <KFL/Vector.hpp>
+#include <KFL/Matrix.hpp>
+#include <KlayGE/Context.hpp>
+#include <KlayGE/SceneObject.hpp>
+#include <KlayGE/Camera.hpp>
+#include <KlayGE/App3D.hpp>
+#include <KlayGE/DeferredRenderingLayer.hpp>
+
+#include <algorithm>
+#include <boost/assert.hpp>
+
+#include <KlayGE/BVH/BVH.hpp>
+
+namespace
+{
+	using namespace KlayGE;
+
+	AABBox Merge(AABBox const & lhs, AABBox const & rhs)
+	{
+		AABBox ret = lhs;
+		ret |= rhs;
+		return ret;
+	}
+
+	// Half of the surface area, enough for comparing costs
+	float HalfArea(AABBox const & aabb)
+	{
+		float3 const size = aabb.Max() - aabb.Min();
+		return size.x() * size.y() + size.y() * size.z() + size.z() * size.x();
+	}
+
+	bool Contains(AABBox const & outer, AABBox const & inner)
+	{
+		return (outer.Min().x() <= inner.Min().x()) && (outer.Min().y() <= inner.Min().y())
+			&& (outer.Min().z() <= inner.Min().z())
+			&& (outer.Max().x() >= inner.Max().x()) && (outer.Max().y() >= inner.Max().y())
+			&& (outer.Max().z() >= inner.Max().z());
+	}
+}
+
+namespace KlayGE
+{
+	BVH::BVH()
+		: root_(-1), free_list_(-1), fat_margin_(0.1f), refit_frame_(0xFFFFFFFF)
+	{
+	}
+
+	void BVH::FatMargin(float margin)
+	{
+		fat_margin_ = std::max(margin, 0.0f);
+	}
+
+	float BVH::FatMargin() const
+	{
+		return fat_margin_;
+	}
+
+	void BVH::ClipScene()
+	{
+		App3DFramework& app = Context::Instance().AppInstance();
+		Camera& camera = app.ActiveCamera();
+
+		this->PropagateTransforms();
+
+		// ClipScene runs for every camera and pass. The objects only move once per frame.
+		uint32_t const frame = app.TotalNumFrames();
+		if (frame != refit_frame_)
+		{
+			this->RefitMoveables();
+			refit_frame_ = frame;
+		}
+
+		float4x4 view_proj = camera.ViewProjMatrix();
+		auto drl = Context::Instance().DeferredRenderingLayerInstance();
+		if (drl)
+		{
+			int32_t cas_index = drl->CurrCascadeIndex();
+			if (cas_index >= 0)
+			{
+				view_proj *= drl->GetCascadedShadowLayer()->CascadeCropMatrix(cas_index);
+			}
+		}
+
+		float3 const & view_dir = camera.ForwardVec();
+		float3 const & eye_pos = camera.EyePos();
+		bool const omni = camera.OmniDirectionalMode();
+
+		// Flush has cleared the marks, so only the visible objects in the tree need one
+		this->MarkTreeObjs(view_dir, eye_pos, view_proj, omni);
+
+		for (auto so : linear_objs_)
+		{
+			if (so->Visible())
+			{
+				BoundOverlap visible = this->VisibleTestFromParent(so, view_dir, eye_pos, view_proj);
+				if (BO_Partial == visible)
+				{
+					uint32_t const attr = so->Attrib();
+					if ((attr & SceneObject::SOA_Cullable) && !omni)
+					{
+						visible = this->AABBVisible(so->PosBoundWS());
+					}
+					else
+					{
+						visible = BO_Yes;
+					}
+				}
+				so->VisibleMark(visible);
+			}
+			else
+			{
+				so->VisibleMark(BO_No);
+			}
+		}
+	}
+
+	void BVH::ClearObject()
+	{
+		SceneManager::ClearObject();
+
+		nodes_.clear();
+		root_ = -1;
+		free_list_ = -1;
+		obj_leaves_.clear();
+		moveable_leaves_.clear();
+		linear_objs_.clear();
+	}
+
+	void BVH::OnAddSceneObject(SceneObjectPtr const & obj)
+	{
+		SceneObject* so = obj.get();
+
+		// Added again once its renderable is ready, with a new bound
+		this->RemoveObj(so);
+
+		uint32_t const attr = so->Attrib();
+		if ((attr & SceneObject::SOA_Cullable) && !so->Parent())
+		{
+			bool const moveable = (attr & SceneObject::SOA_Moveable) ? true : false;
+			if (moveable)
+			{
+				so->UpdateAbsModelMatrix();
+			}
+
+			int const leaf = this->AllocNode();
+			bvh_node_t& node = nodes_[leaf];
+			node.obj = so;
+			node.bb = so->PosBoundWS();
+			if (moveable)
+			{
+				float3 const margin = node.bb.HalfSize() * (fat_margin_ * 2);
+				node.bb = AABBox(node.bb.Min() - margin, node.bb.Max() + margin);
+				moveable_leaves_.push_back(leaf);
+			}
+			this->InsertLeaf(leaf);
+
+			obj_leaves_.emplace(so, leaf);
+		}
+		else
+		{
+			linear_objs_.push_back(so);
+		}
+	}
+
+	void BVH::OnDelSceneObject(std::vector<SceneObjectPtr>::iterator iter)
+	{
+		BOOST_ASSERT(iter != scene_objs_.end());
+
+		this->RemoveObj(iter->get());
+	}
+
+	void BVH::RemoveObj(SceneObject* so)
+	{
+		auto leaf_iter = obj_leaves_.find(so);
+		if (leaf_iter != obj_leaves_.end())
+		{
+			int const leaf = leaf_iter->second;
+			this->RemoveLeaf(leaf);
+			this->FreeNode(leaf);
+			obj_leaves_.erase(leaf_iter);
+
+			auto moveable_iter = std::find(moveable_leaves_.begin(), moveable_leaves_.end(), leaf);
+			if (moveable_iter != moveable_leaves_.end())
+			{
+				*moveable_iter = moveable_leaves_.back();
+				moveable_leaves_.pop_back();
+			}
+		}
+		else
+		{
+			auto linear_iter = std::find(linear_objs_.begin(), linear_objs_.end(), so);
+			if (linear_iter != linear_objs_.end())
+			{
+				linear_objs_.erase(linear_iter);
+			}
+		}
+	}
+
+	void BVH::DoSuspend()
+	{
+	}
+
+	void BVH::DoResume()
+	{
+	}
+
+	void BVH::RefitMoveables()
+	{
+		for (auto leaf : moveable_leaves_)
+		{
+			SceneObject* so = nodes_[leaf].obj;
+			if (so->Visible())
+			{
+				AABBox const & aabb = so->PosBoundWS();
+				if (!Contains(nodes_[leaf].bb, aabb))
+				{
+					this->RemoveLeaf(leaf);
+
+					float3 const margin = aabb.HalfSize() * (fat_margin_ * 2);
+					nodes_[leaf].bb = AABBox(aabb.Min() - margin, aabb.Max() + margin);
+					this->InsertLeaf(leaf);
+				}
+			}
+		}
+	}
+
+	void BVH::MarkTreeObjs(float3 const & view_dir, float3 const & eye_pos, float4x4 const & view_proj, bool omni)
+	{
+		if (root_ < 0)
+		{
+			return;
+		}
+
+		// Everything is in the frustum of an omni-directional camera, only the small objects are culled
+		traversal_stack_.emplace_back(root_, omni ? BO_Yes : BO_Partial);
+		while (!traversal_stack_.empty())
+		{
+			int const index = traversal_stack_.back().first;
+			BoundOverlap visible = traversal_stack_.back().second;
+			traversal_stack_.pop_back();
+
+			bvh_node_t const & node = nodes_[index];
+			if (node.obj != nullptr)
+			{
+				SceneObject* so = node.obj;
+				if (so->Visible())
+				{
+					AABBox const & aabb_ws = so->PosBoundWS();
+					if (BO_Partial == visible)
+					{
+						// The leaf bound can be enlarged, test the real one
+						visible = frustum_->Intersect(aabb_ws);
+					}
+					if ((visible != BO_No) && !this->LargeEnough(aabb_ws, view_dir, eye_pos, view_proj))
+					{
+						visible = BO_No;
+					}
+					so->VisibleMark(visible);
+				}
+			}
+			else
+			{
+				// A node bound contains all the objects under it, so they are at most as large on the screen
+				if (BO_Partial == visible)
+				{
+					visible = frustum_->Intersect(node.bb);
+				}
+				if ((visible != BO_No) && this->LargeEnough(node.bb, view_dir, eye_pos, view_proj))
+				{
+					traversal_stack_.emplace_back(node.children[0], visible);
+					traversal_stack_.emplace_back(node.children[1], visible);
+				}
+			}
+		}
+	}
+
+	bool BVH::LargeEnough(AABBox const & aabb, float3 const & view_dir, float3 const & eye_pos,
+		float4x4 const & view_proj) const
+	{
+		return (small_obj_threshold_ <= 0)
+			|| ((MathLib::ortho_area(view_dir, aabb) > small_obj_threshold_)
+				&& (MathLib::perspective_area(eye_pos, view_proj, aabb) > small_obj_threshold_));
+	}
+
+	int BVH::AllocNode()
+	{
+		int index;
+		if (free_list_ >= 0)
+		{
+			index = free_list_;
+			free_list_ = nodes_[index].parent;
+		}
+		else
+		{
+			index = static_cast<int>(nodes_.size());
+			nodes_.emplace_back();
+		}
+
+		bvh_node_t& node = nodes_[index];
+		node.parent = -1;
+		node.children[0] = node.children[1] = -1;
+		node.height = 0;
+		node.obj = nullptr;
+		return index;
+	}
+
+	void BVH::FreeNode(int index)
+	{
+		BOOST_ASSERT(static_cast<size_t>(index) < nodes_.size());
+
+		nodes_[index].obj = nullptr;
+		nodes_[index].parent = free_list_;
+		free_list_ = index;
+	}
+
+	void BVH::InsertLeaf(int leaf)
+	{
+		if (root_ < 0)
+		{
+			root_ = leaf;
+			nodes_[leaf].parent = -1;
+			return;
+		}
+
+		// Walks down to the sibling with the least increase of surface area
+		AABBox const leaf_bb = nodes_[leaf].bb;
+		int index = root_;
+		while (nodes_[index].children[0] != -1)
+		{
+			bvh_node_t const & node = nodes_[index];
+			float const area = HalfArea(node.bb);
+			float const combined_area = HalfArea(Merge(node.bb, leaf_bb));
+
+			// A new parent of this node and the leaf
+			float const cost = 2 * combined_area;
+			// This node grows if the leaf goes further down
+			float const inheritance_cost = 2 * (combined_area - area);
+
+			float child_costs[2];
+			for (int i = 0; i < 2; ++ i)
+			{
+				bvh_node_t const & child = nodes_[node.children[i]];
+				child_costs[i] = HalfArea(Merge(child.bb, leaf_bb)) + inheritance_cost;
+				if (child.children[0] != -1)
+				{
+					child_costs[i] -= HalfArea(child.bb);
+				}
+			}
+
+			if ((cost < child_costs[0]) && (cost < child_costs[1]))
+			{
+				break;
+			}
+
+			index = node.children[(child_costs[0] < child_costs[1]) ? 0 : 1];
+		}
+
+		int const sibling = index;
+		int const old_parent = nodes_[sibling].parent;
+		int const new_parent = this->AllocNode();
+		{
+			bvh_node_t& node = nodes_[new_parent];
+			node.parent = old_parent;
+			node.children[0] = sibling;
+			node.children[1] = leaf;
+			node.height = nodes_[sibling].height + 1;
+			node.bb = Merge(nodes_[sibling].bb, leaf_bb);
+		}
+		if (old_parent != -1)
+		{
+			bvh_node_t& node = nodes_[old_parent];
+			node.children[(node.children[0] == sibling) ? 0 : 1] = new_parent;
+		}
+		else
+		{
+			root_ = new_parent;
+		}
+		nodes_[sibling].parent = new_parent;
+		nodes_[leaf].parent = new_parent;
+
+		this->RefitAncestors(new_parent);
+	}
+
+	void BVH::RemoveLeaf(int leaf)
+	{
+		if (leaf == root_)
+		{
+			root_ = -1;
+			return;
+		}
+
+		int const parent = nodes_[leaf].parent;
+		int const grand_parent = nodes_[parent].parent;
+		int const sibling = nodes_[parent].children[(nodes_[parent].children[0] == leaf) ? 1 : 0];
+
+		nodes_[sibling].parent = grand_parent;
+		if (grand_parent != -1)
+		{
+			bvh_node_t& node = nodes_[grand_parent];
+			node.children[(node.children[0] == parent) ? 0 : 1] = sibling;
+		}
+		else
+		{
+			root_ = sibling;
+		}
+		this->FreeNode(parent);
+
+		this->RefitAncestors(grand_parent);
+	}
+
+	void BVH::RefitAncestors(int index)
+	{
+		while (index != -1)
+		{
+			index = this->Balance(index);
+
+			bvh_node_t& node = nodes_[index];
+			bvh_node_t const & child0 = nodes_[node.children[0]];
+			bvh_node_t const & child1 = nodes_[node.children[1]];
+			node.height = std::max(child0.height, child1.height) + 1;
+			node.bb = Merge(child0.bb, child1.bb);
+
+			index = node.parent;
+		}
+	}
+
+	int BVH::Balance(int index)
+	{
+		bvh_node_t const & node = nodes_[index];
+		if ((node.children[0] == -1) || (node.height < 2))
+		{
+			return index;
+		}
+
+		int const balance = nodes_[node.children[1]].height - nodes_[node.children[0]].height;
+		if (balance > 1)
+		{
+			return this->Rotate(index, node.children[1]);
+		}
+		else if (balance < -1)
+		{
+			return this->Rotate(index, node.children[0]);
+		}
+		else
+		{
+			return index;
+		}
+	}
+
+	// The taller child takes the place of the node. The node becomes its child, and takes the shorter grand child.
+	int BVH::Rotate(int index, int child)
+	{
+		bvh_node_t& node = nodes_[index];
+		bvh_node_t& up = nodes_[child];
+
+		int const child_slot = (node.children[0] == child) ? 0 : 1;
+		int const other = node.children[1 - child_slot];
+		int const keep = (nodes_[up.children[0]].height > nodes_[up.children[1]].height)
+			? up.children[0] : up.children[1];
+		int const move = (keep == up.children[0]) ? up.children[1] : up.children[0];
+
+		up.parent = node.parent;
+		node.parent = child;
+		if (up.parent != -1)
+		{
+			bvh_node_t& parent = nodes_[up.parent];
+			parent.children[(parent.children[0] == index) ? 0 : 1] = child;
+		}
+		else
+		{
+			root_ = child;
+		}
+
+		up.children[0] = index;
+		up.children[1] = keep;
+		node.children[child_slot] = move;
+		nodes_[move].parent = index;
+
+		node.bb = Merge(nodes_[other].bb, nodes_[move].bb);
+		node.height = std::max(nodes_[other].height, nodes_[move].height) + 1;
+		up.bb = Merge(node.bb, nodes_[keep].bb);
+		up.height = std::max(node.height, nodes_[keep].height) + 1;
+
+		return child;
+	}
+}
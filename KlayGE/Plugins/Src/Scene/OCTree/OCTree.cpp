@@ -28,6 +28,7 @@
 #include <KFL/Vector.hpp>
 #include <KFL/Matrix.hpp>
 #include <KFL/Plane.hpp>
+#include <KFL/TaskScheduler.hpp>
 #include <KlayGE/SceneObject.hpp>
 #include <KlayGE/RenderableHelper.hpp>
 #include <KlayGE/Camera.hpp>
@@ -46,6 +47,31 @@
 
 #include <KlayGE/OCTree/OCTree.hpp>
 
+namespace
+{
+	// A leaf node is divided once it has more objects than this, and a node is folded back once it and the nodes
+	//  under it have no more than the other
+	size_t const NODE_SPLIT_THRESHOLD = 8;
+	uint32_t const NODE_MERGE_THRESHOLD = 4;
+	// Objects far away from everything else are left in the root after this many doublings
+	uint32_t const MAX_ROOT_GROWTH = 32;
+
+	// Objects per task of the parallel culling
+	size_t const CULLING_GRAIN = 256;
+	// Nodes per task when marking the objects in visible nodes
+	size_t const CULLING_NODE_GRAIN = 16;
+	// Objects of a node gathered for each call of the batch frustum test
+	size_t const CULLING_BATCH = 64;
+
+	bool Contains(KlayGE::AABBox const & outer, KlayGE::AABBox const & inner)
+	{
+		return (outer.Min().x() <= inner.Min().x()) && (outer.Min().y() <= inner.Min().y())
+			&& (outer.Min().z() <= inner.Min().z())
+			&& (outer.Max().x() >= inner.Max().x()) && (outer.Max().y() >= inner.Max().y())
+			&& (outer.Max().z() >= inner.Max().z());
+	}
+}
+
 #ifdef KLAYGE_DRAW_NODES
 namespace
 {
@@ -106,6 +132,7 @@ namespace KlayGE
 	void OCTree::MaxTreeDepth(uint32_t max_tree_depth)
 	{
 		max_tree_depth_ = std::min<uint32_t>(max_tree_depth, 16UL);
+		rebuild_tree_ = true;
 	}
 
 	uint32_t OCTree::MaxTreeDepth() const
@@ -117,29 +144,39 @@ namespace KlayGE
 	{
 		if (rebuild_tree_)
 		{
-			octree_.resize(1);
-			AABBox bb_root(float3(0, 0, 0), float3(0, 0, 0));
-			octree_[0].first_child_index = -1;
-			octree_[0].visible = BO_No;
-			for (auto const & obj : scene_objs_)
+			this->RebuildTree();
+		}
+		if (!pending_objs_.empty())
+		{
+			if (octree_.empty())
 			{
-				uint32_t const attr = obj->Attrib();
-				if ((attr & SceneObject::SOA_Cullable)
-					&& !(attr & SceneObject::SOA_Moveable))
+				AABBox bb_root = pending_objs_[0]->PosBoundWS();
+				for (auto so : pending_objs_)
 				{
-					bb_root |= obj->PosBoundWS();
-					octree_[0].obj_ptrs.push_back(obj.get());
+					bb_root |= so->PosBoundWS();
 				}
-			}
-			float3 const & center = bb_root.Center();
-			float3 const & extent = bb_root.HalfSize();
-			float longest_dim = std::max(std::max(extent.x(), extent.y()), extent.z());
-			float3 new_extent(longest_dim, longest_dim, longest_dim);
-			octree_[0].bb = AABBox(center - new_extent, center + new_extent);
+				float3 const & center = bb_root.Center();
+				float3 const & extent = bb_root.HalfSize();
+				float longest_dim = std::max(std::max(std::max(extent.x(), extent.y()), extent.z()), 1e-3f);
+				float3 new_extent(longest_dim, longest_dim, longest_dim);
 
-			this->DivideNode(0, 1);
+				octree_.resize(1);
+				octree_[0].bb = AABBox(center - new_extent, center + new_extent);
+				octree_[0].parent_index = -1;
+				octree_[0].first_child_index = -1;
+				octree_[0].visible = BO_No;
+				octree_[0].num_objs = 0;
+			}
 
-			rebuild_tree_ = false;
+			for (auto so : pending_objs_)
+			{
+				// Pending twice if it's added again before the tree is updated
+				if (obj_nodes_.find(so) == obj_nodes_.end())
+				{
+					this->InsertObject(so);
+				}
+			}
+			pending_objs_.clear();
 		}
 
 #ifdef KLAYGE_DRAW_NODES
@@ -150,11 +187,6 @@ namespace KlayGE
 		checked_pointer_cast<NodeRenderable>(node_renderable_)->ClearInstances();
 #endif
 
-		if (!octree_.empty())
-		{
-			this->NodeVisible(0);
-		}
-
 		App3DFramework& app = Context::Instance().AppInstance();
 		Camera& camera = app.ActiveCamera();
 
@@ -169,85 +201,83 @@ namespace KlayGE
 			}
 		}
 
-		if (camera.OmniDirectionalMode())
+		float3 const & view_dir = camera.ForwardVec();
+		float3 const & eye_pos = camera.EyePos();
+		bool const omni = camera.OmniDirectionalMode();
+
+		this->PropagateTransforms();
+
+		auto const & objs = obj_store_.Objects();
+		auto const & parents = obj_store_.Parents();
+		auto const & attribs = obj_store_.Attribs();
+		auto const & aabbs_ws = obj_store_.PosBoundsWS();
+		auto& marks = obj_store_.VisibleMarks();
+
+		auto& ts = Context::Instance().TaskScheduler();
+		if (omni)
 		{
-			for (auto const & obj : scene_objs_)
-			{
-				if (obj->Visible())
+			ts.parallel_for(static_cast<size_t>(0), static_cast<size_t>(obj_store_.NumSlots()), CULLING_GRAIN,
+				[&, this](size_t i)
 				{
-					uint32_t const attr = obj->Attrib();
-					if (attr & SceneObject::SOA_Moveable)
+					if (objs[i] && !parents[i])
 					{
-						obj->UpdateAbsModelMatrix();
+						uint32_t const attr = attribs[i];
+						marks[i] = (attr & SceneObject::SOA_Invisible)
+							? BO_No : this->VisibleTestRoot(attr, aabbs_ws[i], view_dir, eye_pos, view_proj);
 					}
-
-					if (attr & SceneObject::SOA_Cullable)
-					{
-						BoundOverlap bo;
-						if (small_obj_threshold_ > 0)
-						{
-							AABBox const & aabb_ws = obj->PosBoundWS();
-							bo = ((MathLib::ortho_area(camera.ForwardVec(), aabb_ws) > small_obj_threshold_)
-								&& (MathLib::perspective_area(camera.EyePos(), view_proj, aabb_ws) > small_obj_threshold_))
-								? BO_Yes : BO_No;
-						}
-						else
-						{
-							bo = BO_Yes;
-						}
-						obj->VisibleMark(bo);
-					}
-				}
-				else
-				{
-					obj->VisibleMark(BO_No);
-				}
-			}
+				});
 		}
 		else
 		{
 			if (!octree_.empty())
 			{
-				this->MarkNodeObjs(0, false);
+				// Each subtree under the root is tested by its own task
+				octree_node_t& root = octree_[0];
+				this->NodeVisible(0, view_dir, eye_pos, view_proj);
+				if ((BO_Partial == root.visible) && (root.first_child_index != -1))
+				{
+					size_t const first_child = root.first_child_index;
+					ts.parallel_for(static_cast<size_t>(0), static_cast<size_t>(8), static_cast<size_t>(1),
+						[this, first_child, &view_dir, &eye_pos, &view_proj](size_t i)
+						{
+							this->SubtreeVisible(first_child + i, view_dir, eye_pos, view_proj);
+						});
+				}
+
+				// An object lives in only one node, so the nodes can be marked in any order
+				visible_nodes_.clear();
+				this->CollectVisibleNodes(0, false);
+				ts.parallel_for(static_cast<size_t>(0), visible_nodes_.size(), CULLING_NODE_GRAIN,
+					[this, &view_dir, &eye_pos, &view_proj](size_t i)
+					{
+						this->MarkNodeObjs(visible_nodes_[i], view_dir, eye_pos, view_proj);
+					});
 			}
 
-			for (auto const & obj : scene_objs_)
-			{
-				if (obj->Visible())
+			ts.parallel_for(static_cast<size_t>(0), static_cast<size_t>(obj_store_.NumSlots()), CULLING_GRAIN,
+				[&, this](size_t i)
 				{
-					BoundOverlap visible = this->VisibleTestFromParent(obj.get(), camera.ForwardVec(), camera.EyePos(), view_proj);
-					if (BO_Partial == visible)
+					uint32_t const attr = attribs[i];
+					if (objs[i] && !parents[i] && !(attr & SceneObject::SOA_Invisible))
 					{
-						uint32_t const attr = obj->Attrib();
-						if (attr & SceneObject::SOA_Moveable)
-						{
-							obj->UpdateAbsModelMatrix();
-						}
-
 						if (attr & SceneObject::SOA_Cullable)
 						{
+							// Static ones are marked by MarkNodeObjs
 							if (attr & SceneObject::SOA_Moveable)
 							{
-								obj->VisibleMark(this->AABBVisible(obj->PosBoundWS()));
-							}
-							else
-							{
-								obj->VisibleMark(visible);
+								marks[i] = this->AABBVisible(aabbs_ws[i]);
 							}
 						}
 						else
 						{
-							obj->VisibleMark(BO_Yes);
+							marks[i] = BO_Yes;
 						}
 					}
-					else
-					{
-						obj->VisibleMark(visible);
-					}
-				}
-			}
+				});
 		}
 
+		this->ClipChildObjects(view_dir, eye_pos, view_proj, omni);
+
 #ifdef KLAYGE_DRAW_NODES
 		node_renderable_->Render();
 #endif
@@ -258,16 +288,22 @@ namespace KlayGE
 		SceneManager::ClearObject();
 
 		octree_.clear();
-		rebuild_tree_ = true;
+		free_node_blocks_.clear();
+		obj_nodes_.clear();
+		pending_objs_.clear();
+		rebuild_tree_ = false;
 	}
 
 	void OCTree::OnAddSceneObject(SceneObjectPtr const & obj)
 	{
+		// Added again once its renderable is ready, with a new bound
+		this->RemoveObject(obj.get());
+
 		uint32_t const attr = obj->Attrib();
 		if ((attr & SceneObject::SOA_Cullable)
 			&& !(attr & SceneObject::SOA_Moveable))
 		{
-			rebuild_tree_ = true;
+			pending_objs_.push_back(obj.get());
 		}
 	}
 
@@ -275,12 +311,10 @@ namespace KlayGE
 	{
 		BOOST_ASSERT(iter != scene_objs_.end());
 
-		uint32_t const attr = (*iter)->Attrib();
-		if ((attr & SceneObject::SOA_Cullable)
-			&& !(attr & SceneObject::SOA_Moveable))
-		{
-			rebuild_tree_ = true;
-		}
+		// In the tree, or pending, maybe more than once
+		SceneObject* so = iter->get();
+		pending_objs_.erase(std::remove(pending_objs_.begin(), pending_objs_.end(), so), pending_objs_.end());
+		this->RemoveObject(so);
 	}
 
 	void OCTree::DoSuspend()
@@ -293,160 +327,392 @@ namespace KlayGE
 		// TODO
 	}
 
-	void OCTree::DivideNode(size_t index, uint32_t curr_depth)
+	void OCTree::RebuildTree()
 	{
-		if (octree_[index].obj_ptrs.size() > 1)
-		{
-			size_t const this_size = octree_.size();
-			AABBox const parent_bb = octree_[index].bb;
-			float3 const parent_center = parent_bb.Center();
-			octree_[index].first_child_index = static_cast<int>(this_size);
-			octree_[index].visible = BO_No;
-
-			octree_.resize(this_size + 8);
-			for (auto so : octree_[index].obj_ptrs)
-			{
-				AABBox const & aabb = so->PosBoundWS();
-				int mark[6];
-				mark[0] = aabb.Min().x() >= parent_center.x() ? 1 : 0;
-				mark[1] = aabb.Min().y() >= parent_center.y() ? 2 : 0;
-				mark[2] = aabb.Min().z() >= parent_center.z() ? 4 : 0;
-				mark[3] = aabb.Max().x() >= parent_center.x() ? 1 : 0;
-				mark[4] = aabb.Max().y() >= parent_center.y() ? 2 : 0;
-				mark[5] = aabb.Max().z() >= parent_center.z() ? 4 : 0;
-				for (int j = 0; j < 8; ++ j)
+		octree_.clear();
+		free_node_blocks_.clear();
+		obj_nodes_.clear();
+		pending_objs_.clear();
+		for (auto const & obj : scene_objs_)
+		{
+			uint32_t const attr = obj->Attrib();
+			if ((attr & SceneObject::SOA_Cullable)
+				&& !(attr & SceneObject::SOA_Moveable))
+			{
+				pending_objs_.push_back(obj.get());
+			}
+		}
+
+		rebuild_tree_ = false;
+	}
+
+	void OCTree::InsertObject(SceneObject* so)
+	{
+		AABBox const & aabb = so->PosBoundWS();
+		this->GrowRoot(aabb);
+
+		size_t index = 0;
+		uint32_t depth = 1;
+		for (;;)
+		{
+			++ octree_[index].num_objs;
+
+			int const child = this->ChildContaining(index, aabb);
+			if (child < 0)
+			{
+				octree_[index].obj_ptrs.push_back(so);
+				obj_nodes_[so] = index;
+
+				if ((-1 == octree_[index].first_child_index) && (depth < max_tree_depth_)
+					&& (octree_[index].obj_ptrs.size() > NODE_SPLIT_THRESHOLD))
 				{
-					if (j == ((j & 1) ? mark[3] : mark[0])
-						+ ((j & 2) ? mark[4] : mark[1])
-						+ ((j & 4) ? mark[5] : mark[2]))
-					{
-						octree_[this_size + j].obj_ptrs.push_back(so);
-					}
+					this->DivideNode(index, depth);
 				}
+				break;
 			}
 
-			for (size_t j = 0; j < 8; ++ j)
+			index = child;
+			++ depth;
+		}
+	}
+
+	void OCTree::RemoveObject(SceneObject* so)
+	{
+		auto iter = obj_nodes_.find(so);
+		if (iter == obj_nodes_.end())
+		{
+			return;
+		}
+
+		size_t const node_index = iter->second;
+		obj_nodes_.erase(iter);
+
+		auto& obj_ptrs = octree_[node_index].obj_ptrs;
+		auto obj_iter = std::find(obj_ptrs.begin(), obj_ptrs.end(), so);
+		BOOST_ASSERT(obj_iter != obj_ptrs.end());
+		*obj_iter = obj_ptrs.back();
+		obj_ptrs.pop_back();
+
+		// The highest node that has few enough objects left is folded back
+		int merge_index = -1;
+		for (int index = static_cast<int>(node_index); index != -1; index = octree_[index].parent_index)
+		{
+			octree_node_t& node = octree_[index];
+			-- node.num_objs;
+			if ((node.first_child_index != -1) && (node.num_objs <= NODE_MERGE_THRESHOLD))
 			{
-				octree_node_t& new_node = octree_[this_size + j];
-				new_node.first_child_index = -1;
-				new_node.bb = AABBox(float3((j & 1) ? parent_center.x() : parent_bb.Min().x(),
-						(j & 2) ? parent_center.y() : parent_bb.Min().y(),
-						(j & 4) ? parent_center.z() : parent_bb.Min().z()),
-					float3((j & 1) ? parent_bb.Max().x() : parent_center.x(),
-						(j & 2) ? parent_bb.Max().y() : parent_center.y(),
-						(j & 4) ? parent_bb.Max().z() : parent_center.z()));
+				merge_index = index;
+			}
+		}
+
+		if (0 == octree_[0].num_objs)
+		{
+			// The next object starts a new tree around itself
+			octree_.clear();
+			free_node_blocks_.clear();
+		}
+		else if (merge_index != -1)
+		{
+			this->MergeNode(merge_index);
+		}
+	}
 
-				if (curr_depth < max_tree_depth_)
+	void OCTree::GrowRoot(AABBox const & aabb)
+	{
+		// Doubles the root towards the object until it fits. The old root becomes one of the children.
+		for (uint32_t i = 0; (i < MAX_ROOT_GROWTH) && !Contains(octree_[0].bb, aabb); ++ i)
+		{
+			AABBox const old_bb = octree_[0].bb;
+			float3 const size = old_bb.Max() - old_bb.Min();
+			float3 const center = old_bb.Center();
+			float3 const obj_center = aabb.Center();
+
+			int old_slot = 0;
+			float3 new_min = old_bb.Min();
+			float3 new_max = old_bb.Max();
+			for (int axis = 0; axis < 3; ++ axis)
+			{
+				if (obj_center[axis] < center[axis])
 				{
-					this->DivideNode(this_size + j, curr_depth + 1);
+					new_min[axis] -= size[axis];
+					old_slot |= 1 << axis;
+				}
+				else
+				{
+					new_max[axis] += size[axis];
 				}
 			}
 
-			octree_[index].obj_ptrs.clear();
-			octree_[index].obj_ptrs.shrink_to_fit();
+			size_t const first_child = this->AllocNodeBlock(0);
+			size_t const moved = first_child + old_slot;
+			octree_[moved].first_child_index = octree_[0].first_child_index;
+			octree_[moved].num_objs = octree_[0].num_objs;
+			octree_[moved].obj_ptrs.swap(octree_[0].obj_ptrs);
+			if (octree_[moved].first_child_index != -1)
+			{
+				for (int j = 0; j < 8; ++ j)
+				{
+					octree_[octree_[moved].first_child_index + j].parent_index = static_cast<int>(moved);
+				}
+			}
+			for (auto so : octree_[moved].obj_ptrs)
+			{
+				obj_nodes_[so] = moved;
+			}
+
+			octree_[0].bb = AABBox(new_min, new_max);
+			octree_[0].first_child_index = static_cast<int>(first_child);
+			for (int j = 0; j < 8; ++ j)
+			{
+				octree_node_t& child = octree_[first_child + j];
+				float3 const child_center = octree_[0].bb.Center();
+				child.bb = AABBox(float3((j & 1) ? child_center.x() : new_min.x(),
+						(j & 2) ? child_center.y() : new_min.y(),
+						(j & 4) ? child_center.z() : new_min.z()),
+					float3((j & 1) ? new_max.x() : child_center.x(),
+						(j & 2) ? new_max.y() : child_center.y(),
+						(j & 4) ? new_max.z() : child_center.z()));
+			}
 		}
 	}
 
-	void OCTree::NodeVisible(size_t index)
+	void OCTree::DivideNode(size_t index, uint32_t curr_depth)
 	{
-		BOOST_ASSERT(index < octree_.size());
+		size_t const first_child = this->AllocNodeBlock(index);
+		AABBox const parent_bb = octree_[index].bb;
+		float3 const parent_center = parent_bb.Center();
+		octree_[index].first_child_index = static_cast<int>(first_child);
 
-		App3DFramework& app = Context::Instance().AppInstance();
-		Camera& camera = app.ActiveCamera();
+		for (size_t j = 0; j < 8; ++ j)
+		{
+			octree_[first_child + j].bb = AABBox(float3((j & 1) ? parent_center.x() : parent_bb.Min().x(),
+					(j & 2) ? parent_center.y() : parent_bb.Min().y(),
+					(j & 4) ? parent_center.z() : parent_bb.Min().z()),
+				float3((j & 1) ? parent_bb.Max().x() : parent_center.x(),
+					(j & 2) ? parent_bb.Max().y() : parent_center.y(),
+					(j & 4) ? parent_bb.Max().z() : parent_center.z()));
+		}
 
-		float4x4 view_proj = camera.ViewProjMatrix();
-		auto drl = Context::Instance().DeferredRenderingLayerInstance();
-		if (drl)
+		// Objects that fit in a child move down. The ones on the boundaries stay, instead of being copied to every
+		//  child they overlap.
+		std::vector<SceneObject*> staying;
+		for (auto so : octree_[index].obj_ptrs)
 		{
-			int32_t cas_index = drl->CurrCascadeIndex();
-			if (cas_index >= 0)
+			int const child = this->ChildContaining(index, so->PosBoundWS());
+			if (child < 0)
 			{
-				view_proj *= drl->GetCascadedShadowLayer()->CascadeCropMatrix(cas_index);
+				staying.push_back(so);
+			}
+			else
+			{
+				octree_[child].obj_ptrs.push_back(so);
+				++ octree_[child].num_objs;
+				obj_nodes_[so] = child;
 			}
 		}
+		octree_[index].obj_ptrs.swap(staying);
 
-		octree_node_t& node = octree_[index];
-		if ((small_obj_threshold_ <= 0)
-			|| ((MathLib::ortho_area(camera.ForwardVec(), node.bb) > small_obj_threshold_)
-				&& (MathLib::perspective_area(camera.EyePos(), view_proj, node.bb) > small_obj_threshold_)))
+		if (curr_depth + 1 < max_tree_depth_)
 		{
-			BoundOverlap const vis = frustum_->Intersect(node.bb);
-			node.visible = vis;
-			if (BO_Partial == vis)
+			for (size_t j = 0; j < 8; ++ j)
 			{
-				if (node.first_child_index != -1)
+				if (octree_[first_child + j].obj_ptrs.size() > NODE_SPLIT_THRESHOLD)
 				{
-					for (int i = 0; i < 8; ++ i)
-					{
-						this->NodeVisible(node.first_child_index + i);
-					}
+					this->DivideNode(first_child + j, curr_depth + 1);
 				}
 			}
 		}
+	}
+
+	void OCTree::MergeNode(size_t index)
+	{
+		int const first_child = octree_[index].first_child_index;
+		if (first_child != -1)
+		{
+			for (int j = 0; j < 8; ++ j)
+			{
+				size_t const child = first_child + j;
+				this->MergeNode(child);
+
+				auto& child_objs = octree_[child].obj_ptrs;
+				for (auto so : child_objs)
+				{
+					obj_nodes_[so] = index;
+				}
+				octree_[index].obj_ptrs.insert(octree_[index].obj_ptrs.end(), child_objs.begin(), child_objs.end());
+			}
+
+			this->FreeNodeBlock(first_child);
+			octree_[index].first_child_index = -1;
+		}
+	}
+
+	int OCTree::ChildContaining(size_t index, AABBox const & aabb) const
+	{
+		octree_node_t const & node = octree_[index];
+		if (-1 == node.first_child_index)
+		{
+			return -1;
+		}
+
+		float3 const center = node.bb.Center();
+		int slot = 0;
+		for (int i = 0; i < 3; ++ i)
+		{
+			if (aabb.Min()[i] >= center[i])
+			{
+				slot |= 1 << i;
+			}
+			else if (aabb.Max()[i] > center[i])
+			{
+				return -1;
+			}
+		}
+		return node.first_child_index + slot;
+	}
+
+	size_t OCTree::AllocNodeBlock(size_t parent_index)
+	{
+		size_t first_index;
+		if (free_node_blocks_.empty())
+		{
+			first_index = octree_.size();
+			octree_.resize(first_index + 8);
+		}
 		else
 		{
+			first_index = free_node_blocks_.back();
+			free_node_blocks_.pop_back();
+		}
+
+		for (size_t j = 0; j < 8; ++ j)
+		{
+			octree_node_t& node = octree_[first_index + j];
+			node.parent_index = static_cast<int>(parent_index);
+			node.first_child_index = -1;
 			node.visible = BO_No;
+			node.num_objs = 0;
+			node.obj_ptrs.clear();
 		}
+		return first_index;
+	}
 
-#ifdef KLAYGE_DRAW_NODES
-		if ((vis != BO_No) && (-1 == node.first_child_index))
+	void OCTree::FreeNodeBlock(size_t first_index)
+	{
+		for (size_t j = 0; j < 8; ++ j)
 		{
-			checked_pointer_cast<NodeRenderable>(node_renderable_)->AddInstance(MathLib::scaling(node.bb.HalfSize()) * MathLib::translation(node.bb.Center()));
+			octree_node_t& node = octree_[first_index + j];
+			node.obj_ptrs.clear();
+			node.obj_ptrs.shrink_to_fit();
 		}
-#endif
+		free_node_blocks_.push_back(first_index);
 	}
 
-	void OCTree::MarkNodeObjs(size_t index, bool force)
+	void OCTree::NodeVisible(size_t index, float3 const & view_dir, float3 const & eye_pos, float4x4 const & view_proj)
 	{
 		BOOST_ASSERT(index < octree_.size());
 
-		App3DFramework& app = Context::Instance().AppInstance();
-		Camera& camera = app.ActiveCamera();
+		octree_node_t& node = octree_[index];
+		if ((small_obj_threshold_ <= 0)
+			|| ((MathLib::ortho_area(view_dir, node.bb) > small_obj_threshold_)
+				&& (MathLib::perspective_area(eye_pos, view_proj, node.bb) > small_obj_threshold_)))
+		{
+			node.visible = frustum_->Intersect(node.bb);
+		}
+		else
+		{
+			node.visible = BO_No;
+		}
+	}
 
-		float4x4 view_proj = camera.ViewProjMatrix();
-		auto drl = Context::Instance().DeferredRenderingLayerInstance();
-		if (drl)
+	void OCTree::SubtreeVisible(size_t index, float3 const & view_dir, float3 const & eye_pos, float4x4 const & view_proj)
+	{
+		this->NodeVisible(index, view_dir, eye_pos, view_proj);
+
+		octree_node_t const & node = octree_[index];
+		if ((BO_Partial == node.visible) && (node.first_child_index != -1))
 		{
-			int32_t cas_index = drl->CurrCascadeIndex();
-			if (cas_index >= 0)
+			for (int i = 0; i < 8; ++ i)
 			{
-				view_proj *= drl->GetCascadedShadowLayer()->CascadeCropMatrix(cas_index);
+				this->SubtreeVisible(node.first_child_index + i, view_dir, eye_pos, view_proj);
 			}
 		}
+	}
 
-		octree_node_t const & node = octree_[index];
+	void OCTree::CollectVisibleNodes(size_t index, bool force)
+	{
+		BOOST_ASSERT(index < octree_.size());
+
+		octree_node_t& node = octree_[index];
 		if ((node.visible != BO_No) || force)
 		{
-			for (auto so : node.obj_ptrs)
+			// Nodes under a fully visible one aren't tested
+			if (force)
 			{
-				if ((BO_No == so->VisibleMark()) && so->Visible())
-				{
-					BoundOverlap visible = this->VisibleTestFromParent(so, camera.ForwardVec(), camera.EyePos(), view_proj);
-					if (BO_Partial == visible)
-					{
-						AABBox const & aabb_ws = so->PosBoundWS();
-						if (so->Parent() || (small_obj_threshold_ <= 0)
-							|| ((MathLib::ortho_area(camera.ForwardVec(), node.bb) > small_obj_threshold_)
-								&& (MathLib::perspective_area(camera.EyePos(), view_proj, aabb_ws) > small_obj_threshold_)))
-						{
-							visible = frustum_->Intersect(aabb_ws);
-						}
-						else
-						{
-							visible = BO_No;
-						}
-					}
-					so->VisibleMark(visible);
-				}
+				node.visible = BO_Yes;
+			}
+
+			if (!node.obj_ptrs.empty())
+			{
+				visible_nodes_.push_back(index);
 			}
 
 			if (node.first_child_index != -1)
 			{
 				for (int i = 0; i < 8; ++ i)
 				{
-					this->MarkNodeObjs(node.first_child_index + i, (BO_Yes == node.visible) || force);
+					this->CollectVisibleNodes(node.first_child_index + i, (BO_Yes == node.visible) || force);
 				}
 			}
+#ifdef KLAYGE_DRAW_NODES
+			else
+			{
+				checked_pointer_cast<NodeRenderable>(node_renderable_)->AddInstance(MathLib::scaling(node.bb.HalfSize()) * MathLib::translation(node.bb.Center()));
+			}
+#endif
+		}
+	}
+
+	void OCTree::MarkNodeObjs(size_t index, float3 const & view_dir, float3 const & eye_pos, float4x4 const & view_proj)
+	{
+		BOOST_ASSERT(index < octree_.size());
+
+		octree_node_t const & node = octree_[index];
+		bool const node_large_enough = (small_obj_threshold_ <= 0)
+			|| (MathLib::ortho_area(view_dir, node.bb) > small_obj_threshold_);
+
+		SceneObject* batch_objs[CULLING_BATCH];
+		AABBox const * batch_aabbs[CULLING_BATCH];
+		BoundOverlap batch_overlaps[CULLING_BATCH];
+		for (size_t first = 0; first < node.obj_ptrs.size(); first += CULLING_BATCH)
+		{
+			size_t const last = std::min(first + CULLING_BATCH, node.obj_ptrs.size());
+			size_t num_batch = 0;
+			for (size_t i = first; i < last; ++ i)
+			{
+				// Children are marked after their parents by ClipChildObjects
+				SceneObject* so = node.obj_ptrs[i];
+				if (!so->Parent() && so->Visible())
+				{
+					if (node_large_enough && ((small_obj_threshold_ <= 0)
+						|| (MathLib::perspective_area(eye_pos, view_proj, so->PosBoundWS()) > small_obj_threshold_)))
+					{
+						batch_objs[num_batch] = so;
+						batch_aabbs[num_batch] = &so->PosBoundWS();
+						++ num_batch;
+					}
+					else
+					{
+						so->VisibleMark(BO_No);
+					}
+				}
+			}
+
+			this->FrustumTestBounds(batch_overlaps, batch_aabbs, num_batch);
+			for (size_t i = 0; i < num_batch; ++ i)
+			{
+				batch_objs[i]->VisibleMark(batch_overlaps[i]);
+			}
 		}
 	}
 
@@ -160,7 +160,7 @@ namespace
 
 		void OnInstanceBegin(uint32_t id)
 		{
-			InstData const * data = static_cast<InstData const *>(instances_[id]->InstanceData());
+			InstData const * data = static_cast<InstData const *>(instances_[id]->RenderInstanceData());
 
 			float4x4 model;
 			model.Col(0, data->mat[0]);
@@ -223,7 +223,7 @@ namespace
 
 		void Instance(float4x4 const & mat, Color const & clr)
 		{
-			model_ = mat;
+			this->ModelMatrix(mat);
 			inst_.clr = clr.ABGR();
 		}
 
@@ -241,17 +241,18 @@ namespace
 		{
 			KFL_UNUSED(app_time);
 
-			last_model_ = model_;
+			last_model_ = this->ModelMatrix();
 
 			float4x4 mat_t = MathLib::transpose(last_model_);
 			inst_.last_mat[0] = mat_t.Row(0);
 			inst_.last_mat[1] = mat_t.Row(1);
 			inst_.last_mat[2] = mat_t.Row(2);
 
-			float e = elapsed_time * 0.3f * -model_(3, 1);
-			model_ *= MathLib::rotation_y(e);
+			float e = elapsed_time * 0.3f * -last_model_(3, 1);
+			float4x4 const model = last_model_ * MathLib::rotation_y(e);
+			this->ModelMatrix(model);
 
-			mat_t = MathLib::transpose(model_);
+			mat_t = MathLib::transpose(model);
 			inst_.mat[0] = mat_t.Row(0);
 			inst_.mat[1] = mat_t.Row(1);
 			inst_.mat[2] = mat_t.Row(2);
@@ -0,0 +1,141 @@
+#include <KlayGE/KlayGE.hpp>
+#include <KlayGE/Context.hpp>
+#include <KlayGE/App3D.hpp>
+#include <KlayGE/Camera.hpp>
+#include <KlayGE/FrameBuffer.hpp>
+#include <KlayGE/RenderFactory.hpp>
+#include <KlayGE/RenderEngine.hpp>
+#include <KlayGE/RenderableHelper.hpp>
+#include <KlayGE/SceneObjectHelper.hpp>
+#include <KlayGE/SceneManager.hpp>
+#include <KlayGE/Light.hpp>
+#include <KlayGE/DeferredRenderingLayer.hpp>
+
+#include <vector>
+
+#include "KlayGETests.hpp"
+
+using namespace std;
+using namespace KlayGE;
+
+namespace
+{
+	uint32_t const NUM_STATIC_CASTERS = 8;
+	uint32_t const NUM_WARM_UP_FRAMES = 3;
+
+	// A sky box, a ground, a row of static casters and a moveable one, under a shadowed spot light
+	class CachedShadowsTest : public KlayGETest
+	{
+	protected:
+		void AdjustConfig(ContextCfg& cfg) override
+		{
+			cfg.deferred_rendering = true;
+		}
+
+		void SetUp() override
+		{
+			KlayGETest::SetUp();
+
+			RenderEngine& re = Context::Instance().RenderFactoryInstance().RenderEngineInstance();
+			FrameBufferPtr const & fb = re.CurFrameBuffer();
+
+			auto drl = Context::Instance().DeferredRenderingLayerInstance();
+			drl->SetupViewport(0, fb, 0);
+			// Every shadow map is drawn in every frame, so only the caching changes the draws
+			drl->ShadowMapUpdateBudget(0);
+
+			Camera& camera = app->ActiveCamera();
+			camera.ViewParams(float3(0, 8, -12), float3(0, 0, 0));
+			camera.ProjParams(PI / 4, static_cast<float>(fb->Width()) / fb->Height(), 0.1f, 100.0f);
+
+			// Hidden in the shadow passes and shown again in the others, every frame. That mustn't throw the caches away.
+			auto sky_box = MakeSharedPtr<SceneObjectSkyBox>();
+			sky_box->AddToSceneManager();
+
+			auto ground = MakeSharedPtr<SceneObjectHelper>(MakeSharedPtr<RenderablePlane>(20.0f, 20.0f, 1, 1, true, true),
+				SceneObject::SOA_Cullable);
+			ground->ModelMatrix(MathLib::rotation_x(PI / 2));
+			ground->AddToSceneManager();
+
+			RenderablePtr caster = MakeSharedPtr<RenderablePlane>(1.0f, 1.0f, 1, 1, true, true);
+			for (uint32_t i = 0; i < NUM_STATIC_CASTERS; ++ i)
+			{
+				static_casters_.push_back(MakeSharedPtr<SceneObjectHelper>(caster, SceneObject::SOA_Cullable));
+				static_casters_.back()->ModelMatrix(MathLib::rotation_x(PI / 2)
+					* MathLib::translation((i - NUM_STATIC_CASTERS / 2.0f) * 1.5f, 1.0f, 0.0f));
+				static_casters_.back()->AddToSceneManager();
+			}
+
+			auto moveable_caster = MakeSharedPtr<SceneObjectHelper>(caster,
+				SceneObject::SOA_Cullable | SceneObject::SOA_Moveable);
+			moveable_caster->ModelMatrix(MathLib::rotation_x(PI / 2) * MathLib::translation(0.0f, 2.0f, 2.0f));
+			moveable_caster->AddToSceneManager();
+
+			auto spot_light = MakeSharedPtr<SpotLightSource>();
+			spot_light->Attrib(0);
+			spot_light->Color(float3(10.0f, 10.0f, 10.0f));
+			spot_light->Falloff(float3(1, 0.5f, 0));
+			spot_light->Position(float3(0, 10, 0));
+			spot_light->Direction(float3(0, -1, 0));
+			spot_light->OuterAngle(PI / 2.5f);
+			spot_light->InnerAngle(PI / 4);
+			spot_light->AddToSceneManager();
+		}
+
+		void TearDown() override
+		{
+			SceneManager& sm = Context::Instance().SceneManagerInstance();
+			sm.ClearObject();
+			sm.ClearLight();
+			static_casters_.clear();
+
+			KlayGETest::TearDown();
+		}
+
+		uint32_t NumDrawsOfFrame()
+		{
+			SceneManager& sm = Context::Instance().SceneManagerInstance();
+			sm.Update();
+			return sm.NumDrawCalls();
+		}
+
+	protected:
+		vector<SceneObjectPtr> static_casters_;
+	};
+}
+
+TEST_F(CachedShadowsTest, DrawsOnlyMoveableCasters)
+{
+	auto drl = Context::Instance().DeferredRenderingLayerInstance();
+
+	drl->CachedShadows(false);
+	for (uint32_t i = 0; i < NUM_WARM_UP_FRAMES; ++ i)
+	{
+		this->NumDrawsOfFrame();
+	}
+	uint32_t const uncached_draws = this->NumDrawsOfFrame();
+
+	drl->CachedShadows(true);
+	// Draws the static casters into the cache
+	this->NumDrawsOfFrame();
+	uint32_t const cached_draws = this->NumDrawsOfFrame();
+	EXPECT_LT(cached_draws, uncached_draws);
+	EXPECT_EQ(cached_draws, this->NumDrawsOfFrame());
+}
+
+TEST_F(CachedShadowsTest, RedrawsAfterStaticChange)
+{
+	auto drl = Context::Instance().DeferredRenderingLayerInstance();
+
+	drl->CachedShadows(true);
+	for (uint32_t i = 0; i < NUM_WARM_UP_FRAMES; ++ i)
+	{
+		this->NumDrawsOfFrame();
+	}
+	uint32_t const cached_draws = this->NumDrawsOfFrame();
+
+	// Moving a static caster throws the cache away once
+	static_casters_[0]->ModelMatrix(MathLib::rotation_x(PI / 2) * MathLib::translation(0.0f, 1.0f, -2.0f));
+	EXPECT_GT(this->NumDrawsOfFrame(), cached_draws);
+	EXPECT_EQ(cached_draws, this->NumDrawsOfFrame());
+}
@@ -0,0 +1,117 @@
+#include <KlayGE/KlayGE.hpp>
+#include <KlayGE/Context.hpp>
+#include <KlayGE/RenderFactory.hpp>
+#include <KlayGE/RenderEffect.hpp>
+#include <KlayGE/RenderLayout.hpp>
+#include <KlayGE/RenderableHelper.hpp>
+#include <KlayGE/SceneObjectHelper.hpp>
+#include <KlayGE/SceneManager.hpp>
+
+#include <vector>
+
+#include "KlayGETests.hpp"
+
+using namespace std;
+using namespace KlayGE;
+
+namespace
+{
+	uint32_t const NUM_OBJECTS = 4;
+
+	// Draws the geometry of another renderable with its effect, but from a layout of its own, like the
+	//  renderables of different meshes sharing the same buffers.
+	class SharedGeometryRenderable : public RenderableHelper
+	{
+	public:
+		explicit SharedGeometryRenderable(RenderableHelper const & src)
+			: RenderableHelper(L"SharedGeometry")
+		{
+			effect_ = src.GetRenderEffect();
+			technique_ = src.GetRenderTechnique();
+			pos_aabb_ = src.PosBound();
+			tc_aabb_ = src.TexcoordBound();
+
+			RenderLayout const & src_rl = src.GetRenderLayout();
+			rl_ = Context::Instance().RenderFactoryInstance().MakeRenderLayout();
+			rl_->TopologyType(src_rl.TopologyType());
+			rl_->BindVertexStream(src_rl.GetVertexStream(0), src_rl.VertexStreamFormat(0));
+			rl_->BindIndexStream(src_rl.GetIndexStream(), src_rl.IndexStreamFormat());
+		}
+	};
+
+	class InstancedSceneObject : public SceneObjectHelper
+	{
+	public:
+		InstancedSceneObject(RenderablePtr const & renderable, float3 const & pos, bool instanced)
+			: SceneObjectHelper(renderable, 0),
+				inst_(pos.x(), pos.y(), pos.z(), 1)
+		{
+			if (instanced)
+			{
+				instance_format_.push_back(VertexElement(VEU_TextureCoord, 1, EF_ABGR32F));
+			}
+			this->ModelMatrix(MathLib::translation(pos));
+		}
+
+		void const * InstanceData() const override
+		{
+			return &inst_;
+		}
+
+	private:
+		float4 inst_;
+	};
+
+	// Returns the number of draws the objects add to a frame
+	uint32_t NumDrawsOfObjects(bool instanced, uint32_t& num_passes)
+	{
+		SceneManager& sm = Context::Instance().SceneManagerInstance();
+
+		sm.ClearObject();
+		sm.Update();
+		uint32_t const base_draws = sm.NumDrawCalls();
+
+		auto box = MakeSharedPtr<RenderableTriBox>(OBBox(float3(0, 0, 0), float3(1, 0, 0), float3(0, 1, 0),
+			float3(0, 0, 1), float3(1, 1, 1)), Color(1, 1, 1, 1));
+		num_passes = box->GetRenderTechnique()->NumPasses();
+
+		vector<SceneObjectPtr> objs;
+		for (uint32_t i = 0; i < NUM_OBJECTS; ++ i)
+		{
+			RenderablePtr renderable;
+			if (0 == i)
+			{
+				renderable = box;
+			}
+			else
+			{
+				renderable = MakeSharedPtr<SharedGeometryRenderable>(*box);
+			}
+
+			objs.push_back(MakeSharedPtr<InstancedSceneObject>(renderable, float3(i * 3.0f, 0, 0), instanced));
+			objs.back()->AddToSceneManager();
+		}
+
+		sm.Update();
+		uint32_t const draws = sm.NumDrawCalls();
+
+		sm.ClearObject();
+
+		return draws - base_draws;
+	}
+}
+
+TEST_F(KlayGETest, InstanceBatchSharedGeometry)
+{
+	uint32_t num_passes;
+	uint32_t const num_draws = NumDrawsOfObjects(true, num_passes);
+	EXPECT_EQ(num_passes, num_draws);
+}
+
+TEST_F(KlayGETest, InstanceBatchNoInstanceFormat)
+{
+	// Without instance data, each renderable keeps its own draw
+	uint32_t num_passes;
+	uint32_t const num_draws = NumDrawsOfObjects(false, num_passes);
+	EXPECT_EQ(NUM_OBJECTS * num_passes, num_draws);
+}
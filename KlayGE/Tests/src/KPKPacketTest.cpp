@@ -0,0 +1,182 @@
+#include <KlayGE/KlayGE.hpp>
+#include <KFL/Util.hpp>
+#include <KFL/ResIdentifier.hpp>
+#include <KlayGE/LZ4Codec.hpp>
+#include <KlayGE/KPKPacket.hpp>
+
+#include <cstdio>
+#include <cstring>
+#include <fstream>
+#include <random>
+#include <string>
+#include <vector>
+
+#include "KlayGETests.hpp"
+
+using namespace std;
+using namespace KlayGE;
+
+namespace
+{
+	std::vector<uint8_t> GenData(uint32_t size, uint32_t alphabet, uint32_t seed)
+	{
+		std::ranlux24_base gen(seed);
+		std::uniform_int_distribution<uint32_t> dis(0, alphabet - 1);
+
+		std::vector<uint8_t> data(size);
+		for (auto& d : data)
+		{
+			d = static_cast<uint8_t>(dis(gen));
+		}
+		return data;
+	}
+
+	std::vector<uint8_t> ReadAll(ResIdentifierPtr const & res)
+	{
+		res->seekg(0, std::ios_base::end);
+		std::vector<uint8_t> data(static_cast<size_t>(res->tellg()));
+		res->seekg(0, std::ios_base::beg);
+		res->read(data.data(), data.size());
+		return data;
+	}
+}
+
+TEST(LZ4CodecTest, RoundTrip)
+{
+	LZ4Codec lz4;
+
+	std::vector<std::vector<uint8_t>> inputs;
+	inputs.push_back(std::vector<uint8_t>());
+	inputs.push_back(GenData(7, 4, 1));
+	inputs.push_back(GenData(100000, 4, 2));
+	inputs.push_back(GenData(100000, 256, 3));
+	inputs.push_back(std::vector<uint8_t>(300000, 'K'));
+	{
+		// Long repeats with a far distance
+		std::vector<uint8_t> block = GenData(50000, 256, 4);
+		std::vector<uint8_t> repeated;
+		for (int i = 0; i < 4; ++ i)
+		{
+			repeated.insert(repeated.end(), block.begin(), block.end());
+		}
+		inputs.push_back(repeated);
+	}
+
+	for (auto const & input : inputs)
+	{
+		std::vector<uint8_t> encoded;
+		lz4.Encode(encoded, input.data(), input.size());
+
+		std::vector<uint8_t> decoded;
+		lz4.Decode(decoded, encoded.data(), encoded.size(), input.size());
+		EXPECT_TRUE(decoded == input);
+	}
+
+	std::vector<uint8_t> encoded;
+	lz4.Encode(encoded, inputs[4].data(), inputs[4].size());
+	EXPECT_LT(encoded.size(), inputs[4].size() / 100);
+}
+
+TEST(LZ4CodecTest, Corrupted)
+{
+	LZ4Codec lz4;
+
+	std::vector<uint8_t> input = GenData(10000, 4, 5);
+	std::vector<uint8_t> encoded;
+	lz4.Encode(encoded, input.data(), input.size());
+
+	std::vector<uint8_t> decoded;
+	EXPECT_ANY_THROW(lz4.Decode(decoded, encoded.data(), encoded.size() / 2, input.size()));
+	EXPECT_ANY_THROW(lz4.Decode(decoded, encoded.data(), encoded.size(), input.size() + 1));
+}
+
+TEST(KPKPacketTest, SaveAndOpen)
+{
+	std::string const pkt_name = "KPKPacketTest.kpk";
+
+	std::vector<std::string> file_paths;
+	std::vector<std::vector<uint8_t>> data;
+	file_paths.push_back("Textures/Compressible.dds");
+	data.push_back(std::vector<uint8_t>(65536, 0x5A));
+	file_paths.push_back("Textures/Random.dds");
+	data.push_back(GenData(12345, 256, 6));
+	file_paths.push_back("Empty.txt");
+	data.push_back(std::vector<uint8_t>());
+	for (uint32_t i = 0; i < 100; ++ i)
+	{
+		file_paths.push_back("Models/Model" + std::to_string(i) + ".meshml");
+		data.push_back(GenData(1000 + i * 37, 16, 100 + i));
+	}
+
+	KPKPacket::Save(pkt_name, file_paths, data, 64);
+
+	{
+		KPKPacket packet(pkt_name, 42);
+		EXPECT_EQ(42U, packet.Timestamp());
+		EXPECT_EQ(file_paths.size(), packet.FilePaths().size());
+
+		for (size_t i = 0; i < file_paths.size(); ++ i)
+		{
+			EXPECT_TRUE(packet.Contains(file_paths[i]));
+
+			ResIdentifierPtr res = packet.Open(file_paths[i], file_paths[i]);
+			ASSERT_TRUE(res);
+			EXPECT_TRUE(ReadAll(res) == data[i]);
+
+			// Stored or decoded, the content is always in memory as a whole
+			ASSERT_EQ(data[i].size(), res->size());
+			if (!data[i].empty())
+			{
+				ASSERT_TRUE(res->data() != nullptr);
+				EXPECT_EQ(0, std::memcmp(res->data(), data[i].data(), data[i].size()));
+			}
+		}
+
+		EXPECT_TRUE(packet.Contains("textures/random.DDS"));
+		EXPECT_FALSE(packet.Contains("Textures/Missing.dds"));
+		EXPECT_FALSE(packet.Open("Missing", "Missing"));
+
+		std::vector<std::string> names = { "Empty.txt", "Missing", "Models/Model7.meshml" };
+		std::vector<ResIdentifierPtr> res;
+		packet.Open(names, names, res);
+		ASSERT_EQ(3U, res.size());
+		EXPECT_TRUE(res[0] && ReadAll(res[0]).empty());
+		EXPECT_FALSE(res[1]);
+		EXPECT_TRUE(res[2] && (ReadAll(res[2]) == data[3 + 7]));
+	}
+
+	std::remove(pkt_name.c_str());
+}
+
+TEST(KPKPacketTest, CorruptedOriginalSize)
+{
+	std::string const pkt_name = "KPKPacketTestCorrupted.kpk";
+
+	std::vector<std::string> file_paths;
+	std::vector<std::vector<uint8_t>> data;
+	file_paths.push_back("Compressible.dds");
+	data.push_back(std::vector<uint8_t>(65536, 0x5A));
+
+	KPKPacket::Save(pkt_name, file_paths, data);
+
+	{
+		KPKPacket packet(pkt_name, 0);
+		EXPECT_TRUE(ReadAll(packet.Open(file_paths[0], file_paths[0])) == data[0]);
+	}
+
+	{
+		// A huge original size mustn't be allocated before the entry is decoded
+		std::fstream fs(pkt_name, std::ios_base::in | std::ios_base::out | std::ios_base::binary);
+		KPKPacket::Entry entry;
+		fs.seekg(sizeof(KPKPacket::Header));
+		fs.read(reinterpret_cast<char*>(&entry), sizeof(entry));
+		ASSERT_EQ(static_cast<uint32_t>(KPKPacket::C_LZ4), LE2Native(entry.codec));
+		entry.original_size = Native2LE(static_cast<uint64_t>(1) << 48);
+		fs.seekp(sizeof(KPKPacket::Header));
+		fs.write(reinterpret_cast<char const *>(&entry), sizeof(entry));
+	}
+
+	EXPECT_ANY_THROW(KPKPacket(pkt_name, 0));
+
+	std::remove(pkt_name.c_str());
+}
@@ -1,6 +1,8 @@
 #include <KlayGE/KlayGE.hpp>
 #include <KlayGE/App3D.hpp>
 #include <KlayGE/ResLoader.hpp>
+#include <KlayGE/Renderable.hpp>
+#include <KlayGE/DeferredRenderingLayer.hpp>
 
 #include "KlayGETests.hpp"
 
@@ -21,8 +23,12 @@ namespace KlayGE
 
 		virtual uint32_t DoUpdate(uint32_t pass) override
 		{
-			KFL_UNUSED(pass);
-			return URV_Finished;
+			auto drl = Context::Instance().DeferredRenderingLayerInstance();
+			if (drl)
+			{
+				return drl->Update(pass);
+			}
+			return URV_NeedFlush | URV_Finished;
 		}
 	};
 
@@ -35,6 +41,7 @@ namespace KlayGE
 		context_cfg.graphics_cfg.hdr = false;
 		context_cfg.graphics_cfg.color_grading = false;
 		context_cfg.graphics_cfg.gamma = false;
+		this->AdjustConfig(context_cfg);
 		Context::Instance().Config(context_cfg);
 
 		app = MakeSharedPtr<KlayGETestsApp>();
@@ -44,4 +51,9 @@ namespace KlayGE
 	void KlayGETest::TearDown()
 	{
 	}
+
+	void KlayGETest::AdjustConfig(ContextCfg& cfg)
+	{
+		KFL_UNUSED(cfg);
+	}
 }
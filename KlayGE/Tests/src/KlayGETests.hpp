@@ -16,6 +16,9 @@ namespace KlayGE
 
 		void TearDown() override;
 
+		// Changes the configuration before the app is created
+		virtual void AdjustConfig(ContextCfg& cfg);
+
 	protected:
 		std::shared_ptr<App3DFramework> app;
 	};
@@ -0,0 +1,87 @@
+#include <KlayGE/KlayGE.hpp>
+#include <KFL/Math.hpp>
+#include <KlayGE/LightIndex.hpp>
+
+#include "KlayGETests.hpp"
+
+#include <vector>
+#include <random>
+
+using namespace std;
+using namespace KlayGE;
+
+namespace
+{
+	Frustum TestFrustum(float3 const & eye_pos, float3 const & look_at)
+	{
+		float4x4 const view = MathLib::look_at_lh(eye_pos, look_at, float3(0, 1, 0));
+		float4x4 const proj = MathLib::perspective_fov_lh(PI / 3, 1.6f, 0.1f, 200.0f);
+		float4x4 const view_proj = view * proj;
+
+		Frustum frustum;
+		frustum.ClipMatrix(view_proj, MathLib::inverse(view_proj));
+		return frustum;
+	}
+
+	std::vector<AABBox> RandomLights(uint32_t num, uint32_t seed)
+	{
+		std::ranlux24_base gen(seed);
+		std::uniform_real_distribution<float> dis_pos(-500.0f, 500.0f);
+		std::uniform_real_distribution<float> dis_range(0.5f, 5.0f);
+
+		std::vector<AABBox> lights;
+		for (uint32_t i = 0; i < num; ++ i)
+		{
+			float3 const center(dis_pos(gen), dis_pos(gen) * 0.05f, dis_pos(gen));
+			float const range = dis_range(gen);
+			lights.emplace_back(center - float3(range, range, range), center + float3(range, range, range));
+		}
+		return lights;
+	}
+}
+
+TEST(LightIndexTest, Query)
+{
+	std::vector<AABBox> const lights = RandomLights(5000, 21);
+
+	LightIndex index;
+	for (uint32_t i = 0; i < lights.size(); ++ i)
+	{
+		index.Add(i * 2 + 1, lights[i]);
+	}
+	index.Build();
+	EXPECT_EQ(lights.size(), index.NumLights());
+
+	Frustum const frusta[] = { TestFrustum(float3(0, 10, 0), float3(1, 10, 1)),
+		TestFrustum(float3(-100, 5, 300), float3(-100, 0, 0)), TestFrustum(float3(0, 150, 0), float3(0, 0, 1)) };
+	for (auto const & frustum : frusta)
+	{
+		std::vector<uint32_t> ref_ids;
+		for (uint32_t i = 0; i < lights.size(); ++ i)
+		{
+			if (frustum.Intersect(lights[i]) != BO_No)
+			{
+				ref_ids.push_back(i * 2 + 1);
+			}
+		}
+		EXPECT_FALSE(ref_ids.empty());
+
+		std::vector<uint32_t> ids;
+		index.Query(frustum, ids);
+		EXPECT_EQ(ref_ids, ids);
+	}
+
+	Frustum const * batch[] = { &frusta[0], nullptr, &frusta[1] };
+	std::vector<std::vector<uint32_t>> batch_ids;
+	index.Query(batch, batch_ids);
+	ASSERT_EQ(3U, batch_ids.size());
+	EXPECT_EQ(lights.size(), batch_ids[1].size());
+	std::vector<uint32_t> ids;
+	index.Query(frusta[1], ids);
+	EXPECT_EQ(ids, batch_ids[2]);
+
+	index.Clear();
+	index.Build();
+	index.Query(frusta[0], ids);
+	EXPECT_TRUE(ids.empty());
+}
@@ -30,3 +30,19 @@ TEST(MathTest, NormalizeFloat4)
 	v = MathLib::normalize(v);
 	EXPECT_LT(MathLib::abs(MathLib::length(v) - 1.0f), 1e-5f);
 }
+
+TEST(MathTest, IntersectSphereFrustum)
+{
+	float4x4 const view = MathLib::look_at_lh(float3(0, 0, 0), float3(0, 0, 1), float3(0, 1, 0));
+	float4x4 const proj = MathLib::perspective_fov_lh(PI / 2, 1.0f, 1.0f, 100.0f);
+	float4x4 const view_proj = view * proj;
+
+	Frustum frustum;
+	frustum.ClipMatrix(view_proj, MathLib::inverse(view_proj));
+
+	EXPECT_EQ(BO_Yes, MathLib::intersect_sphere_frustum(Sphere(float3(0, 0, 50), 1), frustum));
+	EXPECT_EQ(BO_Partial, MathLib::intersect_sphere_frustum(Sphere(float3(0, 0, 100), 1), frustum));
+	EXPECT_EQ(BO_Partial, MathLib::intersect_sphere_frustum(Sphere(float3(50, 0, 50), 1), frustum));
+	EXPECT_EQ(BO_No, MathLib::intersect_sphere_frustum(Sphere(float3(0, 0, -10), 1), frustum));
+	EXPECT_EQ(BO_No, MathLib::intersect_sphere_frustum(Sphere(float3(0, 60, 50), 1), frustum));
+}
@@ -0,0 +1,149 @@
+#include <KlayGE/KlayGE.hpp>
+#include <KFL/Math.hpp>
+#include <KFL/SIMDMath.hpp>
+#include <KlayGE/OcclusionBuffer.hpp>
+
+#include "KlayGETests.hpp"
+
+#include <vector>
+#include <random>
+
+using namespace std;
+using namespace KlayGE;
+
+namespace
+{
+	float4x4 TestViewProj()
+	{
+		float4x4 const view = MathLib::look_at_lh(float3(0, 0, 0), float3(0, 0, 1), float3(0, 1, 0));
+		float4x4 const proj = MathLib::perspective_fov_lh(PI / 2, 2.0f, 1.0f, 100.0f);
+		return view * proj;
+	}
+
+	// A square wall facing the camera, at z = 10
+	void WallOccluder(std::vector<float3>& positions, std::vector<uint16_t>& indices)
+	{
+		positions = { float3(-5, -5, 10), float3(5, -5, 10), float3(5, 5, 10), float3(-5, 5, 10) };
+		indices = { 0, 1, 2, 0, 2, 3 };
+	}
+}
+
+TEST(OcclusionBufferTest, RasterizeTriangle)
+{
+	uint32_t const width = 37;
+	uint32_t const height = 23;
+	uint32_t const pitch = 40;
+
+	std::ranlux24_base gen(11);
+	std::uniform_real_distribution<float> dis_x(-10.0f, width + 10.0f);
+	std::uniform_real_distribution<float> dis_y(-10.0f, height + 10.0f);
+	std::uniform_real_distribution<float> dis_z(0.0f, 1.0f);
+
+	std::vector<float> depth(pitch * height, 1.0f);
+	std::vector<float> ref_depth(pitch * height, 1.0f);
+	uint32_t num_mismatches = 0;
+	for (int t = 0; t < 200; ++ t)
+	{
+		float3 const v[] = { float3(dis_x(gen), dis_y(gen), dis_z(gen)),
+			float3(dis_x(gen), dis_y(gen), dis_z(gen)), float3(dis_x(gen), dis_y(gen), dis_z(gen)) };
+		SIMDMathLib::RasterizeTriangleDepth(depth.data(), width, height, pitch, v[0], v[1], v[2]);
+
+		// Reference with barycentric coordinates in double
+		double const area = (double(v[1].x()) - v[0].x()) * (double(v[2].y()) - v[0].y())
+			- (double(v[1].y()) - v[0].y()) * (double(v[2].x()) - v[0].x());
+		for (uint32_t y = 0; y < height; ++ y)
+		{
+			for (uint32_t x = 0; x < width; ++ x)
+			{
+				double const px = x + 0.5;
+				double const py = y + 0.5;
+				double w[3];
+				for (int k = 0; k < 3; ++ k)
+				{
+					float3 const & a = v[(k + 1) % 3];
+					float3 const & b = v[(k + 2) % 3];
+					w[k] = ((b.x() - a.x()) * (py - a.y()) - (b.y() - a.y()) * (px - a.x())) / area;
+				}
+				if ((w[0] >= 0) && (w[1] >= 0) && (w[2] >= 0))
+				{
+					float const z = static_cast<float>(w[0] * v[0].z() + w[1] * v[1].z() + w[2] * v[2].z());
+					ref_depth[y * pitch + x] = std::min(ref_depth[y * pitch + x], z);
+				}
+			}
+		}
+
+		for (uint32_t y = 0; y < height; ++ y)
+		{
+			for (uint32_t x = 0; x < width; ++ x)
+			{
+				// Pixel centers right on an edge can go either way
+				if (MathLib::abs(depth[y * pitch + x] - ref_depth[y * pitch + x]) > 1e-4f)
+				{
+					++ num_mismatches;
+					depth[y * pitch + x] = ref_depth[y * pitch + x];
+				}
+			}
+			for (uint32_t x = width; x < pitch; ++ x)
+			{
+				EXPECT_EQ(1.0f, depth[y * pitch + x]);
+			}
+		}
+	}
+
+	EXPECT_LT(num_mismatches, 20U);
+}
+
+TEST(OcclusionBufferTest, Occluded)
+{
+	float4x4 const view_proj = TestViewProj();
+
+	std::vector<float3> positions;
+	std::vector<uint16_t> indices;
+	WallOccluder(positions, indices);
+
+	OcclusionBuffer buffer(64, 32);
+	buffer.RasterizeTriangles(positions.data(), static_cast<uint32_t>(positions.size()), indices.data(),
+		static_cast<uint32_t>(indices.size()), view_proj);
+	buffer.BuildHiZ();
+
+	// Behind the wall
+	EXPECT_TRUE(buffer.Occluded(AABBox(float3(-1, -1, 20), float3(1, 1, 22)), view_proj));
+	EXPECT_TRUE(buffer.Occluded(AABBox(float3(-9, -9, 50), float3(9, 9, 60)), view_proj));
+	// In front of the wall
+	EXPECT_FALSE(buffer.Occluded(AABBox(float3(-1, -1, 5), float3(1, 1, 6)), view_proj));
+	// Through the wall
+	EXPECT_FALSE(buffer.Occluded(AABBox(float3(-1, -1, 9), float3(1, 1, 11)), view_proj));
+	// Behind, but sticking out on a side
+	EXPECT_FALSE(buffer.Occluded(AABBox(float3(3, -1, 20), float3(12, 1, 22)), view_proj));
+	// Behind, and reaching far past the screen, further than a uint32_t pixel coordinate goes
+	EXPECT_FALSE(buffer.Occluded(AABBox(float3(-1, -1, 20), float3(1e11f, 1e11f, 22)), view_proj));
+	// Crossing the near plane
+	EXPECT_FALSE(buffer.Occluded(AABBox(float3(-1, -1, -5), float3(1, 1, 22)), view_proj));
+
+	// The wall itself isn't occluded by its own proxy
+	EXPECT_FALSE(buffer.Occluded(AABBox(float3(-5, -5, 9.9f), float3(5, 5, 10.1f)), view_proj));
+
+	buffer.Clear();
+	buffer.BuildHiZ();
+	EXPECT_FALSE(buffer.Occluded(AABBox(float3(-1, -1, 20), float3(1, 1, 22)), view_proj));
+}
+
+TEST(OcclusionBufferTest, NearPlane)
+{
+	float4x4 const view_proj = TestViewProj();
+
+	// Reaches behind the camera, so it's skipped
+	std::vector<float3> const positions = { float3(-50, -50, -10), float3(50, -50, 10), float3(0, 50, 10) };
+	std::vector<uint16_t> const indices = { 0, 1, 2 };
+
+	OcclusionBuffer buffer(64, 32);
+	buffer.RasterizeTriangles(positions.data(), static_cast<uint32_t>(positions.size()), indices.data(),
+		static_cast<uint32_t>(indices.size()), view_proj);
+	for (uint32_t y = 0; y < buffer.Height(); ++ y)
+	{
+		for (uint32_t x = 0; x < buffer.Width(); ++ x)
+		{
+			EXPECT_EQ(1.0f, buffer.Depth(x, y));
+		}
+	}
+}
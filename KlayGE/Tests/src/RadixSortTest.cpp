@@ -0,0 +1,55 @@
+#include <KlayGE/KlayGE.hpp>
+#include <KFL/RadixSort.hpp>
+
+#include "KlayGETests.hpp"
+
+#include <algorithm>
+#include <vector>
+#include <random>
+
+using namespace std;
+using namespace KlayGE;
+
+namespace
+{
+	std::vector<std::pair<uint64_t, uint32_t>> GenItems(size_t num, uint64_t key_mask, uint32_t seed)
+	{
+		std::mt19937_64 gen(seed);
+		std::vector<std::pair<uint64_t, uint32_t>> items(num);
+		for (size_t i = 0; i < num; ++ i)
+		{
+			items[i] = std::make_pair(gen() & key_mask, static_cast<uint32_t>(i));
+		}
+		return items;
+	}
+
+	uint64_t ItemKey(std::pair<uint64_t, uint32_t> const & item)
+	{
+		return item.first;
+	}
+}
+
+TEST(RadixSortTest, Sort)
+{
+	uint64_t const masks[] = { 0xFFFFFFFFFFFFFFFFULL, 0xFFFF000000FF0000ULL, 0x3ULL, 0 };
+	size_t const sizes[] = { 0, 1, 2, 100, 10000 };
+	for (auto mask : masks)
+	{
+		for (auto size : sizes)
+		{
+			auto items = GenItems(size, mask, static_cast<uint32_t>(size));
+
+			// The payload is the original index, so stable_sort gives the only correct result
+			auto expected = items;
+			std::stable_sort(expected.begin(), expected.end(),
+				[](std::pair<uint64_t, uint32_t> const & lhs, std::pair<uint64_t, uint32_t> const & rhs)
+				{
+					return lhs.first < rhs.first;
+				});
+
+			std::vector<std::pair<uint64_t, uint32_t>> temp(items.size());
+			RadixSort(items.data(), temp.data(), items.size(), ItemKey);
+			EXPECT_TRUE(items == expected);
+		}
+	}
+}
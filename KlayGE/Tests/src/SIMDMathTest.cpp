@@ -7,10 +7,55 @@
 #include <vector>
 #include <string>
 #include <iostream>
+#include <random>
 
 using namespace std;
 using namespace KlayGE;
 
+namespace
+{
+	Frustum TestFrustum()
+	{
+		float4x4 const view = MathLib::look_at_lh(float3(1, 2, -3), float3(2, 1, 10), float3(0, 1, 0));
+		float4x4 const proj = MathLib::perspective_fov_lh(PI / 3, 1.5f, 1.0f, 100.0f);
+		float4x4 const view_proj = view * proj;
+
+		Frustum frustum;
+		frustum.ClipMatrix(view_proj, MathLib::inverse(view_proj));
+		return frustum;
+	}
+
+	struct SoABounds
+	{
+		std::vector<float> center_x, center_y, center_z;
+		std::vector<float> extent_x, extent_y, extent_z;
+		std::vector<AABBox> aabbs;
+
+		SoABounds(size_t num, uint32_t seed)
+		{
+			std::ranlux24_base gen(seed);
+			std::uniform_real_distribution<float> pos_dis(-60, 60);
+			std::uniform_real_distribution<float> size_dis(0.01f, 8);
+
+			for (size_t i = 0; i < num; ++ i)
+			{
+				float3 const pos(pos_dis(gen), pos_dis(gen), pos_dis(gen) + 50);
+				float3 const size(size_dis(gen), size_dis(gen), size_dis(gen));
+				aabbs.emplace_back(pos - size, pos + size);
+
+				float3 const center = aabbs.back().Center();
+				float3 const extent = aabbs.back().HalfSize();
+				center_x.push_back(center.x());
+				center_y.push_back(center.y());
+				center_z.push_back(center.z());
+				extent_x.push_back(extent.x());
+				extent_y.push_back(extent.y());
+				extent_z.push_back(extent.z());
+			}
+		}
+	};
+}
+
 TEST(SIMDMathTest, NormalizeVector2)
 {
 	SIMDVectorF4 v = SIMDMathLib::SetVector(1, 2, 0, 0);
@@ -31,3 +76,55 @@ TEST(SIMDMathTest, NormalizeVector4)
 	v = SIMDMathLib::NormalizeVector4(v);
 	EXPECT_LT(MathLib::abs(SIMDMathLib::GetX(SIMDMathLib::LengthVector4(v)) - 1.0f), 1e-3f);
 }
+
+TEST(SIMDMathTest, IntersectAABBFrustum)
+{
+	Frustum const frustum = TestFrustum();
+
+	// Not a multiple of 4, to cover the remainder
+	SoABounds const bounds(10003, 1);
+	std::vector<BoundOverlap> overlaps(bounds.aabbs.size());
+	SIMDMathLib::IntersectAABBFrustum(overlaps.data(), bounds.center_x.data(), bounds.center_y.data(),
+		bounds.center_z.data(), bounds.extent_x.data(), bounds.extent_y.data(), bounds.extent_z.data(),
+		bounds.aabbs.size(), frustum);
+
+	uint32_t counts[3] = { 0, 0, 0 };
+	for (size_t i = 0; i < bounds.aabbs.size(); ++ i)
+	{
+		EXPECT_EQ(MathLib::intersect_aabb_frustum(bounds.aabbs[i], frustum), overlaps[i]);
+		++ counts[overlaps[i]];
+	}
+	EXPECT_GT(counts[BO_Yes], 0U);
+	EXPECT_GT(counts[BO_No], 0U);
+	EXPECT_GT(counts[BO_Partial], 0U);
+
+	// Unaligned input
+	SIMDMathLib::IntersectAABBFrustum(overlaps.data(), bounds.center_x.data() + 1, bounds.center_y.data() + 1,
+		bounds.center_z.data() + 1, bounds.extent_x.data() + 1, bounds.extent_y.data() + 1, bounds.extent_z.data() + 1,
+		bounds.aabbs.size() - 1, frustum);
+	for (size_t i = 0; i < bounds.aabbs.size() - 1; ++ i)
+	{
+		EXPECT_EQ(MathLib::intersect_aabb_frustum(bounds.aabbs[i + 1], frustum), overlaps[i]);
+	}
+}
+
+TEST(SIMDMathTest, IntersectSphereFrustum)
+{
+	Frustum const frustum = TestFrustum();
+
+	SoABounds const bounds(10003, 2);
+	std::vector<BoundOverlap> overlaps(bounds.aabbs.size());
+	SIMDMathLib::IntersectSphereFrustum(overlaps.data(), bounds.center_x.data(), bounds.center_y.data(),
+		bounds.center_z.data(), bounds.extent_x.data(), bounds.aabbs.size(), frustum);
+
+	uint32_t counts[3] = { 0, 0, 0 };
+	for (size_t i = 0; i < bounds.aabbs.size(); ++ i)
+	{
+		Sphere const sphere(bounds.aabbs[i].Center(), bounds.extent_x[i]);
+		EXPECT_EQ(MathLib::intersect_sphere_frustum(sphere, frustum), overlaps[i]);
+		++ counts[overlaps[i]];
+	}
+	EXPECT_GT(counts[BO_Yes], 0U);
+	EXPECT_GT(counts[BO_No], 0U);
+	EXPECT_GT(counts[BO_Partial], 0U);
+}
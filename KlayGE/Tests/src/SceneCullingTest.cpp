@@ -0,0 +1,452 @@
+#include <KlayGE/KlayGE.hpp>
+#include <KFL/Math.hpp>
+#include <KlayGE/Context.hpp>
+#include <KlayGE/App3D.hpp>
+#include <KlayGE/Camera.hpp>
+#include <KlayGE/RenderableHelper.hpp>
+#include <KlayGE/SceneObjectHelper.hpp>
+#include <KlayGE/SceneManager.hpp>
+
+#include <string>
+#include <vector>
+
+#include "KlayGETests.hpp"
+
+using namespace std;
+using namespace KlayGE;
+
+namespace
+{
+	uint32_t const GRID_SIZE = 8;
+	float const GRID_SPACING = 4.0f;
+
+	// A grid of boxes on the xz plane around the origin, and views looking at it from different sides
+	class SceneCullingTest : public KlayGETest
+	{
+	protected:
+		void SetUp() override
+		{
+			KlayGETest::SetUp();
+
+			std::string const sm_name = this->SceneManagerName();
+			if (!sm_name.empty())
+			{
+				Context::Instance().LoadSceneManager(sm_name);
+			}
+
+			SceneManager& sm = Context::Instance().SceneManagerInstance();
+			// The small object test only runs for some of the views
+			sm.SmallObjectThreshold(0);
+
+			box_ = MakeSharedPtr<RenderableTriBox>(OBBox(float3(0, 0, 0), float3(1, 0, 0), float3(0, 1, 0),
+				float3(0, 0, 1), float3(0.5f, 0.5f, 0.5f)), Color(1, 1, 1, 1));
+			for (uint32_t z = 0; z < GRID_SIZE; ++ z)
+			{
+				for (uint32_t x = 0; x < GRID_SIZE; ++ x)
+				{
+					float3 const pos((x - GRID_SIZE / 2.0f) * GRID_SPACING, 0, (z - GRID_SIZE / 2.0f) * GRID_SPACING);
+					objs_.push_back(this->AddBox(pos, SceneObject::SOA_Cullable));
+				}
+			}
+
+			views_.push_back(this->MakeView(float3(0, 5, -30), float3(0, 0, 0)));
+			views_.push_back(this->MakeView(float3(30, 5, 0), float3(0, 0, 0)));
+			views_.push_back(this->MakeView(float3(-2, 1, -2), float3(-10, 0, -10)));
+		}
+
+		void TearDown() override
+		{
+			Context::Instance().SceneManagerInstance().ClearObject();
+			objs_.clear();
+			views_.clear();
+			box_.reset();
+
+			if (!this->SceneManagerName().empty())
+			{
+				Context::Instance().LoadSceneManager(Context::Instance().Config().scene_manager_name);
+			}
+
+			KlayGETest::TearDown();
+		}
+
+		// The plugin the tests run on, the configured one if empty
+		virtual std::string SceneManagerName() const
+		{
+			return std::string();
+		}
+
+		SceneObjectPtr AddBox(float3 const & pos, uint32_t attrib)
+		{
+			auto obj = MakeSharedPtr<SceneObjectHelper>(box_, attrib);
+			obj->ModelMatrix(MathLib::translation(pos));
+			obj->AddToSceneManager();
+			return obj;
+		}
+
+		CameraPtr MakeView(float3 const & eye_pos, float3 const & look_at)
+		{
+			auto camera = MakeSharedPtr<Camera>();
+			camera->ViewParams(eye_pos, look_at);
+			camera->ProjParams(PI / 4, 1, 0.1f, 100.0f);
+			return camera;
+		}
+
+		// One bit per scene object, set if its mark isn't BO_No, in the layout of ClipFrusta
+		vector<uint32_t> MarkedBits()
+		{
+			SceneManager& sm = Context::Instance().SceneManagerInstance();
+			vector<uint32_t> bits((sm.NumSceneObjects() + 31) / 32, 0);
+			for (uint32_t i = 0; i < sm.NumSceneObjects(); ++ i)
+			{
+				if (sm.GetSceneObject(i)->VisibleMark() != BO_No)
+				{
+					bits[i / 32] |= (1UL << (i & 31));
+				}
+			}
+			return bits;
+		}
+
+		// Culls the scene for a view through the flush of the active camera
+		vector<uint32_t> FlushedBits(Camera const & view)
+		{
+			Camera& camera = app->ActiveCamera();
+			camera.ViewParams(view.EyePos(), view.LookAt(), view.UpVec());
+			camera.ProjParams(view.FOV(), view.Aspect(), view.NearPlane(), view.FarPlane());
+
+			Context::Instance().SceneManagerInstance().Update();
+			return this->MarkedBits();
+		}
+
+		// Tests the bound of every object on its own, children are only visible with their parents
+		static bool BruteForceVisible(SceneObject const & obj, Frustum const & frustum)
+		{
+			if (!obj.Visible() || (obj.Parent() && !BruteForceVisible(*obj.Parent(), frustum)))
+			{
+				return false;
+			}
+			return !(obj.Attrib() & SceneObject::SOA_Cullable) || (frustum.Intersect(obj.PosBoundWS()) != BO_No);
+		}
+
+		vector<uint32_t> BruteForceBits(Camera const & view)
+		{
+			SceneManager& sm = Context::Instance().SceneManagerInstance();
+			vector<uint32_t> bits((sm.NumSceneObjects() + 31) / 32, 0);
+			for (uint32_t i = 0; i < sm.NumSceneObjects(); ++ i)
+			{
+				if (BruteForceVisible(*sm.GetSceneObject(i), view.ViewFrustum()))
+				{
+					bits[i / 32] |= (1UL << (i & 31));
+				}
+			}
+			return bits;
+		}
+
+		// Flushes every view, in the frame the scene is in now
+		void ExpectMatchesBruteForce()
+		{
+			for (auto const & view : views_)
+			{
+				vector<uint32_t> const flushed = this->FlushedBits(*view);
+				EXPECT_EQ(this->BruteForceBits(*view), flushed);
+			}
+		}
+
+	protected:
+		RenderablePtr box_;
+		vector<SceneObjectPtr> objs_;
+		vector<CameraPtr> views_;
+	};
+
+	class BVHCullingTest : public SceneCullingTest
+	{
+	protected:
+		std::string SceneManagerName() const override
+		{
+			return "BVH";
+		}
+	};
+
+	class OCTreeCullingTest : public SceneCullingTest
+	{
+	protected:
+		std::string SceneManagerName() const override
+		{
+			return "OCTree";
+		}
+	};
+}
+
+TEST_F(SceneCullingTest, ClipCamerasMatchFlush)
+{
+	SceneManager& sm = Context::Instance().SceneManagerInstance();
+	for (auto const & view : views_)
+	{
+		vector<uint32_t> const expected = this->FlushedBits(*view);
+
+		sm.ClipCameras(view.get());
+		EXPECT_EQ(expected, this->MarkedBits());
+
+		// From the cached marks
+		sm.ClipCameras(view.get());
+		EXPECT_EQ(expected, this->MarkedBits());
+	}
+}
+
+TEST_F(SceneCullingTest, ClipFrustaMatchFlush)
+{
+	vector<Frustum const *> frusta;
+	vector<vector<uint32_t>> expected;
+	for (auto const & view : views_)
+	{
+		frusta.push_back(&view->ViewFrustum());
+		expected.push_back(this->FlushedBits(*view));
+	}
+
+	vector<vector<uint32_t>> visible_bits;
+	Context::Instance().SceneManagerInstance().ClipFrusta(frusta, visible_bits);
+	EXPECT_EQ(expected, visible_bits);
+}
+
+TEST_F(SceneCullingTest, ClipCamerasKeepFlushedFrustum)
+{
+	SceneManager& sm = Context::Instance().SceneManagerInstance();
+	this->FlushedBits(*views_[0]);
+
+	// In front of the first view, behind the second one
+	AABBox const aabb(float3(-1, -1, -21), float3(1, 1, -19));
+	BoundOverlap const visible = sm.AABBVisible(aabb);
+	EXPECT_NE(BO_No, visible);
+
+	sm.ClipCameras(views_[1].get());
+	EXPECT_EQ(visible, sm.AABBVisible(aabb));
+}
+
+TEST_F(BVHCullingTest, MatchesBruteForce)
+{
+	this->ExpectMatchesBruteForce();
+}
+
+TEST_F(BVHCullingTest, MoveableObjects)
+{
+	// Crossing the grid and leaving it, further than the fat margin of their leaves in every frame
+	vector<SceneObjectPtr> moveables;
+	for (uint32_t i = 0; i < GRID_SIZE; ++ i)
+	{
+		moveables.push_back(this->AddBox(float3(-20, 1, (i - GRID_SIZE / 2.0f) * GRID_SPACING),
+			SceneObject::SOA_Cullable | SceneObject::SOA_Moveable));
+	}
+	for (uint32_t frame = 0; frame < 10; ++ frame)
+	{
+		for (uint32_t i = 0; i < moveables.size(); ++ i)
+		{
+			moveables[i]->ModelMatrix(MathLib::translation(-20 + frame * 5.0f, 1.0f,
+				(i - GRID_SIZE / 2.0f) * GRID_SPACING + frame * 0.5f));
+		}
+		this->ExpectMatchesBruteForce();
+	}
+}
+
+TEST_F(BVHCullingTest, AddAndRemove)
+{
+	for (size_t i = 0; i < objs_.size(); i += 3)
+	{
+		objs_[i]->DelFromSceneManager();
+	}
+	this->ExpectMatchesBruteForce();
+
+	// Inside the tree and far outside of it
+	this->AddBox(float3(1, 2, 1), SceneObject::SOA_Cullable);
+	this->AddBox(float3(-60, 0, -60), SceneObject::SOA_Cullable);
+	this->AddBox(float3(-7, 0, -7), SceneObject::SOA_Cullable | SceneObject::SOA_Moveable);
+	this->ExpectMatchesBruteForce();
+
+	// Hidden objects stay in the tree
+	objs_[1]->Visible(false);
+	this->ExpectMatchesBruteForce();
+	objs_[1]->Visible(true);
+	this->ExpectMatchesBruteForce();
+}
+
+TEST_F(OCTreeCullingTest, MatchesBruteForce)
+{
+	this->ExpectMatchesBruteForce();
+}
+
+TEST_F(OCTreeCullingTest, IncrementalInsert)
+{
+	this->ExpectMatchesBruteForce();
+
+	// Into the nodes of the existing tree, enough of them to divide the nodes again
+	for (uint32_t i = 0; i < 24; ++ i)
+	{
+		this->AddBox(float3(-13 + (i % 6) * 0.8f, (i / 6) * 1.5f, -13 + (i % 4) * 0.7f), SceneObject::SOA_Cullable);
+		if (0 == (i % 5))
+		{
+			this->ExpectMatchesBruteForce();
+		}
+	}
+	this->ExpectMatchesBruteForce();
+}
+
+TEST_F(OCTreeCullingTest, GrowRoot)
+{
+	this->ExpectMatchesBruteForce();
+
+	// Outside the root on every side, so it grows around the old one in different directions
+	float3 const far_positions[] = { float3(40, 0, 0), float3(-40, 3, -40), float3(0, 25, 60), float3(-70, -10, 10) };
+	for (auto const & pos : far_positions)
+	{
+		this->AddBox(pos, SceneObject::SOA_Cullable);
+		this->ExpectMatchesBruteForce();
+	}
+}
+
+TEST_F(OCTreeCullingTest, RemoveAndMerge)
+{
+	this->ExpectMatchesBruteForce();
+
+	// Emptied down to the merge threshold, then to nothing, and filled again
+	for (size_t i = 0; i < objs_.size(); ++ i)
+	{
+		objs_[i]->DelFromSceneManager();
+		if ((0 == (i % 8)) || (i + 4 >= objs_.size()))
+		{
+			this->ExpectMatchesBruteForce();
+		}
+	}
+	for (size_t i = 0; i < objs_.size(); i += 2)
+	{
+		objs_[i]->AddToSceneManager();
+	}
+	this->ExpectMatchesBruteForce();
+}
+
+TEST_F(OCTreeCullingTest, MoveableObjects)
+{
+	// Moveable objects aren't in the tree
+	vector<SceneObjectPtr> moveables;
+	for (uint32_t i = 0; i < GRID_SIZE; ++ i)
+	{
+		moveables.push_back(this->AddBox(float3(-20, 1, (i - GRID_SIZE / 2.0f) * GRID_SPACING),
+			SceneObject::SOA_Cullable | SceneObject::SOA_Moveable));
+	}
+	for (uint32_t frame = 0; frame < 10; ++ frame)
+	{
+		for (uint32_t i = 0; i < moveables.size(); ++ i)
+		{
+			moveables[i]->ModelMatrix(MathLib::translation(-20 + frame * 5.0f, 1.0f,
+				(i - GRID_SIZE / 2.0f) * GRID_SPACING));
+		}
+		this->ExpectMatchesBruteForce();
+	}
+}
+
+TEST_F(SceneCullingTest, ParallelCullIsStable)
+{
+	// Enough objects for several chunks of the parallel culling, static and moveable ones
+	for (uint32_t z = 0; z < 32; ++ z)
+	{
+		for (uint32_t x = 0; x < 32; ++ x)
+		{
+			this->AddBox(float3(x * 1.3f - 20, 2 + (x & 1) * 0.5f, z * 1.3f - 20),
+				((x + z) & 3) ? SceneObject::SOA_Cullable : (SceneObject::SOA_Cullable | SceneObject::SOA_Moveable));
+		}
+	}
+
+	// The views take turns, so none of them is flushed from its cached marks
+	vector<vector<uint32_t>> first_bits;
+	for (auto const & view : views_)
+	{
+		first_bits.push_back(this->FlushedBits(*view));
+		EXPECT_EQ(this->BruteForceBits(*view), first_bits.back());
+	}
+	for (uint32_t run = 0; run < 8; ++ run)
+	{
+		for (size_t i = 0; i < views_.size(); ++ i)
+		{
+			EXPECT_EQ(first_bits[i], this->FlushedBits(*views_[i]));
+		}
+	}
+}
+
+TEST_F(SceneCullingTest, DirtyHierarchy)
+{
+	// Children inside the bounds of their parents, which is what the brute-force test assumes
+	auto small_box = MakeSharedPtr<RenderableTriBox>(OBBox(float3(0, 0, 0), float3(1, 0, 0), float3(0, 1, 0),
+		float3(0, 0, 1), float3(0.2f, 0.2f, 0.2f)), Color(1, 1, 1, 1));
+	vector<SceneObjectPtr> parents;
+	vector<SceneObjectPtr> children;
+	for (uint32_t i = 0; i < GRID_SIZE; ++ i)
+	{
+		parents.push_back(this->AddBox(float3(-20, 2, (i - GRID_SIZE / 2.0f) * GRID_SPACING),
+			SceneObject::SOA_Cullable | SceneObject::SOA_Moveable));
+
+		children.push_back(MakeSharedPtr<SceneObjectHelper>(small_box,
+			SceneObject::SOA_Cullable | SceneObject::SOA_Moveable));
+		children.back()->ModelMatrix(MathLib::translation(0.2f, 0.0f, 0.0f));
+		children.back()->Parent(parents.back().get());
+		children.back()->AddToSceneManager();
+	}
+
+	for (uint32_t frame = 0; frame < 12; ++ frame)
+	{
+		// Only the parents move in some frames, only the children in others, and both in the rest
+		for (uint32_t i = 0; i < parents.size(); ++ i)
+		{
+			if (frame % 3 != 1)
+			{
+				parents[i]->ModelMatrix(MathLib::translation(-20 + frame * 4.0f, 2.0f,
+					(i - GRID_SIZE / 2.0f) * GRID_SPACING));
+			}
+			if (frame % 3 != 0)
+			{
+				children[i]->ModelMatrix(MathLib::translation(0.2f, ((frame + i) % 4) * 0.1f - 0.15f, 0.0f));
+			}
+		}
+		this->ExpectMatchesBruteForce();
+
+		// The world bounds follow both levels
+		for (uint32_t i = 0; i < children.size(); ++ i)
+		{
+			AABBox const expected = MathLib::transform_aabb(small_box->PosBound(),
+				parents[i]->ModelMatrix() * children[i]->ModelMatrix());
+			EXPECT_TRUE(expected.Min() == children[i]->PosBoundWS().Min());
+			EXPECT_TRUE(expected.Max() == children[i]->PosBoundWS().Max());
+		}
+	}
+}
+
+TEST_F(SceneCullingTest, CachedMarksFollowChanges)
+{
+	// Only one view, so every flush after the first starts from the cached marks
+	Camera const & view = *views_[0];
+	auto expect_matches = [this, &view]()
+		{
+			vector<uint32_t> const flushed = this->FlushedBits(view);
+			EXPECT_EQ(this->BruteForceBits(view), flushed);
+		};
+	expect_matches();
+	expect_matches();
+
+	// Into the view and out of it again
+	auto moveable = this->AddBox(float3(-60, 0, 0), SceneObject::SOA_Cullable | SceneObject::SOA_Moveable);
+	expect_matches();
+	moveable->ModelMatrix(MathLib::translation(0.0f, 1.0f, -10.0f));
+	expect_matches();
+	moveable->ModelMatrix(MathLib::translation(0.0f, 1.0f, -40.0f));
+	expect_matches();
+
+	objs_[GRID_SIZE + 3]->Visible(false);
+	expect_matches();
+	objs_[GRID_SIZE + 3]->Visible(true);
+	expect_matches();
+
+	this->AddBox(float3(1, 3, -5), SceneObject::SOA_Cullable);
+	expect_matches();
+	objs_[2]->DelFromSceneManager();
+	moveable->DelFromSceneManager();
+	expect_matches();
+
+	// Nothing changed since the last flush
+	expect_matches();
+}
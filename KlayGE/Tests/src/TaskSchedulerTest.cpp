@@ -0,0 +1,123 @@
+#include <KlayGE/KlayGE.hpp>
+#include <KFL/Thread.hpp>
+#include <KFL/TaskScheduler.hpp>
+
+#include <atomic>
+#include <numeric>
+#include <stdexcept>
+#include <vector>
+
+#include "KlayGETests.hpp"
+
+using namespace std;
+using namespace KlayGE;
+
+TEST(TaskSchedulerTest, ParallelFor)
+{
+	task_scheduler ts(4);
+
+	std::vector<uint32_t> hits(100000, 0);
+	ts.parallel_for(0U, static_cast<uint32_t>(hits.size()), [&hits](uint32_t i)
+		{
+			++ hits[i];
+		});
+	for (auto hit : hits)
+	{
+		EXPECT_EQ(1U, hit);
+	}
+
+	uint32_t calls = 0;
+	ts.parallel_for(5, 5, [&calls](int)
+		{
+			++ calls;
+		});
+	EXPECT_EQ(0U, calls);
+}
+
+TEST(TaskSchedulerTest, ParallelReduce)
+{
+	task_scheduler ts(4);
+
+	std::vector<uint64_t> values(123457);
+	std::iota(values.begin(), values.end(), 1ULL);
+
+	uint64_t const sum = ts.parallel_reduce(static_cast<size_t>(0), values.size(), static_cast<size_t>(1000), 0ULL,
+		[&values](size_t first, size_t last)
+		{
+			return std::accumulate(values.begin() + first, values.begin() + last, 0ULL);
+		},
+		[](uint64_t lhs, uint64_t rhs)
+		{
+			return lhs + rhs;
+		});
+	EXPECT_EQ(values.size() * (values.size() + 1) / 2, sum);
+}
+
+TEST(TaskSchedulerTest, NestedGroups)
+{
+	task_scheduler ts(3);
+
+	std::atomic<uint32_t> count(0);
+	task_group outer(ts);
+	for (uint32_t i = 0; i < 16; ++ i)
+	{
+		outer.run([&ts, &count]
+			{
+				task_group inner(ts);
+				for (uint32_t j = 0; j < 16; ++ j)
+				{
+					inner.run([&count]
+						{
+							++ count;
+						});
+				}
+				inner.wait();
+			});
+	}
+	outer.wait();
+	EXPECT_EQ(256U, count.load());
+}
+
+TEST(TaskSchedulerTest, Continuation)
+{
+	task_scheduler ts(2);
+
+	std::atomic<uint32_t> count(0);
+	uint32_t seen_by_continuation = 0;
+	task_group group(ts);
+	for (uint32_t i = 0; i < 64; ++ i)
+	{
+		group.run([&count]
+			{
+				++ count;
+			});
+	}
+	group.then([&count, &seen_by_continuation]
+		{
+			seen_by_continuation = count.load();
+		});
+	group.wait();
+	EXPECT_EQ(64U, seen_by_continuation);
+
+	// A continuation on a finished group runs right away
+	bool ran = false;
+	group.then([&ran]
+		{
+			ran = true;
+		});
+	group.wait();
+	EXPECT_TRUE(ran);
+}
+
+TEST(TaskSchedulerTest, Exception)
+{
+	task_scheduler ts(2);
+
+	task_group group(ts);
+	group.run([]
+		{
+			throw std::runtime_error("task failed");
+		});
+	EXPECT_THROW(group.wait(), std::runtime_error);
+	EXPECT_TRUE(group.done());
+}
@@ -0,0 +1,90 @@
+#include <KlayGE/KlayGE.hpp>
+#include <KFL/Util.hpp>
+#include <KFL/ResIdentifier.hpp>
+#include <KFL/CXX17/filesystem.hpp>
+#include <KlayGE/ResLoader.hpp>
+#include <KlayGE/Extract7z.hpp>
+#include <KlayGE/KPKPacket.hpp>
+
+#include <iostream>
+#include <fstream>
+#include <string>
+#include <vector>
+
+using namespace std;
+using namespace KlayGE;
+
+namespace
+{
+	void Pkt2KPK(std::string const & in_file, std::string const & password, std::string const & out_file,
+		uint32_t alignment)
+	{
+		std::filesystem::path in_path(in_file);
+#if defined(KLAYGE_CXX17_LIBRARY_FILESYSTEM_SUPPORT) || defined(KLAYGE_TS_LIBRARY_FILESYSTEM_SUPPORT)
+		uint64_t timestamp = std::filesystem::last_write_time(in_path).time_since_epoch().count();
+#else
+		uint64_t timestamp = std::filesystem::last_write_time(in_path);
+#endif
+		ResIdentifierPtr in_is = MakeSharedPtr<ResIdentifier>(in_file, timestamp,
+			MakeSharedPtr<std::ifstream>(in_file.c_str(), std::ios_base::binary));
+
+		Archive7z archive(in_is, password);
+		std::vector<std::string> const & file_paths = archive.FilePaths();
+
+		// All files at once, so every solid block is decompressed only once
+		std::vector<std::vector<uint8_t>> data;
+		archive.Extract(file_paths, data);
+
+		KPKPacket::Save(out_file, file_paths, data, alignment);
+
+		uint64_t original_size = 0;
+		for (auto const & file_data : data)
+		{
+			original_size += file_data.size();
+		}
+		cout << file_paths.size() << " files, " << original_size << " bytes are converted." << endl;
+	}
+}
+
+int main(int argc, char* argv[])
+{
+	if (argc < 3)
+	{
+		cout << "Usage: Pkt2KPK xxx.7z yyy.kpk [password] [alignment]" << endl;
+		return 1;
+	}
+
+	std::string in_file = ResLoader::Instance().Locate(argv[1]);
+	if (in_file.empty())
+	{
+		cout << "Couldn't locate " << argv[1] << endl;
+		Context::Destroy();
+		return 1;
+	}
+
+	std::string password;
+	if (argc >= 4)
+	{
+		password = argv[3];
+	}
+
+	uint32_t alignment = 16;
+	if (argc >= 5)
+	{
+		alignment = std::max(static_cast<uint32_t>(std::stoul(argv[4])), 1U);
+		if ((alignment & (alignment - 1)) != 0)
+		{
+			cout << "The alignment must be a power of 2." << endl;
+			Context::Destroy();
+			return 1;
+		}
+	}
+
+	Pkt2KPK(in_file, password, argv[2], alignment);
+
+	cout << "The packet is saved to " << argv[2] << endl;
+
+	Context::Destroy();
+
+	return 0;
+}
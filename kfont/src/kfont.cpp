@@ -346,14 +346,21 @@ namespace KlayGE
 		uint32_t size;
 		this->GetLZMADistanceData(nullptr, size, index);
 
-		std::vector<uint8_t> in_data(size);
-		this->GetLZMADistanceData(&in_data[0], size, index);
+		// Decoded in place if the font is in memory as a whole
+		std::vector<uint8_t> in_data;
+		uint8_t const * lzma_data = this->LZMADistanceDataInPlace(index);
+		if (nullptr == lzma_data)
+		{
+			in_data.resize(size);
+			this->GetLZMADistanceData(&in_data[0], size, index);
+			lzma_data = &in_data[0];
+		}
 
 		SizeT s_out_len = static_cast<SizeT>(decoded.size());
 
-		SizeT s_src_len = static_cast<SizeT>(in_data.size() - LZMA_PROPS_SIZE);
-		LZMALoader::Instance().LzmaUncompress(static_cast<Byte*>(&decoded[0]), &s_out_len, &in_data[LZMA_PROPS_SIZE], &s_src_len,
-			&in_data[0], LZMA_PROPS_SIZE);
+		SizeT s_src_len = static_cast<SizeT>(size - LZMA_PROPS_SIZE);
+		LZMALoader::Instance().LzmaUncompress(static_cast<Byte*>(&decoded[0]), &s_out_len, lzma_data + LZMA_PROPS_SIZE, &s_src_len,
+			lzma_data, LZMA_PROPS_SIZE);
 
 		uint8_t const * char_data = &decoded[0];
 		for (uint32_t y = 0; y < char_size_; ++ y)
@@ -369,16 +376,40 @@ namespace KlayGE
 		size = static_cast<uint32_t>(distances_addr_[index + 1] - distances_addr_[index]);
 		if (p != nullptr)
 		{
-			if (kfont_input_)
+			uint8_t const * lzma_data = this->LZMADistanceDataInPlace(index);
+			if (lzma_data != nullptr)
+			{
+				memcpy(p, lzma_data, size);
+			}
+			else
 			{
 				kfont_input_->seekg(distances_lzma_start_ + (index + 1) * sizeof(uint64_t) + distances_addr_[index],
 					std::ios_base::beg);
 				kfont_input_->read(p, size);
 			}
-			else
+		}
+	}
+
+	uint8_t const * KFont::LZMADistanceDataInPlace(int32_t index) const
+	{
+		if (kfont_input_)
+		{
+			uint8_t const * data = static_cast<uint8_t const *>(kfont_input_->data());
+			if (data != nullptr)
 			{
-				memcpy(p, &distances_lzma_[distances_addr_[index]], size);
+				// A truncated file leaves the stream path to deal with it, instead of reading past the end
+				uint64_t const offset = distances_lzma_start_ + (index + 1) * sizeof(uint64_t) + distances_addr_[index];
+				uint64_t const size = distances_addr_[index + 1] - distances_addr_[index];
+				if (offset + size <= kfont_input_->size())
+				{
+					return data + offset;
+				}
 			}
+			return nullptr;
+		}
+		else
+		{
+			return &distances_lzma_[distances_addr_[index]];
 		}
 	}
 